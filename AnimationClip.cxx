@@ -0,0 +1,327 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "AnimationClip.h"
+
+#include <math.h>
+#include <string.h>
+
+// The file is written in the byte order of the machine, little endian on all our platforms.
+// Every section starts on a four bytes boundary so that the mapped view is read in place.
+struct AnimationClip::Header
+{
+    char mMagic[4];
+    int mVersion;
+    int mJointCount;
+    int mFrameCount;
+    double mFrameRate;
+    // Time of the first frame, in seconds.
+    double mStartTime;
+    // Size of the names following the joints, a multiple of four.
+    int mNameTableSize;
+    int mReserved;
+};
+
+struct AnimationClip::Joint
+{
+    // Offset of the null terminated name in the name table.
+    int mNameOffset;
+    float mScaling[3];
+};
+
+struct AnimationClip::Key
+{
+    // X, Y, Z and W, scaled by QUATERNION_SCALE.
+    short mRotation[4];
+    float mTranslation[3];
+};
+
+namespace
+{
+    const char CLIP_MAGIC[4] = {'F', 'C', 'L', 'P'};
+    const int CLIP_VERSION = 1;
+    const float QUATERNION_SCALE = 32767.f;
+
+    bool IsAnimated(FbxNode * pNode, FbxAnimLayer * pAnimLayer)
+    {
+        return pNode->LclTranslation.GetCurveNode(pAnimLayer) != NULL ||
+            pNode->LclRotation.GetCurveNode(pAnimLayer) != NULL ||
+            pNode->LclScaling.GetCurveNode(pAnimLayer) != NULL;
+    }
+
+    void FindAnimatedNodesRecursive(FbxNode * pNode, FbxAnimLayer * pAnimLayer, FbxArray<FbxNode *> & pNodes)
+    {
+        if (IsAnimated(pNode, pAnimLayer))
+        {
+            pNodes.Add(pNode);
+        }
+
+        const int lChildCount = pNode->GetChildCount();
+        for (int lChildIndex = 0; lChildIndex < lChildCount; ++lChildIndex)
+        {
+            FindAnimatedNodesRecursive(pNode->GetChild(lChildIndex), pAnimLayer, pNodes);
+        }
+    }
+
+    short QuantizeComponent(double pValue)
+    {
+        return static_cast<short>(floor(pValue * QUATERNION_SCALE + 0.5));
+    }
+}
+
+AnimationClip::AnimationClip() : mHeader(NULL), mJoints(NULL), mNames(NULL), mKeys(NULL)
+{
+}
+
+AnimationClip::~AnimationClip()
+{
+    Unload();
+}
+
+bool AnimationClip::Bake(FbxScene * pScene, FbxAnimLayer * pAnimLayer,
+                         const FbxTime & pStart, const FbxTime & pStop, const FbxTime & pFrameTime,
+                         const char * pFileName)
+{
+    if (!pScene || !pAnimLayer || pFrameTime.Get() <= 0 || pStop < pStart)
+    {
+        return false;
+    }
+
+    FbxArray<FbxNode *> lNodes;
+    FindAnimatedNodesRecursive(pScene->GetRootNode(), pAnimLayer, lNodes);
+    const int lJointCount = lNodes.GetCount();
+    if (lJointCount == 0)
+    {
+        return false;
+    }
+
+    // Joint table and names.
+    FbxArray<Joint> lJoints;
+    FbxArray<char> lNames;
+    for (int lJointIndex = 0; lJointIndex < lJointCount; ++lJointIndex)
+    {
+        FbxNode * lNode = lNodes[lJointIndex];
+        const FbxVector4 lScaling = lNode->EvaluateLocalTransform(pStart).GetS();
+
+        Joint lJoint;
+        lJoint.mNameOffset = lNames.GetCount();
+        lJoint.mScaling[0] = static_cast<float>(lScaling[0]);
+        lJoint.mScaling[1] = static_cast<float>(lScaling[1]);
+        lJoint.mScaling[2] = static_cast<float>(lScaling[2]);
+        lJoints.Add(lJoint);
+
+        const char * lName = lNode->GetName();
+        const int lNameLength = static_cast<int>(strlen(lName));
+        for (int lCharIndex = 0; lCharIndex <= lNameLength; ++lCharIndex)
+        {
+            lNames.Add(lName[lCharIndex]);
+        }
+    }
+    while (lNames.GetCount() % 4)
+    {
+        lNames.Add('\0');
+    }
+
+    Header lHeader;
+    memcpy(lHeader.mMagic, CLIP_MAGIC, sizeof(CLIP_MAGIC));
+    lHeader.mVersion = CLIP_VERSION;
+    lHeader.mJointCount = lJointCount;
+    lHeader.mFrameCount = static_cast<int>((pStop - pStart).Get() / pFrameTime.Get()) + 1;
+    lHeader.mFrameRate = 1.0 / pFrameTime.GetSecondDouble();
+    lHeader.mStartTime = pStart.GetSecondDouble();
+    lHeader.mNameTableSize = lNames.GetCount();
+    lHeader.mReserved = 0;
+
+    FILE * lFile = NULL;
+    FBXSDK_fopen(lFile, pFileName, "wb");
+    if (lFile == NULL)
+    {
+        return false;
+    }
+
+    bool lResult = fwrite(&lHeader, sizeof(Header), 1, lFile) == 1 &&
+        fwrite(lJoints.GetArray(), sizeof(Joint), lJointCount, lFile) == static_cast<size_t>(lJointCount) &&
+        fwrite(lNames.GetArray(), 1, lNames.GetCount(), lFile) == static_cast<size_t>(lNames.GetCount());
+
+    // Sample the frames, the evaluator is used here and never during playback.
+    FbxArray<Key> lKeys;
+    lKeys.Resize(lJointCount);
+    FbxArray<FbxQuaternion> lLastRotations;
+    lLastRotations.Resize(lJointCount);
+    for (int lFrameIndex = 0; lResult && lFrameIndex < lHeader.mFrameCount; ++lFrameIndex)
+    {
+        const FbxTime lTime = pStart + pFrameTime * lFrameIndex;
+        for (int lJointIndex = 0; lJointIndex < lJointCount; ++lJointIndex)
+        {
+            const FbxAMatrix & lLocalTransform = lNodes[lJointIndex]->EvaluateLocalTransform(lTime);
+            FbxQuaternion lRotation = lLocalTransform.GetQ();
+            const FbxVector4 lTranslation = lLocalTransform.GetT();
+
+            // Keep the quaternions of consecutive frames in the same hemisphere,
+            // so that interpolating them takes the shortest path.
+            if (lFrameIndex > 0 && lRotation.DotProduct(lLastRotations[lJointIndex]) < 0)
+            {
+                lRotation = -lRotation;
+            }
+            lLastRotations[lJointIndex] = lRotation;
+
+            Key & lKey = lKeys[lJointIndex];
+            for (int lComponent = 0; lComponent < 4; ++lComponent)
+            {
+                lKey.mRotation[lComponent] = QuantizeComponent(lRotation[lComponent]);
+            }
+            lKey.mTranslation[0] = static_cast<float>(lTranslation[0]);
+            lKey.mTranslation[1] = static_cast<float>(lTranslation[1]);
+            lKey.mTranslation[2] = static_cast<float>(lTranslation[2]);
+        }
+
+        lResult = fwrite(lKeys.GetArray(), sizeof(Key), lJointCount, lFile) == static_cast<size_t>(lJointCount);
+    }
+
+    if (fclose(lFile) != 0)
+    {
+        lResult = false;
+    }
+
+    return lResult;
+}
+
+bool AnimationClip::Load(const char * pFileName)
+{
+    Unload();
+
+    if (!mFile.Open(pFileName))
+    {
+        return false;
+    }
+
+    const char * lData = mFile.GetData();
+    const size_t lSize = mFile.GetSize();
+    const Header * lHeader = reinterpret_cast<const Header *>(lData);
+    if (lSize < sizeof(Header) ||
+        memcmp(lHeader->mMagic, CLIP_MAGIC, sizeof(CLIP_MAGIC)) != 0 ||
+        lHeader->mVersion != CLIP_VERSION ||
+        lHeader->mJointCount <= 0 || lHeader->mFrameCount <= 0 || lHeader->mFrameRate <= 0 ||
+        lHeader->mNameTableSize <= 0 || lHeader->mNameTableSize % 4)
+    {
+        mFile.Close();
+        return false;
+    }
+
+    const size_t lJointsOffset = sizeof(Header);
+    const size_t lNamesOffset = lJointsOffset + sizeof(Joint) * lHeader->mJointCount;
+    const size_t lKeysOffset = lNamesOffset + lHeader->mNameTableSize;
+    const size_t lExpectedSize = lKeysOffset +
+        sizeof(Key) * static_cast<size_t>(lHeader->mJointCount) * static_cast<size_t>(lHeader->mFrameCount);
+    if (lSize != lExpectedSize || lData[lKeysOffset - 1] != '\0')
+    {
+        mFile.Close();
+        return false;
+    }
+
+    const Joint * lJoints = reinterpret_cast<const Joint *>(lData + lJointsOffset);
+    for (int lJointIndex = 0; lJointIndex < lHeader->mJointCount; ++lJointIndex)
+    {
+        if (lJoints[lJointIndex].mNameOffset < 0 || lJoints[lJointIndex].mNameOffset >= lHeader->mNameTableSize)
+        {
+            mFile.Close();
+            return false;
+        }
+    }
+
+    mHeader = lHeader;
+    mJoints = lJoints;
+    mNames = lData + lNamesOffset;
+    mKeys = reinterpret_cast<const Key *>(lData + lKeysOffset);
+
+    return true;
+}
+
+void AnimationClip::Unload()
+{
+    mHeader = NULL;
+    mJoints = NULL;
+    mNames = NULL;
+    mKeys = NULL;
+    mFile.Close();
+}
+
+int AnimationClip::GetJointCount() const
+{
+    return mHeader ? mHeader->mJointCount : 0;
+}
+
+const char * AnimationClip::GetJointName(int pJointIndex) const
+{
+    return mNames + mJoints[pJointIndex].mNameOffset;
+}
+
+int AnimationClip::GetFrameCount() const
+{
+    return mHeader ? mHeader->mFrameCount : 0;
+}
+
+double AnimationClip::GetFrameRate() const
+{
+    return mHeader ? mHeader->mFrameRate : 0;
+}
+
+void AnimationClip::EvaluateLocalTransform(int pJointIndex, const FbxTime & pTime, FbxAMatrix & pLocalTransform) const
+{
+    const int lJointCount = mHeader->mJointCount;
+    const int lLastFrame = mHeader->mFrameCount - 1;
+
+    double lFrame = (pTime.GetSecondDouble() - mHeader->mStartTime) * mHeader->mFrameRate;
+    if (lFrame < 0)
+    {
+        lFrame = 0;
+    }
+    else if (lFrame > lLastFrame)
+    {
+        lFrame = lLastFrame;
+    }
+    const int lFrameIndex = static_cast<int>(lFrame);
+    const int lNextFrameIndex = lFrameIndex < lLastFrame ? lFrameIndex + 1 : lFrameIndex;
+    const float lWeight = static_cast<float>(lFrame - lFrameIndex);
+
+    const Key & lKey = mKeys[lFrameIndex * lJointCount + pJointIndex];
+    const Key & lNextKey = mKeys[lNextFrameIndex * lJointCount + pJointIndex];
+
+    // The quaternions of two frames are in the same hemisphere, a normalized lerp is enough.
+    float lRotation[4];
+    float lLengthSquare = 0;
+    for (int lComponent = 0; lComponent < 4; ++lComponent)
+    {
+        const float lValue = lKey.mRotation[lComponent];
+        lRotation[lComponent] = lValue + (lNextKey.mRotation[lComponent] - lValue) * lWeight;
+        lLengthSquare += lRotation[lComponent] * lRotation[lComponent];
+    }
+    if (lLengthSquare <= 0)
+    {
+        lRotation[3] = lLengthSquare = 1.f;
+    }
+    const float lInverseLength = 1.f / sqrtf(lLengthSquare);
+
+    float lTranslation[3];
+    for (int lComponent = 0; lComponent < 3; ++lComponent)
+    {
+        const float lValue = lKey.mTranslation[lComponent];
+        lTranslation[lComponent] = lValue + (lNextKey.mTranslation[lComponent] - lValue) * lWeight;
+    }
+
+    const float * lScaling = mJoints[pJointIndex].mScaling;
+    pLocalTransform.SetTQS(
+        FbxVector4(lTranslation[0], lTranslation[1], lTranslation[2]),
+        FbxQuaternion(lRotation[0] * lInverseLength, lRotation[1] * lInverseLength,
+                      lRotation[2] * lInverseLength, lRotation[3] * lInverseLength),
+        FbxVector4(lScaling[0], lScaling[1], lScaling[2]));
+}
+
@@ -0,0 +1,65 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _ANIMATION_CLIP_H
+#define _ANIMATION_CLIP_H
+
+#include <fbxsdk.h>
+#include "MappedFile.h"
+
+// Animation of a scene sampled once at every frame and stored in a flat binary file.
+// The file is a header, a table of the joints with their names, then for every frame
+// the local rotation of every joint as a quaternion quantized to 16 bits per component
+// and its local translation. The clip is played from a memory mapped view of the file,
+// without evaluating any animation curve.
+class AnimationClip
+{
+public:
+    AnimationClip();
+    ~AnimationClip();
+
+    // Sample the local transform of every node animated in the layer at each frame of
+    // [pStart, pStop] and write the clip. The scaling is not animated in the clip, the
+    // scaling at pStart is kept for every joint.
+    static bool Bake(FbxScene * pScene, FbxAnimLayer * pAnimLayer,
+                     const FbxTime & pStart, const FbxTime & pStop, const FbxTime & pFrameTime,
+                     const char * pFileName);
+
+    // Map a baked clip, return false if the file is missing or invalid.
+    bool Load(const char * pFileName);
+    void Unload();
+    bool IsLoaded() const { return mHeader != NULL; }
+
+    int GetJointCount() const;
+    const char * GetJointName(int pJointIndex) const;
+    int GetFrameCount() const;
+    double GetFrameRate() const;
+
+    // Local transform of the joint at the given time, linearly interpolated between the
+    // two nearest frames and clamped to the range of the clip.
+    void EvaluateLocalTransform(int pJointIndex, const FbxTime & pTime, FbxAMatrix & pLocalTransform) const;
+
+private:
+    // Layout of the file, defined with the reader and the writer.
+    struct Header;
+    struct Joint;
+    struct Key;
+
+    MappedFile mFile;
+    const Header * mHeader;
+    const Joint * mJoints;
+    const char * mNames;
+    // Frame after frame, GetJointCount() keys in every frame.
+    const Key * mKeys;
+};
+
+#endif // _ANIMATION_CLIP_H
+
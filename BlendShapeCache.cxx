@@ -0,0 +1,184 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "BlendShapeCache.h"
+
+#include <algorithm>
+
+namespace
+{
+    void AddInfluence(int pTarget, double pWeight, FbxArray<BlendShapeCache::Influence> & pInfluences)
+    {
+        if (pWeight == 0.0)
+            return;
+
+        BlendShapeCache::Influence lInfluence;
+        lInfluence.mTarget = pTarget;
+        lInfluence.mWeight = static_cast<float>(pWeight);
+        pInfluences.Add(lInfluence);
+    }
+}
+
+BlendShapeCache::BlendShapeCache()
+{
+}
+
+BlendShapeCache::~BlendShapeCache()
+{
+    for (int i = 0; i < mTargets.GetCount(); i++)
+    {
+        delete mTargets[i];
+    }
+    mTargets.Clear();
+
+    for (int i = 0; i < mChannels.GetCount(); i++)
+    {
+        delete mChannels[i];
+    }
+    mChannels.Clear();
+}
+
+bool BlendShapeCache::Initialize(FbxMesh * pMesh)
+{
+    const int lVertexCount = pMesh->GetControlPointsCount();
+    const FbxVector4 * lBaseVertices = pMesh->GetControlPoints();
+
+    const int lBlendShapeCount = pMesh->GetDeformerCount(FbxDeformer::eBlendShape);
+    for (int lBlendShapeIndex = 0; lBlendShapeIndex < lBlendShapeCount; ++lBlendShapeIndex)
+    {
+        FbxBlendShape * lBlendShape = (FbxBlendShape *)pMesh->GetDeformer(lBlendShapeIndex, FbxDeformer::eBlendShape);
+        const int lChannelCount = lBlendShape->GetBlendShapeChannelCount();
+        for (int lChannelIndex = 0; lChannelIndex < lChannelCount; ++lChannelIndex)
+        {
+            FbxBlendShapeChannel * lChannel = lBlendShape->GetBlendShapeChannel(lChannelIndex);
+            const int lShapeCount = lChannel ? lChannel->GetTargetShapeCount() : 0;
+            if (lShapeCount == 0)
+                continue;
+
+            Channel * lChannelCache = new Channel;
+            lChannelCache->mBlendShapeIndex = lBlendShapeIndex;
+            lChannelCache->mChannelIndex = lChannelIndex;
+            lChannelCache->mFirstTarget = mTargets.GetCount();
+
+            const double * lFullWeights = lChannel->GetTargetShapeFullWeights();
+            for (int lShapeIndex = 0; lShapeIndex < lShapeCount; ++lShapeIndex)
+            {
+                lChannelCache->mFullWeights.Add(lFullWeights[lShapeIndex]);
+
+                // Keep the control points which differ from the base geometry.
+                Target * lTarget = new Target;
+                const FbxShape * lShape = lChannel->GetTargetShape(lShapeIndex);
+                const FbxVector4 * lShapeVertices = lShape->GetControlPoints();
+                const int lShapeVertexCount = FbxMin(lVertexCount, lShape->GetControlPointsCount());
+                for (int lIndex = 0; lIndex < lShapeVertexCount; ++lIndex)
+                {
+                    const float lOffset[3] = {
+                        static_cast<float>(lShapeVertices[lIndex][0] - lBaseVertices[lIndex][0]),
+                        static_cast<float>(lShapeVertices[lIndex][1] - lBaseVertices[lIndex][1]),
+                        static_cast<float>(lShapeVertices[lIndex][2] - lBaseVertices[lIndex][2])};
+                    if (lOffset[0] == 0.0f && lOffset[1] == 0.0f && lOffset[2] == 0.0f)
+                        continue;
+
+                    lTarget->mIndices.Add(lIndex);
+                    lTarget->mOffsets.Add(lOffset[0]);
+                    lTarget->mOffsets.Add(lOffset[1]);
+                    lTarget->mOffsets.Add(lOffset[2]);
+                }
+                mTargets.Add(lTarget);
+            }
+            mChannels.Add(lChannelCache);
+        }
+    }
+
+    return mChannels.GetCount() > 0;
+}
+
+bool BlendShapeCache::EvaluateInfluences(FbxMesh * pMesh, const FbxTime & pTime, FbxAnimLayer * pAnimLayer,
+                                         FbxArray<Influence> & pInfluences) const
+{
+    pInfluences.Clear();
+
+    const int lChannelCount = mChannels.GetCount();
+    for (int lChannelIndex = 0; lChannelIndex < lChannelCount; ++lChannelIndex)
+    {
+        const Channel * lChannel = mChannels[lChannelIndex];
+
+        // Get the percentage of influence on this channel.
+        FbxAnimCurve * lFCurve = pMesh->GetShapeChannel(lChannel->mBlendShapeIndex, lChannel->mChannelIndex, pAnimLayer);
+        if (!lFCurve)
+            continue;
+        const double lWeight = lFCurve->Evaluate(pTime);
+        if (lWeight <= 0.0)
+            continue;
+
+        /*
+        With a single target, the channel morphs from the base geometry to the target:
+        dstGeometry = baseGeometry + (targetShape - baseGeometry) * weight / fullWeight
+
+        With in-between targets, the weight falls between the full weights of two targets
+        and the channel morphs from the first one to the second one. Since the targets are
+        stored as offsets from the base geometry, that is the sum of both offsets:
+        dstGeometry = baseGeometry + startOffset * (1 - t) + endOffset * t
+        where t = (weight - startFullWeight) / (endFullWeight - startFullWeight).
+        */
+        const FbxArray<double> & lFullWeights = lChannel->mFullWeights;
+        const int lLastShape = lFullWeights.GetCount() - 1;
+        if (lWeight <= lFullWeights[0])
+        {
+            AddInfluence(lChannel->mFirstTarget, lWeight / lFullWeights[0], pInfluences);
+        }
+        else if (lWeight >= lFullWeights[lLastShape])
+        {
+            // Past the last target, morph toward it as with a single target.
+            AddInfluence(lChannel->mFirstTarget + lLastShape, lWeight / lFullWeights[lLastShape], pInfluences);
+        }
+        else
+        {
+            int lEndShape = 1;
+            while (lWeight > lFullWeights[lEndShape])
+            {
+                ++lEndShape;
+            }
+            const double lStartWeight = lFullWeights[lEndShape - 1];
+            const double lEndWeight = lFullWeights[lEndShape];
+            const double lRatio = (lWeight - lStartWeight) / (lEndWeight - lStartWeight);
+            AddInfluence(lChannel->mFirstTarget + lEndShape - 1, 1.0 - lRatio, pInfluences);
+            AddInfluence(lChannel->mFirstTarget + lEndShape, lRatio, pInfluences);
+        }
+    }
+
+    return pInfluences.GetCount() > 0;
+}
+
+void BlendShapeCache::ApplyInfluences(const FbxArray<Influence> & pInfluences, FbxVector4 * pVertexArray,
+                                      int pBegin, int pEnd) const
+{
+    const int lInfluenceCount = pInfluences.GetCount();
+    for (int lInfluenceIndex = 0; lInfluenceIndex < lInfluenceCount; ++lInfluenceIndex)
+    {
+        const Target * lTarget = mTargets[pInfluences[lInfluenceIndex].mTarget];
+        const float lWeight = pInfluences[lInfluenceIndex].mWeight;
+
+        // The indices are sorted, find the first one in the range.
+        const int * lIndices = lTarget->mIndices.GetArray();
+        const int lIndexCount = lTarget->mIndices.GetCount();
+        const float * lOffsets = lTarget->mOffsets.GetArray();
+        for (int k = static_cast<int>(std::lower_bound(lIndices, lIndices + lIndexCount, pBegin) - lIndices);
+             k < lIndexCount && lIndices[k] < pEnd; ++k)
+        {
+            FbxVector4 & lVertex = pVertexArray[lIndices[k]];
+            lVertex[0] += lOffsets[k * 3] * lWeight;
+            lVertex[1] += lOffsets[k * 3 + 1] * lWeight;
+            lVertex[2] += lOffsets[k * 3 + 2] * lWeight;
+        }
+    }
+}
+
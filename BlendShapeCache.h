@@ -0,0 +1,72 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _BLEND_SHAPE_CACHE_H
+#define _BLEND_SHAPE_CACHE_H
+
+#include <fbxsdk.h>
+
+// Blend shape targets baked from the FbxBlendShape deformers of a mesh when the scene is loaded.
+// Every target shape keeps only the control points it moves, sorted by index, with their offset
+// from the base geometry in single precision. A frame adds the weighted offsets of the targets
+// with an influence, so its cost depends on the vertices moved, not on the size of the mesh.
+class BlendShapeCache
+{
+public:
+    // Weight of a target shape for the current frame.
+    struct Influence
+    {
+        int mTarget;
+        float mWeight;
+    };
+
+    BlendShapeCache();
+    ~BlendShapeCache();
+
+    // Bake the targets of all the blend shape deformers of the mesh.
+    bool Initialize(FbxMesh * pMesh);
+
+    // Evaluate the channels at the given time and list the targets with a non zero weight.
+    // Return false if there is none.
+    bool EvaluateInfluences(FbxMesh * pMesh, const FbxTime & pTime, FbxAnimLayer * pAnimLayer,
+                            FbxArray<Influence> & pInfluences) const;
+
+    // Add the weighted offsets of the influences to the vertices [pBegin, pEnd) of the array.
+    void ApplyInfluences(const FbxArray<Influence> & pInfluences, FbxVector4 * pVertexArray,
+                         int pBegin, int pEnd) const;
+
+private:
+    // Control points moved by a target shape, and their offsets, three floats each.
+    struct Target
+    {
+        FbxArray<int> mIndices;
+        FbxArray<float> mOffsets;
+    };
+
+    // A channel morphs through its targets in turn, in-between targets first.
+    struct Channel
+    {
+        Channel() : mBlendShapeIndex(0), mChannelIndex(0), mFirstTarget(0) {}
+
+        int mBlendShapeIndex;
+        int mChannelIndex;
+        // Targets [mFirstTarget, mFirstTarget + mFullWeights.GetCount()) of mTargets.
+        int mFirstTarget;
+        // Weight, in percent, at which every target is reached.
+        FbxArray<double> mFullWeights;
+    };
+
+    FbxArray<Target *> mTargets;
+    FbxArray<Channel *> mChannels;
+};
+
+#endif // _BLEND_SHAPE_CACHE_H
+
@@ -0,0 +1,141 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "DeformationCache.h"
+
+namespace
+{
+    // Four floats for every position, as in the VBO.
+    const int VERTEX_STRIDE = 4;
+}
+
+int DeformationCache::sCapacity = 0;
+int DeformationCache::sGeneration = 0;
+
+DeformationCache::Key::Key() : mNode(NULL), mAnimLayer(NULL), mPose(NULL), mLod(0), mGeneration(-1)
+{
+}
+
+DeformationCache::Key::Key(const FbxNode * pNode, const FbxTime & pTime, const FbxAnimLayer * pAnimLayer,
+                           const FbxPose * pPose, int pLod)
+    : mNode(pNode), mTime(pTime), mAnimLayer(pAnimLayer), mPose(pPose), mLod(pLod), mGeneration(sGeneration)
+{
+}
+
+bool DeformationCache::Key::operator==(const Key & pOther) const
+{
+    return mNode == pOther.mNode && mTime == pOther.mTime && mAnimLayer == pOther.mAnimLayer &&
+        mPose == pOther.mPose && mLod == pOther.mLod && mGeneration == pOther.mGeneration;
+}
+
+DeformationCache::DeformationCache() : mHasCurrent(false)
+{
+}
+
+DeformationCache::~DeformationCache()
+{
+    for (int i = 0; i < mFrames.GetCount(); i++)
+    {
+        delete mFrames[i];
+    }
+
+    mFrames.Clear();
+}
+
+void DeformationCache::SetCurrent(const Key & pKey)
+{
+    mCurrent = pKey;
+    mHasCurrent = true;
+}
+
+const float * DeformationCache::Find(const Key & pKey)
+{
+    Trim();
+
+    const int lFrameCount = mFrames.GetCount();
+    for (int lFrameIndex = 0; lFrameIndex < lFrameCount; ++lFrameIndex)
+    {
+        Frame * lFrame = mFrames[lFrameIndex];
+        if (lFrame->mKey == pKey)
+        {
+            // Move to the front.
+            for (int i = lFrameIndex; i > 0; --i)
+            {
+                mFrames[i] = mFrames[i - 1];
+            }
+            mFrames[0] = lFrame;
+            return lFrame->mVertices.GetArray();
+        }
+    }
+
+    return NULL;
+}
+
+void DeformationCache::Add(const Key & pKey, const float * pVertices, int pVertexCount)
+{
+    float * lVertices = AddFrame(pKey, pVertexCount);
+    if (lVertices)
+    {
+        memcpy(lVertices, pVertices, pVertexCount * VERTEX_STRIDE * sizeof(float));
+    }
+}
+
+void DeformationCache::Add(const Key & pKey, const FbxVector4 * pVertices, int pVertexCount)
+{
+    float * lVertices = AddFrame(pKey, pVertexCount);
+    if (lVertices)
+    {
+        for (int lIndex = 0; lIndex < pVertexCount; ++lIndex)
+        {
+            lVertices[lIndex * VERTEX_STRIDE] = static_cast<float>(pVertices[lIndex][0]);
+            lVertices[lIndex * VERTEX_STRIDE + 1] = static_cast<float>(pVertices[lIndex][1]);
+            lVertices[lIndex * VERTEX_STRIDE + 2] = static_cast<float>(pVertices[lIndex][2]);
+            lVertices[lIndex * VERTEX_STRIDE + 3] = 1;
+        }
+    }
+}
+
+void DeformationCache::SetCapacity(int pCapacity)
+{
+    sCapacity = pCapacity > 0 ? pCapacity : 0;
+}
+
+float * DeformationCache::AddFrame(const Key & pKey, int pVertexCount)
+{
+    Trim();
+    if (sCapacity == 0)
+        return NULL;
+
+    // Reuse the memory of the least recently used frame when the cache is full.
+    Frame * lFrame = NULL;
+    if (mFrames.GetCount() == sCapacity)
+    {
+        lFrame = mFrames.RemoveLast();
+    }
+    else
+    {
+        lFrame = new Frame;
+    }
+    lFrame->mKey = pKey;
+    lFrame->mVertices.Resize(pVertexCount * VERTEX_STRIDE);
+    mFrames.InsertAt(0, lFrame);
+
+    return lFrame->mVertices.GetArray();
+}
+
+void DeformationCache::Trim()
+{
+    while (mFrames.GetCount() > sCapacity)
+    {
+        delete mFrames.RemoveLast();
+    }
+}
+
@@ -0,0 +1,86 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _DEFORMATION_CACHE_H
+#define _DEFORMATION_CACHE_H
+
+#include <fbxsdk.h>
+
+// Deformation results of a mesh, so that a frame drawn again (paused animation, camera
+// moves) is neither deformed nor uploaded again. The deformation held by the vertex buffer
+// is always remembered; optionally, the last few frames are kept in a least recently used
+// list to scrub the timeline back and forth.
+class DeformationCache
+{
+public:
+    // Everything a deformation depends on, besides the mesh itself.
+    struct Key
+    {
+        Key();
+        Key(const FbxNode * pNode, const FbxTime & pTime, const FbxAnimLayer * pAnimLayer, const FbxPose * pPose,
+            int pLod = 0);
+        bool operator==(const Key & pOther) const;
+
+        const FbxNode * mNode;
+        FbxTime mTime;
+        const FbxAnimLayer * mAnimLayer;
+        const FbxPose * mPose;
+        // The coarser levels of detail only deform some of the vertices.
+        int mLod;
+        // Value of the global generation when the key was made, see InvalidateAll.
+        int mGeneration;
+    };
+
+    DeformationCache();
+    ~DeformationCache();
+
+    // The deformation held by the vertex buffer of the mesh.
+    bool IsCurrent(const Key & pKey) const { return mHasCurrent && mCurrent == pKey; }
+    void SetCurrent(const Key & pKey);
+
+    // Recently deformed frames, four floats for every control point as VBOMesh takes them.
+    // Return NULL if the frame is not kept, otherwise it becomes the most recently used.
+    const float * Find(const Key & pKey);
+    // Keep a copy of a frame, dropping the least recently used one if the cache is full.
+    void Add(const Key & pKey, const float * pVertices, int pVertexCount);
+    void Add(const Key & pKey, const FbxVector4 * pVertices, int pVertexCount);
+
+    // Frames kept by every mesh, zero to keep only the current deformation.
+    static int GetCapacity() { return sCapacity; }
+    static void SetCapacity(int pCapacity);
+
+    // Forget every deformation, when they change without their key changing
+    // (skinning path, baked clip...).
+    static void InvalidateAll() { ++sGeneration; }
+
+private:
+    struct Frame
+    {
+        Key mKey;
+        FbxArray<float> mVertices;
+    };
+
+    // Storage for a new frame, most recently used.
+    float * AddFrame(const Key & pKey, int pVertexCount);
+    // Drop the least recently used frames beyond the capacity.
+    void Trim();
+
+    Key mCurrent;
+    bool mHasCurrent;
+    // Most recently used first.
+    FbxArray<Frame *> mFrames;
+
+    static int sCapacity;
+    static int sGeneration;
+};
+
+#endif // _DEFORMATION_CACHE_H
+
@@ -11,6 +11,11 @@
 
 #include "DrawScene.h"
 #include "SceneCache.h"
+#include "SkinCache.h"
+#include "PointCacheStream.h"
+#include "BlendShapeCache.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
 #include "GetPosition.h"
 
 void DrawNode(FbxNode* pNode, 
@@ -19,13 +24,14 @@ void DrawNode(FbxNode* pNode,
               FbxAMatrix& pParentGlobalPosition,
               FbxAMatrix& pGlobalPosition,
               FbxPose* pPose,
-              ShadingMode pShadingMode);
+              ShadingMode pShadingMode,
+              int pLod);
 void DrawMarker(FbxAMatrix& pGlobalPosition);
 void DrawSkeleton(FbxNode* pNode, 
                   FbxAMatrix& pParentGlobalPosition, 
                   FbxAMatrix& pGlobalPosition);
 void DrawMesh(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
-              FbxAMatrix& pGlobalPosition, FbxPose* pPose, ShadingMode pShadingMode);
+              FbxAMatrix& pGlobalPosition, FbxPose* pPose, ShadingMode pShadingMode, int pLod);
 void ComputeShapeDeformation(FbxMesh* pMesh, 
                              FbxTime& pTime, 
                              FbxAnimLayer * pAnimLayer,
@@ -64,6 +70,607 @@ void MatrixScale(FbxAMatrix& pMatrix, double pValue);
 void MatrixAddToDiagonal(FbxAMatrix& pMatrix, double pValue);
 void MatrixAdd(FbxAMatrix& pDstMatrix, FbxAMatrix& pSrcMatrix);
 
+namespace
+{
+    // Number of vertices deformed by one task, larger meshes are split in several tasks.
+    const int DEFORMATION_GRAIN_SIZE = 4096;
+
+    // Four floats for every position, as in the VBO.
+    const int VERTEX_STRIDE = 4;
+
+    // FbxCache is not reentrant, the vertex caches are read one at a time.
+    FbxSpinLock gVertexCacheLock;
+
+    // Set while the scene is baked progressively, see SetSkipMeshesWithoutVBO.
+    bool gSkipMeshesWithoutVBO = false;
+
+    // Whether a mesh is still waiting for its VBO.
+    bool IsMeshPending(FbxNode* pNode)
+    {
+        return gSkipMeshesWithoutVBO && pNode->GetMesh() && !pNode->GetMesh()->GetUserDataPtr();
+    }
+
+    // The targets baked when the scene was loaded, hooked on the first blend shape deformer.
+    const BlendShapeCache* GetBlendShapeCache(FbxMesh* pMesh)
+    {
+        if (pMesh->GetDeformerCount(FbxDeformer::eBlendShape) == 0)
+            return NULL;
+        return static_cast<const BlendShapeCache*>(pMesh->GetDeformer(0, FbxDeformer::eBlendShape)->GetUserDataPtr());
+    }
+
+    // The deformed vertices of a mesh for the current frame. Everything which needs
+    // the FBX evaluation is computed on the main thread when the record is created,
+    // the tasks only run the per vertex work.
+    struct MeshDeformation
+    {
+        MeshDeformation() : mMesh(NULL), mControlPoints(NULL), mVertexCount(0), mHasVertexCache(false),
+            mPointCache(NULL), mHasShape(false), mShapeCache(NULL), mSkinCache(NULL), mBoneMatrices(NULL), mPalette(NULL), mDQPalette(NULL),
+            mDQPaletteDouble(NULL), mGPUSkin(false), mSrcPositions(NULL), mVertexArray(NULL), mVertices(NULL), mCache(NULL), mCachedVertices(NULL),
+            mLodRanges(NULL), mLodRangeCount(0) {}
+        ~MeshDeformation()
+        {
+            delete [] mBoneMatrices;
+            delete [] mPalette;
+            delete [] mDQPalette;
+            delete [] mDQPaletteDouble;
+            delete [] mSrcPositions;
+            delete [] mVertexArray;
+            delete [] mVertices;
+        }
+
+        FbxMesh* mMesh;
+        const FbxVector4* mControlPoints;
+        int mVertexCount;
+        FbxTime mTime;
+
+        bool mHasVertexCache;
+        // Stream of the PC2 file of the vertex cache, NULL to read it through the FBX SDK.
+        PointCacheStream* mPointCache;
+        bool mHasShape;
+        const BlendShapeCache* mShapeCache;
+        FbxArray<BlendShapeCache::Influence> mShapeInfluences;
+        // Skin deformed by the tasks, NULL if the skin was deformed on the main thread.
+        const SkinCache* mSkinCache;
+        FbxAMatrix* mBoneMatrices;
+        // Bone matrices for the single precision kernel, NULL for the double precision path.
+        float* mPalette;
+        // Bone dual quaternions of dual quaternion and blend skins, in single or double precision.
+        float* mDQPalette;
+        double* mDQPaletteDouble;
+        // The palette is uploaded when drawing and the vertices are deformed by the GPU.
+        bool mGPUSkin;
+        // Source of the single precision kernel after the shapes, in SoA layout.
+        float* mSrcPositions;
+
+        // Deformed vertices in double precision, NULL if only the single precision result is needed.
+        FbxVector4* mVertexArray;
+        // Deformed vertices in the VBO layout, computed by the single precision kernel.
+        float* mVertices;
+
+        // Cache of the mesh VBO, NULL without VBO.
+        DeformationCache* mCache;
+        DeformationCache::Key mCacheKey;
+        // Vertices found in the cache, nothing else is computed.
+        const float* mCachedVertices;
+
+        // The ranges of control points used by a coarser level of detail, the only ones
+        // skinned. NULL to skin all of them.
+        const int* mLodRanges;
+        int mLodRangeCount;
+    };
+
+    // Bones of copies posed the same differ by rounding only, relative to their magnitude.
+    const double POSE_TOLERANCE = 1e-6;
+
+    // Copies of a mesh drawn together when the first one is met: the nodes share the
+    // geometry of their VBO and their materials, and their meshes are deformed the same
+    // way this frame, so only the first one is deformed. With instancing, the copies take
+    // a single draw call for every material.
+    struct MeshBatch
+    {
+        MeshBatch() : mMeshCache(NULL), mDeformation(NULL), mBoneMatrices(NULL), mBoneCount(0), mLod(0) {}
+        ~MeshBatch()
+        {
+            delete mDeformation;
+            delete [] mBoneMatrices;
+        }
+
+        // VBO of the first node, drawn for all of them.
+        const VBOMesh* mMeshCache;
+        // Deformation of the first node, NULL if there is nothing to upload.
+        MeshDeformation* mDeformation;
+        // Bone matrices of the first node the copies are compared with, NULL without skin.
+        FbxAMatrix* mBoneMatrices;
+        int mBoneCount;
+        // Level of detail of all the copies.
+        int mLod;
+
+        FbxArray<FbxNode*> mNodes;
+        // Global position of every node, column major in single precision.
+        FbxArray<float> mTransforms;
+    };
+
+    // Batches made by ComputeDeformations for the current frame.
+    FbxArray<MeshBatch*> gBatches;
+    // Batch of every node for the current frame by its index in the global position cache,
+    // NULL for the nodes drawn alone. The user data of the nodes is left to the load caches.
+    FbxArray<MeshBatch*> gNodeBatches;
+
+    int GetNodeIndex(FbxNode* pNode)
+    {
+        const GlobalPositionCache* lCache = GlobalPositionCache::GetCurrent();
+        const int lNodeIndex = lCache ? lCache->GetNodeIndex(pNode) : -1;
+        return lNodeIndex < gNodeBatches.GetCount() ? lNodeIndex : -1;
+    }
+
+    MeshBatch* GetNodeBatch(FbxNode* pNode)
+    {
+        const int lNodeIndex = GetNodeIndex(pNode);
+        return lNodeIndex >= 0 ? gNodeBatches[lNodeIndex] : NULL;
+    }
+
+    // The skin binding baked when the scene was loaded, hooked on the first skin deformer.
+    const SkinCache* GetSkinCache(FbxMesh* pMesh)
+    {
+        if (pMesh->GetDeformerCount(FbxDeformer::eSkin) == 0)
+            return NULL;
+        return static_cast<const SkinCache*>(pMesh->GetDeformer(0, FbxDeformer::eSkin)->GetUserDataPtr());
+    }
+
+    bool IsSamePose(const FbxAMatrix* pFirst, const FbxAMatrix* pSecond, int pBoneCount)
+    {
+        for (int lBoneIndex = 0; lBoneIndex < pBoneCount; ++lBoneIndex)
+        {
+            const double* lFirst = (const double*)pFirst[lBoneIndex];
+            const double* lSecond = (const double*)pSecond[lBoneIndex];
+            for (int lIndex = 0; lIndex < 16; ++lIndex)
+            {
+                if (fabs(lFirst[lIndex] - lSecond[lIndex]) > POSE_TOLERANCE * (1.0 + fabs(lFirst[lIndex])))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether the node can be drawn with the copies of the batch.
+    bool CanJoinBatch(const MeshBatch* pBatch, FbxNode* pNode, const VBOMesh* pMeshCache,
+                      const FbxAMatrix* pBoneMatrices, int pBoneCount, int pLod)
+    {
+        if (pBatch->mMeshCache->GetSharedGeometry() != pMeshCache->GetSharedGeometry() ||
+            pBatch->mBoneCount != pBoneCount || pBatch->mLod != pLod)
+            return false;
+
+        FbxNode* lFirstNode = pBatch->mNodes[0];
+        for (int lIndex = 0; lIndex < pMeshCache->GetSubMeshCount(); ++lIndex)
+        {
+            if (lFirstNode->GetMaterial(lIndex) != pNode->GetMaterial(lIndex))
+                return false;
+        }
+
+        return IsSamePose(pBatch->mBoneMatrices, pBoneMatrices, pBoneCount);
+    }
+
+    void AddToBatch(MeshBatch* pBatch, FbxNode* pNode, int pNodeIndex, const FbxAMatrix& pGlobalPosition)
+    {
+        pBatch->mNodes.Add(pNode);
+        const double* lMatrix = (const double*)pGlobalPosition;
+        for (int lIndex = 0; lIndex < 16; ++lIndex)
+        {
+            pBatch->mTransforms.Add(static_cast<float>(lMatrix[lIndex]));
+        }
+        gNodeBatches[pNodeIndex] = pBatch;
+    }
+
+    // Set the material of a material group of the node, for the shaded mode.
+    void SetSubMeshMaterial(FbxNode* pNode, int pMaterialIndex)
+    {
+        const FbxSurfaceMaterial * lMaterial = pNode->GetMaterial(pMaterialIndex);
+        if (lMaterial)
+        {
+            const MaterialCache * lMaterialCache = static_cast<const MaterialCache *>(lMaterial->GetUserDataPtr());
+            if (lMaterialCache)
+            {
+                lMaterialCache->SetCurrentMaterial();
+            }
+        }
+        else
+        {
+            // Draw green for faces without material
+            MaterialCache::SetDefaultMaterial();
+        }
+    }
+
+    // The bone matrices of the skin, unless they were already computed into pBoneMatrices.
+    void GetBoneMatrices(const SkinCache* pSkinCache, FbxAMatrix& pGlobalPosition, FbxTime& pTime, FbxPose* pPose,
+                         const FbxAMatrix* pBoneMatrices, FbxAMatrix* pResult)
+    {
+        if (!pBoneMatrices)
+        {
+            pSkinCache->ComputeBoneMatrices(pGlobalPosition, pTime, pPose, pResult);
+            return;
+        }
+
+        for (int lBoneIndex = 0; lBoneIndex < pSkinCache->GetBoneCount(); ++lBoneIndex)
+        {
+            pResult[lBoneIndex] = pBoneMatrices[lBoneIndex];
+        }
+    }
+
+    // Half size of the glyphs of the nulls and the markers.
+    const double GLYPH_HALF_SIZE = 3.0;
+
+    // Projected heights in pixels below which a mesh is drawn with the next coarser level
+    // of detail, every level having half the triangles of the previous one.
+    const double LOD_SCREEN_HEIGHTS[VBOMesh::MAX_LOD_COUNT - 1] = { 300.0, 150.0, 75.0 };
+
+    // Axis aligned box in world space.
+    struct Bounds
+    {
+        bool mEmpty;
+        // Drawn wherever the camera looks, for what cannot be bounded cheaply.
+        bool mInfinite;
+        double mMin[3];
+        double mMax[3];
+    };
+
+    // Bounds of a node for the current frame, stored in the order the nodes are visited.
+    struct NodeBounds
+    {
+        // What DrawNode draws for the node.
+        Bounds mContent;
+        bool mContentVisible;
+        // The node and all its children.
+        Bounds mSubtree;
+        bool mSubtreeVisible;
+        int mSubtreeSize;
+        // Level of detail of a mesh.
+        int mLod;
+    };
+
+    bool gFrustumCulling = true;
+    bool gLodSelection = true;
+
+    // Planes a, b, c, d of the view frustum, ax + by + cz + d >= 0 inside.
+    double gFrustumPlanes[6][4];
+    // Last row of the projection times the model view, the clip w of a point.
+    double gClipW[4];
+    // Height in pixels of a unit at a clip w of one.
+    double gPixelScale = 0.0;
+
+    // Filled by ComputeDeformations, read by DrawNodeRecursive.
+    FbxArray<NodeBounds> gNodeBounds;
+
+    int gVisitedNodeCount = 0;
+    int gCulledNodeCount = 0;
+    int gDrawnNodeCount = 0;
+
+    void ResetBounds(Bounds& pBounds)
+    {
+        pBounds.mEmpty = true;
+        pBounds.mInfinite = false;
+    }
+
+    void AddRange(Bounds& pBounds, const double* pMin, const double* pMax)
+    {
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            if (pBounds.mEmpty || pMin[lAxis] < pBounds.mMin[lAxis])
+                pBounds.mMin[lAxis] = pMin[lAxis];
+            if (pBounds.mEmpty || pMax[lAxis] > pBounds.mMax[lAxis])
+                pBounds.mMax[lAxis] = pMax[lAxis];
+        }
+        pBounds.mEmpty = false;
+    }
+
+    void AddPoint(Bounds& pBounds, const FbxVector4& pPoint)
+    {
+        const double lPoint[3] = { pPoint[0], pPoint[1], pPoint[2] };
+        AddRange(pBounds, lPoint, lPoint);
+    }
+
+    // Add the box [pMin, pMax] moved by the matrix, which transforms row vectors.
+    void AddBox(Bounds& pBounds, const FbxVector4& pMin, const FbxVector4& pMax, const FbxAMatrix& pMatrix)
+    {
+        const double* lMatrix = (const double*)pMatrix;
+        double lMin[3];
+        double lMax[3];
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            double lCenter = lMatrix[12 + lAxis];
+            double lExtent = 0.0;
+            for (int lRow = 0; lRow < 3; ++lRow)
+            {
+                lCenter += (pMin[lRow] + pMax[lRow]) * 0.5 * lMatrix[lRow * 4 + lAxis];
+                lExtent += (pMax[lRow] - pMin[lRow]) * 0.5 * fabs(lMatrix[lRow * 4 + lAxis]);
+            }
+            lMin[lAxis] = lCenter - lExtent;
+            lMax[lAxis] = lCenter + lExtent;
+        }
+        AddRange(pBounds, lMin, lMax);
+    }
+
+    void AddBounds(Bounds& pBounds, const Bounds& pOther)
+    {
+        pBounds.mInfinite = pBounds.mInfinite || pOther.mInfinite;
+        if (!pOther.mEmpty)
+            AddRange(pBounds, pOther.mMin, pOther.mMax);
+    }
+
+    // Read the planes and the scale of the projection from the matrices and the viewport
+    // SetCamera left in OpenGL.
+    void ReadFrustumPlanes()
+    {
+        GLdouble lProjection[16];
+        GLdouble lModelView[16];
+        GLint lViewport[4];
+        glGetDoublev(GL_PROJECTION_MATRIX, lProjection);
+        glGetDoublev(GL_MODELVIEW_MATRIX, lModelView);
+        glGetIntegerv(GL_VIEWPORT, lViewport);
+        gPixelScale = lProjection[5] * lViewport[3] * 0.5;
+
+        // Projection * model view, column major.
+        double lClip[16];
+        for (int lColumn = 0; lColumn < 4; ++lColumn)
+        {
+            for (int lRow = 0; lRow < 4; ++lRow)
+            {
+                lClip[lColumn * 4 + lRow] = 0.0;
+                for (int lIndex = 0; lIndex < 4; ++lIndex)
+                {
+                    lClip[lColumn * 4 + lRow] += lProjection[lIndex * 4 + lRow] * lModelView[lColumn * 4 + lIndex];
+                }
+            }
+        }
+
+        // -w <= x, y, z <= w: the last row plus and minus every other row.
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            for (int lColumn = 0; lColumn < 4; ++lColumn)
+            {
+                gFrustumPlanes[lAxis * 2][lColumn] = lClip[lColumn * 4 + 3] + lClip[lColumn * 4 + lAxis];
+                gFrustumPlanes[lAxis * 2 + 1][lColumn] = lClip[lColumn * 4 + 3] - lClip[lColumn * 4 + lAxis];
+            }
+        }
+        for (int lColumn = 0; lColumn < 4; ++lColumn)
+        {
+            gClipW[lColumn] = lClip[lColumn * 4 + 3];
+        }
+    }
+
+    // Whether some of the box may be in the frustum: test the corner furthest inside every plane.
+    bool IsInFrustum(const Bounds& pBounds)
+    {
+        if (pBounds.mInfinite)
+            return true;
+        if (pBounds.mEmpty)
+            return false;
+
+        for (int lPlaneIndex = 0; lPlaneIndex < 6; ++lPlaneIndex)
+        {
+            const double* lPlane = gFrustumPlanes[lPlaneIndex];
+            double lDistance = lPlane[3];
+            for (int lAxis = 0; lAxis < 3; ++lAxis)
+            {
+                lDistance += lPlane[lAxis] * (lPlane[lAxis] >= 0.0 ? pBounds.mMax[lAxis] : pBounds.mMin[lAxis]);
+            }
+            if (lDistance < 0.0)
+                return false;
+        }
+        return true;
+    }
+
+    // The level of detail of a mesh from the projected height of its bounds, the full mesh if
+    // the camera is within them.
+    int SelectLod(const Bounds& pBounds)
+    {
+        if (!gLodSelection || pBounds.mInfinite || pBounds.mEmpty)
+            return 0;
+
+        double lCenter[3];
+        double lRadiusSquared = 0.0;
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            lCenter[lAxis] = (pBounds.mMin[lAxis] + pBounds.mMax[lAxis]) * 0.5;
+            lRadiusSquared += (pBounds.mMax[lAxis] - lCenter[lAxis]) * (pBounds.mMax[lAxis] - lCenter[lAxis]);
+        }
+        const double lRadius = sqrt(lRadiusSquared);
+        // The depth of the center, and the one of the nearest point of the sphere; the scale
+        // of the depth is 0 with an orthographic camera.
+        const double lW = gClipW[0] * lCenter[0] + gClipW[1] * lCenter[1] + gClipW[2] * lCenter[2] + gClipW[3];
+        const double lDepthScale = sqrt(gClipW[0] * gClipW[0] + gClipW[1] * gClipW[1] + gClipW[2] * gClipW[2]);
+        if (lW - lRadius * lDepthScale <= 0.0)
+            return 0;
+
+        const double lHeight = 2.0 * lRadius * gPixelScale / lW;
+        int lLod = 0;
+        while (lLod < VBOMesh::MAX_LOD_COUNT - 1 && lHeight < LOD_SCREEN_HEIGHTS[lLod])
+        {
+            ++lLod;
+        }
+        return lLod;
+    }
+
+    // Fit the bounds of a mesh. A skinned mesh is bounded by the boxes of its bones, which
+    // are returned in pBoneMatrices to deform it; meshes with shapes or vertex caches are not
+    // bounded.
+    void ComputeMeshBounds(FbxNode* pNode, FbxAMatrix& pGlobalPosition, FbxTime& pTime, FbxPose* pPose,
+                           Bounds& pBounds, FbxAMatrix*& pBoneMatrices)
+    {
+        FbxMesh* lMesh = pNode->GetMesh();
+        if (IsMeshPending(pNode) || lMesh->GetControlPointsCount() == 0)
+            return;
+
+        if (lMesh->GetDeformerCount(FbxDeformer::eVertexCache) > 0 || lMesh->GetShapeCount() > 0)
+        {
+            pBounds.mInfinite = true;
+            return;
+        }
+
+        if (lMesh->GetDeformerCount(FbxDeformer::eSkin) > 0)
+        {
+            const SkinCache* lSkinCache = GetSkinCache(lMesh);
+            FbxVector4 lMin;
+            FbxVector4 lMax;
+            if (lSkinCache)
+            {
+                pBoneMatrices = new FbxAMatrix[lSkinCache->GetBoneCount()];
+                lSkinCache->ComputeBoneMatrices(pGlobalPosition, pTime, pPose, pBoneMatrices);
+            }
+            if (lSkinCache && lSkinCache->ComputeBounds(pBoneMatrices, lMin, lMax))
+                AddBox(pBounds, lMin, lMax, pGlobalPosition);
+            else
+                pBounds.mInfinite = true;
+            return;
+        }
+
+        // Immediate mode meshes have no box baked.
+        const VBOMesh* lMeshCache = static_cast<const VBOMesh*>(lMesh->GetUserDataPtr());
+        if (lMeshCache)
+            AddBox(pBounds, lMeshCache->GetBoundsMin(), lMeshCache->GetBoundsMax(), pGlobalPosition);
+        else
+            pBounds.mInfinite = true;
+    }
+
+    // Fit the bounds of what DrawNode draws for the node, see ComputeMeshBounds.
+    void ComputeContentBounds(FbxNode* pNode, FbxAMatrix& pParentGlobalPosition, FbxAMatrix& pGlobalPosition,
+                              FbxTime& pTime, FbxPose* pPose, Bounds& pBounds, FbxAMatrix*& pBoneMatrices)
+    {
+        ResetBounds(pBounds);
+        pBoneMatrices = NULL;
+
+        // Lights are drawn before the scene, and nodes without attribute are not drawn.
+        FbxNodeAttribute* lNodeAttribute = pNode->GetNodeAttribute();
+        if (!lNodeAttribute)
+            return;
+
+        const FbxVector4 lGlyphMin(-GLYPH_HALF_SIZE, -GLYPH_HALF_SIZE, -GLYPH_HALF_SIZE);
+        const FbxVector4 lGlyphMax(GLYPH_HALF_SIZE, GLYPH_HALF_SIZE, GLYPH_HALF_SIZE);
+        switch (lNodeAttribute->GetAttributeType())
+        {
+        case FbxNodeAttribute::eMarker:
+        case FbxNodeAttribute::eNull:
+            AddBox(pBounds, lGlyphMin, lGlyphMax, pGlobalPosition);
+            break;
+        case FbxNodeAttribute::eSkeleton:
+            // The limb from the parent.
+            AddPoint(pBounds, pParentGlobalPosition.GetT());
+            AddPoint(pBounds, pGlobalPosition.GetT());
+            break;
+        case FbxNodeAttribute::eMesh:
+            ComputeMeshBounds(pNode, pGlobalPosition, pTime, pPose, pBounds, pBoneMatrices);
+            break;
+        case FbxNodeAttribute::eCamera:
+            // Drawn with its look at, never culled.
+            pBounds.mInfinite = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Skin the vertices [pBegin, pEnd) of a mesh.
+    void SkinRange(MeshDeformation* pDeformation, int pBegin, int pEnd)
+    {
+        if (pDeformation->mVertices)
+        {
+            // Without shape, the single precision kernel reads the bind positions baked in the skin cache.
+            if (pDeformation->mSrcPositions)
+            {
+                SkinCache::ConvertToSoA(pDeformation->mVertexArray, pDeformation->mVertexCount, pDeformation->mSrcPositions, pBegin, pEnd);
+            }
+            if (pDeformation->mDQPalette)
+            {
+                pDeformation->mSkinCache->ComputeDualQuaternionDeformation(pDeformation->mPalette, pDeformation->mDQPalette,
+                    pDeformation->mSrcPositions, pDeformation->mVertices, pBegin, pEnd);
+            }
+            else
+            {
+                pDeformation->mSkinCache->ComputeLinearDeformation(pDeformation->mPalette, pDeformation->mSrcPositions,
+                    pDeformation->mVertices, pBegin, pEnd);
+            }
+        }
+        else if (pDeformation->mDQPaletteDouble)
+        {
+            pDeformation->mSkinCache->ComputeDualQuaternionDeformation(pDeformation->mBoneMatrices, pDeformation->mDQPaletteDouble,
+                pDeformation->mVertexArray, pBegin, pEnd);
+        }
+        else
+        {
+            pDeformation->mSkinCache->ComputeLinearDeformation(pDeformation->mBoneMatrices, pDeformation->mVertexArray, pBegin, pEnd);
+        }
+    }
+
+    // Deform the vertices [pBegin, pEnd) of a mesh, may run on any thread.
+    void DeformTask(void* pData, int pBegin, int pEnd)
+    {
+        PROFILE_SCOPE("DeformTask");
+        MeshDeformation* lDeformation = static_cast<MeshDeformation*>(pData);
+
+        // Active vertex cache deformer will overwrite any other deformer
+        if (lDeformation->mHasVertexCache)
+        {
+            if (lDeformation->mPointCache)
+            {
+                // Prefetched from the mapped file, no need to serialize the reads.
+                if (lDeformation->mVertices)
+                {
+                    lDeformation->mPointCache->Read(lDeformation->mTime, lDeformation->mVertices, lDeformation->mVertexCount);
+                }
+                else
+                {
+                    memcpy(lDeformation->mVertexArray, lDeformation->mControlPoints, lDeformation->mVertexCount * sizeof(FbxVector4));
+                    lDeformation->mPointCache->Read(lDeformation->mTime, lDeformation->mVertexArray, lDeformation->mVertexCount);
+                }
+                return;
+            }
+
+            memcpy(lDeformation->mVertexArray, lDeformation->mControlPoints, lDeformation->mVertexCount * sizeof(FbxVector4));
+            gVertexCacheLock.Acquire();
+            ReadVertexCacheData(lDeformation->mMesh, lDeformation->mTime, lDeformation->mVertexArray);
+            gVertexCacheLock.Release();
+            return;
+        }
+
+        if (lDeformation->mVertexArray)
+        {
+            memcpy(lDeformation->mVertexArray + pBegin, lDeformation->mControlPoints + pBegin, (pEnd - pBegin) * sizeof(FbxVector4));
+            if (lDeformation->mHasShape)
+            {
+                lDeformation->mShapeCache->ApplyInfluences(lDeformation->mShapeInfluences, lDeformation->mVertexArray, pBegin, pEnd);
+            }
+        }
+
+        if (!lDeformation->mSkinCache)
+            return;
+
+        if (!lDeformation->mLodRanges)
+        {
+            SkinRange(lDeformation, pBegin, pEnd);
+            return;
+        }
+
+        // Only the control points of the level of detail, the ranges are sorted.
+        for (int lRangeIndex = 0; lRangeIndex < lDeformation->mLodRangeCount; ++lRangeIndex)
+        {
+            const int lBegin = FbxMax(lDeformation->mLodRanges[lRangeIndex * 2], pBegin);
+            const int lEnd = FbxMin(lDeformation->mLodRanges[lRangeIndex * 2 + 1], pEnd);
+            if (lBegin >= pEnd)
+                break;
+            if (lBegin < lEnd)
+                SkinRange(lDeformation, lBegin, lEnd);
+        }
+    }
+}
+
+MeshDeformation* CreateMeshDeformation(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                                       FbxAMatrix& pGlobalPosition, FbxPose* pPose, ThreadPool* pThreadPool,
+                                       int pLod, const FbxAMatrix* pBoneMatrices = NULL);
+void ComputeDeformationsRecursive(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                                  FbxAMatrix& pParentGlobalPosition, FbxPose* pPose, ThreadPool* pThreadPool);
+void DrawNodeRecursive(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                       FbxAMatrix& pParentGlobalPosition, FbxPose* pPose,
+                       ShadingMode pShadingMode, int pBoundsIndex);
+
 void InitializeLights(const FbxScene* pScene, const FbxTime & pTime, FbxPose* pPose)
 {
     // Set ambient light. Turn on light0 and set its attributes to default (white directional light in Z axis).
@@ -96,22 +703,57 @@ void DrawNodeRecursive(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
                        FbxAMatrix& pParentGlobalPosition, FbxPose* pPose,
                        ShadingMode pShadingMode)
 {
+    gVisitedNodeCount = 0;
+    gCulledNodeCount = 0;
+    gDrawnNodeCount = 0;
+    DrawNodeRecursive(pNode, pTime, pAnimLayer, pParentGlobalPosition, pPose, pShadingMode,
+        gNodeBounds.GetCount() ? 0 : -1);
+}
+
+// Same, skipping what is out of the view frustum and with the level of detail picked for
+// every node. The bounds of the node are gNodeBounds[pBoundsIndex], -1 if none were fitted.
+void DrawNodeRecursive(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                       FbxAMatrix& pParentGlobalPosition, FbxPose* pPose,
+                       ShadingMode pShadingMode, int pBoundsIndex)
+{
+    ++gVisitedNodeCount;
+    const bool lCulled = pBoundsIndex >= 0;
+    if (lCulled && !gNodeBounds[pBoundsIndex].mSubtreeVisible)
+    {
+        gCulledNodeCount += gNodeBounds[pBoundsIndex].mSubtreeSize;
+        return;
+    }
+
     FbxAMatrix lGlobalPosition = GetGlobalPosition(pNode, pTime, pPose, &pParentGlobalPosition);
 
     if (pNode->GetNodeAttribute())
     {
-    // Geometry offset.
-    // it is not inherited by the children.
-    FbxAMatrix lGeometryOffset = GetGeometry(pNode);
-    FbxAMatrix lGlobalOffPosition = lGlobalPosition * lGeometryOffset;
+        if (lCulled && !gNodeBounds[pBoundsIndex].mContentVisible)
+        {
+            ++gCulledNodeCount;
+        }
+        else
+        {
+            // Geometry offset.
+            // it is not inherited by the children.
+            FbxAMatrix lGeometryOffset = GetGeometry(pNode);
+            FbxAMatrix lGlobalOffPosition = lGlobalPosition * lGeometryOffset;
 
-        DrawNode(pNode, pTime, pAnimLayer, pParentGlobalPosition, lGlobalOffPosition, pPose, pShadingMode);
+            DrawNode(pNode, pTime, pAnimLayer, pParentGlobalPosition, lGlobalOffPosition, pPose, pShadingMode,
+                lCulled ? gNodeBounds[pBoundsIndex].mLod : 0);
+            ++gDrawnNodeCount;
+        }
     }
 
+    // The subtrees of the children follow each other.
+    int lChildBoundsIndex = lCulled ? pBoundsIndex + 1 : -1;
     const int lChildCount = pNode->GetChildCount();
     for (int lChildIndex = 0; lChildIndex < lChildCount; ++lChildIndex)
     {
-        DrawNodeRecursive(pNode->GetChild(lChildIndex), pTime, pAnimLayer, lGlobalPosition, pPose, pShadingMode);
+        DrawNodeRecursive(pNode->GetChild(lChildIndex), pTime, pAnimLayer, lGlobalPosition, pPose, pShadingMode,
+            lChildBoundsIndex);
+        if (lCulled)
+            lChildBoundsIndex += gNodeBounds[lChildBoundsIndex].mSubtreeSize;
     }
 }
 
@@ -121,7 +763,7 @@ void DrawNode(FbxNode* pNode,
               FbxAnimLayer* pAnimLayer,
               FbxAMatrix& pParentGlobalPosition,
               FbxAMatrix& pGlobalPosition,
-              FbxPose* pPose, ShadingMode pShadingMode)
+              FbxPose* pPose, ShadingMode pShadingMode, int pLod)
 {
     FbxNodeAttribute* lNodeAttribute = pNode->GetNodeAttribute();
 
@@ -137,9 +779,9 @@ void DrawNode(FbxNode* pNode,
             DrawSkeleton(pNode, pParentGlobalPosition, pGlobalPosition);
         }
         // NURBS and patch have been converted into triangluation meshes.
-        else if (lNodeAttribute->GetAttributeType() == FbxNodeAttribute::eMesh)
+        else if (lNodeAttribute->GetAttributeType() == FbxNodeAttribute::eMesh && !IsMeshPending(pNode))
         {
-            DrawMesh(pNode, pTime, pAnimLayer, pGlobalPosition, pPose, pShadingMode);
+            DrawMesh(pNode, pTime, pAnimLayer, pGlobalPosition, pPose, pShadingMode, pLod);
         }
         else if (lNodeAttribute->GetAttributeType() == FbxNodeAttribute::eCamera)
         {
@@ -182,10 +824,11 @@ void DrawSkeleton(FbxNode* pNode, FbxAMatrix& pParentGlobalPosition, FbxAMatrix&
 }
 
 
-// Draw the vertices of a mesh.
+// Draw the vertices of a mesh, with the level of detail pLod unless it is in a batch.
 void DrawMesh(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
-              FbxAMatrix& pGlobalPosition, FbxPose* pPose, ShadingMode pShadingMode)
+              FbxAMatrix& pGlobalPosition, FbxPose* pPose, ShadingMode pShadingMode, int pLod)
 {
+    PROFILE_SCOPE("DrawMesh");
     FbxMesh* lMesh = pNode->GetMesh();
     const int lVertexCount = lMesh->GetControlPointsCount();
 
@@ -197,51 +840,97 @@ void DrawMesh(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
 
     const VBOMesh * lMeshCache = static_cast<const VBOMesh *>(lMesh->GetUserDataPtr());
 
-    // If it has some defomer connection, update the vertices position
-    const bool lHasVertexCache = lMesh->GetDeformerCount(FbxDeformer::eVertexCache) &&
-        (static_cast<FbxVertexCacheDeformer*>(lMesh->GetDeformer(0, FbxDeformer::eVertexCache)))->IsActive();
-    const bool lHasShape = lMesh->GetShapeCount() > 0;
-    const bool lHasSkin = lMesh->GetDeformerCount(FbxDeformer::eSkin) > 0;
-    const bool lHasDeformation = lHasVertexCache || lHasShape || lHasSkin;
+    // Use the deformation computed before the draw pass if any, otherwise deform the mesh now.
+    // The copies of a batch are all drawn with the first one.
+    MeshBatch* lBatch = GetNodeBatch(pNode);
+    if (lBatch && lBatch->mNodes[0] != pNode)
+    {
+        return;
+    }
+    MeshDeformation* lDeformation = lBatch ? lBatch->mDeformation : NULL;
+    const int lLod = lBatch ? lBatch->mLod : pLod;
+    const bool lOwnDeformation = lBatch == NULL;
+    if (lOwnDeformation)
+    {
+        lDeformation = CreateMeshDeformation(pNode, pTime, pAnimLayer, pGlobalPosition, pPose, NULL, lLod);
+    }
 
-    FbxVector4* lVertexArray = NULL;
-    if (!lMeshCache || lHasDeformation)
+    const FbxVector4* lVertexArray = lMesh->GetControlPoints();
+    if (lDeformation)
     {
-        lVertexArray = new FbxVector4[lVertexCount];
-        memcpy(lVertexArray, lMesh->GetControlPoints(), lVertexCount * sizeof(FbxVector4));
+        if (lMeshCache)
+        {
+            PROFILE_SCOPE("UploadVertices");
+            DeformationCache* lCache = lDeformation->mCache;
+            if (lDeformation->mCachedVertices)
+            {
+                lMeshCache->UpdateVertexPosition(lMesh, lDeformation->mCachedVertices);
+            }
+            else if (lDeformation->mGPUSkin)
+            {
+                // The result stays on the GPU, only the current one is known.
+                lMeshCache->SkinVertexPosition(lDeformation->mPalette);
+            }
+            else if (lDeformation->mVertices)
+            {
+                lMeshCache->UpdateVertexPosition(lMesh, lDeformation->mVertices);
+                if (lCache && DeformationCache::GetCapacity())
+                    lCache->Add(lDeformation->mCacheKey, lDeformation->mVertices, lVertexCount);
+            }
+            else
+            {
+                lMeshCache->UpdateVertexPosition(lMesh, lDeformation->mVertexArray);
+                if (lCache && DeformationCache::GetCapacity())
+                    lCache->Add(lDeformation->mCacheKey, lDeformation->mVertexArray, lVertexCount);
+            }
+
+            if (lCache)
+                lCache->SetCurrent(lDeformation->mCacheKey);
+        }
+        else
+        {
+            lVertexArray = lDeformation->mVertexArray;
+        }
     }
 
-    if (lHasDeformation)
+    const int lInstanceCount = lBatch ? lBatch->mNodes.GetCount() : 1;
+    if (lMeshCache && lInstanceCount > 1)
     {
-        // Active vertex cache deformer will overwrite any other deformer
-        if (lHasVertexCache)
+        // Every material of the copies at once, or one copy after the other.
+        const bool lInstanced = VBOMesh::IsInstancingSupported();
+        if (lInstanced)
         {
-            ReadVertexCacheData(lMesh, pTime, lVertexArray);
+            lMeshCache->BeginInstancedDraw(pShadingMode, lBatch->mTransforms.GetArray(), lInstanceCount, lLod);
         }
         else
         {
-            if (lHasShape)
+            lMeshCache->BeginDraw(pShadingMode, lLod);
+        }
+
+        const int lSubMeshCount = lMeshCache->GetSubMeshCount();
+        for (int lIndex = 0; lIndex < lSubMeshCount; ++lIndex)
+        {
+            if (pShadingMode == SHADING_MODE_SHADED)
             {
-                // Deform the vertex array with the shapes.
-                ComputeShapeDeformation(lMesh, pTime, pAnimLayer, lVertexArray);
+                SetSubMeshMaterial(pNode, lIndex);
             }
 
-            //we need to get the number of clusters
-            const int lSkinCount = lMesh->GetDeformerCount(FbxDeformer::eSkin);
-            int lClusterCount = 0;
-            for (int lSkinIndex = 0; lSkinIndex < lSkinCount; ++lSkinIndex)
+            if (lInstanced)
             {
-                lClusterCount += ((FbxSkin *)(lMesh->GetDeformer(lSkinIndex, FbxDeformer::eSkin)))->GetClusterCount();
+                lMeshCache->Draw(lIndex, pShadingMode);
+                continue;
             }
-            if (lClusterCount)
+
+            for (int lInstanceIndex = 0; lInstanceIndex < lInstanceCount; ++lInstanceIndex)
             {
-                // Deform the vertex array with the skin deformer.
-                ComputeSkinDeformation(pGlobalPosition, lMesh, pTime, lVertexArray, pPose);
+                glPushMatrix();
+                glMultMatrixf(lBatch->mTransforms.GetArray() + lInstanceIndex * 16);
+                lMeshCache->Draw(lIndex, pShadingMode);
+                glPopMatrix();
             }
         }
-
-        if (lMeshCache)
-            lMeshCache->UpdateVertexPosition(lMesh, lVertexArray);
+        lMeshCache->EndDraw();
+        return;
     }
 
     glPushMatrix();
@@ -249,26 +938,13 @@ void DrawMesh(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
 
     if (lMeshCache)
     {
-        lMeshCache->BeginDraw(pShadingMode);
+        lMeshCache->BeginDraw(pShadingMode, lLod);
         const int lSubMeshCount = lMeshCache->GetSubMeshCount();
         for (int lIndex = 0; lIndex < lSubMeshCount; ++lIndex)
         {
             if (pShadingMode == SHADING_MODE_SHADED)
             {
-                const FbxSurfaceMaterial * lMaterial = pNode->GetMaterial(lIndex);
-                if (lMaterial)
-                {
-                    const MaterialCache * lMaterialCache = static_cast<const MaterialCache *>(lMaterial->GetUserDataPtr());
-                    if (lMaterialCache)
-                    {
-                        lMaterialCache->SetCurrentMaterial();
-                    }
-                }
-                else
-                {
-                    // Draw green for faces without material
-                    MaterialCache::SetDefaultMaterial();
-                }
+                SetSubMeshMaterial(pNode, lIndex);
             }
 
             lMeshCache->Draw(lIndex, pShadingMode);
@@ -286,7 +962,7 @@ void DrawMesh(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
             glBegin(GL_LINE_LOOP);
             for (int lVerticeIndex = 0; lVerticeIndex < lVerticeCount; lVerticeIndex++)
             {
-                glVertex3dv((GLdouble *)lVertexArray[lMesh->GetPolygonVertex(lPolygonIndex, lVerticeIndex)]);
+                glVertex3dv((const GLdouble *)lVertexArray[lMesh->GetPolygonVertex(lPolygonIndex, lVerticeIndex)]);
             }
             glEnd();
         }
@@ -294,137 +970,356 @@ void DrawMesh(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
 
     glPopMatrix();
 
-    delete [] lVertexArray;
+    if (lOwnDeformation)
+        delete lDeformation;
 }
 
+// Gather what the deformation of the mesh needs for the current frame, then deform the
+// vertices on the thread pool, or right now if there is none. Return NULL if the mesh
+// is not deformed and its vertices are already in the VBO.
+MeshDeformation* CreateMeshDeformation(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                                       FbxAMatrix& pGlobalPosition, FbxPose* pPose, ThreadPool* pThreadPool,
+                                       int pLod, const FbxAMatrix* pBoneMatrices)
+{
+    FbxMesh* lMesh = pNode->GetMesh();
+    const int lVertexCount = lMesh->GetControlPointsCount();
+    if (lVertexCount == 0)
+        return NULL;
 
-// Deform the vertex array with the shapes contained in the mesh.
-void ComputeShapeDeformation(FbxMesh* pMesh, FbxTime& pTime, FbxAnimLayer * pAnimLayer, FbxVector4* pVertexArray)
+    const VBOMesh * lMeshCache = static_cast<const VBOMesh *>(lMesh->GetUserDataPtr());
+
+    // If it has some defomer connection, update the vertices position
+    const bool lHasVertexCache = lMesh->GetDeformerCount(FbxDeformer::eVertexCache) &&
+        (static_cast<FbxVertexCacheDeformer*>(lMesh->GetDeformer(0, FbxDeformer::eVertexCache)))->IsActive();
+    const bool lHasShape = lMesh->GetShapeCount() > 0;
+    const bool lHasSkin = lMesh->GetDeformerCount(FbxDeformer::eSkin) > 0;
+    const bool lHasDeformation = lHasVertexCache || lHasShape || lHasSkin;
+
+    // Immediate mode draws the control points as they are.
+    if (!lHasDeformation)
+        return NULL;
+
+    // Nothing to do if the VBO already holds this deformation.
+    DeformationCache* lCache = lMeshCache ? &lMeshCache->GetDeformationCache() : NULL;
+    const int lLod = lMeshCache ? FbxMin(pLod, lMeshCache->GetLodCount() - 1) : 0;
+    const DeformationCache::Key lCacheKey(pNode, pTime, pAnimLayer, pPose, lLod);
+    if (lCache && lCache->IsCurrent(lCacheKey))
+        return NULL;
+
+    MeshDeformation* lDeformation = new MeshDeformation;
+    lDeformation->mMesh = lMesh;
+    lDeformation->mControlPoints = lMesh->GetControlPoints();
+    lDeformation->mVertexCount = lVertexCount;
+    lDeformation->mTime = pTime;
+    lDeformation->mHasVertexCache = lHasVertexCache;
+    lDeformation->mCache = lCache;
+    lDeformation->mCacheKey = lCacheKey;
+    if (lMeshCache)
+        lDeformation->mLodRanges = lMeshCache->GetLodControlPointRanges(lLod, lDeformation->mLodRangeCount);
+
+    // A recently deformed frame is only uploaded again.
+    if (lCache)
+    {
+        lDeformation->mCachedVertices = lCache->Find(lCacheKey);
+        if (lDeformation->mCachedVertices)
+            return lDeformation;
+    }
+
+    // Skins which cannot be deformed by the tasks are deformed on this thread,
+    // because evaluating the links is not thread safe.
+    bool lSkinOnThisThread = false;
+    if (lHasVertexCache)
+    {
+        // A streamed point cache is read straight into the VBO layout.
+        lDeformation->mPointCache = static_cast<PointCacheStream*>(lMesh->GetDeformer(0, FbxDeformer::eVertexCache)->GetUserDataPtr());
+        if (lDeformation->mPointCache && lMeshCache)
+        {
+            lDeformation->mVertices = new float[lVertexCount * VERTEX_STRIDE];
+        }
+    }
+    else
+    {
+        if (lHasShape)
+        {
+            lDeformation->mShapeCache = GetBlendShapeCache(lMesh);
+            lDeformation->mHasShape = lDeformation->mShapeCache &&
+                lDeformation->mShapeCache->EvaluateInfluences(lMesh, pTime, pAnimLayer, lDeformation->mShapeInfluences);
+        }
+
+        //we need to get the number of clusters
+        const int lSkinCount = lMesh->GetDeformerCount(FbxDeformer::eSkin);
+        int lClusterCount = 0;
+        for (int lSkinIndex = 0; lSkinIndex < lSkinCount; ++lSkinIndex)
+        {
+            lClusterCount += ((FbxSkin *)(lMesh->GetDeformer(lSkinIndex, FbxDeformer::eSkin)))->GetClusterCount();
+        }
+        if (lClusterCount)
+        {
+            FbxSkin * lSkinDeformer = (FbxSkin *)lMesh->GetDeformer(0, FbxDeformer::eSkin);
+            FbxSkin::EType lSkinningType = lSkinDeformer->GetSkinningType();
+            const SkinCache * lSkinCache = static_cast<const SkinCache *>(lSkinDeformer->GetUserDataPtr());
+
+            if (lSkinCache && (lSkinningType == FbxSkin::eLinear || lSkinningType == FbxSkin::eRigid) &&
+                SkinCache::GetSkinningPath() == SkinCache::SKINNING_PATH_GPU &&
+                lMeshCache && lMeshCache->HasSkin() && !lDeformation->mHasShape)
+            {
+                // Only the palette is computed here, the vertices are deformed when drawing.
+                FbxAMatrix* lBoneMatrices = new FbxAMatrix[lSkinCache->GetBoneCount()];
+                GetBoneMatrices(lSkinCache, pGlobalPosition, pTime, pPose, pBoneMatrices, lBoneMatrices);
+                lDeformation->mPalette = new float[lSkinCache->GetBoneCount() * SkinCache::PALETTE_STRIDE];
+                SkinCache::ConvertPalette(lBoneMatrices, lSkinCache->GetBoneCount(), lDeformation->mPalette);
+                lDeformation->mGPUSkin = true;
+                delete [] lBoneMatrices;
+            }
+            else if (lSkinCache)
+            {
+                const int lBoneCount = lSkinCache->GetBoneCount();
+                const bool lLinear = lSkinningType != FbxSkin::eDualQuaternion;
+                const bool lDualQuaternion = lSkinningType == FbxSkin::eDualQuaternion || lSkinningType == FbxSkin::eBlend;
+                lDeformation->mSkinCache = lSkinCache;
+                lDeformation->mBoneMatrices = new FbxAMatrix[lBoneCount];
+                GetBoneMatrices(lSkinCache, pGlobalPosition, pTime, pPose, pBoneMatrices, lDeformation->mBoneMatrices);
+
+                // The single precision kernels write straight into the VBO layout,
+                // they also stand in for the GPU path when the mesh cannot take it.
+                if (lMeshCache && SkinCache::GetSkinningPath() != SkinCache::SKINNING_PATH_REFERENCE &&
+                    lSkinCache->GetLinkMode() != FbxCluster::eAdditive)
+                {
+                    if (lLinear)
+                    {
+                        lDeformation->mPalette = new float[lBoneCount * SkinCache::PALETTE_STRIDE];
+                        SkinCache::ConvertPalette(lDeformation->mBoneMatrices, lBoneCount, lDeformation->mPalette);
+                    }
+                    if (lDualQuaternion)
+                    {
+                        lDeformation->mDQPalette = new float[lBoneCount * SkinCache::DQ_PALETTE_STRIDE];
+                        SkinCache::ConvertDualQuaternionPalette(lDeformation->mBoneMatrices, lBoneCount, lDeformation->mDQPalette);
+                    }
+                    lDeformation->mVertices = new float[lVertexCount * VERTEX_STRIDE];
+                    if (lDeformation->mHasShape)
+                    {
+                        lDeformation->mSrcPositions = new float[lVertexCount * 3];
+                    }
+                }
+                else if (lDualQuaternion)
+                {
+                    lDeformation->mDQPaletteDouble = new double[lBoneCount * SkinCache::DQ_PALETTE_STRIDE];
+                    SkinCache::ConvertDualQuaternionPalette(lDeformation->mBoneMatrices, lBoneCount, lDeformation->mDQPaletteDouble);
+                }
+            }
+            else
+            {
+                lSkinOnThisThread = true;
+            }
+        }
+    }
+
+    if (!(lDeformation->mVertices || lDeformation->mGPUSkin) || lDeformation->mHasShape)
+    {
+        lDeformation->mVertexArray = new FbxVector4[lVertexCount];
+    }
+
+    if (lSkinOnThisThread)
+    {
+        DeformTask(lDeformation, 0, lVertexCount);
+        // Deform the vertex array with the skin deformer.
+        ComputeSkinDeformation(pGlobalPosition, lMesh, pTime, lDeformation->mVertexArray, pPose);
+    }
+    else if (!pThreadPool)
+    {
+        DeformTask(lDeformation, 0, lVertexCount);
+    }
+    else if (lHasVertexCache)
+    {
+        pThreadPool->Push(DeformTask, lDeformation, 0, lVertexCount);
+    }
+    else
+    {
+        pThreadPool->PushRange(DeformTask, lDeformation, 0, lVertexCount, DEFORMATION_GRAIN_SIZE);
+    }
+
+    return lDeformation;
+}
+
+// Add the mesh of the node to the batch of its copies posed the same, or deform it in a new
+// batch. Meshes which are not deformed and have no copy are left alone. The bone matrices
+// already computed for the skin, if any, are taken over. pNodeIndex is the index of the node
+// in the global position cache.
+void BatchMesh(FbxNode* pNode, int pNodeIndex, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+               FbxAMatrix& pGlobalPosition, FbxPose* pPose, ThreadPool* pThreadPool,
+               int pLod, FbxAMatrix* pBoneMatrices)
 {
-    int lVertexCount = pMesh->GetControlPointsCount();
+    FbxMesh* lMesh = pNode->GetMesh();
+    const VBOMesh* lMeshCache = static_cast<const VBOMesh*>(lMesh->GetUserDataPtr());
+
+    // Shared geometries only have skins for deformers, the copies are told apart by their bones.
+    const bool lShared = lMeshCache && lMeshCache->IsGeometryShared() &&
+        (lMesh->GetDeformerCount(FbxDeformer::eSkin) == 0 || GetSkinCache(lMesh));
+    FbxAMatrix* lBoneMatrices = pBoneMatrices;
+    const SkinCache* lSkinCache = GetSkinCache(lMesh);
+    const int lBoneCount = lSkinCache ? lSkinCache->GetBoneCount() : 0;
+    if (lShared)
+    {
+        if (lSkinCache && !lBoneMatrices)
+        {
+            lBoneMatrices = new FbxAMatrix[lBoneCount];
+            lSkinCache->ComputeBoneMatrices(pGlobalPosition, pTime, pPose, lBoneMatrices);
+        }
 
-    FbxVector4* lSrcVertexArray = pVertexArray;
-    FbxVector4* lDstVertexArray = new FbxVector4[lVertexCount];
-    memcpy(lDstVertexArray, pVertexArray, lVertexCount * sizeof(FbxVector4));
+        for (int lBatchIndex = 0; lBatchIndex < gBatches.GetCount(); ++lBatchIndex)
+        {
+            MeshBatch* lBatch = gBatches[lBatchIndex];
+            if (lBatch->mMeshCache && CanJoinBatch(lBatch, pNode, lMeshCache, lBoneMatrices, lBoneCount, pLod))
+            {
+                AddToBatch(lBatch, pNode, pNodeIndex, pGlobalPosition);
+                delete [] lBoneMatrices;
+                return;
+            }
+        }
+    }
 
-	int lBlendShapeDeformerCount = pMesh->GetDeformerCount(FbxDeformer::eBlendShape);
-	for(int lBlendShapeIndex = 0; lBlendShapeIndex<lBlendShapeDeformerCount; ++lBlendShapeIndex)
-	{
-		FbxBlendShape* lBlendShape = (FbxBlendShape*)pMesh->GetDeformer(lBlendShapeIndex, FbxDeformer::eBlendShape);
+    MeshDeformation* lDeformation = CreateMeshDeformation(pNode, pTime, pAnimLayer, pGlobalPosition, pPose, pThreadPool,
+        pLod, lBoneMatrices);
+    if (!lDeformation && !lShared)
+    {
+        delete [] lBoneMatrices;
+        return;
+    }
 
-		int lBlendShapeChannelCount = lBlendShape->GetBlendShapeChannelCount();
-		for(int lChannelIndex = 0; lChannelIndex<lBlendShapeChannelCount; ++lChannelIndex)
-		{
-			FbxBlendShapeChannel* lChannel = lBlendShape->GetBlendShapeChannel(lChannelIndex);
-			if(lChannel)
-			{
-				// Get the percentage of influence on this channel.
-				FbxAnimCurve* lFCurve = pMesh->GetShapeChannel(lBlendShapeIndex, lChannelIndex, pAnimLayer);
-				if (!lFCurve) continue;
-				double lWeight = lFCurve->Evaluate(pTime);
-
-				/*
-				If there is only one targetShape on this channel, the influence is easy to calculate:
-                influence = (targetShape - baseGeometry) * weight * 0.01
-				dstGeometry = baseGeometry + influence
-
-				But if there are more than one targetShapes on this channel, this is an in-between 
-				blendshape, also called progressive morph. The calculation of influence is different.
-				
-				For example, given two in-between targets, the full weight percentage of first target
-				is 50, and the full weight percentage of the second target is 100.
-				When the weight percentage reach 50, the base geometry is already be fully morphed 
-				to the first target shape. When the weight go over 50, it begin to morph from the 
-				first target shape to the second target shape.
-
-				To calculate influence when the weight percentage is 25:
-				1. 25 falls in the scope of 0 and 50, the morphing is from base geometry to the first target.
-				2. And since 25 is already half way between 0 and 50, so the real weight percentage change to 
-				the first target is 50.
-				influence = (firstTargetShape - baseGeometry) * (25-0)/(50-0) * 100
-				dstGeometry = baseGeometry + influence
-
-				To calculate influence when the weight percentage is 75:
-				1. 75 falls in the scope of 50 and 100, the morphing is from the first target to the second.
-				2. And since 75 is already half way between 50 and 100, so the real weight percentage change 
-				to the second target is 50.
-				influence = (secondTargetShape - firstTargetShape) * (75-50)/(100-50) * 100
-				dstGeometry = firstTargetShape + influence
-				*/
-
-				// Find the two shape indices for influence calculation according to the weight.
-				// Consider index of base geometry as -1.
-
-				int lShapeCount = lChannel->GetTargetShapeCount();
-				double* lFullWeights = lChannel->GetTargetShapeFullWeights();
-
-				// Find out which scope the lWeight falls in.
-				int lStartIndex = -1;
-				int lEndIndex = -1;
-				for(int lShapeIndex = 0; lShapeIndex<lShapeCount; ++lShapeIndex)
-				{
-					if(lWeight > 0 && lWeight <= lFullWeights[0])
-					{
-						lEndIndex = 0;
-						break;
-					}
-					if(lWeight > lFullWeights[lShapeIndex] && lWeight < lFullWeights[lShapeIndex+1])
-					{
-						lStartIndex = lShapeIndex;
-						lEndIndex = lShapeIndex + 1;
-						break;
-					}
-				}
+    MeshBatch* lBatch = new MeshBatch;
+    lBatch->mMeshCache = lMeshCache;
+    lBatch->mDeformation = lDeformation;
+    lBatch->mBoneMatrices = lBoneMatrices;
+    lBatch->mBoneCount = lBoneCount;
+    lBatch->mLod = pLod;
+    AddToBatch(lBatch, pNode, pNodeIndex, pGlobalPosition);
+    gBatches.Add(lBatch);
+}
 
-				FbxShape* lStartShape = NULL;
-				FbxShape* lEndShape = NULL;
-				if(lStartIndex > -1)
-				{
-					lStartShape = lChannel->GetTargetShape(lStartIndex);
-				}
-				if(lEndIndex > -1)
-				{
-					lEndShape = lChannel->GetTargetShape(lEndIndex);
-				}
+// Walk the tree as DrawNodeRecursive does and deform every mesh met. Fit the bounds of
+// every node and subtree to pick the levels of detail and, if culling is on, skip the
+// meshes out of the view frustum.
+void ComputeDeformationsRecursive(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                                  FbxAMatrix& pParentGlobalPosition, FbxPose* pPose, ThreadPool* pThreadPool)
+{
+    FbxAMatrix lGlobalPosition = GetGlobalPosition(pNode, pTime, pPose, &pParentGlobalPosition);
 
-				//The weight percentage falls between base geometry and the first target shape.
-				if(lStartIndex == -1 && lEndShape) 
-				{
-					double lEndWeight = lFullWeights[0];
-					// Calculate the real weight.
-					lWeight = (lWeight/lEndWeight) * 100;
-					// Initialize the lDstVertexArray with vertex of base geometry.
-					memcpy(lDstVertexArray, lSrcVertexArray, lVertexCount * sizeof(FbxVector4));
-					for (int j = 0; j < lVertexCount; j++)
-					{
-						// Add the influence of the shape vertex to the mesh vertex.
-						FbxVector4 lInfluence = (lEndShape->GetControlPoints()[j] - lSrcVertexArray[j]) * lWeight * 0.01;
-						lDstVertexArray[j] += lInfluence;
-					}	
-				}
-				//The weight percentage falls between two target shapes.
-				else if(lStartShape && lEndShape)
-				{
-					double lStartWeight = lFullWeights[lStartIndex];
-					double lEndWeight = lFullWeights[lEndIndex];
-					// Calculate the real weight.
-					lWeight = ((lWeight-lStartWeight)/(lEndWeight-lStartWeight)) * 100;
-					// Initialize the lDstVertexArray with vertex of the previous target shape geometry.
-					memcpy(lDstVertexArray, lStartShape->GetControlPoints(), lVertexCount * sizeof(FbxVector4));
-					for (int j = 0; j < lVertexCount; j++)
-					{
-						// Add the influence of the shape vertex to the previous shape vertex.
-						FbxVector4 lInfluence = (lEndShape->GetControlPoints()[j] - lStartShape->GetControlPoints()[j]) * lWeight * 0.01;
-						lDstVertexArray[j] += lInfluence;
-					}	
-				}
-			}//If lChannel is valid
-		}//For each blend shape channel
-	}//For each blend shape deformer
+    // Geometry offset.
+    // it is not inherited by the children.
+    FbxAMatrix lGeometryOffset = GetGeometry(pNode);
+    FbxAMatrix lGlobalOffPosition = lGlobalPosition * lGeometryOffset;
 
-    memcpy(pVertexArray, lDstVertexArray, lVertexCount * sizeof(FbxVector4));
+    // The children add their bounds after the ones of the node.
+    const int lBoundsIndex = gNodeBounds.GetCount();
+    FbxAMatrix* lBoneMatrices = NULL;
+    NodeBounds lNodeBounds;
+    ComputeContentBounds(pNode, pParentGlobalPosition, lGlobalOffPosition, pTime, pPose, lNodeBounds.mContent,
+        lBoneMatrices);
+    lNodeBounds.mContentVisible = !gFrustumCulling || IsInFrustum(lNodeBounds.mContent);
+    lNodeBounds.mSubtree = lNodeBounds.mContent;
+    lNodeBounds.mLod = SelectLod(lNodeBounds.mContent);
+    gNodeBounds.Add(lNodeBounds);
+
+    // Nodes without index are deformed when drawn.
+    FbxNodeAttribute* lNodeAttribute = pNode->GetNodeAttribute();
+    const int lNodeIndex = GetNodeIndex(pNode);
+    if (lNodeBounds.mContentVisible && lNodeAttribute && lNodeAttribute->GetAttributeType() == FbxNodeAttribute::eMesh &&
+        lNodeIndex >= 0 && !gNodeBatches[lNodeIndex] && !IsMeshPending(pNode))
+    {
+        BatchMesh(pNode, lNodeIndex, pTime, pAnimLayer, lGlobalOffPosition, pPose, pThreadPool, lNodeBounds.mLod, lBoneMatrices);
+    }
+    else
+    {
+        delete [] lBoneMatrices;
+    }
+
+    const int lChildCount = pNode->GetChildCount();
+    for (int lChildIndex = 0; lChildIndex < lChildCount; ++lChildIndex)
+    {
+        const int lChildBoundsIndex = gNodeBounds.GetCount();
+        ComputeDeformationsRecursive(pNode->GetChild(lChildIndex), pTime, pAnimLayer, lGlobalPosition, pPose, pThreadPool);
+        AddBounds(gNodeBounds[lBoundsIndex].mSubtree, gNodeBounds[lChildBoundsIndex].mSubtree);
+    }
+
+    NodeBounds& lSubtreeBounds = gNodeBounds[lBoundsIndex];
+    lSubtreeBounds.mSubtreeVisible = !gFrustumCulling || IsInFrustum(lSubtreeBounds.mSubtree);
+    lSubtreeBounds.mSubtreeSize = gNodeBounds.GetCount() - lBoundsIndex;
+}
+
+void ComputeDeformations(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer,
+                         FbxAMatrix& pParentGlobalPosition, FbxPose* pPose, ThreadPool* pThreadPool)
+{
+    {
+        PROFILE_SCOPE("ReadFrustumPlanes");
+        ReadFrustumPlanes();
+    }
+    const GlobalPositionCache* lCache = GlobalPositionCache::GetCurrent();
+    const int lNodeCount = lCache ? lCache->GetNodeCount() : 0;
+    gNodeBatches.Resize(lNodeCount);
+    for (int lNodeIndex = 0; lNodeIndex < lNodeCount; ++lNodeIndex)
+    {
+        gNodeBatches[lNodeIndex] = NULL;
+    }
+    ComputeDeformationsRecursive(pNode, pTime, pAnimLayer, pParentGlobalPosition, pPose, pThreadPool);
+    if (pThreadPool)
+    {
+        pThreadPool->Run();
+    }
+}
 
-    delete [] lDstVertexArray;
+void ReleaseDeformations()
+{
+    for (int lBatchIndex = 0; lBatchIndex < gBatches.GetCount(); ++lBatchIndex)
+    {
+        delete gBatches[lBatchIndex];
+    }
+    gBatches.Clear();
+    gNodeBatches.Clear();
+    gNodeBounds.Clear();
+}
+
+void SetSkipMeshesWithoutVBO(bool pSkip)
+{
+    gSkipMeshesWithoutVBO = pSkip;
+}
+
+void SetFrustumCulling(bool pCulling)
+{
+    gFrustumCulling = pCulling;
+}
+
+bool GetFrustumCulling()
+{
+    return gFrustumCulling;
+}
+
+void SetLodSelection(bool pSelection)
+{
+    gLodSelection = pSelection;
+}
+
+bool GetLodSelection()
+{
+    return gLodSelection;
+}
+
+void GetCullingStatistics(int& pVisitedNodeCount, int& pCulledNodeCount, int& pDrawnNodeCount)
+{
+    pVisitedNodeCount = gVisitedNodeCount;
+    pCulledNodeCount = gCulledNodeCount;
+    pDrawnNodeCount = gDrawnNodeCount;
+}
+
+
+// Deform the vertex array with the shapes contained in the mesh.
+void ComputeShapeDeformation(FbxMesh* pMesh, FbxTime& pTime, FbxAnimLayer * pAnimLayer, FbxVector4* pVertexArray)
+{
+    const BlendShapeCache* lShapeCache = GetBlendShapeCache(pMesh);
+    FbxArray<BlendShapeCache::Influence> lInfluences;
+    if (lShapeCache && lShapeCache->EvaluateInfluences(pMesh, pTime, pAnimLayer, lInfluences))
+    {
+        lShapeCache->ApplyInfluences(lInfluences, pVertexArray, 0, pMesh->GetControlPointsCount());
+    }
 }
 
 //Compute the transform matrix that the cluster will transform the vertex.
@@ -507,6 +1402,18 @@ void ComputeLinearDeformation(FbxAMatrix& pGlobalPosition,
                                FbxVector4* pVertexArray,
 							   FbxPose* pPose)
 {
+	// Use the skin binding baked at load time if there is one, only the bone
+	// matrices have to be computed for this frame.
+	const SkinCache * lSkinCache = static_cast<const SkinCache *>(pMesh->GetDeformer(0, FbxDeformer::eSkin)->GetUserDataPtr());
+	if (lSkinCache)
+	{
+		FbxAMatrix* lBoneMatrices = new FbxAMatrix[lSkinCache->GetBoneCount()];
+		lSkinCache->ComputeBoneMatrices(pGlobalPosition, pTime, pPose, lBoneMatrices);
+		lSkinCache->ComputeLinearDeformation(lBoneMatrices, pVertexArray, 0, lSkinCache->GetVertexCount());
+		delete [] lBoneMatrices;
+		return;
+	}
+
 	// All the links must have the same link mode.
 	FbxCluster::ELinkMode lClusterMode = ((FbxSkin*)pMesh->GetDeformer(0, FbxDeformer::eSkin))->GetCluster(0)->GetLinkMode();
 
@@ -749,6 +1656,18 @@ void ComputeSkinDeformation(FbxAMatrix& pGlobalPosition,
 	{
 		ComputeLinearDeformation(pGlobalPosition, pMesh, pTime, pVertexArray, pPose);
 	}
+	else if (const SkinCache * lSkinCache = static_cast<const SkinCache *>(lSkinDeformer->GetUserDataPtr()))
+	{
+		// Dual quaternion and blend skinning in a single pass over the influences.
+		const int lBoneCount = lSkinCache->GetBoneCount();
+		FbxAMatrix* lBoneMatrices = new FbxAMatrix[lBoneCount];
+		double* lDQPalette = new double[lBoneCount * SkinCache::DQ_PALETTE_STRIDE];
+		lSkinCache->ComputeBoneMatrices(pGlobalPosition, pTime, pPose, lBoneMatrices);
+		SkinCache::ConvertDualQuaternionPalette(lBoneMatrices, lBoneCount, lDQPalette);
+		lSkinCache->ComputeDualQuaternionDeformation(lBoneMatrices, lDQPalette, pVertexArray, 0, lSkinCache->GetVertexCount());
+		delete [] lDQPalette;
+		delete [] lBoneMatrices;
+	}
 	else if(lSkinningType == FbxSkin::eDualQuaternion)
 	{
 		ComputeDualQuaternionDeformation(pGlobalPosition, pMesh, pTime, pVertexArray, pPose);
@@ -14,12 +14,41 @@ this software in either electronic or hard copy form.
 
 #include "GlFunctions.h"
 
+class ThreadPool;
+
 void InitializeLights(const FbxScene* pScene, const FbxTime & pTime, FbxPose* pPose = NULL);
 
 void DrawNodeRecursive(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer, 
                        FbxAMatrix& pParentGlobalPosition,
                        FbxPose* pPose, ShadingMode pShadingMode);
 
+// Deform the meshes of the node and its children before drawing them, spreading the meshes
+// and the vertex ranges of the large ones over the thread pool. DrawNodeRecursive then only
+// uploads the deformed vertices. Copies of a shared geometry posed the same are deformed
+// once and drawn together, instanced if the driver allows it. The bounds of every node and
+// subtree are fitted against the camera set by SetCamera: with frustum culling, the meshes
+// out of view are not deformed, and DrawNodeRecursive skips the subtrees out of view; the
+// meshes far away are deformed and drawn with a coarser level of detail.
+// ReleaseDeformations must be called after drawing.
+void ComputeDeformations(FbxNode* pNode, FbxTime& pTime, FbxAnimLayer* pAnimLayer, 
+                         FbxAMatrix& pParentGlobalPosition,
+                         FbxPose* pPose, ThreadPool* pThreadPool);
+// Free the deformed vertices computed by ComputeDeformations.
+void ReleaseDeformations();
+
+// While the scene is baked progressively, skip the meshes without VBO yet
+// instead of drawing them in immediate mode.
+void SetSkipMeshesWithoutVBO(bool pSkip);
+
+// Cull the nodes out of the view frustum, on by default.
+void SetFrustumCulling(bool pCulling);
+bool GetFrustumCulling();
+// Draw the meshes far away with fewer triangles, on by default.
+void SetLodSelection(bool pSelection);
+bool GetLodSelection();
+// The nodes tested, skipped and drawn by the last DrawNodeRecursive.
+void GetCullingStatistics(int& pVisitedNodeCount, int& pCulledNodeCount, int& pDrawnNodeCount);
+
 #endif // #ifndef _DRAW_SCENE_H
 
 
@@ -76,42 +76,77 @@ void Frame::SetNumJoints(unsigned int num)
     m_quaternionData.resize(num, Quaternion(0,0,0,0));
 }
 
-mat3 ComputeBVHRot(float r1, float r2, float r3, const std::string& rotOrder) // For BVH
+// One function per BVH rotation order, the angles come in the order of the channels
+mat3 ComputeBVHRotXYZ(float r1, float r2, float r3)
 {
     mat3 m;
-	float ry, rx, rz;
+    m.FromEulerAnglesXYZ(vec3(r1, r2, r3) * Deg2Rad);
+    return m;
+}
 
-    if (rotOrder == "xyz") 
-    {
-        rx = r1; ry = r2; rz = r3;
-        m.FromEulerAnglesXYZ(vec3(rx, ry, rz) * Deg2Rad);
-    }
-    else if (rotOrder == "xzy")
-    {
-        rx = r1; rz = r2; ry = r3;
-        m.FromEulerAnglesXZY(vec3(rx, ry, rz) * Deg2Rad);
-    }
-    else if (rotOrder == "yxz")
-    {
-        ry = r1; rx = r2; rz = r3;
-        m.FromEulerAnglesYXZ(vec3(rx, ry, rz) * Deg2Rad);
-    }
-    else if (rotOrder == "yzx")
-    {
-        ry = r1; rz = r2; rx = r3;
-        m.FromEulerAnglesYZX(vec3(rx, ry, rz) * Deg2Rad);
-    }
-    else if (rotOrder == "zxy")
-    {
-        rz = r1; rx = r2; ry = r3;
-        m.FromEulerAnglesZXY(vec3(rx, ry, rz) * Deg2Rad);
-    }
-    else if (rotOrder == "zyx")
+mat3 ComputeBVHRotXZY(float r1, float r2, float r3)
+{
+    mat3 m;
+    m.FromEulerAnglesXZY(vec3(r1, r3, r2) * Deg2Rad);
+    return m;
+}
+
+mat3 ComputeBVHRotYXZ(float r1, float r2, float r3)
+{
+    mat3 m;
+    m.FromEulerAnglesYXZ(vec3(r2, r1, r3) * Deg2Rad);
+    return m;
+}
+
+mat3 ComputeBVHRotYZX(float r1, float r2, float r3)
+{
+    mat3 m;
+    m.FromEulerAnglesYZX(vec3(r3, r1, r2) * Deg2Rad);
+    return m;
+}
+
+mat3 ComputeBVHRotZXY(float r1, float r2, float r3)
+{
+    mat3 m;
+    m.FromEulerAnglesZXY(vec3(r2, r3, r1) * Deg2Rad);
+    return m;
+}
+
+mat3 ComputeBVHRotZYX(float r1, float r2, float r3)
+{
+    mat3 m;
+    m.FromEulerAnglesZYX(vec3(r3, r2, r1) * Deg2Rad);
+    return m;
+}
+
+mat3 ComputeBVHRotUnknown(float r1, float r2, float r3)
+{
+    return mat3();
+}
+
+BVHRotationFunc GetBVHRotationFunc(const std::string& rotOrder)
+{
+    if (rotOrder == "xyz") return ComputeBVHRotXYZ;
+    if (rotOrder == "xzy") return ComputeBVHRotXZY;
+    if (rotOrder == "yxz") return ComputeBVHRotYXZ;
+    if (rotOrder == "yzx") return ComputeBVHRotYZX;
+    if (rotOrder == "zxy") return ComputeBVHRotZXY;
+    if (rotOrder == "zyx") return ComputeBVHRotZYX;
+    return ComputeBVHRotUnknown;
+}
+
+void ComputeBVHChannelLayout(const Skeleton& pSkeleton, std::vector<BVHChannelLayout>& layout)
+{
+    layout.resize(pSkeleton.GetNumJoints());
+    for (unsigned int i = 0; i < layout.size(); i++)
     {
-        rz = r1; ry = r2; rx = r3;
-        m.FromEulerAnglesZYX(vec3(rx, ry, rz) * Deg2Rad);
+        Joint* pJoint = pSkeleton.GetJointByID(i);
+        unsigned int numChannels = pJoint->GetNumChannels();
+
+        // Only the translation and rotation or the rotation alone are read
+        layout[i].numChannels = (numChannels == 6 || numChannels == 3) ? numChannels : 0;
+        layout[i].rotation = GetBVHRotationFunc(pJoint->GetRotationOrder());
     }
-    return m;
 }
 
 mat3 ComputeAMCRot(float r1, float r2, float r3, const std::string& rotOrder)
@@ -187,34 +222,53 @@ void Frame::LoadFromAMCFile(std::ifstream& inFile, const Skeleton& pSkeleton)
 
 void Frame::LoadFromBVHFile(std::ifstream& inFile, const Skeleton& pSkeleton)
 {
-	float tx, ty, tz, r1, r2, r3;
-	for (unsigned int i = 0; i < pSkeleton.GetNumJoints(); i++)
+    std::vector<BVHChannelLayout> layout;
+    ComputeBVHChannelLayout(pSkeleton, layout);
+
+    std::vector<float> channels;
+	for (unsigned int i = 0; i < layout.size(); i++)
 	{
-        tx = ty = tz = 0.0f;
-		r1 = r2 = r3 = 0.0f;
-
-		Joint* pJoint = pSkeleton.GetJointByID(i);
-		if (pJoint->GetNumChannels() == 6)
-		{
-            inFile >> tx >> ty >> tz;
-            inFile >> r1 >> r2 >> r3;
+        for (unsigned int c = 0; c < layout[i].numChannels; c++)
+        {
+            float value = 0.0f;
+            inFile >> value;
+            channels.push_back(value);
         }
-        else if (pJoint->GetNumChannels() == 3)
+	}
+
+    channels.push_back(0.0f); // never empty
+    LoadFromBVHChannels(&channels[0], layout);
+}
+
+void Frame::LoadFromBVHChannels(const float* channels, const std::vector<BVHChannelLayout>& layout)
+{
+    unsigned int numJoints = layout.size();
+    m_eulerData.resize(numJoints);
+    m_rotationData.resize(numJoints);
+    m_quaternionData.resize(numJoints);
+
+	for (unsigned int i = 0; i < numJoints; i++)
+	{
+        float tx = 0.0f, ty = 0.0f, tz = 0.0f;
+        float r1 = 0.0f, r2 = 0.0f, r3 = 0.0f;
+
+        if (layout[i].numChannels == 6)
         {
-            inFile >> r1 >> r2 >> r3;
+            tx = channels[0]; ty = channels[1]; tz = channels[2];
+            r1 = channels[3]; r2 = channels[4]; r3 = channels[5];
         }
-        else
+        else if (layout[i].numChannels == 3)
         {
+            r1 = channels[0]; r2 = channels[1]; r3 = channels[2];
         }
+        channels += layout[i].numChannels;
 
         if (i == 0) m_rootTranslation = vec3(tx, ty, tz);
 
-        mat3 m = ComputeBVHRot(r1, r2, r3, pJoint->GetRotationOrder());
-        m_rotationData.push_back(m); 
-
-        Quaternion q;
-        q.FromRotation(m);
-		m_quaternionData.push_back(q);
+        mat3 m = layout[i].rotation(r1, r2, r3);
+        m_eulerData[i] = vec3(r1, r2, r3);
+        m_rotationData[i] = m;
+        m_quaternionData[i].FromRotation(m);
 	}
 }
 
@@ -8,6 +8,18 @@
 #include "Skeleton.h"
 #include <vector>
 
+// Rotation of a BVH joint from its three rotation channels, in the order of the file
+typedef mat3 (*BVHRotationFunc)(float r1, float r2, float r3);
+BVHRotationFunc GetBVHRotationFunc(const std::string& rotOrder);
+
+// Channels of one joint in a BVH frame, resolved once per skeleton instead of once per value
+struct BVHChannelLayout
+{
+    unsigned int numChannels; // 6 (translation and rotation), 3 (rotation) or 0
+    BVHRotationFunc rotation;
+};
+void ComputeBVHChannelLayout(const Skeleton& pSkeleton, std::vector<BVHChannelLayout>& layout);
+
 class Frame
 {
 
@@ -18,6 +30,7 @@ public:
 	virtual ~Frame();
 
     void LoadFromBVHFile(std::ifstream& inFile, const Skeleton& pSkeleton);	// Read from BVH file and assume ZXY rotation order
+    void LoadFromBVHChannels(const float* channels, const std::vector<BVHChannelLayout>& layout);	// Read the channel values of one frame
     void LoadFromAMCFile(std::ifstream& inFile, const Skeleton& pSkeleton);	
     void SaveToBVHFile(std::ofstream& outFile, const Skeleton& pSkeleton);	// Write to BVH file and assume ZXY rotation order
     void SaveToAMCFile(std::ofstream& outFile, const Skeleton& pSkeleton);	// Write to BVH file and assume ZXY rotation order
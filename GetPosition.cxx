@@ -17,11 +17,35 @@
 /////////////////////////////////////////////////////////////////////////
 
 #include "GetPosition.h"
+#include "AnimationClip.h"
+
+#include <string.h>
+
+FbxAMatrix EvaluateGlobalPosition(FbxNode* pNode, 
+                                  const FbxTime& pTime, 
+                                  FbxPose* pPose,
+                                  FbxAMatrix* pParentGlobalPosition,
+                                  bool* pFromPose = NULL);
 
 // Get the global position of the node for the current pose.
 // If the specified node is not part of the pose or no pose is specified, get its
 // global position at the current time.
 FbxAMatrix GetGlobalPosition(FbxNode* pNode, const FbxTime& pTime, FbxPose* pPose, FbxAMatrix* pParentGlobalPosition)
+{
+    // The positions of the current frame are usually evaluated already.
+    FbxAMatrix lGlobalPosition;
+    const GlobalPositionCache* lCache = GlobalPositionCache::GetCurrent();
+    if (lCache && lCache->Find(pNode, pTime, pPose, lGlobalPosition))
+    {
+        return lGlobalPosition;
+    }
+
+    return EvaluateGlobalPosition(pNode, pTime, pPose, pParentGlobalPosition);
+}
+
+// Evaluate the global position of the node, pFromPose tells whether it was found in the pose.
+FbxAMatrix EvaluateGlobalPosition(FbxNode* pNode, const FbxTime& pTime, FbxPose* pPose, FbxAMatrix* pParentGlobalPosition,
+                                  bool* pFromPose)
 {
     FbxAMatrix lGlobalPosition;
     bool        lPositionFound = false;
@@ -77,6 +101,11 @@ FbxAMatrix GetGlobalPosition(FbxNode* pNode, const FbxTime& pTime, FbxPose* pPos
         lGlobalPosition = pNode->EvaluateGlobalTransform(pTime);
     }
 
+    if (pFromPose)
+    {
+        *pFromPose = lPositionFound;
+    }
+
     return lGlobalPosition;
 }
 
@@ -101,3 +130,146 @@ FbxAMatrix GetGeometry(FbxNode* pNode)
     return FbxAMatrix(lT, lR, lS);
 }
 
+
+GlobalPositionCache* GlobalPositionCache::sCurrent = NULL;
+
+GlobalPositionCache::GlobalPositionCache() : mClip(NULL), mGlobalPositions(NULL), mFilled(false), mPose(NULL),
+    mHitCount(0), mMissCount(0)
+{
+}
+
+GlobalPositionCache::~GlobalPositionCache()
+{
+    Clear();
+}
+
+void GlobalPositionCache::Initialize(FbxScene* pScene)
+{
+    Clear();
+
+    AddNodeRecursive(pScene->GetRootNode(), -1);
+
+    mGlobalPositions = new FbxAMatrix[mNodes.GetCount()];
+    mFromPose.Resize(mNodes.GetCount());
+}
+
+void GlobalPositionCache::Clear()
+{
+    if (sCurrent == this)
+    {
+        sCurrent = NULL;
+    }
+
+    mNodes.Clear();
+    mParentIndices.Clear();
+    mNodeIndices.Clear();
+    mClip = NULL;
+    mJointIndices.Clear();
+    mFromPose.Clear();
+
+    delete [] mGlobalPositions;
+    mGlobalPositions = NULL;
+    mFilled = false;
+}
+
+void GlobalPositionCache::SetClip(const AnimationClip* pClip)
+{
+    mClip = pClip && pClip->IsLoaded() ? pClip : NULL;
+    mJointIndices.Clear();
+    mFilled = false;
+    if (!mClip)
+    {
+        return;
+    }
+
+    const int lNodeCount = mNodes.GetCount();
+    mJointIndices.Resize(lNodeCount);
+    for (int lNodeIndex = 0; lNodeIndex < lNodeCount; ++lNodeIndex)
+    {
+        mJointIndices[lNodeIndex] = -1;
+    }
+
+    // Once when the clip is loaded, the first node with the name of the joint plays it.
+    const int lJointCount = mClip->GetJointCount();
+    for (int lJointIndex = 0; lJointIndex < lJointCount; ++lJointIndex)
+    {
+        const char* lJointName = mClip->GetJointName(lJointIndex);
+        for (int lNodeIndex = 0; lNodeIndex < lNodeCount; ++lNodeIndex)
+        {
+            if (mJointIndices[lNodeIndex] < 0 && strcmp(mNodes[lNodeIndex]->GetName(), lJointName) == 0)
+            {
+                mJointIndices[lNodeIndex] = lJointIndex;
+                break;
+            }
+        }
+    }
+}
+
+void GlobalPositionCache::Fill(const FbxTime& pTime, FbxPose* pPose)
+{
+    mHitCount = 0;
+    mMissCount = 0;
+
+    // The parents come first, their positions are ready for the local matrices of a rest pose.
+    const int lNodeCount = mNodes.GetCount();
+    for (int lNodeIndex = 0; lNodeIndex < lNodeCount; ++lNodeIndex)
+    {
+        const int lParentIndex = mParentIndices[lNodeIndex];
+        FbxAMatrix* lParentGlobalPosition = lParentIndex < 0 ? NULL : &mGlobalPositions[lParentIndex];
+
+        // The pose still wins over the clip, as it does over the animation curves.
+        const int lJointIndex = mClip ? mJointIndices[lNodeIndex] : -1;
+        if (lJointIndex >= 0 && (!pPose || pPose->Find(mNodes[lNodeIndex]) < 0))
+        {
+            FbxAMatrix lLocalPosition;
+            mClip->EvaluateLocalTransform(lJointIndex, pTime, lLocalPosition);
+            mGlobalPositions[lNodeIndex] = lParentGlobalPosition ? *lParentGlobalPosition * lLocalPosition : lLocalPosition;
+            mFromPose[lNodeIndex] = false;
+            continue;
+        }
+
+        mGlobalPositions[lNodeIndex] = EvaluateGlobalPosition(mNodes[lNodeIndex], pTime, pPose, lParentGlobalPosition,
+            &mFromPose[lNodeIndex]);
+    }
+
+    mTime = pTime;
+    mPose = pPose;
+    mFilled = true;
+}
+
+bool GlobalPositionCache::Find(FbxNode* pNode, const FbxTime& pTime, FbxPose* pPose, FbxAMatrix& pGlobalPosition) const
+{
+    const FbxMap<FbxNode*, int>::RecordType* lRecord = mFilled && pTime == mTime ? mNodeIndices.Find(pNode) : NULL;
+    if (lRecord)
+    {
+        const int lNodeIndex = lRecord->GetValue();
+        if (pPose == mPose || (!pPose && !mFromPose[lNodeIndex]))
+        {
+            pGlobalPosition = mGlobalPositions[lNodeIndex];
+            ++mHitCount;
+            return true;
+        }
+    }
+
+    ++mMissCount;
+    return false;
+}
+
+int GlobalPositionCache::GetNodeIndex(FbxNode* pNode) const
+{
+    const FbxMap<FbxNode*, int>::RecordType* lRecord = mNodeIndices.Find(pNode);
+    return lRecord ? lRecord->GetValue() : -1;
+}
+
+void GlobalPositionCache::AddNodeRecursive(FbxNode* pNode, int pParentIndex)
+{
+    const int lNodeIndex = mNodes.Add(pNode);
+    mParentIndices.Add(pParentIndex);
+    mNodeIndices.Insert(pNode, lNodeIndex);
+
+    const int lChildCount = pNode->GetChildCount();
+    for (int lChildIndex = 0; lChildIndex < lChildCount; ++lChildIndex)
+    {
+        AddNodeRecursive(pNode->GetChild(lChildIndex), lNodeIndex);
+    }
+}
@@ -14,6 +14,8 @@ this software in either electronic or hard copy form.
  
 #include <fbxsdk.h>
 
+class AnimationClip;
+
 FbxAMatrix GetGlobalPosition(FbxNode* pNode, 
 							  const FbxTime& pTime, 
 							  FbxPose* pPose = NULL,
@@ -22,6 +24,67 @@ FbxAMatrix GetPoseMatrix(FbxPose* pPose,
                           int pNodeIndex);
 FbxAMatrix GetGeometry(FbxNode* pNode);
 
+// Global positions of all the nodes of a scene for one frame, evaluated once in a single
+// pass with the parents before their children. While it is current, GetGlobalPosition
+// reads the positions from it instead of evaluating the nodes again.
+class GlobalPositionCache
+{
+public:
+    GlobalPositionCache();
+    ~GlobalPositionCache();
+
+    // Index the nodes of the scene, parents first.
+    void Initialize(FbxScene* pScene);
+    void Clear();
+
+    // Play the animated nodes from a baked clip instead of evaluating their curves,
+    // the joints are matched with the nodes by name. NULL to evaluate all the nodes.
+    void SetClip(const AnimationClip* pClip);
+    const AnimationClip* GetClip() const { return mClip; }
+
+    // Evaluate the global position of every node for the given time and pose.
+    // The hit and miss counters restart from zero.
+    void Fill(const FbxTime& pTime, FbxPose* pPose);
+
+    // Get the position of the node if it was evaluated for the same time and pose.
+    // Nodes which are not in the pose also answer the queries without pose.
+    bool Find(FbxNode* pNode, const FbxTime& pTime, FbxPose* pPose, FbxAMatrix& pGlobalPosition) const;
+
+    int GetNodeCount() const { return mNodes.GetCount(); }
+    // Index of the node in topological order, -1 if it was not in the scene when initialized.
+    int GetNodeIndex(FbxNode* pNode) const;
+    int GetHitCount() const { return mHitCount; }
+    int GetMissCount() const { return mMissCount; }
+
+    // The cache used by GetGlobalPosition, NULL to always evaluate the nodes.
+    static GlobalPositionCache* GetCurrent() { return sCurrent; }
+    static void SetCurrent(GlobalPositionCache* pCache) { sCurrent = pCache; }
+
+private:
+    void AddNodeRecursive(FbxNode* pNode, int pParentIndex);
+
+    // Nodes in topological order and the index of their parent, -1 for the root.
+    FbxArray<FbxNode*> mNodes;
+    FbxArray<int> mParentIndices;
+    FbxMap<FbxNode*, int> mNodeIndices;
+
+    // Index of the joint of the clip played by every node, -1 if the node is evaluated.
+    const AnimationClip* mClip;
+    FbxArray<int> mJointIndices;
+
+    FbxAMatrix* mGlobalPositions;
+    // Whether the position of every node comes from the pose.
+    FbxArray<bool> mFromPose;
+    bool mFilled;
+    FbxTime mTime;
+    FbxPose* mPose;
+
+    mutable int mHitCount;
+    mutable int mMissCount;
+
+    static GlobalPositionCache* sCurrent;
+};
+
 #endif // #ifndef _GET_POSITION_H
 
 
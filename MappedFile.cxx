@@ -0,0 +1,141 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile() : mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mData(NULL), mSize(0)
+{
+}
+
+bool MappedFile::Open(const char * pFileName)
+{
+    Close();
+
+    mFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER lSize;
+    if (!GetFileSizeEx(mFile, &lSize) || lSize.QuadPart == 0 || (unsigned long long)lSize.QuadPart > (size_t)-1)
+    {
+        Close();
+        return false;
+    }
+
+    mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMapping == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const char *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (mData == NULL)
+    {
+        Close();
+        return false;
+    }
+    mSize = static_cast<size_t>(lSize.QuadPart);
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+    {
+        UnmapViewOfFile(mData);
+        mData = NULL;
+    }
+    if (mMapping)
+    {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+    mSize = 0;
+}
+
+#else
+
+MappedFile::MappedFile() : mFile(-1), mData(NULL), mSize(0)
+{
+}
+
+bool MappedFile::Open(const char * pFileName)
+{
+    Close();
+
+    mFile = open(pFileName, O_RDONLY);
+    if (mFile < 0)
+    {
+        return false;
+    }
+
+    struct stat lStat;
+    if (fstat(mFile, &lStat) != 0 || lStat.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    void * lData = mmap(NULL, static_cast<size_t>(lStat.st_size), PROT_READ, MAP_PRIVATE, mFile, 0);
+    if (lData == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    mData = static_cast<const char *>(lData);
+    mSize = static_cast<size_t>(lStat.st_size);
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+    {
+        munmap(const_cast<char *>(mData), mSize);
+        mData = NULL;
+    }
+    if (mFile >= 0)
+    {
+        close(mFile);
+        mFile = -1;
+    }
+    mSize = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
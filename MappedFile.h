@@ -0,0 +1,49 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <stddef.h>
+
+// A read only view of a whole file mapped in memory.
+// The pages are loaded by the system on first access, nothing is copied.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Map the file, return false if it cannot be opened or is empty.
+    bool Open(const char * pFileName);
+    void Close();
+
+    bool IsOpen() const { return mData != NULL; }
+    const char * GetData() const { return mData; }
+    size_t GetSize() const { return mSize; }
+
+private:
+    // Not copyable, the view belongs to one object.
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+
+#if defined(_WIN32)
+    void * mFile;
+    void * mMapping;
+#else
+    int mFile;
+#endif
+    const char * mData;
+    size_t mSize;
+};
+
+#endif // _MAPPED_FILE_H
+
@@ -0,0 +1,317 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+
+namespace
+{
+    const int TRIANGLE_VERTEX_COUNT = 3;
+
+    // A collapse may not turn the normal of a triangle by more than about 80 degrees.
+    const double MIN_NORMAL_COSINE = 0.2;
+
+    // An edge between two points, the lower one in the high bits, and the group of its triangle.
+    struct GroupEdge
+    {
+        unsigned long long mKey;
+        int mGroup;
+
+        bool operator<(const GroupEdge & pOther) const { return mKey < pOther.mKey; }
+    };
+
+    FbxVector4 Cross(const FbxVector4 & pFirst, const FbxVector4 & pSecond)
+    {
+        return FbxVector4(pFirst[1] * pSecond[2] - pFirst[2] * pSecond[1],
+                          pFirst[2] * pSecond[0] - pFirst[0] * pSecond[2],
+                          pFirst[0] * pSecond[1] - pFirst[1] * pSecond[0]);
+    }
+
+    double Dot(const FbxVector4 & pFirst, const FbxVector4 & pSecond)
+    {
+        return pFirst[0] * pSecond[0] + pFirst[1] * pSecond[1] + pFirst[2] * pSecond[2];
+    }
+
+    // Squared distance to the planes of the quadric, summed.
+    double Evaluate(const double * pFirst, const double * pSecond, const FbxVector4 & pPoint)
+    {
+        double lValues[10];
+        for (int i = 0; i < 10; ++i)
+        {
+            lValues[i] = pFirst[i] + pSecond[i];
+        }
+
+        const double x = pPoint[0];
+        const double y = pPoint[1];
+        const double z = pPoint[2];
+        return lValues[0] * x * x + 2.0 * lValues[1] * x * y + 2.0 * lValues[2] * x * z + 2.0 * lValues[3] * x +
+            lValues[4] * y * y + 2.0 * lValues[5] * y * z + 2.0 * lValues[6] * y +
+            lValues[7] * z * z + 2.0 * lValues[8] * z + lValues[9];
+    }
+}
+
+MeshSimplifier::MeshSimplifier() : mTriangleCount(0), mHeapBuilt(false)
+{
+}
+
+void MeshSimplifier::Initialize(const FbxVector4 * pPoints, int pPointCount, const unsigned int * pVertexPoints,
+                                const unsigned int * pIndices, const int * pGroups, int pTriangleCount)
+{
+    mPoints.Resize(pPointCount);
+    mQuadrics.Resize(pPointCount);
+    mLocked.Resize(pPointCount);
+    mCollapsed.Resize(pPointCount);
+    mStamps.Resize(pPointCount);
+    mFirstCorners.Resize(pPointCount);
+    for (int lPoint = 0; lPoint < pPointCount; ++lPoint)
+    {
+        mPoints[lPoint] = pPoints[lPoint];
+        memset(&mQuadrics[lPoint], 0, sizeof(Quadric));
+        mLocked[lPoint] = false;
+        mCollapsed[lPoint] = false;
+        mStamps[lPoint] = 0;
+        mFirstCorners[lPoint] = -1;
+    }
+
+    const int lCornerCount = pTriangleCount * TRIANGLE_VERTEX_COUNT;
+    mIndices.Resize(lCornerCount);
+    mTrianglePoints.Resize(lCornerCount);
+    mNextCorners.Resize(lCornerCount);
+    mAlive.Resize(pTriangleCount);
+    mTriangleCount = 0;
+
+    FbxArray<GroupEdge> lEdges;
+    for (int lTriangle = 0; lTriangle < pTriangleCount; ++lTriangle)
+    {
+        const int lFirstCorner = lTriangle * TRIANGLE_VERTEX_COUNT;
+        for (int lCorner = lFirstCorner; lCorner < lFirstCorner + TRIANGLE_VERTEX_COUNT; ++lCorner)
+        {
+            mIndices[lCorner] = pIndices[lCorner];
+            mTrianglePoints[lCorner] = pVertexPoints[pIndices[lCorner]];
+        }
+
+        // Triangles already degenerate are left out of the coarser levels.
+        const int * lPoints = mTrianglePoints.GetArray() + lFirstCorner;
+        mAlive[lTriangle] = lPoints[0] != lPoints[1] && lPoints[1] != lPoints[2] && lPoints[2] != lPoints[0];
+        if (!mAlive[lTriangle])
+            continue;
+        ++mTriangleCount;
+
+        for (int lCorner = 0; lCorner < TRIANGLE_VERTEX_COUNT; ++lCorner)
+        {
+            mNextCorners[lFirstCorner + lCorner] = mFirstCorners[lPoints[lCorner]];
+            mFirstCorners[lPoints[lCorner]] = lFirstCorner + lCorner;
+
+            GroupEdge lEdge;
+            const unsigned long long lLow = FbxMin(lPoints[lCorner], lPoints[(lCorner + 1) % TRIANGLE_VERTEX_COUNT]);
+            const unsigned long long lHigh = FbxMax(lPoints[lCorner], lPoints[(lCorner + 1) % TRIANGLE_VERTEX_COUNT]);
+            lEdge.mKey = (lLow << 32) | lHigh;
+            lEdge.mGroup = pGroups[lTriangle];
+            lEdges.Add(lEdge);
+        }
+
+        // The plane of the triangle, weighted by its area, goes to the quadric of its points.
+        const FbxVector4 lNormal = Cross(mPoints[lPoints[1]] - mPoints[lPoints[0]], mPoints[lPoints[2]] - mPoints[lPoints[0]]);
+        const double lLength = sqrt(Dot(lNormal, lNormal));
+        if (lLength == 0.0)
+            continue;
+        const double lPlane[4] = { lNormal[0] / lLength, lNormal[1] / lLength, lNormal[2] / lLength,
+            -Dot(lNormal, mPoints[lPoints[0]]) / lLength };
+        const double lArea = lLength * 0.5;
+        for (int lCorner = 0; lCorner < TRIANGLE_VERTEX_COUNT; ++lCorner)
+        {
+            double * lValues = mQuadrics[lPoints[lCorner]].mValues;
+            int lValueIndex = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = i; j < 4; ++j)
+                {
+                    lValues[lValueIndex++] += lPlane[i] * lPlane[j] * lArea;
+                }
+            }
+        }
+    }
+
+    // Lock the points on a boundary, edge of a single triangle, or between two groups.
+    std::sort(lEdges.GetArray(), lEdges.GetArray() + lEdges.GetCount());
+    int lBegin = 0;
+    while (lBegin < lEdges.GetCount())
+    {
+        int lEnd = lBegin + 1;
+        bool lBorder = false;
+        while (lEnd < lEdges.GetCount() && lEdges[lEnd].mKey == lEdges[lBegin].mKey)
+        {
+            lBorder = lBorder || lEdges[lEnd].mGroup != lEdges[lBegin].mGroup;
+            ++lEnd;
+        }
+        if (lBorder || lEnd - lBegin == 1)
+        {
+            mLocked[static_cast<int>(lEdges[lBegin].mKey >> 32)] = true;
+            mLocked[static_cast<int>(lEdges[lBegin].mKey & 0xFFFFFFFF)] = true;
+        }
+        lBegin = lEnd;
+    }
+}
+
+void MeshSimplifier::Simplify(int pTargetTriangleCount)
+{
+    if (!mHeapBuilt)
+    {
+        for (int lPoint = 0; lPoint < mPoints.GetCount(); ++lPoint)
+        {
+            UpdateCandidate(lPoint);
+        }
+        mHeapBuilt = true;
+    }
+
+    while (mTriangleCount > pTargetTriangleCount && mHeap.GetCount())
+    {
+        std::pop_heap(mHeap.GetArray(), mHeap.GetArray() + mHeap.GetCount());
+        const Candidate lCandidate = mHeap.RemoveLast();
+        if (mCollapsed[lCandidate.mPoint] || mCollapsed[lCandidate.mTarget] ||
+            lCandidate.mStamp != mStamps[lCandidate.mPoint])
+            continue;
+
+        Collapse(lCandidate.mPoint, lCandidate.mTarget);
+    }
+}
+
+bool MeshSimplifier::IsValidCollapse(int pPoint, int pTarget) const
+{
+    for (int lCorner = mFirstCorners[pPoint]; lCorner >= 0; lCorner = mNextCorners[lCorner])
+    {
+        const int lTriangle = lCorner / TRIANGLE_VERTEX_COUNT;
+        if (!mAlive[lTriangle])
+            continue;
+
+        // The triangles on the edge are removed.
+        const int lFirstCorner = lTriangle * TRIANGLE_VERTEX_COUNT;
+        const int lNextPoint = mTrianglePoints[lFirstCorner + (lCorner - lFirstCorner + 1) % TRIANGLE_VERTEX_COUNT];
+        const int lLastPoint = mTrianglePoints[lFirstCorner + (lCorner - lFirstCorner + 2) % TRIANGLE_VERTEX_COUNT];
+        if (lNextPoint == pTarget || lLastPoint == pTarget)
+            continue;
+
+        const FbxVector4 lOldNormal = Cross(mPoints[lNextPoint] - mPoints[pPoint], mPoints[lLastPoint] - mPoints[pPoint]);
+        const FbxVector4 lNewNormal = Cross(mPoints[lNextPoint] - mPoints[pTarget], mPoints[lLastPoint] - mPoints[pTarget]);
+        if (Dot(lOldNormal, lNewNormal) <= MIN_NORMAL_COSINE * sqrt(Dot(lOldNormal, lOldNormal) * Dot(lNewNormal, lNewNormal)))
+            return false;
+    }
+    return true;
+}
+
+void MeshSimplifier::UpdateCandidate(int pPoint)
+{
+    // The collapses pushed before are out of date.
+    ++mStamps[pPoint];
+    if (mLocked[pPoint] || mCollapsed[pPoint])
+        return;
+
+    Candidate lBest;
+    lBest.mTarget = -1;
+    for (int lCorner = mFirstCorners[pPoint]; lCorner >= 0; lCorner = mNextCorners[lCorner])
+    {
+        const int lTriangle = lCorner / TRIANGLE_VERTEX_COUNT;
+        if (!mAlive[lTriangle])
+            continue;
+
+        for (int lOther = 1; lOther < TRIANGLE_VERTEX_COUNT; ++lOther)
+        {
+            const int lFirstCorner = lTriangle * TRIANGLE_VERTEX_COUNT;
+            const int lTarget = mTrianglePoints[lFirstCorner + (lCorner - lFirstCorner + lOther) % TRIANGLE_VERTEX_COUNT];
+            const double lCost = Evaluate(mQuadrics[pPoint].mValues, mQuadrics[lTarget].mValues, mPoints[lTarget]);
+            if ((lBest.mTarget < 0 || lCost < lBest.mCost) && IsValidCollapse(pPoint, lTarget))
+            {
+                lBest.mCost = lCost;
+                lBest.mTarget = lTarget;
+            }
+        }
+    }
+
+    if (lBest.mTarget < 0)
+        return;
+
+    lBest.mPoint = pPoint;
+    lBest.mStamp = mStamps[pPoint];
+    mHeap.Add(lBest);
+    std::push_heap(mHeap.GetArray(), mHeap.GetArray() + mHeap.GetCount());
+}
+
+void MeshSimplifier::Collapse(int pPoint, int pTarget)
+{
+    // The vertex of the target in a triangle on the edge: the point is on no split, so its
+    // triangles take the normal and UV of the target on this side.
+    unsigned int lTargetVertex = 0;
+    for (int lCorner = mFirstCorners[pPoint]; lCorner >= 0; lCorner = mNextCorners[lCorner])
+    {
+        const int lFirstCorner = (lCorner / TRIANGLE_VERTEX_COUNT) * TRIANGLE_VERTEX_COUNT;
+        if (!mAlive[lFirstCorner / TRIANGLE_VERTEX_COUNT])
+            continue;
+        for (int lOther = lFirstCorner; lOther < lFirstCorner + TRIANGLE_VERTEX_COUNT; ++lOther)
+        {
+            if (mTrianglePoints[lOther] == pTarget)
+                lTargetVertex = mIndices[lOther];
+        }
+    }
+
+    for (int i = 0; i < 10; ++i)
+    {
+        mQuadrics[pTarget].mValues[i] += mQuadrics[pPoint].mValues[i];
+    }
+    mCollapsed[pPoint] = true;
+
+    // Remove the triangles on the edge, and move the others to the target.
+    int lCorner = mFirstCorners[pPoint];
+    while (lCorner >= 0)
+    {
+        const int lNextCorner = mNextCorners[lCorner];
+        const int lTriangle = lCorner / TRIANGLE_VERTEX_COUNT;
+        if (mAlive[lTriangle])
+        {
+            const int lFirstCorner = lTriangle * TRIANGLE_VERTEX_COUNT;
+            if (mTrianglePoints[lFirstCorner] == pTarget || mTrianglePoints[lFirstCorner + 1] == pTarget ||
+                mTrianglePoints[lFirstCorner + 2] == pTarget)
+            {
+                mAlive[lTriangle] = false;
+                --mTriangleCount;
+            }
+            else
+            {
+                mTrianglePoints[lCorner] = pTarget;
+                mIndices[lCorner] = lTargetVertex;
+                mNextCorners[lCorner] = mFirstCorners[pTarget];
+                mFirstCorners[pTarget] = lCorner;
+            }
+        }
+        lCorner = lNextCorner;
+    }
+    mFirstCorners[pPoint] = -1;
+
+    // The collapses of the target and of its neighbours changed.
+    FbxArray<int> lNeighbours;
+    lNeighbours.Add(pTarget);
+    for (lCorner = mFirstCorners[pTarget]; lCorner >= 0; lCorner = mNextCorners[lCorner])
+    {
+        const int lFirstCorner = (lCorner / TRIANGLE_VERTEX_COUNT) * TRIANGLE_VERTEX_COUNT;
+        if (!mAlive[lFirstCorner / TRIANGLE_VERTEX_COUNT])
+            continue;
+        for (int lOther = lFirstCorner; lOther < lFirstCorner + TRIANGLE_VERTEX_COUNT; ++lOther)
+        {
+            lNeighbours.Add(mTrianglePoints[lOther]);
+        }
+    }
+    std::sort(lNeighbours.GetArray(), lNeighbours.GetArray() + lNeighbours.GetCount());
+    for (int lIndex = 0; lIndex < lNeighbours.GetCount(); ++lIndex)
+    {
+        if (lIndex == 0 || lNeighbours[lIndex] != lNeighbours[lIndex - 1])
+            UpdateCandidate(lNeighbours[lIndex]);
+    }
+}
@@ -0,0 +1,94 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+#include <fbxsdk.h>
+
+// Decimate a triangle mesh by collapsing its edges in the order of their quadric error
+// (Garland and Heckbert). Every collapse moves a point onto one of its neighbours, so the
+// triangles left only use the vertices of the full mesh and the levels of detail share its
+// vertex buffers. Simplify may be called again with a lower count, for a coarser level.
+//
+// The triangles index vertices, several vertices may be at the same point when the normals
+// or UVs are split. A point collapses with all its vertices, which must then hold the same
+// attributes; the points on a split, on a boundary of the mesh or between two groups of
+// triangles are never moved.
+class MeshSimplifier
+{
+public:
+    MeshSimplifier();
+
+    // pVertexPoints holds the point of every vertex, pIndices three vertices for every
+    // triangle, pGroups the group (material) of every triangle.
+    void Initialize(const FbxVector4 * pPoints, int pPointCount, const unsigned int * pVertexPoints,
+                    const unsigned int * pIndices, const int * pGroups, int pTriangleCount);
+
+    // Keep the point where it is, call it before Simplify.
+    void LockPoint(int pPoint) { mLocked[pPoint] = true; }
+
+    // Collapse edges until at most pTargetTriangleCount triangles are left, or until no
+    // collapse can be done without folding the surface.
+    void Simplify(int pTargetTriangleCount);
+
+    int GetTriangleCount() const { return mTriangleCount; }
+    bool IsTriangleAlive(int pTriangle) const { return mAlive[pTriangle]; }
+    // The three vertices of a triangle left.
+    const unsigned int * GetTriangle(int pTriangle) const { return mIndices.GetArray() + pTriangle * 3; }
+
+private:
+    struct Quadric
+    {
+        double mValues[10];
+    };
+
+    // The best collapse of a point, mStamp tells if it is out of date.
+    struct Candidate
+    {
+        double mCost;
+        int mPoint;
+        int mTarget;
+        int mStamp;
+
+        // Cheapest on top of the heap.
+        bool operator<(const Candidate & pOther) const { return mCost > pOther.mCost; }
+    };
+
+    // Whether moving pPoint onto pTarget leaves every triangle facing the same way.
+    bool IsValidCollapse(int pPoint, int pTarget) const;
+    // Push the cheapest valid collapse of the point, if any.
+    void UpdateCandidate(int pPoint);
+    void Collapse(int pPoint, int pTarget);
+
+    FbxArray<FbxVector4> mPoints;
+    FbxArray<Quadric> mQuadrics;
+    FbxArray<bool> mLocked;
+    FbxArray<bool> mCollapsed;
+    FbxArray<int> mStamps;
+
+    // Three of each for every triangle.
+    FbxArray<unsigned int> mIndices;
+    FbxArray<int> mTrianglePoints;
+    FbxArray<bool> mAlive;
+    int mTriangleCount;
+
+    // Corners of the triangles around every point, linked; the corners of the triangles
+    // removed stay in the lists and are skipped.
+    FbxArray<int> mFirstCorners;
+    FbxArray<int> mNextCorners;
+
+    // Filled by the first call of Simplify.
+    FbxArray<Candidate> mHeap;
+    bool mHeapBuilt;
+};
+
+#endif // _MESH_SIMPLIFIER_H
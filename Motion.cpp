@@ -9,6 +9,8 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <string.h>
 
 #pragma warning(disable : 4244)
 
@@ -26,8 +28,11 @@ std::string Motion::PruneName(const std::string& name)
     return temp;
 }
 
-Motion::Motion()
+Motion::Motion(Layout layout)
 {
+    m_layout = layout;
+    m_numJoints = 0;
+    m_numFrames = 0;
 	m_name = "None";
 	m_currentFrame = 0;
     m_fps = 0;
@@ -45,7 +50,11 @@ Motion& Motion::operator=(const Motion& orig)
 	m_name = orig.m_name;
     m_currentFrame = orig.m_currentFrame;
     m_fps = orig.m_fps;
-    m_keyFrames = orig.m_keyFrames;
+    m_layout = orig.m_layout;
+    m_numJoints = orig.m_numJoints;
+    m_numFrames = orig.m_numFrames;
+    m_rotations = orig.m_rotations;
+    m_rootTranslations = orig.m_rootTranslations;
     //m_phases = orig.m_phases;
 
     return *this;
@@ -58,7 +67,10 @@ Motion::~Motion()
 void Motion::Clear()
 {
     //m_phases.clear();
-    m_keyFrames.clear();
+    m_numJoints = 0;
+    m_numFrames = 0;
+    m_rotations.clear();
+    m_rootTranslations.clear();
     m_currentFrame = 0;
     m_name = "None";
     m_fps = 0;
@@ -102,7 +114,7 @@ bool Motion::LoadAMCFile(const std::string& amcfile, const Skeleton& pSkeleton,
 	{
 		Frame frame;
         frame.LoadFromAMCFile(inFile, pSkeleton);
-		m_keyFrames.push_back(frame);
+		AppendFrame(frame);
 	}
 
 	inFile.close();
@@ -110,29 +122,160 @@ bool Motion::LoadAMCFile(const std::string& amcfile, const Skeleton& pSkeleton,
 }
 
 bool Motion::LoadFromBVHFile(std::ifstream& inFile, const Skeleton& pSkeleton)
+{
+    // Read the rest of the stream at once and parse it in memory
+    std::string data((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    return LoadFromBVHData(data.c_str(), data.size(), pSkeleton);
+}
+
+static inline bool IsBVHSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline void SkipBVHSpaces(const char*& p, const char* end)
+{
+    while (p < end && IsBVHSpace(*p)) p++;
+}
+
+// Consume the next token if it is the given keyword
+static bool ReadBVHKeyword(const char*& p, const char* end, const char* keyword)
+{
+    SkipBVHSpaces(p, end);
+    size_t length = strlen(keyword);
+    if ((size_t)(end - p) < length || strncmp(p, keyword, length) != 0) return false;
+    if (p + length < end && !IsBVHSpace(p[length])) return false;
+    p += length;
+    return true;
+}
+
+// Hand written parser for the plain decimal numbers of BVH files, much faster than operator>>
+static bool ReadBVHFloat(const char*& p, const char* end, float& value)
+{
+    static const double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+
+    SkipBVHSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Up to 18 significant digits fit in the mantissa, the others only move the decimal point
+    long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+    {
+        if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+        else exponent++;
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true)
+        {
+            if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; exponent--; }
+        }
+    }
+    if (!any) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+        {
+            negativeExponent = *q == '-';
+            q++;
+        }
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            int e = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++) if (e < 1000) e = e * 10 + (*q - '0');
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+    if (p < end && !IsBVHSpace(*p)) return false;
+
+    double result = (double)mantissa;
+    while (exponent > 18) { result *= powersOf10[18]; exponent -= 18; }
+    while (exponent < -18) { result /= powersOf10[18]; exponent += 18; }
+    result = exponent < 0 ? result / powersOf10[-exponent] : result * powersOf10[exponent];
+
+    value = (float)(negative ? -result : result);
+    return true;
+}
+
+bool Motion::LoadFromBVHData(const char* data, size_t size, const Skeleton& pSkeleton)
 {
     Clear();
 
-    std::string readString;
-	unsigned int frameCount;
-	inFile >> readString;
-	if (readString != "MOTION")
-		return false;
-	inFile >> readString;
-	if(readString != "Frames:") 
-		return false;
-	inFile >> frameCount;
-	inFile >> readString; // "Frame"
-	getline(inFile, readString); // " Time: 0.033333"
-    m_fps = 1.0/atof(&(readString.c_str()[6]));
-
-    // Read frames
-    m_keyFrames.resize(frameCount);
-	for (unsigned int i = 0; i < frameCount; i++)
+    // Skip the hierarchy, if any, token by token up to the MOTION keyword
+    const char* p = data;
+    const char* end = data + size;
+    while (!ReadBVHKeyword(p, end, "MOTION"))
+    {
+        if (p >= end) return false;
+        while (p < end && !IsBVHSpace(*p)) p++;
+    }
+
+    float frameCount = 0, frameTime = 0;
+    if (!ReadBVHKeyword(p, end, "Frames:") || !ReadBVHFloat(p, end, frameCount) ||
+        !ReadBVHKeyword(p, end, "Frame") || !ReadBVHKeyword(p, end, "Time:") ||
+        !ReadBVHFloat(p, end, frameTime) || frameCount < 0 || frameTime <= 0)
+    {
+        return false;
+    }
+    m_fps = 1.0/frameTime;
+
+    // The rotation order of every joint is looked up once, not for every value
+    std::vector<BVHChannelLayout> layout;
+    ComputeBVHChannelLayout(pSkeleton, layout);
+    unsigned int channelsPerFrame = 0;
+    for (unsigned int i = 0; i < layout.size(); i++)
+    {
+        channelsPerFrame += layout[i].numChannels;
+    }
+
+    // All the values go into one flat array, then the key frames are built from it
+    unsigned int numFrames = (unsigned int) frameCount;
+    std::vector<float> channels(numFrames * channelsPerFrame + 1);
+    for (size_t i = 0; i < numFrames * channelsPerFrame; i++)
+    {
+        if (!ReadBVHFloat(p, end, channels[i]))
+        {
+            return false;
+        }
+    }
+
+    m_numJoints = layout.size();
+    m_numFrames = numFrames;
+    m_rotations.resize(4 * m_numJoints * m_numFrames);
+    m_rootTranslations.resize(3 * m_numFrames);
+	for (unsigned int i = 0; i < numFrames; i++)
 	{
-		m_keyFrames[i].LoadFromBVHFile(inFile, pSkeleton);
+        const float* values = &channels[i * channelsPerFrame];
+        for (unsigned int j = 0; j < m_numJoints; j++)
+        {
+            float r1 = 0.0f, r2 = 0.0f, r3 = 0.0f;
+            if (layout[j].numChannels == 6)
+            {
+                if (j == 0) SetRootTranslation(i, vec3(values[0], values[1], values[2]));
+                r1 = values[3]; r2 = values[4]; r3 = values[5];
+            }
+            else if (layout[j].numChannels == 3)
+            {
+                r1 = values[0]; r2 = values[1]; r3 = values[2];
+            }
+            values += layout[j].numChannels;
+
+            SetJointRotation(i, j, layout[j].rotation(r1, r2, r3));
+        }
 	}
-	
+
 	return true;
 }
 
@@ -245,9 +388,11 @@ void Motion::SaveToBVHFile(std::ofstream& outFile, const Skeleton& pSkeleton)
 	outFile << "MOTION" << std::endl;
 	outFile << "Frames: " << GetNumFrames() << std::endl;
 	outFile << "Frame Time: " << 1.0/m_fps << std::endl;
-	for (unsigned int i = 0; i < m_keyFrames.size(); i++)
+    Frame frame;
+	for (unsigned int i = 0; i < m_numFrames; i++)
 	{
-		m_keyFrames[i].SaveToBVHFile(outFile, pSkeleton);
+        CopyFrame(i, frame);
+		frame.SaveToBVHFile(outFile, pSkeleton);
 	}
 }
 
@@ -274,10 +419,12 @@ bool Motion::SaveAMCFile(const std::string& filename, const Skeleton& pSkeleton)
         }
 		outFile << ":FULLY-SPECIFIED" << std::endl;
 		outFile << ":DEGREES" << std::endl;
-		for (unsigned int i = 0; i < m_keyFrames.size(); i++)
+        Frame frame;
+		for (unsigned int i = 0; i < m_numFrames; i++)
 		{
 			outFile << i + 1 << std::endl;
-			m_keyFrames[i].SaveToAMCFile(outFile, pSkeleton);
+            CopyFrame(i, frame);
+			frame.SaveToAMCFile(outFile, pSkeleton);
 		}
 		outFile.close();
         return true;
@@ -298,40 +445,101 @@ void Motion::SetFps(double fps)
 void Motion::SetCurrentIndex(unsigned int currentFrame)
 {
     m_currentFrame = std::max<unsigned int>(0, 
-                     std::min<unsigned int>(m_keyFrames.size()-1, currentFrame));
+                     std::min<unsigned int>(m_numFrames-1, currentFrame));
 }
 
-const Frame& Motion::GetFrame(unsigned int index) const
+void Motion::SetLayout(Layout layout)
 {
-	assert(index >= 0 && index < m_keyFrames.size());
-	return m_keyFrames[index];
+    if (layout == m_layout) return;
+
+    std::vector<float> rotations(m_rotations.size());
+    for (unsigned int i = 0; i < m_numFrames; i++)
+    {
+        for (unsigned int j = 0; j < m_numJoints; j++)
+        {
+            unsigned int offset = 4 * (layout == FRAME_MAJOR ? i * m_numJoints + j : j * m_numFrames + i);
+            memcpy(&rotations[offset], &m_rotations[GetRotationOffset(i, j)], 4 * sizeof(float));
+        }
+    }
+    m_rotations.swap(rotations);
+    m_layout = layout;
 }
 
-Frame& Motion::GetFrame(unsigned int index)
+FrameView Motion::GetFrame(unsigned int index) const
 {
-	assert(index >= 0 && index < m_keyFrames.size());
-	return m_keyFrames[index];
+	assert(index >= 0 && index < m_numFrames);
+	return FrameView(*this, index);
 }
 
-const Frame& Motion::GetCurrentFrame() const
+FrameView Motion::GetCurrentFrame() const
 {
    return GetFrame(m_currentFrame);
 }
 
+void Motion::CopyFrame(unsigned int index, Frame& f) const
+{
+    f.SetNumJoints(m_numJoints);
+    f.SetRootTranslation(GetRootTranslation(index));
+    for (unsigned int j = 0; j < m_numJoints; j++)
+    {
+        f.SetJointQuaternion(j, GetJointQuaternion(index, j));
+    }
+}
+
 void Motion::SetFrame(unsigned int index, const Frame& f)
 {
-    m_keyFrames[index] = f;
+    assert(f.GetNumJoints() == m_numJoints);
+    SetRootTranslation(index, f.GetRootTranslation());
+    for (unsigned int j = 0; j < m_numJoints; j++)
+    {
+        SetJointRotation(index, j, j < f.GetNumJoints() ? f.GetJointRotation(j) : identity3D);
+    }
+}
+
+vec3 Motion::GetRootTranslation(unsigned int frame) const
+{
+    const float* t = &m_rootTranslations[3 * frame];
+    return vec3(t[0], t[1], t[2]);
+}
+
+void Motion::SetRootTranslation(unsigned int frame, const vec3& translation)
+{
+    float* t = &m_rootTranslations[3 * frame];
+    t[0] = translation[VX]; t[1] = translation[VY]; t[2] = translation[VZ];
+}
+
+Quaternion Motion::GetJointQuaternion(unsigned int frame, unsigned int joint) const
+{
+    const float* q = &m_rotations[GetRotationOffset(frame, joint)];
+    return Quaternion(q[3], q[0], q[1], q[2]);
+}
+
+void Motion::SetJointQuaternion(unsigned int frame, unsigned int joint, const Quaternion& rotation)
+{
+    float* q = &m_rotations[GetRotationOffset(frame, joint)];
+    q[0] = rotation.X(); q[1] = rotation.Y(); q[2] = rotation.Z(); q[3] = rotation.W();
+}
+
+mat3 Motion::GetJointRotation(unsigned int frame, unsigned int joint) const
+{
+    return GetJointQuaternion(frame, joint).ToRotation();
+}
+
+void Motion::SetJointRotation(unsigned int frame, unsigned int joint, const mat3& rotation)
+{
+    Quaternion q;
+    q.FromRotation(rotation);
+    SetJointQuaternion(frame, joint, q);
 }
 
 unsigned int Motion::GetNumJoints() const
 {
-    if (m_keyFrames.size() == 0) return 0;
-    return m_keyFrames[0].GetNumJoints();
+    return m_numJoints;
 }
 
 unsigned int Motion::GetNumFrames() const
 {
-    return m_keyFrames.size();
+    return m_numFrames;
 }
 
 const std::string& Motion::GetName() const
@@ -346,37 +554,87 @@ void Motion::SetName(const std::string& name)
 
 void Motion::ReOrient(const vec3& startPos, const mat3& startOri)
 {
-   if (m_keyFrames.size() == 0) return;
+   if (m_numFrames == 0) return;
 
    Transform transformDesired(startPos, startOri);
 
-   Frame firstKey = m_keyFrames[0];
-   Transform transformInv(firstKey.GetRootTranslation(), firstKey.GetJointRotation(0));
+   Transform transformInv(GetRootTranslation(0), GetJointRotation(0, 0));
    transformInv = transformInv.Inverse();
 
-   for (unsigned int i = 0; i < m_keyFrames.size(); i++)
+   for (unsigned int i = 0; i < m_numFrames; i++)
    {
-      Frame& key = m_keyFrames[i];
-      
-      Transform keyTransform(key.GetRootTranslation(), key.GetJointRotation(0));
+      Transform keyTransform(GetRootTranslation(i), GetJointRotation(i, 0));
       keyTransform = transformDesired * transformInv * keyTransform;
 
-      key.SetRootTranslation(keyTransform.m_translation);
-      key.SetJointRotation(0, keyTransform.m_rotation);
+      SetRootTranslation(i, keyTransform.m_translation);
+      SetJointRotation(i, 0, keyTransform.m_rotation);
    }
 }
 
 void Motion::AppendFrame(const Frame& frame)
 {
-    m_keyFrames.push_back(frame);
+    if (m_layout == JOINT_MAJOR)
+    {
+        Motion single;
+        single.AppendFrame(frame);
+        AppendFrames(single, 0, 1);
+        return;
+    }
+
+    if (m_numFrames == 0) m_numJoints = frame.GetNumJoints();
+    m_numFrames++;
+    m_rotations.resize(4 * m_numJoints * m_numFrames);
+    m_rootTranslations.resize(3 * m_numFrames);
+    SetFrame(m_numFrames - 1, frame);
+}
+
+void Motion::AppendFrames(const Motion& motion, unsigned int startFrame, unsigned int endFrame)
+{
+    if (startFrame >= endFrame) return;
+    if (&motion == this)
+    {
+        Motion copy(motion);
+        AppendFrames(copy, startFrame, endFrame);
+        return;
+    }
+
+    if (m_numFrames == 0) m_numJoints = motion.m_numJoints;
+    assert(motion.m_numJoints == m_numJoints);
+    if (motion.m_numJoints != m_numJoints) return;
+
+    m_rootTranslations.insert(m_rootTranslations.end(),
+        motion.m_rootTranslations.begin() + 3 * startFrame, motion.m_rootTranslations.begin() + 3 * endFrame);
+
+    // The frames are one block in both motions
+    if (m_layout == FRAME_MAJOR && motion.m_layout == FRAME_MAJOR)
+    {
+        m_rotations.insert(m_rotations.end(),
+            motion.m_rotations.begin() + motion.GetRotationOffset(startFrame, 0),
+            motion.m_rotations.begin() + motion.GetRotationOffset(endFrame, 0));
+        m_numFrames += endFrame - startFrame;
+        return;
+    }
+
+    // Otherwise every joint moves to its place in the new layout
+    unsigned int numFrames = m_numFrames + endFrame - startFrame;
+    std::vector<float> rotations(4 * m_numJoints * numFrames);
+    for (unsigned int i = 0; i < numFrames; i++)
+    {
+        for (unsigned int j = 0; j < m_numJoints; j++)
+        {
+            unsigned int offset = 4 * (m_layout == FRAME_MAJOR ? i * m_numJoints + j : j * numFrames + i);
+            const float* q = i < m_numFrames ? &m_rotations[GetRotationOffset(i, j)] :
+                &motion.m_rotations[motion.GetRotationOffset(startFrame + i - m_numFrames, j)];
+            memcpy(&rotations[offset], q, 4 * sizeof(float));
+        }
+    }
+    m_rotations.swap(rotations);
+    m_numFrames = numFrames;
 }
 
 void Motion::Append(const Motion& motion)
 {
-	for (unsigned int i = 0; i < motion.GetNumFrames(); i++)
-	{
-		AppendFrame(motion.GetFrame(i));
-	}
+    AppendFrames(motion, 0, motion.GetNumFrames());
 }
 
 Motion Motion::SubMotion(int startFrame, int endFrame)
@@ -384,23 +642,25 @@ Motion Motion::SubMotion(int startFrame, int endFrame)
     startFrame = std::max<unsigned int>(0, startFrame);
     endFrame = std::min<unsigned int>(GetNumFrames(), endFrame);
 
-    Motion m;
+    Motion m(m_layout);
     m.SetFps(GetFps());
-	for (unsigned int i = startFrame; i < endFrame; i++)
-	{
-		m.AppendFrame(GetFrame(i));
-	}
+    m.AppendFrames(*this, startFrame, endFrame);
     return m;
 }
 
 void Motion::SetSubMotion(int startFrame, int endFrame, const Motion& m)
 {
     assert (endFrame-startFrame <= m.GetNumFrames());
+    assert (m.GetNumJoints() == m_numJoints);
 
     int index = 0;
-    for (unsigned int i = startFrame; i < endFrame; i++)
+    for (unsigned int i = startFrame; i < endFrame; i++, index++)
     {
-        SetFrame(i, m.GetFrame(index++));
+        memcpy(&m_rootTranslations[3 * i], &m.m_rootTranslations[3 * index], 3 * sizeof(float));
+        for (unsigned int j = 0; j < m_numJoints; j++)
+        {
+            memcpy(&m_rotations[GetRotationOffset(i, j)], &m.m_rotations[m.GetRotationOffset(index, j)], 4 * sizeof(float));
+        }
     }
 }
 /*
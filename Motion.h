@@ -9,15 +9,27 @@
 
 
 class Frame;
+class FrameView;
+
+// The key frames are stored in contiguous arrays: one float quaternion (x, y, z, w)
+// per joint and frame, and one root translation track. The rotations are laid out
+// frame after frame or joint after joint, as chosen at construction.
 class Motion
 {
 public:
-	Motion();
+    enum Layout
+    {
+        FRAME_MAJOR,    // All the joints of a frame are together, for playback
+        JOINT_MAJOR     // All the frames of a joint are together, for per joint processing
+    };
+
+	Motion(Layout layout = FRAME_MAJOR);
     Motion(const Motion& orig); // Deep copy
     Motion& operator=(const Motion& orig); // Deep copy
 	virtual ~Motion();
 	
     bool LoadFromBVHFile(std::ifstream& inFile, const Skeleton& pSkeleton);	// Read from BVH file
+    bool LoadFromBVHData(const char* data, size_t size, const Skeleton& pSkeleton);	// Read the MOTION section of a BVH file in memory
     bool LoadAMCFile(const std::string& amcfile, const Skeleton& pSkeleton, float fps = 120.0);	// Read from BVH file
     void SaveToBVHFile(std::ofstream& outFile, const Skeleton& pSkeleton);	// Write to BVH file
     bool SaveAMCFile(const std::string& filename, const Skeleton& pSkeleton);
@@ -27,12 +39,24 @@ public:
 	void SetCurrentIndex(unsigned int currentFrame);
 	unsigned int GetCurrentIndex() const { return m_currentFrame; }
 
-   	const Frame& GetFrame(unsigned int index) const;	// Get frame at index, allowing reading and writing
-   	Frame& GetFrame(unsigned int index);	// Get frame at index, allowing reading and writing
-	const Frame& GetCurrentFrame() const;
+    Layout GetLayout() const { return m_layout; }
+    void SetLayout(Layout layout);	// Reorder the key frames
+
+   	FrameView GetFrame(unsigned int index) const;	// Get a view of the frame at index, nothing is copied
+	FrameView GetCurrentFrame() const;
+    void CopyFrame(unsigned int index, Frame& f) const;
     void SetFrame(unsigned int index, const Frame& f);
 
-    void AppendFrame(const Frame& frame);
+    vec3 GetRootTranslation(unsigned int frame) const;
+    void SetRootTranslation(unsigned int frame, const vec3& translation);
+    Quaternion GetJointQuaternion(unsigned int frame, unsigned int joint) const;
+    void SetJointQuaternion(unsigned int frame, unsigned int joint, const Quaternion& rotation);
+    const float* GetJointQuaternionData(unsigned int frame, unsigned int joint) const { return &m_rotations[GetRotationOffset(frame, joint)]; } // x, y, z, w
+    const float* GetRootTranslationData(unsigned int frame) const { return &m_rootTranslations[3 * frame]; }
+    mat3 GetJointRotation(unsigned int frame, unsigned int joint) const;
+    void SetJointRotation(unsigned int frame, unsigned int joint, const mat3& rotation);
+
+    void AppendFrame(const Frame& frame);	// Cheap in FRAME_MAJOR layout, moves all the key frames in JOINT_MAJOR
     void Append(const Motion& motion);
     Motion SubMotion(int startFrame, int endFrame);
     void SetSubMotion(int startFrame, int endFrame, const Motion& m);
@@ -47,8 +71,17 @@ public:
     void ReOrient(const vec3& startPos, const mat3& startOri);
 
 private:
-
-    std::vector<Frame> m_keyFrames;
+    unsigned int GetRotationOffset(unsigned int frame, unsigned int joint) const
+    {
+        return 4 * (m_layout == FRAME_MAJOR ? frame * m_numJoints + joint : joint * m_numFrames + frame);
+    }
+    void AppendFrames(const Motion& motion, unsigned int startFrame, unsigned int endFrame);
+
+    Layout m_layout;
+    unsigned int m_numJoints;
+    unsigned int m_numFrames;
+    std::vector<float> m_rotations;     // 4 floats per joint and frame
+    std::vector<float> m_rootTranslations;  // 3 floats per frame
 	unsigned int m_currentFrame;
     std::string m_name;
     double m_fps;
@@ -57,6 +90,22 @@ public:
     static std::string PruneName(const std::string& name);
 };
 
+// Lightweight read only view of one frame of a motion, valid while the motion is unchanged
+class FrameView
+{
+public:
+    FrameView(const Motion& motion, unsigned int index) : m_motion(&motion), m_index(index) {}
+
+	unsigned int GetNumJoints() const { return m_motion->GetNumJoints(); }
+	vec3 GetRootTranslation() const { return m_motion->GetRootTranslation(m_index); }
+	mat3 GetJointRotation(unsigned int index) const { return m_motion->GetJointRotation(m_index, index); }
+	Quaternion GetJointQuaternion(unsigned int index) const { return m_motion->GetJointQuaternion(m_index, index); }
+
+private:
+    const Motion* m_motion;
+    unsigned int m_index;
+};
+
 
 
 #endif
\ No newline at end of file
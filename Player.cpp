@@ -2,6 +2,7 @@
 // Copyright (C) 2013 by Aline Normoyle, Liming Zhao, Alla Safonova, Teresa Fan
 
 #include "Player.h"
+#include "MappedFile.h"
 #include <fstream>
 #pragma warning(disable : 4244)
 
@@ -64,8 +65,11 @@ bool Player::LoadBVHFile(const std::string& filename)
         return false;
 	}
 
-	bool status = m_skeleton.LoadFromBVHFile(inFile) && 
-                  m_motion.LoadFromBVHFile(inFile, m_skeleton);
+    // The hierarchy is small and read from the stream, the frames are parsed
+    // in place from a memory mapped view of the file
+    MappedFile mappedFile;
+	bool status = m_skeleton.LoadFromBVHFile(inFile) && mappedFile.Open(filename.c_str()) &&
+                  m_motion.LoadFromBVHData(mappedFile.GetData(), mappedFile.GetSize(), m_skeleton);
 
     if (status)
     {
@@ -151,6 +155,25 @@ const Skeleton& Player::GetSkeleton() const
 	return m_skeleton;
 }
 
+bool Player::EvaluatePoses(const std::vector<double>& times, std::vector<float>& palettes)
+{
+    // The skeleton can be changed through GetSkeleton, flatten it again: a few joints
+    // against the poses of the whole crowd
+    if (!IsValid() || !m_poseBatch.Initialize(m_skeleton)) return false;
+
+    m_instances.resize(times.size());
+    for (unsigned int i = 0; i < times.size(); i++)
+    {
+        m_instances[i] = PoseBatch::Instance();
+        m_instances[i].motion = &m_motion;
+        m_instances[i].time = times[i];
+    }
+
+    palettes.resize(times.size() * m_poseBatch.GetNumJoints() * PoseBatch::PALETTE_STRIDE);
+    if (!times.empty()) m_poseBatch.Evaluate(&m_instances[0], times.size(), &palettes[0]);
+    return true;
+}
+
 bool Player::IsValid()
 {
 	return (m_skeleton.GetNumJoints() > 0 && 
@@ -210,7 +233,7 @@ void Player::ConvertAMC2BVH()
 
     for (int i = 0; i < GetMotion().GetNumFrames(); i++)
     {
-        Frame frame = GetMotion().GetFrame(i);
+        FrameView frame = GetMotion().GetFrame(i);
 
         Frame newFrame;
         newFrame.SetNumJoints(skeleton.GetNumJoints());
@@ -7,6 +7,7 @@
 #include "Frame.h"
 #include "Motion.h"
 #include "Skeleton.h"
+#include "PoseBatch.h"
 #include <vector>
 
 class Player
@@ -36,12 +37,18 @@ public:
     const Skeleton& GetSkeleton() const;
     void SetSkeleton(const Skeleton& skeleton);
 
+    // Palettes of a crowd playing the motion, one instance per time in seconds, in one call.
+    // Laid out as in PoseBatch::Evaluate. False if the skeleton is not supported.
+    bool EvaluatePoses(const std::vector<double>& times, std::vector<float>& palettes);
+
 protected:
     virtual void init() {}
 
 protected:
 	Skeleton m_skeleton;
     Motion m_motion;
+    PoseBatch m_poseBatch;
+    std::vector<PoseBatch::Instance> m_instances;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "PointCacheStream.h"
+
+#include <math.h>
+
+namespace
+{
+    // Header of a PC2 file, followed by the samples, three little endian floats per point.
+    struct PC2Header
+    {
+        char mSignature[12];
+        int mFileVersion;
+        int mPointCount;
+        float mStartFrame;
+        float mSampleRate;
+        int mSampleCount;
+    };
+
+    const char PC2_SIGNATURE[] = "POINTCACHE2";
+}
+
+const int PointCacheStream::DEFAULT_PREFETCH_COUNT;
+
+PointCacheStream::PointCacheStream()
+    : mPointCount(0), mSampleCount(0), mStartFrame(0.0f), mSampleRate(1.0f),
+      mSlots(NULL), mSlotCount(0), mRequestedSample(0), mThread(NULL), mQuit(false)
+{
+}
+
+PointCacheStream::~PointCacheStream()
+{
+    Close();
+}
+
+bool PointCacheStream::Open(const char * pFileName, int pPrefetchCount)
+{
+    Close();
+
+    if (!mFile.Open(pFileName))
+        return false;
+
+    // Check the header, and that the file holds all the samples it announces.
+    PC2Header lHeader;
+    if (mFile.GetSize() < sizeof(PC2Header))
+    {
+        Close();
+        return false;
+    }
+    memcpy(&lHeader, mFile.GetData(), sizeof(PC2Header));
+    const size_t lSampleSize = static_cast<size_t>(lHeader.mPointCount) * 3 * sizeof(float);
+    if (memcmp(lHeader.mSignature, PC2_SIGNATURE, sizeof(PC2_SIGNATURE)) != 0 ||
+        lHeader.mPointCount <= 0 || lHeader.mSampleCount <= 0 || lHeader.mSampleRate <= 0.0f ||
+        (mFile.GetSize() - sizeof(PC2Header)) / lSampleSize < static_cast<size_t>(lHeader.mSampleCount))
+    {
+        Close();
+        return false;
+    }
+    mPointCount = lHeader.mPointCount;
+    mSampleCount = lHeader.mSampleCount;
+    mStartFrame = lHeader.mStartFrame;
+    mSampleRate = lHeader.mSampleRate;
+
+    // No more slots than samples, the whole cache then ends up in the ring.
+    mSlotCount = pPrefetchCount > 0 ? pPrefetchCount : 1;
+    if (mSlotCount > mSampleCount)
+        mSlotCount = mSampleCount;
+    mSlots = new Slot[mSlotCount];
+    for (int lSlotIndex = 0; lSlotIndex < mSlotCount; ++lSlotIndex)
+    {
+        mSlots[lSlotIndex].mPositions = new float[mPointCount * 3];
+    }
+    mRequestedSample = 0;
+
+    mQuit = false;
+    mThread = new FbxThread(PrefetchProc, this);
+    mWakeSemaphore.Signal();
+
+    return true;
+}
+
+void PointCacheStream::Close()
+{
+    if (mThread)
+    {
+        mQuit = true;
+        mWakeSemaphore.Signal();
+        mThread->Join();
+        delete mThread;
+        mThread = NULL;
+    }
+
+    for (int lSlotIndex = 0; lSlotIndex < mSlotCount; ++lSlotIndex)
+    {
+        delete [] mSlots[lSlotIndex].mPositions;
+    }
+    delete [] mSlots;
+    mSlots = NULL;
+    mSlotCount = 0;
+
+    mFile.Close();
+    mPointCount = 0;
+    mSampleCount = 0;
+}
+
+bool PointCacheStream::Read(const FbxTime & pTime, float * pVertices, int pVertexCount)
+{
+    if (!IsOpen())
+        return false;
+
+    int lSlot = -1;
+    const float * lPositions = AcquireSample(GetSampleIndex(pTime), lSlot);
+    const int lCount = FbxMin(pVertexCount, mPointCount);
+    for (int lIndex = 0; lIndex < lCount; ++lIndex)
+    {
+        pVertices[lIndex * 4] = lPositions[lIndex * 3];
+        pVertices[lIndex * 4 + 1] = lPositions[lIndex * 3 + 1];
+        pVertices[lIndex * 4 + 2] = lPositions[lIndex * 3 + 2];
+        pVertices[lIndex * 4 + 3] = 1.0f;
+    }
+    ReleaseSample(lSlot);
+
+    return true;
+}
+
+bool PointCacheStream::Read(const FbxTime & pTime, FbxVector4 * pVertexArray, int pVertexCount)
+{
+    if (!IsOpen())
+        return false;
+
+    int lSlot = -1;
+    const float * lPositions = AcquireSample(GetSampleIndex(pTime), lSlot);
+    const int lCount = FbxMin(pVertexCount, mPointCount);
+    for (int lIndex = 0; lIndex < lCount; ++lIndex)
+    {
+        pVertexArray[lIndex].mData[0] = lPositions[lIndex * 3];
+        pVertexArray[lIndex].mData[1] = lPositions[lIndex * 3 + 1];
+        pVertexArray[lIndex].mData[2] = lPositions[lIndex * 3 + 2];
+    }
+    ReleaseSample(lSlot);
+
+    return true;
+}
+
+void PointCacheStream::PrefetchProc(void * pArg)
+{
+    PointCacheStream * lStream = static_cast<PointCacheStream *>(pArg);
+
+    for (;;)
+    {
+        lStream->mWakeSemaphore.Wait();
+        if (lStream->mQuit)
+            break;
+
+        // Fill the window, starting over if the reader moved meanwhile.
+        while (!lStream->mQuit && lStream->PrefetchNext())
+        {
+        }
+    }
+}
+
+int PointCacheStream::GetSampleIndex(const FbxTime & pTime) const
+{
+    const double lFrame = static_cast<double>(pTime.GetFrameCount());
+    const int lSample = static_cast<int>(floor((lFrame - mStartFrame) / mSampleRate + 0.5));
+    if (lSample < 0)
+        return 0;
+    if (lSample >= mSampleCount)
+        return mSampleCount - 1;
+    return lSample;
+}
+
+const float * PointCacheStream::GetMappedSample(int pSample) const
+{
+    const char * lSamples = mFile.GetData() + sizeof(PC2Header);
+    return reinterpret_cast<const float *>(lSamples + static_cast<size_t>(pSample) * mPointCount * 3 * sizeof(float));
+}
+
+const float * PointCacheStream::AcquireSample(int pSample, int & pSlot)
+{
+    pSlot = -1;
+
+    mLock.Acquire();
+    const bool lMoved = mRequestedSample != pSample;
+    mRequestedSample = pSample;
+    for (int lSlotIndex = 0; lSlotIndex < mSlotCount; ++lSlotIndex)
+    {
+        Slot & lSlot = mSlots[lSlotIndex];
+        if (lSlot.mSample == pSample && lSlot.mState == SLOT_READY)
+        {
+            ++lSlot.mReaders;
+            pSlot = lSlotIndex;
+            break;
+        }
+    }
+    mLock.Release();
+
+    // Only wake up the thread when the window moved, it fills it entirely every time.
+    if (lMoved)
+    {
+        mWakeSemaphore.Signal();
+    }
+
+    // Not prefetched, the jump is read from the mapping on this thread.
+    return pSlot >= 0 ? mSlots[pSlot].mPositions : GetMappedSample(pSample);
+}
+
+void PointCacheStream::ReleaseSample(int pSlot)
+{
+    if (pSlot < 0)
+        return;
+
+    mLock.Acquire();
+    --mSlots[pSlot].mReaders;
+    mLock.Release();
+}
+
+bool PointCacheStream::IsInWindow(int pSample) const
+{
+    // The window wraps around to follow looping playback.
+    const int lDistance = (pSample - mRequestedSample + mSampleCount) % mSampleCount;
+    return lDistance < mSlotCount;
+}
+
+bool PointCacheStream::PrefetchNext()
+{
+    int lSample = -1;
+    int lFreeSlot = -1;
+
+    mLock.Acquire();
+    for (int lOffset = 0; lOffset < mSlotCount && lSample < 0; ++lOffset)
+    {
+        const int lCandidate = (mRequestedSample + lOffset) % mSampleCount;
+        bool lInRing = false;
+        for (int lSlotIndex = 0; lSlotIndex < mSlotCount && !lInRing; ++lSlotIndex)
+        {
+            lInRing = mSlots[lSlotIndex].mSample == lCandidate && mSlots[lSlotIndex].mState != SLOT_EMPTY;
+        }
+        if (!lInRing)
+            lSample = lCandidate;
+    }
+
+    if (lSample >= 0)
+    {
+        // Reuse a slot that fell out of the window and nobody reads.
+        for (int lSlotIndex = 0; lSlotIndex < mSlotCount && lFreeSlot < 0; ++lSlotIndex)
+        {
+            const Slot & lSlot = mSlots[lSlotIndex];
+            if (lSlot.mReaders == 0 && (lSlot.mState == SLOT_EMPTY || !IsInWindow(lSlot.mSample)))
+                lFreeSlot = lSlotIndex;
+        }
+        if (lFreeSlot >= 0)
+        {
+            mSlots[lFreeSlot].mSample = lSample;
+            mSlots[lFreeSlot].mState = SLOT_LOADING;
+        }
+    }
+    mLock.Release();
+
+    if (lFreeSlot < 0)
+        return false;
+
+    // Touching the mapping here is what brings the sample from the disk.
+    memcpy(mSlots[lFreeSlot].mPositions, GetMappedSample(lSample), mPointCount * 3 * sizeof(float));
+
+    mLock.Acquire();
+    mSlots[lFreeSlot].mState = SLOT_READY;
+    mLock.Release();
+
+    return true;
+}
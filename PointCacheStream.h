@@ -0,0 +1,100 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _POINT_CACHE_STREAM_H
+#define _POINT_CACHE_STREAM_H
+
+#include <fbxsdk.h>
+#include "MappedFile.h"
+
+// Playback of a PC2 point cache file straight from a memory mapping.
+// A background thread copies the samples following the last one read into a small
+// ring of buffers, so the page faults of the mapping are taken off the render thread
+// and playing the cache never waits on the disk unless it jumps around the timeline.
+class PointCacheStream
+{
+public:
+    // Samples read ahead of the last one by default.
+    static const int DEFAULT_PREFETCH_COUNT = 8;
+
+    PointCacheStream();
+    ~PointCacheStream();
+
+    // Map the PC2 file and start prefetching from its first sample.
+    // Return false if the file cannot be mapped or is not a valid PC2 file.
+    bool Open(const char * pFileName, int pPrefetchCount = DEFAULT_PREFETCH_COUNT);
+    void Close();
+
+    bool IsOpen() const { return mFile.IsOpen(); }
+    int GetPointCount() const { return mPointCount; }
+    int GetSampleCount() const { return mSampleCount; }
+
+    // Copy the sample at the given time, clamped to the range of the cache, then move the
+    // prefetch window after it. The first pVertexCount points are written, at most.
+    // Four floats per point with w = 1, the VBO layout.
+    bool Read(const FbxTime & pTime, float * pVertices, int pVertexCount);
+    bool Read(const FbxTime & pTime, FbxVector4 * pVertexArray, int pVertexCount);
+
+private:
+    // Not copyable, the ring belongs to the thread of the stream.
+    PointCacheStream(const PointCacheStream &);
+    PointCacheStream & operator=(const PointCacheStream &);
+
+    enum ESlotState
+    {
+        SLOT_EMPTY,
+        SLOT_LOADING,
+        SLOT_READY
+    };
+
+    struct Slot
+    {
+        Slot() : mSample(-1), mState(SLOT_EMPTY), mReaders(0), mPositions(NULL) {}
+
+        int mSample;
+        ESlotState mState;
+        // Readers copying out of the slot, it is not reused meanwhile.
+        int mReaders;
+        float * mPositions;
+    };
+
+    static void PrefetchProc(void * pArg);
+
+    int GetSampleIndex(const FbxTime & pTime) const;
+    // Positions of a sample in the mapping, three floats per point.
+    const float * GetMappedSample(int pSample) const;
+    // Positions of a sample, from the ring if it was prefetched, otherwise from the mapping.
+    // pSlot receives the slot to give back to ReleaseSample, -1 for the mapping.
+    const float * AcquireSample(int pSample, int & pSlot);
+    void ReleaseSample(int pSlot);
+    // Whether a sample falls in the prefetch window starting at mRequestedSample.
+    bool IsInWindow(int pSample) const;
+    // Load one sample of the window not in the ring yet, return false if there is none.
+    bool PrefetchNext();
+
+    MappedFile mFile;
+    int mPointCount;
+    int mSampleCount;
+    float mStartFrame;
+    float mSampleRate;
+
+    FbxSpinLock mLock;
+    Slot * mSlots;
+    int mSlotCount;
+    int mRequestedSample;
+
+    FbxThread * mThread;
+    FbxSemaphore mWakeSemaphore;
+    volatile bool mQuit;
+};
+
+#endif // _POINT_CACHE_STREAM_H
+
@@ -0,0 +1,309 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) 2013 by Aline Normoyle, Liming Zhao, Alla Safonova, Teresa Fan
+
+#include "PoseBatch.h"
+#include <algorithm>
+#include <math.h>
+
+// One SIMD lane per instance when the target guarantees SSE
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define POSE_BATCH_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+#define LANE_COUNT 4
+#define GLOBAL_STRIDE (12 * LANE_COUNT) // 3x3 rotation and translation, 4 lanes each
+
+#ifdef POSE_BATCH_USE_SSE
+
+typedef __m128 Lanes;
+
+static inline Lanes Set(float v) { return _mm_set1_ps(v); }
+static inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+static inline void Store(float* p, Lanes a) { _mm_storeu_ps(p, a); }
+static inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes InvSqrt(Lanes a) { return _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(a)); }
+// Negate value in the lanes where test is negative
+static inline Lanes FlipSign(Lanes value, Lanes test) { return _mm_xor_ps(value, _mm_and_ps(test, _mm_set1_ps(-0.0f))); }
+
+// Four quaternions (x, y, z, w), one per lane, to one register per component
+static inline void LoadQuaternions(const float* const* q, Lanes& x, Lanes& y, Lanes& z, Lanes& w)
+{
+    x = _mm_loadu_ps(q[0]); y = _mm_loadu_ps(q[1]); z = _mm_loadu_ps(q[2]); w = _mm_loadu_ps(q[3]);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+}
+
+#else
+
+struct Lanes { float v[LANE_COUNT]; };
+
+static inline Lanes Set(float v) { Lanes r; for (int i = 0; i < LANE_COUNT; i++) r.v[i] = v; return r; }
+static inline Lanes Load(const float* p) { Lanes r; for (int i = 0; i < LANE_COUNT; i++) r.v[i] = p[i]; return r; }
+static inline void Store(float* p, Lanes a) { for (int i = 0; i < LANE_COUNT; i++) p[i] = a.v[i]; }
+static inline Lanes Add(Lanes a, Lanes b) { for (int i = 0; i < LANE_COUNT; i++) a.v[i] += b.v[i]; return a; }
+static inline Lanes Sub(Lanes a, Lanes b) { for (int i = 0; i < LANE_COUNT; i++) a.v[i] -= b.v[i]; return a; }
+static inline Lanes Mul(Lanes a, Lanes b) { for (int i = 0; i < LANE_COUNT; i++) a.v[i] *= b.v[i]; return a; }
+static inline Lanes InvSqrt(Lanes a) { for (int i = 0; i < LANE_COUNT; i++) a.v[i] = 1.0f / sqrtf(a.v[i]); return a; }
+static inline Lanes FlipSign(Lanes value, Lanes test) { for (int i = 0; i < LANE_COUNT; i++) if (test.v[i] < 0) value.v[i] = -value.v[i]; return value; }
+
+static inline void LoadQuaternions(const float* const* q, Lanes& x, Lanes& y, Lanes& z, Lanes& w)
+{
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        x.v[i] = q[i][0]; y.v[i] = q[i][1]; z.v[i] = q[i][2]; w.v[i] = q[i][3];
+    }
+}
+
+#endif
+
+static inline Lanes MulAdd(Lanes a, Lanes b, Lanes c) { return Add(Mul(a, b), c); }
+
+struct LaneQuaternion
+{
+    Lanes x, y, z, w;
+
+    Lanes Dot(const LaneQuaternion& q) const { return MulAdd(x, q.x, MulAdd(y, q.y, MulAdd(z, q.z, Mul(w, q.w)))); }
+
+    // Move toward q by weight, on the shortest path
+    void Lerp(LaneQuaternion q, Lanes weight)
+    {
+        Lanes d = Dot(q);
+        x = MulAdd(Sub(FlipSign(q.x, d), x), weight, x);
+        y = MulAdd(Sub(FlipSign(q.y, d), y), weight, y);
+        z = MulAdd(Sub(FlipSign(q.z, d), z), weight, z);
+        w = MulAdd(Sub(FlipSign(q.w, d), w), weight, w);
+    }
+};
+
+// Frames around the time of one instance in one motion
+struct MotionSample
+{
+    const Motion* motion;
+    unsigned int frame0, frame1;
+    float weight;
+};
+
+static const float identityQuaternion[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+static MotionSample SampleMotion(const Motion* motion, double time, unsigned int numJoints)
+{
+    MotionSample sample = {0, 0, 0, 0.0f};
+    if (!motion || motion->GetNumFrames() == 0 || motion->GetNumJoints() != numJoints) return sample;
+
+    unsigned int numFrames = motion->GetNumFrames();
+    double frame = motion->GetFps() > 0 ? fmod(time * motion->GetFps(), (double) numFrames) : 0;
+    if (frame < 0) frame += numFrames;
+
+    sample.motion = motion;
+    sample.frame0 = std::min<unsigned int>((unsigned int) frame, numFrames - 1);
+    sample.frame1 = sample.frame0 + 1 < numFrames ? sample.frame0 + 1 : 0;
+    sample.weight = (float) (frame - sample.frame0);
+    return sample;
+}
+
+static inline const float* SampleQuaternion(const MotionSample& sample, unsigned int frame, unsigned int joint)
+{
+    return sample.motion ? sample.motion->GetJointQuaternionData(frame, joint) : identityQuaternion;
+}
+
+// Interpolated quaternions of one joint in four lanes
+static LaneQuaternion InterpolateJoint(const MotionSample* samples, Lanes weights, unsigned int joint)
+{
+    const float* q0[LANE_COUNT];
+    const float* q1[LANE_COUNT];
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        q0[i] = SampleQuaternion(samples[i], samples[i].frame0, joint);
+        q1[i] = SampleQuaternion(samples[i], samples[i].frame1, joint);
+    }
+
+    LaneQuaternion a, b;
+    LoadQuaternions(q0, a.x, a.y, a.z, a.w);
+    LoadQuaternions(q1, b.x, b.y, b.z, b.w);
+    a.Lerp(b, weights);
+    return a;
+}
+
+// Interpolated root translation in four lanes, or the offset of the root without motion
+static void InterpolateRoot(const MotionSample* samples, const float* offset, float* result)
+{
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        if (!samples[i].motion)
+        {
+            for (int c = 0; c < 3; c++) result[c * LANE_COUNT + i] = offset[c];
+            continue;
+        }
+        const float* t0 = samples[i].motion->GetRootTranslationData(samples[i].frame0);
+        const float* t1 = samples[i].motion->GetRootTranslationData(samples[i].frame1);
+        for (int c = 0; c < 3; c++) result[c * LANE_COUNT + i] = t0[c] + (t1[c] - t0[c]) * samples[i].weight;
+    }
+}
+
+PoseBatch::PoseBatch() : m_scale(1.0f)
+{
+    m_rootOffset[0] = m_rootOffset[1] = m_rootOffset[2] = 0.0f;
+}
+
+bool PoseBatch::Initialize(const Skeleton& skeleton)
+{
+    m_jointIds.clear();
+    m_parents.clear();
+    m_offsets.clear();
+
+    Joint* root = skeleton.GetRootJoint();
+    if (!root || skeleton.AMC) return false;
+
+    // Breadth first, parents before children
+    std::vector<Joint*> joints(1, root);
+    m_parents.push_back(-1);
+    for (unsigned int i = 0; i < joints.size(); i++)
+    {
+        Joint* joint = joints[i];
+        if (joint->AMC) return false;
+
+        m_jointIds.push_back(joint->GetID());
+        vec3 offset = joint->GetLocalTranslation();
+        m_offsets.push_back((float) offset[VX]);
+        m_offsets.push_back((float) offset[VY]);
+        m_offsets.push_back((float) offset[VZ]);
+
+        for (unsigned int c = 0; c < joint->GetNumChildren(); c++)
+        {
+            joints.push_back(joint->GetChildAt(c));
+            m_parents.push_back(i);
+        }
+    }
+    m_scale = skeleton.GetScale();
+
+    // The root translation of the skeleton is scaled already, as in Skeleton::WriteToFrame
+    for (int c = 0; c < 3; c++) m_rootOffset[c] = m_scale != 0.0f ? m_offsets[c] / m_scale : 0.0f;
+
+    if (m_jointIds.size() != skeleton.GetNumJoints())
+    {
+        m_jointIds.clear();
+        return false;
+    }
+    return true;
+}
+
+void PoseBatch::Evaluate(const Instance* instances, unsigned int numInstances, float* palettes) const
+{
+    if (m_jointIds.empty()) return;
+
+    std::vector<float> globals(m_jointIds.size() * GLOBAL_STRIDE);
+    for (unsigned int i = 0; i < numInstances; i += LANE_COUNT)
+    {
+        unsigned int numLanes = std::min<unsigned int>(LANE_COUNT, numInstances - i);
+        EvaluateGroup(instances + i, numLanes, &globals[0], palettes + i * m_jointIds.size() * PALETTE_STRIDE);
+    }
+}
+
+void PoseBatch::EvaluateGroup(const Instance* instances, unsigned int numLanes, float* globals, float* palettes) const
+{
+    unsigned int numJoints = m_jointIds.size();
+
+    // The unused lanes repeat the last instance
+    MotionSample samples[LANE_COUNT], blendSamples[LANE_COUNT];
+    float weights[LANE_COUNT], blendWeights[LANE_COUNT];
+    bool blend = false;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        const Instance& instance = instances[std::min<unsigned int>(i, numLanes - 1)];
+        samples[i] = SampleMotion(instance.motion, instance.time, numJoints);
+        blendSamples[i] = SampleMotion(instance.blendMotion, instance.blendTime, numJoints);
+        blendWeights[i] = blendSamples[i].motion ? instance.blendWeight : 0.0f;
+        blend = blend || blendWeights[i] > 0.0f;
+        weights[i] = samples[i].weight;
+    }
+    Lanes weight = Load(weights);
+    Lanes blendWeight = Load(blendWeights);
+    float blendFrameWeights[LANE_COUNT];
+    for (int i = 0; i < LANE_COUNT; i++) blendFrameWeights[i] = blendSamples[i].weight;
+    Lanes blendFrameWeight = Load(blendFrameWeights);
+
+    const Lanes one = Set(1.0f), two = Set(2.0f);
+    for (unsigned int k = 0; k < numJoints; k++)
+    {
+        unsigned int id = m_jointIds[k];
+
+        // Sample and blend the local rotation
+        LaneQuaternion q = InterpolateJoint(samples, weight, id);
+        if (blend)
+        {
+            q.Lerp(InterpolateJoint(blendSamples, blendFrameWeight, id), blendWeight);
+        }
+        Lanes n = InvSqrt(q.Dot(q));
+        Lanes x = Mul(q.x, n), y = Mul(q.y, n), z = Mul(q.z, n), w = Mul(q.w, n);
+
+        Lanes xx = Mul(x, x), yy = Mul(y, y), zz = Mul(z, z);
+        Lanes xy = Mul(x, y), xz = Mul(x, z), yz = Mul(y, z);
+        Lanes wx = Mul(w, x), wy = Mul(w, y), wz = Mul(w, z);
+        Lanes r[9] = {
+            Sub(one, Mul(two, Add(yy, zz))), Mul(two, Sub(xy, wz)), Mul(two, Add(xz, wy)),
+            Mul(two, Add(xy, wz)), Sub(one, Mul(two, Add(xx, zz))), Mul(two, Sub(yz, wx)),
+            Mul(two, Sub(xz, wy)), Mul(two, Add(yz, wx)), Sub(one, Mul(two, Add(xx, yy)))};
+
+        // Local translation, the root moves with the motion
+        Lanes t[3];
+        if (m_parents[k] < 0)
+        {
+            float root[3 * LANE_COUNT], blendRoot[3 * LANE_COUNT];
+            InterpolateRoot(samples, m_rootOffset, root);
+            InterpolateRoot(blendSamples, m_rootOffset, blendRoot);
+            Lanes scale = Set(m_scale);
+            for (int c = 0; c < 3; c++)
+            {
+                Lanes a = Load(root + c * LANE_COUNT);
+                if (blend) a = MulAdd(Sub(Load(blendRoot + c * LANE_COUNT), a), blendWeight, a);
+                t[c] = Mul(a, scale);
+            }
+        }
+        else
+        {
+            for (int c = 0; c < 3; c++) t[c] = Set(m_offsets[3 * k + c]);
+        }
+
+        // Forward kinematics, the parent is already done
+        float* global = globals + k * GLOBAL_STRIDE;
+        if (m_parents[k] < 0)
+        {
+            for (int c = 0; c < 9; c++) Store(global + c * LANE_COUNT, r[c]);
+            for (int c = 0; c < 3; c++) Store(global + (9 + c) * LANE_COUNT, t[c]);
+        }
+        else
+        {
+            const float* parent = globals + m_parents[k] * GLOBAL_STRIDE;
+            Lanes p[12];
+            for (int c = 0; c < 12; c++) p[c] = Load(parent + c * LANE_COUNT);
+
+            for (int row = 0; row < 3; row++)
+            {
+                for (int col = 0; col < 3; col++)
+                {
+                    Lanes v = MulAdd(p[3 * row], r[col], MulAdd(p[3 * row + 1], r[3 + col], Mul(p[3 * row + 2], r[6 + col])));
+                    Store(global + (3 * row + col) * LANE_COUNT, v);
+                }
+                Lanes v = MulAdd(p[3 * row], t[0], MulAdd(p[3 * row + 1], t[1], MulAdd(p[3 * row + 2], t[2], p[9 + row])));
+                Store(global + (9 + row) * LANE_COUNT, v);
+            }
+        }
+    }
+
+    // Column major palettes, by joint ID
+    for (unsigned int i = 0; i < numLanes; i++)
+    {
+        float* palette = palettes + i * numJoints * PALETTE_STRIDE;
+        for (unsigned int k = 0; k < numJoints; k++)
+        {
+            const float* global = globals + k * GLOBAL_STRIDE + i;
+            float* m = palette + m_jointIds[k] * PALETTE_STRIDE;
+            m[0] = global[0 * LANE_COUNT]; m[4] = global[1 * LANE_COUNT]; m[8]  = global[2 * LANE_COUNT]; m[12] = global[9 * LANE_COUNT];
+            m[1] = global[3 * LANE_COUNT]; m[5] = global[4 * LANE_COUNT]; m[9]  = global[5 * LANE_COUNT]; m[13] = global[10 * LANE_COUNT];
+            m[2] = global[6 * LANE_COUNT]; m[6] = global[7 * LANE_COUNT]; m[10] = global[8 * LANE_COUNT]; m[14] = global[11 * LANE_COUNT];
+            m[3] = 0.0f;                   m[7] = 0.0f;                   m[11] = 0.0f;                   m[15] = 1.0f;
+        }
+    }
+}
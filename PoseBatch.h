@@ -0,0 +1,52 @@
+//-----------------------------------------------------------------------------
+// Copyright (C) 2013 by Aline Normoyle, Liming Zhao, Alla Safonova, Teresa Fan
+
+
+#ifndef PoseBatch_H_
+#define PoseBatch_H_
+
+#include "Skeleton.h"
+#include "Motion.h"
+#include <vector>
+
+// Poses of many characters sharing one skeleton, evaluated in one call.
+// The topology is flattened once; every call samples the motion of each instance,
+// blends it and runs FK for four instances at a time, one SIMD lane per instance.
+class PoseBatch
+{
+public:
+    struct Instance
+    {
+        Instance() : motion(0), time(0), blendMotion(0), blendTime(0), blendWeight(0) {}
+
+        const Motion* motion;       // Same number of joints as the skeleton, NULL for the rest pose
+        double time;                // Seconds, looped over the length of the motion
+        const Motion* blendMotion;  // Optional second motion blended over the first one
+        double blendTime;
+        float blendWeight;          // 0 for motion only, 1 for blendMotion only
+    };
+
+    // Floats per joint in a palette, a column major 4x4 matrix like SkeletonMesh's uniforms
+    static const int PALETTE_STRIDE = 16;
+
+	PoseBatch();
+
+    // Flatten the hierarchy and keep the joint offsets. AMC skeletons are not supported.
+    bool Initialize(const Skeleton& skeleton);
+    unsigned int GetNumJoints() const { return m_jointIds.size(); }
+
+    // Global transform of every joint of every instance, instance after instance and
+    // by joint ID. palettes holds numInstances * GetNumJoints() * PALETTE_STRIDE floats.
+    void Evaluate(const Instance* instances, unsigned int numInstances, float* palettes) const;
+
+private:
+    void EvaluateGroup(const Instance* instances, unsigned int numLanes, float* globals, float* palettes) const;
+
+    std::vector<unsigned int> m_jointIds;   // Joint IDs, parents before children
+    std::vector<int> m_parents;             // Position of the parent in m_jointIds, -1 for the root
+    std::vector<float> m_offsets;           // Local translation of every joint, 3 floats each
+    float m_rootOffset[3];                  // Root translation before scaling, for instances without motion
+    float m_scale;                          // Scale of the root translation
+};
+
+#endif
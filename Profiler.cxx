@@ -0,0 +1,244 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "Profiler.h"
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#include <time.h>
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+namespace
+{
+    // Scopes kept per thread between two frames, the oldest ones are lost past that.
+    const unsigned int RING_SIZE = 4096;
+
+    struct Event
+    {
+        const char * mName;
+        FbxLongLong mStart;
+        FbxLongLong mEnd;
+    };
+
+    struct ThreadBuffer
+    {
+        ThreadBuffer() : mThreadIndex(0), mWriteCount(0), mReadCount(0) {}
+
+        int mThreadIndex;
+        Event mEvents[RING_SIZE];
+        // Written by the thread of the buffer, read by EndFrame.
+        volatile unsigned int mWriteCount;
+        // Only used by EndFrame.
+        unsigned int mReadCount;
+    };
+
+    struct Stage
+    {
+        const char * mName;
+        double mMilliseconds[Profiler::AVERAGE_FRAME_COUNT];
+        int mCalls[Profiler::AVERAGE_FRAME_COUNT];
+    };
+
+    PROFILER_THREAD_LOCAL ThreadBuffer * gThreadBuffer = NULL;
+
+    // The buffers of all the threads which recorded, they live as long as the process.
+    FbxSpinLock gBuffersLock;
+    FbxArray<ThreadBuffer *> gBuffers;
+
+    FbxArray<Stage> gStages;
+    int gFrameCount = 0;
+
+    FILE * gTraceFile = NULL;
+    bool gTraceCSV = false;
+    bool gFirstTraceEvent = true;
+    FbxLongLong gTraceStart = 0;
+
+    FbxLongLong GetTicksPerSecond()
+    {
+#if defined(_WIN32)
+        LARGE_INTEGER lFrequency;
+        QueryPerformanceFrequency(&lFrequency);
+        return lFrequency.QuadPart;
+#else
+        return 1000000000;
+#endif
+    }
+
+    ThreadBuffer * GetThreadBuffer()
+    {
+        if (!gThreadBuffer)
+        {
+            gThreadBuffer = new ThreadBuffer;
+            gBuffersLock.Acquire();
+            gThreadBuffer->mThreadIndex = gBuffers.GetCount();
+            gBuffers.Add(gThreadBuffer);
+            gBuffersLock.Release();
+        }
+        return gThreadBuffer;
+    }
+
+    Stage & GetStage(const char * pName)
+    {
+        for (int lStageIndex = 0; lStageIndex < gStages.GetCount(); ++lStageIndex)
+        {
+            if (gStages[lStageIndex].mName == pName)
+                return gStages[lStageIndex];
+        }
+
+        Stage lStage;
+        memset(&lStage, 0, sizeof(lStage));
+        lStage.mName = pName;
+        gStages.Add(lStage);
+        return gStages[gStages.GetCount() - 1];
+    }
+
+    void WriteTraceEvent(const Event & pEvent, int pThreadIndex, double pTicksPerMicrosecond)
+    {
+        const double lStart = (pEvent.mStart - gTraceStart) / pTicksPerMicrosecond;
+        const double lDuration = (pEvent.mEnd - pEvent.mStart) / pTicksPerMicrosecond;
+        if (gTraceCSV)
+        {
+            fprintf(gTraceFile, "%d,%d,%s,%.3f,%.3f\n", gFrameCount, pThreadIndex, pEvent.mName, lStart, lDuration);
+        }
+        else
+        {
+            fprintf(gTraceFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                gFirstTraceEvent ? "\n" : ",\n", pEvent.mName, pThreadIndex, lStart, lDuration);
+            gFirstTraceEvent = false;
+        }
+    }
+}
+
+bool Profiler::sEnabled = false;
+bool Profiler::sTracing = false;
+
+FbxLongLong Profiler::GetTicks()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER lCounter;
+    QueryPerformanceCounter(&lCounter);
+    return lCounter.QuadPart;
+#else
+    timespec lTime;
+    clock_gettime(CLOCK_MONOTONIC, &lTime);
+    return static_cast<FbxLongLong>(lTime.tv_sec) * 1000000000 + lTime.tv_nsec;
+#endif
+}
+
+void Profiler::Record(const char * pName, FbxLongLong pStart, FbxLongLong pEnd)
+{
+    ThreadBuffer * lBuffer = GetThreadBuffer();
+    Event & lEvent = lBuffer->mEvents[lBuffer->mWriteCount % RING_SIZE];
+    lEvent.mName = pName;
+    lEvent.mStart = pStart;
+    lEvent.mEnd = pEnd;
+    // Publish the event once it is written.
+    lBuffer->mWriteCount = lBuffer->mWriteCount + 1;
+}
+
+void Profiler::EndFrame()
+{
+    const int lSlot = gFrameCount % AVERAGE_FRAME_COUNT;
+    for (int lStageIndex = 0; lStageIndex < gStages.GetCount(); ++lStageIndex)
+    {
+        gStages[lStageIndex].mMilliseconds[lSlot] = 0.0;
+        gStages[lStageIndex].mCalls[lSlot] = 0;
+    }
+
+    const double lTicksPerMillisecond = GetTicksPerSecond() / 1000.0;
+    // Held against a thread recording for the first time, which adds its buffer.
+    gBuffersLock.Acquire();
+    for (int lBufferIndex = 0; lBufferIndex < gBuffers.GetCount(); ++lBufferIndex)
+    {
+        ThreadBuffer * lBuffer = gBuffers[lBufferIndex];
+        const unsigned int lWriteCount = lBuffer->mWriteCount;
+        if (lWriteCount - lBuffer->mReadCount > RING_SIZE)
+            lBuffer->mReadCount = lWriteCount - RING_SIZE;
+
+        for (; lBuffer->mReadCount != lWriteCount; ++lBuffer->mReadCount)
+        {
+            const Event & lEvent = lBuffer->mEvents[lBuffer->mReadCount % RING_SIZE];
+            Stage & lStage = GetStage(lEvent.mName);
+            lStage.mMilliseconds[lSlot] += (lEvent.mEnd - lEvent.mStart) / lTicksPerMillisecond;
+            ++lStage.mCalls[lSlot];
+
+            if (gTraceFile)
+                WriteTraceEvent(lEvent, lBuffer->mThreadIndex, lTicksPerMillisecond / 1000.0);
+        }
+    }
+    gBuffersLock.Release();
+
+    ++gFrameCount;
+}
+
+FbxString Profiler::GetSummary()
+{
+    FbxString lSummary;
+    const int lFrameCount = FbxMin(gFrameCount, static_cast<int>(AVERAGE_FRAME_COUNT));
+    if (lFrameCount == 0)
+        return lSummary;
+
+    for (int lStageIndex = 0; lStageIndex < gStages.GetCount(); ++lStageIndex)
+    {
+        const Stage & lStage = gStages[lStageIndex];
+        double lMilliseconds = 0.0;
+        int lCalls = 0;
+        for (int lFrameIndex = 0; lFrameIndex < lFrameCount; ++lFrameIndex)
+        {
+            lMilliseconds += lStage.mMilliseconds[lFrameIndex];
+            lCalls += lStage.mCalls[lFrameIndex];
+        }
+
+        char lLine[128];
+        FBXSDK_sprintf(lLine, 128, "%s: %.2f ms, %d calls\n", lStage.mName,
+            lMilliseconds / lFrameCount, (lCalls + lFrameCount / 2) / lFrameCount);
+        lSummary += lLine;
+    }
+    return lSummary;
+}
+
+bool Profiler::StartTrace(const char * pFileName)
+{
+    StopTrace();
+
+    gTraceFile = fopen(pFileName, "w");
+    if (!gTraceFile)
+        return false;
+
+    const FbxString lFileName(pFileName);
+    gTraceCSV = lFileName.Right(4).Lower() == ".csv";
+    if (gTraceCSV)
+        fprintf(gTraceFile, "frame,thread,stage,start_us,duration_us\n");
+    else
+        fprintf(gTraceFile, "[");
+    gFirstTraceEvent = true;
+    gTraceStart = GetTicks();
+    sTracing = true;
+
+    return true;
+}
+
+void Profiler::StopTrace()
+{
+    if (!gTraceFile)
+        return;
+
+    if (!gTraceCSV)
+        fprintf(gTraceFile, "\n]\n");
+    fclose(gTraceFile);
+    gTraceFile = NULL;
+    sTracing = false;
+}
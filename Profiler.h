@@ -0,0 +1,82 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <fbxsdk.h>
+
+// Time the enclosing scope as the stage pName, a string literal.
+// Define VIEWSCENE_NO_PROFILER to compile all the timers out.
+#ifndef VIEWSCENE_NO_PROFILER
+#define PROFILE_SCOPE(pName) ProfileScope PROFILE_SCOPE_NAME(lProfileScope, __LINE__)(pName)
+#define PROFILE_SCOPE_NAME(pPrefix, pLine) PROFILE_SCOPE_CONCAT(pPrefix, pLine)
+#define PROFILE_SCOPE_CONCAT(pPrefix, pLine) pPrefix##pLine
+#else
+#define PROFILE_SCOPE(pName)
+#endif
+
+// Timings of the stages of the frames. Every thread records the scopes it closes in its
+// own ring buffer, without locking. Once per frame, the main thread collects the rings
+// into rolling averages per stage, and into a trace file while one is open: Chrome trace
+// JSON (chrome://tracing), or CSV if the file name ends with .csv.
+class Profiler
+{
+public:
+    // Frames of the rolling averages.
+    static const int AVERAGE_FRAME_COUNT = 60;
+
+    // Scopes are only recorded while enabled, or while a trace is open.
+    static void SetEnabled(bool pEnabled) { sEnabled = pEnabled; }
+    static bool IsEnabled() { return sEnabled; }
+    static bool IsRecording() { return sEnabled || sTracing; }
+
+    // Current time in ticks of the profiler clock.
+    static FbxLongLong GetTicks();
+    // Record a scope closed on the calling thread, stages are told apart by the address of
+    // their name, which must outlive the profiler.
+    static void Record(const char * pName, FbxLongLong pStart, FbxLongLong pEnd);
+
+    // Collect the scopes recorded since the last frame. Call it on the main thread while no
+    // other thread records.
+    static void EndFrame();
+
+    // The average milliseconds and calls per frame of every stage, one line each.
+    static FbxString GetSummary();
+
+    // Write the scopes of the next frames into a trace file, until StopTrace.
+    static bool StartTrace(const char * pFileName);
+    static void StopTrace();
+    static bool IsTracing() { return sTracing; }
+
+private:
+    static bool sEnabled;
+    static bool sTracing;
+};
+
+// Record the lifetime of the object as a scope, see PROFILE_SCOPE.
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char * pName)
+        : mName(pName), mStart(Profiler::IsRecording() ? Profiler::GetTicks() : 0) {}
+    ~ProfileScope()
+    {
+        if (mStart)
+            Profiler::Record(mName, mStart, Profiler::GetTicks());
+    }
+
+private:
+    const char * mName;
+    FbxLongLong mStart;
+};
+
+#endif // _PROFILER_H
@@ -10,8 +10,12 @@ this software in either electronic or hard copy form.
 ****************************************************************************************/
 
 #include "SceneCache.h"
+#include "SkinCache.h"
+#include "MeshSimplifier.h"
 //#include "shader.h"
 
+#include <algorithm>
+
 namespace
 {
     const float ANGLE_TO_RADIAN = 3.1415926f / 180.f;
@@ -29,6 +33,608 @@ namespace
     // Two floats for every UV.
     const int UV_STRIDE = 2;
 
+    // How long to wait for the GPU to release a vertex buffer of the ring, in nanoseconds.
+    const GLuint64 VERTEX_RING_TIMEOUT = 1000000000;
+
+    // Influences kept for every vertex skinned on the GPU, in columns of four.
+    const int SKIN_INFLUENCE_COUNT = 8;
+    const int SKIN_INFLUENCE_COLUMN_COUNT = SKIN_INFLUENCE_COUNT / 4;
+
+    // Smaller meshes have no coarser level of detail.
+    const int LOD_MIN_TRIANGLE_COUNT = 256;
+    // A level halves the triangles of the previous one; no level is added if the simplifier
+    // cannot remove a fifth of them.
+    const double LOD_MAX_TRIANGLE_RATIO = 0.8;
+
+    // Vertices kept by the post-transform cache OptimizeTriangleOrder orders the triangles for.
+    const int VERTEX_CACHE_SIZE = 32;
+
+    // An edge of a triangle, between two vertices of the VBO.
+    struct Edge
+    {
+        // The control points of the ends, the lower one in the high bits, tell the same
+        // edges apart even if the triangles do not share their vertices.
+        unsigned long long mKey;
+        unsigned int mFirst;
+        unsigned int mSecond;
+
+        bool operator<(const Edge & pOther) const { return mKey < pOther.mKey; }
+    };
+
+    // Append every edge of the triangles [pFirstTriangle, pFirstTriangle + pTriangleCount)
+    // to pEdgeIndices, once. pControlPoints holds the control point of every index.
+    void AppendUniqueEdges(const unsigned int * pIndices, const unsigned int * pControlPoints,
+                           int pFirstTriangle, int pTriangleCount,
+                           FbxArray<Edge> & pEdges, FbxArray<unsigned int> & pEdgeIndices)
+    {
+        pEdges.Resize(pTriangleCount * TRIANGLE_VERTEX_COUNT);
+        Edge * lEdges = pEdges.GetArray();
+        for (int lTriangle = 0; lTriangle < pTriangleCount; ++lTriangle)
+        {
+            const int lFirstIndex = (pFirstTriangle + lTriangle) * TRIANGLE_VERTEX_COUNT;
+            for (int lCorner = 0; lCorner < TRIANGLE_VERTEX_COUNT; ++lCorner)
+            {
+                const int lIndex = lFirstIndex + lCorner;
+                const int lNextIndex = lFirstIndex + (lCorner + 1) % TRIANGLE_VERTEX_COUNT;
+                const unsigned long long lLow = FbxMin(pControlPoints[lIndex], pControlPoints[lNextIndex]);
+                const unsigned long long lHigh = FbxMax(pControlPoints[lIndex], pControlPoints[lNextIndex]);
+                Edge & lEdge = lEdges[lTriangle * TRIANGLE_VERTEX_COUNT + lCorner];
+                lEdge.mKey = (lLow << 32) | lHigh;
+                lEdge.mFirst = pIndices[lIndex];
+                lEdge.mSecond = pIndices[lNextIndex];
+            }
+        }
+
+        std::sort(lEdges, lEdges + pEdges.GetCount());
+        for (int lEdgeIndex = 0; lEdgeIndex < pEdges.GetCount(); ++lEdgeIndex)
+        {
+            if (lEdgeIndex > 0 && lEdges[lEdgeIndex].mKey == lEdges[lEdgeIndex - 1].mKey)
+                continue;
+            pEdgeIndices.Add(lEdges[lEdgeIndex].mFirst);
+            pEdgeIndices.Add(lEdges[lEdgeIndex].mSecond);
+        }
+    }
+
+    // Hash the control point, normal and UV of a vertex, FNV-1a over their bytes. The normal
+    // and UV may be NULL.
+    unsigned int HashVertex(unsigned int pControlPoint, const float * pNormal, const float * pUV)
+    {
+        unsigned char lBytes[sizeof(unsigned int) + (NORMAL_STRIDE + UV_STRIDE) * sizeof(float)];
+        int lByteCount = 0;
+        memcpy(lBytes, &pControlPoint, sizeof(unsigned int));
+        lByteCount += sizeof(unsigned int);
+        if (pNormal)
+        {
+            memcpy(lBytes + lByteCount, pNormal, NORMAL_STRIDE * sizeof(float));
+            lByteCount += NORMAL_STRIDE * sizeof(float);
+        }
+        if (pUV)
+        {
+            memcpy(lBytes + lByteCount, pUV, UV_STRIDE * sizeof(float));
+            lByteCount += UV_STRIDE * sizeof(float);
+        }
+
+        unsigned int lHash = 2166136261u;
+        for (int lIndex = 0; lIndex < lByteCount; ++lIndex)
+        {
+            lHash = (lHash ^ lBytes[lIndex]) * 16777619u;
+        }
+        return lHash;
+    }
+
+    // Score of a vertex from its place in the cache, -1 if it left, and the triangles not
+    // ordered yet around it (Forsyth, Linear-Speed Vertex Cache Optimisation).
+    float GetVertexCacheScore(int pCachePosition, int pValence)
+    {
+        if (pValence == 0)
+            return -1.0f;
+
+        float lScore = 0.0f;
+        if (pCachePosition >= 0)
+        {
+            // The vertices of the last triangle get a fixed score, not to draw its
+            // neighbours in a strip.
+            if (pCachePosition < TRIANGLE_VERTEX_COUNT)
+                lScore = 0.75f;
+            else
+                lScore = powf(1.0f - static_cast<float>(pCachePosition - TRIANGLE_VERTEX_COUNT) /
+                    (VERTEX_CACHE_SIZE - TRIANGLE_VERTEX_COUNT), 1.5f);
+        }
+        // Finish the vertices with few triangles left first.
+        return lScore + 2.0f / sqrtf(static_cast<float>(pValence));
+    }
+
+    // Reorder the triangles [pFirstTriangle, pFirstTriangle + pTriangleCount) of pIndices,
+    // and the control points of their indices, so that the vertices of a triangle are likely
+    // still in the post-transform cache. The vertices are less than pVertexCount.
+    void OptimizeTriangleOrder(unsigned int * pIndices, unsigned int * pControlPoints,
+                               int pFirstTriangle, int pTriangleCount, int pVertexCount)
+    {
+        if (pTriangleCount < 2)
+            return;
+
+        unsigned int * lIndices = pIndices + pFirstTriangle * TRIANGLE_VERTEX_COUNT;
+        unsigned int * lControlPoints = pControlPoints + pFirstTriangle * TRIANGLE_VERTEX_COUNT;
+        const int lIndexCount = pTriangleCount * TRIANGLE_VERTEX_COUNT;
+
+        // The triangles around every vertex, the ones not ordered yet first.
+        FbxArray<int> lValences;
+        FbxArray<int> lFirstTriangles;
+        FbxArray<int> lVertexTriangles;
+        lValences.Resize(pVertexCount);
+        lFirstTriangles.Resize(pVertexCount + 1);
+        lVertexTriangles.Resize(lIndexCount);
+        for (int lVertex = 0; lVertex < pVertexCount; ++lVertex)
+        {
+            lValences[lVertex] = 0;
+        }
+        for (int lIndex = 0; lIndex < lIndexCount; ++lIndex)
+        {
+            ++lValences[lIndices[lIndex]];
+        }
+        lFirstTriangles[0] = 0;
+        for (int lVertex = 0; lVertex < pVertexCount; ++lVertex)
+        {
+            lFirstTriangles[lVertex + 1] = lFirstTriangles[lVertex] + lValences[lVertex];
+            lValences[lVertex] = 0;
+        }
+        for (int lIndex = 0; lIndex < lIndexCount; ++lIndex)
+        {
+            const int lVertex = lIndices[lIndex];
+            lVertexTriangles[lFirstTriangles[lVertex] + lValences[lVertex]++] = lIndex / TRIANGLE_VERTEX_COUNT;
+        }
+
+        FbxArray<int> lCachePositions;
+        FbxArray<float> lVertexScores;
+        lCachePositions.Resize(pVertexCount);
+        lVertexScores.Resize(pVertexCount);
+        for (int lVertex = 0; lVertex < pVertexCount; ++lVertex)
+        {
+            lCachePositions[lVertex] = -1;
+            lVertexScores[lVertex] = GetVertexCacheScore(-1, lValences[lVertex]);
+        }
+
+        FbxArray<bool> lOrdered;
+        lOrdered.Resize(pTriangleCount);
+        int lBestTriangle = 0;
+        float lBestScore = -1.0f;
+        for (int lTriangle = 0; lTriangle < pTriangleCount; ++lTriangle)
+        {
+            lOrdered[lTriangle] = false;
+            const unsigned int * lTriangleIndices = lIndices + lTriangle * TRIANGLE_VERTEX_COUNT;
+            const float lScore = lVertexScores[lTriangleIndices[0]] + lVertexScores[lTriangleIndices[1]] +
+                lVertexScores[lTriangleIndices[2]];
+            if (lScore > lBestScore)
+            {
+                lBestTriangle = lTriangle;
+                lBestScore = lScore;
+            }
+        }
+
+        FbxArray<unsigned int> lOrderedIndices;
+        FbxArray<unsigned int> lOrderedControlPoints;
+        lOrderedIndices.Resize(lIndexCount);
+        lOrderedControlPoints.Resize(lIndexCount);
+        int lCache[VERTEX_CACHE_SIZE + TRIANGLE_VERTEX_COUNT];
+        int lCacheCount = 0;
+        // Where to look for a triangle left when none is around the cache.
+        int lNextTriangle = 0;
+        for (int lOrderedCount = 0; lOrderedCount < pTriangleCount; ++lOrderedCount)
+        {
+            if (lBestTriangle < 0)
+            {
+                while (lOrdered[lNextTriangle])
+                {
+                    ++lNextTriangle;
+                }
+                lBestTriangle = lNextTriangle;
+            }
+
+            const unsigned int * lTriangleIndices = lIndices + lBestTriangle * TRIANGLE_VERTEX_COUNT;
+            memcpy(lOrderedIndices.GetArray() + lOrderedCount * TRIANGLE_VERTEX_COUNT, lTriangleIndices,
+                TRIANGLE_VERTEX_COUNT * sizeof(unsigned int));
+            memcpy(lOrderedControlPoints.GetArray() + lOrderedCount * TRIANGLE_VERTEX_COUNT,
+                lControlPoints + lBestTriangle * TRIANGLE_VERTEX_COUNT, TRIANGLE_VERTEX_COUNT * sizeof(unsigned int));
+            lOrdered[lBestTriangle] = true;
+
+            // The vertices of the triangle move to the front of the cache, and lose it.
+            int lNewCache[VERTEX_CACHE_SIZE + TRIANGLE_VERTEX_COUNT];
+            int lNewCacheCount = 0;
+            for (int lCorner = 0; lCorner < TRIANGLE_VERTEX_COUNT; ++lCorner)
+            {
+                const int lVertex = lTriangleIndices[lCorner];
+                int * lTriangles = lVertexTriangles.GetArray() + lFirstTriangles[lVertex];
+                for (int lIndex = 0; lIndex < lValences[lVertex]; ++lIndex)
+                {
+                    if (lTriangles[lIndex] == lBestTriangle)
+                    {
+                        lTriangles[lIndex] = lTriangles[--lValences[lVertex]];
+                        break;
+                    }
+                }
+
+                if (std::find(lNewCache, lNewCache + lNewCacheCount, lVertex) == lNewCache + lNewCacheCount)
+                    lNewCache[lNewCacheCount++] = lVertex;
+            }
+            const int lTriangleVertexCount = lNewCacheCount;
+            for (int lIndex = 0; lIndex < lCacheCount; ++lIndex)
+            {
+                const int lVertex = lCache[lIndex];
+                if (std::find(lNewCache, lNewCache + lTriangleVertexCount, lVertex) == lNewCache + lTriangleVertexCount)
+                    lNewCache[lNewCacheCount++] = lVertex;
+            }
+
+            // Score the vertices again, the ones pushed out of the cache too, then the
+            // triangles left around them.
+            for (int lIndex = 0; lIndex < lNewCacheCount; ++lIndex)
+            {
+                const int lVertex = lNewCache[lIndex];
+                lCachePositions[lVertex] = lIndex < VERTEX_CACHE_SIZE ? lIndex : -1;
+                lVertexScores[lVertex] = GetVertexCacheScore(lCachePositions[lVertex], lValences[lVertex]);
+            }
+            lBestTriangle = -1;
+            lBestScore = -1.0f;
+            for (int lIndex = 0; lIndex < lNewCacheCount; ++lIndex)
+            {
+                const int lVertex = lNewCache[lIndex];
+                const int * lTriangles = lVertexTriangles.GetArray() + lFirstTriangles[lVertex];
+                for (int lTriangleIndex = 0; lTriangleIndex < lValences[lVertex]; ++lTriangleIndex)
+                {
+                    const unsigned int * lOtherIndices = lIndices + lTriangles[lTriangleIndex] * TRIANGLE_VERTEX_COUNT;
+                    const float lScore = lVertexScores[lOtherIndices[0]] + lVertexScores[lOtherIndices[1]] +
+                        lVertexScores[lOtherIndices[2]];
+                    if (lScore > lBestScore)
+                    {
+                        lBestTriangle = lTriangles[lTriangleIndex];
+                        lBestScore = lScore;
+                    }
+                }
+            }
+
+            lCacheCount = FbxMin(lNewCacheCount, VERTEX_CACHE_SIZE);
+            memcpy(lCache, lNewCache, lCacheCount * sizeof(int));
+        }
+
+        memcpy(lIndices, lOrderedIndices.GetArray(), lIndexCount * sizeof(unsigned int));
+        memcpy(lControlPoints, lOrderedControlPoints.GetArray(), lIndexCount * sizeof(unsigned int));
+    }
+
+    // Move the pStride floats of every vertex to its new place in pNewVertices.
+    void ReorderVertexAttribute(float * pValues, int pStride, const int * pNewVertices, int pVertexCount)
+    {
+        FbxArray<float> lValues;
+        lValues.Resize(pVertexCount * pStride);
+        memcpy(lValues.GetArray(), pValues, pVertexCount * pStride * sizeof(float));
+        for (int lVertex = 0; lVertex < pVertexCount; ++lVertex)
+        {
+            memcpy(pValues + pNewVertices[lVertex] * pStride, lValues.GetArray() + lVertex * pStride,
+                pStride * sizeof(float));
+        }
+    }
+
+    // The bone indices and weights are matrices, they take a location for every column.
+    enum
+    {
+        SKIN_POSITION_ATTRIBUTE,
+        BONE_INDEX_ATTRIBUTE,
+        BONE_WEIGHT_ATTRIBUTE = BONE_INDEX_ATTRIBUTE + SKIN_INFLUENCE_COLUMN_COUNT,
+    };
+
+    // Same deformation as SkinCache::ComputeLinearDeformation: the palette holds the rows of
+    // every bone matrix, from paletteOffset, the weight missing to one keeps the bind position.
+    const char * SKIN_VERTEX_SHADER =
+        "#version 140\n"
+        "uniform samplerBuffer palette;\n"
+        "uniform int paletteOffset;\n"
+        "in vec4 position;\n"
+        "in mat2x4 boneIndices;\n"
+        "in mat2x4 boneWeights;\n"
+        "out vec4 skinnedPosition;\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 sum = vec4(0.0);\n"
+        "    float weightSum = 0.0;\n"
+        "    for (int column = 0; column < 2; ++column)\n"
+        "    {\n"
+        "        for (int i = 0; i < 4; ++i)\n"
+        "        {\n"
+        "            float weight = boneWeights[column][i];\n"
+        "            if (weight == 0.0)\n"
+        "                continue;\n"
+        "            int row = paletteOffset + int(boneIndices[column][i]) * 4;\n"
+        "            sum += weight * (position.x * texelFetch(palette, row) +\n"
+        "                position.y * texelFetch(palette, row + 1) +\n"
+        "                position.z * texelFetch(palette, row + 2) + texelFetch(palette, row + 3));\n"
+        "            weightSum += weight;\n"
+        "        }\n"
+        "    }\n"
+        "    skinnedPosition = vec4(sum.xyz + position.xyz * (1.0 - weightSum), 1.0);\n"
+        "    gl_Position = skinnedPosition;\n"
+        "}\n";
+
+    // Shared by all the meshes skinned on the GPU, created with the first one and
+    // released with the context.
+    GLuint gSkinProgram = 0;
+    bool gSkinProgramFailed = false;
+    GLint gPaletteOffsetLocation = -1;
+
+    GLuint GetSkinProgram()
+    {
+        if (gSkinProgram || gSkinProgramFailed)
+            return gSkinProgram;
+
+        GLuint lShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(lShader, 1, &SKIN_VERTEX_SHADER, NULL);
+        glCompileShader(lShader);
+
+        GLuint lProgram = glCreateProgram();
+        glAttachShader(lProgram, lShader);
+        glBindAttribLocation(lProgram, SKIN_POSITION_ATTRIBUTE, "position");
+        glBindAttribLocation(lProgram, BONE_INDEX_ATTRIBUTE, "boneIndices");
+        glBindAttribLocation(lProgram, BONE_WEIGHT_ATTRIBUTE, "boneWeights");
+        const GLchar * lVaryings[] = {"skinnedPosition"};
+        glTransformFeedbackVaryings(lProgram, 1, lVaryings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(lProgram);
+        glDeleteShader(lShader);
+
+        GLint lLinked = GL_FALSE;
+        glGetProgramiv(lProgram, GL_LINK_STATUS, &lLinked);
+        if (!lLinked)
+        {
+            GLchar lLog[1024];
+            glGetProgramInfoLog(lProgram, sizeof(lLog), NULL, lLog);
+            FBXSDK_printf("GPU skinning is not available: %s\n", lLog);
+            glDeleteProgram(lProgram);
+            gSkinProgramFailed = true;
+            return 0;
+        }
+
+        glUseProgram(lProgram);
+        glUniform1i(glGetUniformLocation(lProgram, "palette"), 0);
+        glUseProgram(0);
+        gPaletteOffsetLocation = glGetUniformLocation(lProgram, "paletteOffset");
+
+        gSkinProgram = lProgram;
+        return gSkinProgram;
+    }
+
+    // Sixteen floats for every instance transform.
+    const int MATRIX_STRIDE = 16;
+    // Lights looked at by the instance shader, as many as the fixed pipeline guarantees.
+    const int INSTANCE_LIGHT_COUNT = 8;
+
+    // Place every copy with its own matrix, then light it per vertex as the fixed pipeline
+    // does with the current material: infinite viewer, one sided, GL_NORMALIZE.
+    const char * INSTANCE_VERTEX_SHADER =
+        "#version 120\n"
+        "attribute mat4 instanceTransform;\n"
+        "uniform bool lighting;\n"
+        "uniform bool lightEnabled[8];\n"
+        "void main()\n"
+        "{\n"
+        "    vec4 eyePosition = gl_ModelViewMatrix * (instanceTransform * gl_Vertex);\n"
+        "    gl_Position = gl_ProjectionMatrix * eyePosition;\n"
+        "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+        "    if (!lighting)\n"
+        "    {\n"
+        "        gl_FrontColor = gl_Color;\n"
+        "        return;\n"
+        "    }\n"
+        "    // The cofactors are the inverse transpose up to the scale, dropped by normalize.\n"
+        "    mat3 m = mat3(gl_ModelViewMatrix) * mat3(instanceTransform);\n"
+        "    mat3 cofactors = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));\n"
+        "    vec3 normal = normalize(cofactors * gl_Normal);\n"
+        "    vec4 color = gl_FrontLightModelProduct.sceneColor;\n"
+        "    for (int i = 0; i < 8; ++i)\n"
+        "    {\n"
+        "        if (!lightEnabled[i])\n"
+        "            continue;\n"
+        "        vec3 toLight = gl_LightSource[i].position.xyz;\n"
+        "        float attenuation = 1.0;\n"
+        "        if (gl_LightSource[i].position.w != 0.0)\n"
+        "        {\n"
+        "            toLight -= eyePosition.xyz;\n"
+        "            float lightDistance = length(toLight);\n"
+        "            attenuation = 1.0 / (gl_LightSource[i].constantAttenuation +\n"
+        "                gl_LightSource[i].linearAttenuation * lightDistance +\n"
+        "                gl_LightSource[i].quadraticAttenuation * lightDistance * lightDistance);\n"
+        "            if (gl_LightSource[i].spotCutoff != 180.0)\n"
+        "            {\n"
+        "                float spot = dot(-normalize(toLight), normalize(gl_LightSource[i].spotDirection));\n"
+        "                attenuation *= spot >= gl_LightSource[i].spotCosCutoff ?\n"
+        "                    pow(max(spot, 0.0), gl_LightSource[i].spotExponent) : 0.0;\n"
+        "            }\n"
+        "        }\n"
+        "        toLight = normalize(toLight);\n"
+        "        float diffuse = max(dot(normal, toLight), 0.0);\n"
+        "        vec4 light = gl_FrontLightProduct[i].ambient + diffuse * gl_FrontLightProduct[i].diffuse;\n"
+        "        if (diffuse > 0.0)\n"
+        "        {\n"
+        "            float specular = max(dot(normal, normalize(toLight + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+        "            light += (gl_FrontMaterial.shininess > 0.0 ? pow(specular, gl_FrontMaterial.shininess) : 1.0) *\n"
+        "                gl_FrontLightProduct[i].specular;\n"
+        "        }\n"
+        "        color += attenuation * light;\n"
+        "    }\n"
+        "    gl_FrontColor = vec4(color.rgb, gl_FrontMaterial.diffuse.a);\n"
+        "}\n";
+
+    // The texture modulates the lit color, as GL_MODULATE does.
+    const char * INSTANCE_FRAGMENT_SHADER =
+        "#version 120\n"
+        "uniform bool hasTexture;\n"
+        "uniform sampler2D diffuseTexture;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = hasTexture ? gl_Color * texture2D(diffuseTexture, gl_TexCoord[0].st) : gl_Color;\n"
+        "}\n";
+
+    // Shared by all the instanced draws, created with the first one and released with the
+    // context, as the transforms buffer, rewritten by every instanced draw.
+    GLuint gInstanceProgram = 0;
+    bool gInstanceProgramFailed = false;
+    GLint gInstanceTransformLocation = -1;
+    GLint gLightingLocation = -1;
+    GLint gLightEnabledLocation = -1;
+    GLint gHasTextureLocation = -1;
+    GLuint gInstanceBuffer = 0;
+
+    GLuint GetInstanceProgram()
+    {
+        if (gInstanceProgram || gInstanceProgramFailed)
+            return gInstanceProgram;
+
+        GLuint lVertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(lVertexShader, 1, &INSTANCE_VERTEX_SHADER, NULL);
+        glCompileShader(lVertexShader);
+        GLuint lFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(lFragmentShader, 1, &INSTANCE_FRAGMENT_SHADER, NULL);
+        glCompileShader(lFragmentShader);
+
+        GLuint lProgram = glCreateProgram();
+        glAttachShader(lProgram, lVertexShader);
+        glAttachShader(lProgram, lFragmentShader);
+        glLinkProgram(lProgram);
+        glDeleteShader(lVertexShader);
+        glDeleteShader(lFragmentShader);
+
+        GLint lLinked = GL_FALSE;
+        glGetProgramiv(lProgram, GL_LINK_STATUS, &lLinked);
+        if (!lLinked)
+        {
+            GLchar lLog[1024];
+            glGetProgramInfoLog(lProgram, sizeof(lLog), NULL, lLog);
+            FBXSDK_printf("Instanced drawing is not available: %s\n", lLog);
+            glDeleteProgram(lProgram);
+            gInstanceProgramFailed = true;
+            return 0;
+        }
+
+        glUseProgram(lProgram);
+        glUniform1i(glGetUniformLocation(lProgram, "diffuseTexture"), 0);
+        glUseProgram(0);
+        gInstanceTransformLocation = glGetAttribLocation(lProgram, "instanceTransform");
+        gLightingLocation = glGetUniformLocation(lProgram, "lighting");
+        gLightEnabledLocation = glGetUniformLocation(lProgram, "lightEnabled");
+        gHasTextureLocation = glGetUniformLocation(lProgram, "hasTexture");
+
+        glGenBuffers(1, &gInstanceBuffer);
+
+        gInstanceProgram = lProgram;
+        return gInstanceProgram;
+    }
+
+    // The VBO meshes baked by Initialize, which others may share.
+    FbxArray<VBOMesh *> gSharedGeometries;
+
+    bool IsSameIndexArray(const FbxLayerElementArrayTemplate<int> & pFirst, const FbxLayerElementArrayTemplate<int> & pSecond)
+    {
+        if (pFirst.GetCount() != pSecond.GetCount())
+            return false;
+        for (int lIndex = 0; lIndex < pFirst.GetCount(); ++lIndex)
+        {
+            if (pFirst.GetAt(lIndex) != pSecond.GetAt(lIndex))
+                return false;
+        }
+        return true;
+    }
+
+    // Whether two normal or UV elements give the same value to every vertex.
+    template <class Type>
+    bool IsSameElement(const FbxLayerElementTemplate<Type> * pFirst, const FbxLayerElementTemplate<Type> * pSecond)
+    {
+        if (!pFirst || !pSecond)
+            return pFirst == pSecond;
+        if (pFirst->GetMappingMode() != pSecond->GetMappingMode() ||
+            pFirst->GetReferenceMode() != pSecond->GetReferenceMode())
+            return false;
+
+        const FbxLayerElementArrayTemplate<Type> & lFirstArray = pFirst->GetDirectArray();
+        const FbxLayerElementArrayTemplate<Type> & lSecondArray = pSecond->GetDirectArray();
+        if (lFirstArray.GetCount() != lSecondArray.GetCount())
+            return false;
+        for (int lIndex = 0; lIndex < lFirstArray.GetCount(); ++lIndex)
+        {
+            if (lFirstArray.GetAt(lIndex) != lSecondArray.GetAt(lIndex))
+                return false;
+        }
+
+        return pFirst->GetReferenceMode() == FbxLayerElement::eDirect ||
+            IsSameIndexArray(pFirst->GetIndexArray(), pSecond->GetIndexArray());
+    }
+
+    // Whether two meshes have the same clusters, bound to the same control points.
+    bool IsSameSkin(const FbxMesh * pFirst, const FbxMesh * pSecond)
+    {
+        const int lSkinCount = pFirst->GetDeformerCount(FbxDeformer::eSkin);
+        if (lSkinCount != pSecond->GetDeformerCount(FbxDeformer::eSkin))
+            return false;
+
+        for (int lSkinIndex = 0; lSkinIndex < lSkinCount; ++lSkinIndex)
+        {
+            const FbxSkin * lFirstSkin = static_cast<const FbxSkin *>(pFirst->GetDeformer(lSkinIndex, FbxDeformer::eSkin));
+            const FbxSkin * lSecondSkin = static_cast<const FbxSkin *>(pSecond->GetDeformer(lSkinIndex, FbxDeformer::eSkin));
+            const int lClusterCount = lFirstSkin->GetClusterCount();
+            if (lFirstSkin->GetSkinningType() != lSecondSkin->GetSkinningType() ||
+                lClusterCount != lSecondSkin->GetClusterCount())
+                return false;
+
+            for (int lClusterIndex = 0; lClusterIndex < lClusterCount; ++lClusterIndex)
+            {
+                const FbxCluster * lFirstCluster = lFirstSkin->GetCluster(lClusterIndex);
+                const FbxCluster * lSecondCluster = lSecondSkin->GetCluster(lClusterIndex);
+                const int lIndexCount = lFirstCluster->GetControlPointIndicesCount();
+                if (lFirstCluster->GetLinkMode() != lSecondCluster->GetLinkMode() ||
+                    lIndexCount != lSecondCluster->GetControlPointIndicesCount())
+                    return false;
+                if (lIndexCount && (
+                    memcmp(lFirstCluster->GetControlPointIndices(), lSecondCluster->GetControlPointIndices(), lIndexCount * sizeof(int)) ||
+                    memcmp(lFirstCluster->GetControlPointWeights(), lSecondCluster->GetControlPointWeights(), lIndexCount * sizeof(double))))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether two meshes bake the same buffers. The copies of skinned meshes are found
+    // too, their positions only differ once deformed; meshes with other deformers are
+    // never shared.
+    bool IsSameGeometry(const FbxMesh * pFirst, const FbxMesh * pSecond)
+    {
+        const int lControlPointCount = pFirst->GetControlPointsCount();
+        const int lPolygonVertexCount = pFirst->GetPolygonVertexCount();
+        if (lControlPointCount != pSecond->GetControlPointsCount() ||
+            pFirst->GetPolygonCount() != pSecond->GetPolygonCount() ||
+            lPolygonVertexCount != pSecond->GetPolygonVertexCount())
+            return false;
+
+        if (pFirst->GetDeformerCount(FbxDeformer::eVertexCache) || pSecond->GetDeformerCount(FbxDeformer::eVertexCache) ||
+            pFirst->GetShapeCount() || pSecond->GetShapeCount())
+            return false;
+
+        if (memcmp(pFirst->GetControlPoints(), pSecond->GetControlPoints(), lControlPointCount * sizeof(FbxVector4)) ||
+            memcmp(pFirst->GetPolygonVertices(), pSecond->GetPolygonVertices(), lPolygonVertexCount * sizeof(int)))
+            return false;
+
+        const FbxGeometryElementMaterial * lFirstMaterial = pFirst->GetElementMaterial();
+        const FbxGeometryElementMaterial * lSecondMaterial = pSecond->GetElementMaterial();
+        if (!lFirstMaterial != !lSecondMaterial)
+            return false;
+        if (lFirstMaterial && (lFirstMaterial->GetMappingMode() != lSecondMaterial->GetMappingMode() ||
+            !IsSameIndexArray(lFirstMaterial->GetIndexArray(), lSecondMaterial->GetIndexArray())))
+            return false;
+
+        if (pFirst->GetElementNormalCount() != pSecond->GetElementNormalCount() ||
+            (pFirst->GetElementNormalCount() && !IsSameElement(pFirst->GetElementNormal(0), pSecond->GetElementNormal(0))))
+            return false;
+
+        if (pFirst->GetElementUVCount() != pSecond->GetElementUVCount() ||
+            (pFirst->GetElementUVCount() && !IsSameElement(pFirst->GetElementUV(0), pSecond->GetElementUV(0))))
+            return false;
+
+        return IsSameSkin(pFirst, pSecond);
+    }
+
     const GLfloat DEFAULT_LIGHT_POSITION[] = {0.0f, 0.0f, 0.0f, 1.0f};
     const GLfloat DEFAULT_DIRECTION_LIGHT_POSITION[] = {0.0f, 0.0f, 1.0f, 0.0f};
     const GLfloat DEFAULT_SPOT_LIGHT_DIRECTION[] = {0.0f, 0.0f, -1.0f};
@@ -76,20 +682,55 @@ namespace
     }
 }
 
-VBOMesh::VBOMesh() : mHasNormal(false), mHasUV(false), mAllByControlPoint(true)
+VBOMesh::VBOMesh() : mLodCount(1), mHasNormal(false), mHasUV(false), mAllByControlPoint(true), mDeformed(false),
+    mSourceMesh(NULL), mSource(NULL), mReferenceCount(1),
+    mStreaming(false), mVertexBufferSize(0), mVertexRingIndex(0), mVertexRingMapped(false),
+    mSkinBoneCount(0), mPaletteTexture(0), mPaletteSlot(0), mPaletteSlotCount(1), mInstanceCount(0), mLod(0)
 {
     // Reset every VBO to zero, which means no buffer.
     for (int lVBOIndex = 0; lVBOIndex < VBO_COUNT; ++lVBOIndex)
     {
         mVBONames[lVBOIndex] = 0;
     }
+
+    for (int lRingIndex = 0; lRingIndex < VERTEX_RING_SIZE; ++lRingIndex)
+    {
+        mVertexRing[lRingIndex] = 0;
+        mVertexRingFences[lRingIndex] = NULL;
+    }
 }
 
 VBOMesh::~VBOMesh()
 {
-    // Delete VBO objects, zeros are ignored automatically.
-    glDeleteBuffers(VBO_COUNT, mVBONames);
-	
+    if (mSource)
+    {
+        // A copy only owns its positions, the first buffer of the ring is the vertex VBO.
+        glDeleteBuffers(VERTEX_RING_SIZE, mVertexRing);
+    }
+    else
+    {
+        // Delete VBO objects, zeros are ignored automatically.
+        glDeleteBuffers(VBO_COUNT, mVBONames);
+
+        // The first buffer of the ring is the vertex VBO, already deleted.
+        glDeleteBuffers(VERTEX_RING_SIZE - 1, mVertexRing + 1);
+
+        if (mPaletteTexture)
+        {
+            glDeleteTextures(1, &mPaletteTexture);
+        }
+
+        gSharedGeometries.RemoveIt(this);
+    }
+
+    for (int lRingIndex = 0; lRingIndex < VERTEX_RING_SIZE; ++lRingIndex)
+    {
+        if (mVertexRingFences[lRingIndex])
+        {
+            glDeleteSync(mVertexRingFences[lRingIndex]);
+        }
+    }
+
 //	FbxArrayDelete(mSubMeshes);
 
 	for(int i=0; i < mSubMeshes.GetCount(); i++)
@@ -99,6 +740,10 @@ VBOMesh::~VBOMesh()
 	
 	mSubMeshes.Clear();
 
+    if (mSource)
+    {
+        Release(mSource);
+    }
 }
 
 bool VBOMesh::Initialize(const FbxMesh *pMesh)
@@ -197,7 +842,8 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
         }
     }
 
-    // Allocate the array memory, by control point or by polygon vertex.
+    // Allocate the array memory, by control point or by polygon vertex; the polygon vertices
+    // sharing all their attributes are welded, the count is lowered to the vertices left.
     int lPolygonVertexCount = pMesh->GetControlPointsCount();
     if (!mAllByControlPoint)
     {
@@ -205,6 +851,8 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
     }
     float * lVertices = new float[lPolygonVertexCount * VERTEX_STRIDE];
     unsigned int * lIndices = new unsigned int[lPolygonCount * TRIANGLE_VERTEX_COUNT];
+    // The control point of every index, to find the edges shared by the triangles.
+    unsigned int * lIndexControlPoints = new unsigned int[lPolygonCount * TRIANGLE_VERTEX_COUNT];
     float * lNormals = NULL;
     if (mHasNormal)
     {
@@ -220,8 +868,20 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
         lUVName = lUVNames[0];
     }
 
-    // Populate the array with vertex attribute, if by control point.
+    // The bounds of the mesh, to cull it.
     const FbxVector4 * lControlPoints = pMesh->GetControlPoints();
+    for (int lIndex = 0; lIndex < pMesh->GetControlPointsCount(); ++lIndex)
+    {
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            if (lIndex == 0 || lControlPoints[lIndex][lAxis] < mBoundsMin[lAxis])
+                mBoundsMin[lAxis] = lControlPoints[lIndex][lAxis];
+            if (lIndex == 0 || lControlPoints[lIndex][lAxis] > mBoundsMax[lAxis])
+                mBoundsMax[lAxis] = lControlPoints[lIndex][lAxis];
+        }
+    }
+
+    // Populate the array with vertex attribute, if by control point.
     FbxVector4 lCurrentVertex;
     FbxVector4 lCurrentNormal;
     FbxVector2 lCurrentUV;
@@ -276,6 +936,26 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
 
     }
 
+    // Find the vertex with the same control point, normal and UV as a polygon vertex, in a
+    // table with open addressing twice as large as the polygon vertices.
+    FbxArray<int> lWeldTable;
+    unsigned int lWeldMask = 0;
+    if (!mAllByControlPoint)
+    {
+        unsigned int lWeldTableSize = 1;
+        while (lWeldTableSize < static_cast<unsigned int>(lPolygonVertexCount) * 2)
+        {
+            lWeldTableSize <<= 1;
+        }
+        lWeldTable.Resize(lWeldTableSize);
+        for (unsigned int lSlot = 0; lSlot < lWeldTableSize; ++lSlot)
+        {
+            lWeldTable[lSlot] = -1;
+        }
+        lWeldMask = lWeldTableSize - 1;
+        mVertexControlPoints.Resize(lPolygonVertexCount);
+    }
+
     int lVertexCount = 0;
     for (int lPolygonIndex = 0; lPolygonIndex < lPolygonCount; ++lPolygonIndex)
     {
@@ -292,16 +972,16 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
         for (int lVerticeIndex = 0; lVerticeIndex < TRIANGLE_VERTEX_COUNT; ++lVerticeIndex)
         {
             const int lControlPointIndex = pMesh->GetPolygonVertex(lPolygonIndex, lVerticeIndex);
+            lIndexControlPoints[lIndexOffset + lVerticeIndex] = static_cast<unsigned int>(lControlPointIndex);
 
             if (mAllByControlPoint)
             {
                 lIndices[lIndexOffset + lVerticeIndex] = static_cast<unsigned int>(lControlPointIndex);
             }
-            // Populate the array with vertex attribute, if by polygon vertex.
+            // Populate the array with vertex attribute, if by polygon vertex. The attributes
+            // are written after the vertices so far, and kept if no vertex has the same.
             else
             {
-                lIndices[lIndexOffset + lVerticeIndex] = static_cast<unsigned int>(lVertexCount);
-
                 lCurrentVertex = lControlPoints[lControlPointIndex];
                 lVertices[lVertexCount * VERTEX_STRIDE] = static_cast<float>(lCurrentVertex[0]);
                 lVertices[lVertexCount * VERTEX_STRIDE + 1] = static_cast<float>(lCurrentVertex[1]);
@@ -323,18 +1003,219 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
                     lUVs[lVertexCount * UV_STRIDE] = static_cast<float>(lCurrentUV[0]);
                     lUVs[lVertexCount * UV_STRIDE + 1] = static_cast<float>(lCurrentUV[1]);
                 }
+
+                const float * lNormal = lNormals ? lNormals + lVertexCount * NORMAL_STRIDE : NULL;
+                const float * lUV = lUVs ? lUVs + lVertexCount * UV_STRIDE : NULL;
+                unsigned int lSlot = HashVertex(lControlPointIndex, lNormal, lUV) & lWeldMask;
+                for (; lWeldTable[lSlot] >= 0; lSlot = (lSlot + 1) & lWeldMask)
+                {
+                    const int lVertex = lWeldTable[lSlot];
+                    if (mVertexControlPoints[lVertex] == static_cast<unsigned int>(lControlPointIndex) &&
+                        (!lNormal || memcmp(lNormals + lVertex * NORMAL_STRIDE, lNormal, NORMAL_STRIDE * sizeof(float)) == 0) &&
+                        (!lUV || memcmp(lUVs + lVertex * UV_STRIDE, lUV, UV_STRIDE * sizeof(float)) == 0))
+                    {
+                        break;
+                    }
+                }
+                if (lWeldTable[lSlot] < 0)
+                {
+                    lWeldTable[lSlot] = lVertexCount;
+                    mVertexControlPoints[lVertexCount] = static_cast<unsigned int>(lControlPointIndex);
+                    ++lVertexCount;
+                }
+                lIndices[lIndexOffset + lVerticeIndex] = static_cast<unsigned int>(lWeldTable[lSlot]);
             }
-            ++lVertexCount;
         }
         mSubMeshes[lMaterialIndex]->TriangleCount += 1;
     }
+    if (!mAllByControlPoint)
+    {
+        lPolygonVertexCount = lVertexCount;
+        mVertexControlPoints.Resize(lVertexCount);
+    }
+
+    // Order the triangles of every material for the post-transform cache, then number the
+    // welded vertices in the order they are first drawn, for the fetches.
+    for (int lIndex = 0; lIndex < mSubMeshes.GetCount(); ++lIndex)
+    {
+        OptimizeTriangleOrder(lIndices, lIndexControlPoints, mSubMeshes[lIndex]->IndexOffset / TRIANGLE_VERTEX_COUNT,
+            mSubMeshes[lIndex]->TriangleCount, lPolygonVertexCount);
+    }
+    if (!mAllByControlPoint)
+    {
+        FbxArray<int> lNewVertices;
+        lNewVertices.Resize(lVertexCount);
+        for (int lVertex = 0; lVertex < lVertexCount; ++lVertex)
+        {
+            lNewVertices[lVertex] = -1;
+        }
+        int lNewVertexCount = 0;
+        for (int lIndex = 0; lIndex < lPolygonCount * TRIANGLE_VERTEX_COUNT; ++lIndex)
+        {
+            if (lNewVertices[lIndices[lIndex]] < 0)
+            {
+                lNewVertices[lIndices[lIndex]] = lNewVertexCount++;
+            }
+            lIndices[lIndex] = static_cast<unsigned int>(lNewVertices[lIndices[lIndex]]);
+        }
+
+        ReorderVertexAttribute(lVertices, VERTEX_STRIDE, lNewVertices.GetArray(), lVertexCount);
+        if (lNormals)
+        {
+            ReorderVertexAttribute(lNormals, NORMAL_STRIDE, lNewVertices.GetArray(), lVertexCount);
+        }
+        if (lUVs)
+        {
+            ReorderVertexAttribute(lUVs, UV_STRIDE, lNewVertices.GetArray(), lVertexCount);
+        }
+        for (int lIndex = 0; lIndex < lPolygonCount * TRIANGLE_VERTEX_COUNT; ++lIndex)
+        {
+            mVertexControlPoints[lIndices[lIndex]] = lIndexControlPoints[lIndex];
+        }
+    }
+
+    // The coarser levels of detail, the indices of their material groups one after the other.
+    FbxArray<unsigned int> lLodIndices;
+    FbxArray<unsigned int> lLodControlPoints;
+    if (lPolygonCount >= LOD_MIN_TRIANGLE_COUNT)
+    {
+        // The control point of every vertex, and the material group of every triangle.
+        FbxArray<unsigned int> lVertexControlPoints;
+        lVertexControlPoints.Resize(lPolygonVertexCount);
+        for (int lIndex = 0; lIndex < lPolygonCount * TRIANGLE_VERTEX_COUNT; ++lIndex)
+        {
+            lVertexControlPoints[lIndices[lIndex]] = lIndexControlPoints[lIndex];
+        }
+        FbxArray<int> lTriangleGroups;
+        lTriangleGroups.Resize(lPolygonCount);
+        for (int lIndex = 0; lIndex < mSubMeshes.GetCount(); ++lIndex)
+        {
+            const int lFirstTriangle = mSubMeshes[lIndex]->IndexOffset / TRIANGLE_VERTEX_COUNT;
+            for (int lTriangle = 0; lTriangle < mSubMeshes[lIndex]->TriangleCount; ++lTriangle)
+            {
+                lTriangleGroups[lFirstTriangle + lTriangle] = lIndex;
+            }
+        }
+
+        MeshSimplifier lSimplifier;
+        lSimplifier.Initialize(lControlPoints, pMesh->GetControlPointsCount(), lVertexControlPoints.GetArray(),
+            lIndices, lTriangleGroups.GetArray(), lPolygonCount);
+
+        // A control point whose vertices differ by their normal or UV stays in place.
+        if (!mAllByControlPoint)
+        {
+            FbxArray<int> lFirstVertices;
+            lFirstVertices.Resize(pMesh->GetControlPointsCount());
+            for (int lIndex = 0; lIndex < lFirstVertices.GetCount(); ++lIndex)
+            {
+                lFirstVertices[lIndex] = -1;
+            }
+            for (int lVertex = 0; lVertex < lPolygonVertexCount; ++lVertex)
+            {
+                const int lControlPoint = lVertexControlPoints[lVertex];
+                const int lFirstVertex = lFirstVertices[lControlPoint];
+                if (lFirstVertex < 0)
+                {
+                    lFirstVertices[lControlPoint] = lVertex;
+                }
+                else if ((lNormals && memcmp(lNormals + lVertex * NORMAL_STRIDE, lNormals + lFirstVertex * NORMAL_STRIDE,
+                            NORMAL_STRIDE * sizeof(float)) != 0) ||
+                         (lUVs && memcmp(lUVs + lVertex * UV_STRIDE, lUVs + lFirstVertex * UV_STRIDE,
+                            UV_STRIDE * sizeof(float)) != 0))
+                {
+                    lSimplifier.LockPoint(lControlPoint);
+                }
+            }
+        }
+
+        FbxArray<bool> lUsedControlPoints;
+        lUsedControlPoints.Resize(pMesh->GetControlPointsCount());
+        int lPreviousTriangleCount = lSimplifier.GetTriangleCount();
+        for (int lLod = 1; lLod < MAX_LOD_COUNT; ++lLod)
+        {
+            lSimplifier.Simplify(lPolygonCount >> lLod);
+            if (lSimplifier.GetTriangleCount() > lPreviousTriangleCount * LOD_MAX_TRIANGLE_RATIO)
+                break;
+            lPreviousTriangleCount = lSimplifier.GetTriangleCount();
+
+            for (int lIndex = 0; lIndex < lUsedControlPoints.GetCount(); ++lIndex)
+            {
+                lUsedControlPoints[lIndex] = false;
+            }
+            for (int lIndex = 0; lIndex < mSubMeshes.GetCount(); ++lIndex)
+            {
+                SubMesh lSubMesh;
+                lSubMesh.IndexOffset = lPolygonCount * TRIANGLE_VERTEX_COUNT + lLodIndices.GetCount();
+                const int lFirstTriangle = mSubMeshes[lIndex]->IndexOffset / TRIANGLE_VERTEX_COUNT;
+                for (int lTriangle = lFirstTriangle; lTriangle < lFirstTriangle + mSubMeshes[lIndex]->TriangleCount; ++lTriangle)
+                {
+                    if (!lSimplifier.IsTriangleAlive(lTriangle))
+                        continue;
+                    const unsigned int * lTriangleIndices = lSimplifier.GetTriangle(lTriangle);
+                    for (int lCorner = 0; lCorner < TRIANGLE_VERTEX_COUNT; ++lCorner)
+                    {
+                        const unsigned int lControlPoint = lVertexControlPoints[lTriangleIndices[lCorner]];
+                        lLodIndices.Add(lTriangleIndices[lCorner]);
+                        lLodControlPoints.Add(lControlPoint);
+                        lUsedControlPoints[lControlPoint] = true;
+                    }
+                    ++lSubMesh.TriangleCount;
+                }
+                OptimizeTriangleOrder(lLodIndices.GetArray(), lLodControlPoints.GetArray(),
+                    (lSubMesh.IndexOffset - lPolygonCount * TRIANGLE_VERTEX_COUNT) / TRIANGLE_VERTEX_COUNT,
+                    lSubMesh.TriangleCount, lPolygonVertexCount);
+                mLodSubMeshes.Add(lSubMesh);
+            }
+
+            // The control points to deform for this level.
+            for (int lIndex = 0; lIndex < lUsedControlPoints.GetCount(); ++lIndex)
+            {
+                if (!lUsedControlPoints[lIndex])
+                    continue;
+                if (mLodControlPointRanges[lLod].GetCount() &&
+                    mLodControlPointRanges[lLod][mLodControlPointRanges[lLod].GetCount() - 1] == lIndex)
+                {
+                    mLodControlPointRanges[lLod][mLodControlPointRanges[lLod].GetCount() - 1] = lIndex + 1;
+                }
+                else
+                {
+                    mLodControlPointRanges[lLod].Add(lIndex);
+                    mLodControlPointRanges[lLod].Add(lIndex + 1);
+                }
+            }
+            ++mLodCount;
+        }
+    }
 
     // Create VBOs
     glGenBuffers(VBO_COUNT, mVBONames);
 
+    // The positions of deformed meshes are rewritten every frame, in place.
+    const bool lHasDeformation = pMesh->GetDeformerCount(FbxDeformer::eVertexCache) > 0 ||
+        pMesh->GetShapeCount() > 0 || pMesh->GetDeformerCount(FbxDeformer::eSkin) > 0;
+    mDeformed = lHasDeformation;
+    mVertexBufferSize = lPolygonVertexCount * VERTEX_STRIDE * sizeof(float);
+    mVertexRing[0] = mVBONames[VERTEX_VBO];
+
     // Save vertex attributes into GPU
     glBindBuffer(GL_ARRAY_BUFFER, mVBONames[VERTEX_VBO]);
-    glBufferData(GL_ARRAY_BUFFER, lPolygonVertexCount * VERTEX_STRIDE * sizeof(float), lVertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, mVertexBufferSize, lVertices, lHasDeformation ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+
+    if (lHasDeformation)
+    {
+        // Stream through a ring of buffers if they can be mapped without synchronization,
+        // otherwise upload into the single buffer with glBufferSubData.
+        mStreaming = GLEW_ARB_map_buffer_range && GLEW_ARB_sync;
+        if (mStreaming)
+        {
+            glGenBuffers(VERTEX_RING_SIZE - 1, mVertexRing + 1);
+            for (int lRingIndex = 1; lRingIndex < VERTEX_RING_SIZE; ++lRingIndex)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, mVertexRing[lRingIndex]);
+                glBufferData(GL_ARRAY_BUFFER, mVertexBufferSize, lVertices, GL_STREAM_DRAW);
+            }
+        }
+    }
     delete [] lVertices;
 
     if (mHasNormal)
@@ -351,22 +1232,107 @@ bool VBOMesh::Initialize(const FbxMesh *pMesh)
         delete [] lUVs;
     }
     
+    const int lIndexCount = lPolygonCount * TRIANGLE_VERTEX_COUNT;
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVBONames[INDEX_VBO]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lPolygonCount * TRIANGLE_VERTEX_COUNT * sizeof(unsigned int), lIndices, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (lIndexCount + lLodIndices.GetCount()) * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, lIndexCount * sizeof(unsigned int), lIndices);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, lIndexCount * sizeof(unsigned int), lLodIndices.GetCount() * sizeof(unsigned int),
+        lLodIndices.GetArray());
+
+    // Draw the wireframe of a material with a single call of lines, each edge once.
+    FbxArray<Edge> lEdges;
+    FbxArray<unsigned int> lEdgeIndices;
+    for (int lIndex = 0; lIndex < mSubMeshes.GetCount(); ++lIndex)
+    {
+        SubMesh * lSubMesh = mSubMeshes[lIndex];
+        lSubMesh->EdgeOffset = lEdgeIndices.GetCount();
+        AppendUniqueEdges(lIndices, lIndexControlPoints, lSubMesh->IndexOffset / TRIANGLE_VERTEX_COUNT,
+            lSubMesh->TriangleCount, lEdges, lEdgeIndices);
+        lSubMesh->EdgeCount = (lEdgeIndices.GetCount() - lSubMesh->EdgeOffset) / 2;
+    }
+    for (int lIndex = 0; lIndex < mLodSubMeshes.GetCount(); ++lIndex)
+    {
+        SubMesh & lSubMesh = mLodSubMeshes[lIndex];
+        lSubMesh.EdgeOffset = lEdgeIndices.GetCount();
+        AppendUniqueEdges(lLodIndices.GetArray(), lLodControlPoints.GetArray(), (lSubMesh.IndexOffset - lIndexCount) / TRIANGLE_VERTEX_COUNT,
+            lSubMesh.TriangleCount, lEdges, lEdgeIndices);
+        lSubMesh.EdgeCount = (lEdgeIndices.GetCount() - lSubMesh.EdgeOffset) / 2;
+    }
     delete [] lIndices;
+    delete [] lIndexControlPoints;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVBONames[EDGE_INDEX_VBO]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lEdgeIndices.GetCount() * sizeof(unsigned int), lEdgeIndices.GetArray(), GL_STATIC_DRAW);
+
+    // The meshes of the same geometry baked next share these buffers.
+    mSourceMesh = pMesh;
+    gSharedGeometries.Add(this);
 
     return true;
 }
 
+VBOMesh * VBOMesh::FindSameGeometry(const FbxMesh * pMesh)
+{
+    for (int lIndex = 0; lIndex < gSharedGeometries.GetCount(); ++lIndex)
+    {
+        if (IsSameGeometry(gSharedGeometries[lIndex]->mSourceMesh, pMesh))
+            return gSharedGeometries[lIndex];
+    }
+    return NULL;
+}
+
+bool VBOMesh::InitializeShared(const FbxMesh * pMesh, VBOMesh * pSource)
+{
+    mSource = pSource;
+    mSource->AddReference();
+
+    mHasNormal = pSource->mHasNormal;
+    mHasUV = pSource->mHasUV;
+    mAllByControlPoint = pSource->mAllByControlPoint;
+    mDeformed = pSource->mDeformed;
+    for (int lIndex = 0; lIndex < pSource->mSubMeshes.GetCount(); ++lIndex)
+    {
+        mSubMeshes.Add(new SubMesh(*pSource->mSubMeshes[lIndex]));
+    }
+    for (int lVBOIndex = 0; lVBOIndex < VBO_COUNT; ++lVBOIndex)
+    {
+        mVBONames[lVBOIndex] = pSource->mVBONames[lVBOIndex];
+    }
+
+    // Deformed apart, through a ring of its own.
+    mVertexBufferSize = pSource->mVertexBufferSize;
+    mStreaming = pSource->mStreaming;
+    glGenBuffers(mStreaming ? VERTEX_RING_SIZE : 1, mVertexRing);
+    mVBONames[VERTEX_VBO] = mVertexRing[0];
+    for (int lRingIndex = 0; lRingIndex < (mStreaming ? VERTEX_RING_SIZE : 1); ++lRingIndex)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mVertexRing[lRingIndex]);
+        glBufferData(GL_ARRAY_BUFFER, mVertexBufferSize, NULL, GL_STREAM_DRAW);
+    }
+
+    // Drawn in the bind pose until deformed, as the source.
+    UpdateVertexPosition(pMesh, pMesh->GetControlPoints());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return true;
+}
+
+void VBOMesh::Release(VBOMesh * pMeshCache)
+{
+    if (--pMeshCache->mReferenceCount == 0)
+    {
+        delete pMeshCache;
+    }
+}
+
 void VBOMesh::UpdateVertexPosition(const FbxMesh * pMesh, const FbxVector4 * pVertices) const
 {
+    float * lVertices = BeginVertexPositionUpdate();
+
     // Convert to the same sequence with data in GPU.
-    float * lVertices = NULL;
-    int lVertexCount = 0;
     if (mAllByControlPoint)
     {
-        lVertexCount = pMesh->GetControlPointsCount();
-        lVertices = new float[lVertexCount * VERTEX_STRIDE];
+        const int lVertexCount = pMesh->GetControlPointsCount();
         for (int lIndex = 0; lIndex < lVertexCount; ++lIndex)
         {
             lVertices[lIndex * VERTEX_STRIDE] = static_cast<float>(pVertices[lIndex][0]);
@@ -377,56 +1343,310 @@ void VBOMesh::UpdateVertexPosition(const FbxMesh * pMesh, const FbxVector4 * pVe
     }
     else
     {
-        const int lPolygonCount = pMesh->GetPolygonCount();
-        lVertexCount = lPolygonCount * TRIANGLE_VERTEX_COUNT;
-        lVertices = new float[lVertexCount * VERTEX_STRIDE];
-
-        int lVertexCount = 0;
-        for (int lPolygonIndex = 0; lPolygonIndex < lPolygonCount; ++lPolygonIndex)
+        const FbxArray<unsigned int> & lVertexControlPoints = GetSharedGeometry()->mVertexControlPoints;
+        const int lVertexCount = lVertexControlPoints.GetCount();
+        for (int lIndex = 0; lIndex < lVertexCount; ++lIndex)
         {
-            for (int lVerticeIndex = 0; lVerticeIndex < TRIANGLE_VERTEX_COUNT; ++lVerticeIndex)
-            {
-                const int lControlPointIndex = pMesh->GetPolygonVertex(lPolygonIndex, lVerticeIndex);
-                lVertices[lVertexCount * VERTEX_STRIDE] = static_cast<float>(pVertices[lControlPointIndex][0]);
-                lVertices[lVertexCount * VERTEX_STRIDE + 1] = static_cast<float>(pVertices[lControlPointIndex][1]);
-                lVertices[lVertexCount * VERTEX_STRIDE + 2] = static_cast<float>(pVertices[lControlPointIndex][2]);
-                lVertices[lVertexCount * VERTEX_STRIDE + 3] = 1;
-                ++lVertexCount;
-            }
+            const int lControlPointIndex = lVertexControlPoints[lIndex];
+            lVertices[lIndex * VERTEX_STRIDE] = static_cast<float>(pVertices[lControlPointIndex][0]);
+            lVertices[lIndex * VERTEX_STRIDE + 1] = static_cast<float>(pVertices[lControlPointIndex][1]);
+            lVertices[lIndex * VERTEX_STRIDE + 2] = static_cast<float>(pVertices[lControlPointIndex][2]);
+            lVertices[lIndex * VERTEX_STRIDE + 3] = 1;
         }
     }
 
     // Transfer into GPU.
-    if (lVertices)
+    EndVertexPositionUpdate();
+}
+
+void VBOMesh::UpdateVertexPosition(const FbxMesh * pMesh, const float * pVertices) const
+{
+    float * lVertices = BeginVertexPositionUpdate();
+
+    if (mAllByControlPoint)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, mVBONames[VERTEX_VBO]);
-        glBufferData(GL_ARRAY_BUFFER, lVertexCount * VERTEX_STRIDE * sizeof(float), lVertices, GL_STATIC_DRAW);
-        delete [] lVertices;
+        // Already the same sequence as in GPU.
+        memcpy(lVertices, pVertices, mVertexBufferSize);
     }
+    else
+    {
+        const FbxArray<unsigned int> & lVertexControlPoints = GetSharedGeometry()->mVertexControlPoints;
+        const int lVertexCount = lVertexControlPoints.GetCount();
+        for (int lIndex = 0; lIndex < lVertexCount; ++lIndex)
+        {
+            memcpy(lVertices + lIndex * VERTEX_STRIDE, pVertices + lVertexControlPoints[lIndex] * VERTEX_STRIDE,
+                VERTEX_STRIDE * sizeof(float));
+        }
+    }
+
+    EndVertexPositionUpdate();
 }
 
-void VBOMesh::Draw(int pMaterialIndex, ShadingMode pShadingMode) const
+bool VBOMesh::InitializeSkin(const FbxMesh * pMesh, const SkinCache * pSkinCache)
 {
-    // Where to start.
-    GLsizei lOffset = mSubMeshes[pMaterialIndex]->IndexOffset * sizeof(unsigned int);
-    if ( pShadingMode == SHADING_MODE_SHADED)
+    // A copy has the same influences as its source, and writes its palette in a new slot
+    // of the palette buffer of the source.
+    if (mSource)
+    {
+        if (!mSource->HasSkin() || !pSkinCache || pSkinCache->GetBoneCount() != mSource->mSkinBoneCount)
+            return false;
+
+        mSkinBoneCount = mSource->mSkinBoneCount;
+        mPaletteTexture = mSource->mPaletteTexture;
+        mPaletteSlot = mSource->mPaletteSlotCount++;
+        glBindBuffer(GL_TEXTURE_BUFFER, mVBONames[PALETTE_VBO]);
+        glBufferData(GL_TEXTURE_BUFFER, mSource->mPaletteSlotCount * mSkinBoneCount * SkinCache::PALETTE_STRIDE * sizeof(float),
+            NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return true;
+    }
+
+    const int lControlPointCount = pMesh->GetControlPointsCount();
+    if (!GLEW_VERSION_3_1 || mVertexBufferSize == 0 || !pSkinCache ||
+        pSkinCache->GetLinkMode() == FbxCluster::eAdditive ||
+        pSkinCache->GetVertexCount() != lControlPointCount ||
+        pSkinCache->GetMaxInfluenceCount() > SKIN_INFLUENCE_COUNT || GetSkinProgram() == 0)
+    {
+        return false;
+    }
+
+    // The control point of every vertex in the VBO.
+    const int lVertexCount = mVertexBufferSize / static_cast<int>(VERTEX_STRIDE * sizeof(float));
+    FbxArray<int> lControlPoints;
+    lControlPoints.Resize(lVertexCount);
+    if (mAllByControlPoint)
+    {
+        for (int lIndex = 0; lIndex < lVertexCount; ++lIndex)
+        {
+            lControlPoints[lIndex] = lIndex;
+        }
+    }
+    else
+    {
+        for (int lIndex = 0; lIndex < lVertexCount; ++lIndex)
+        {
+            lControlPoints[lIndex] = mVertexControlPoints[lIndex];
+        }
+    }
+
+    FbxArray<float> lPositions;
+    FbxArray<float> lBoneIndices;
+    FbxArray<float> lBoneWeights;
+    lPositions.Resize(lVertexCount * VERTEX_STRIDE);
+    lBoneIndices.Resize(lVertexCount * SKIN_INFLUENCE_COUNT);
+    lBoneWeights.Resize(lVertexCount * SKIN_INFLUENCE_COUNT);
+
+    const FbxVector4 * lBindPositions = pMesh->GetControlPoints();
+    int lBones[SKIN_INFLUENCE_COUNT];
+    for (int lIndex = 0; lIndex < lVertexCount; ++lIndex)
+    {
+        const int lControlPointIndex = lControlPoints[lIndex];
+        lPositions[lIndex * VERTEX_STRIDE] = static_cast<float>(lBindPositions[lControlPointIndex][0]);
+        lPositions[lIndex * VERTEX_STRIDE + 1] = static_cast<float>(lBindPositions[lControlPointIndex][1]);
+        lPositions[lIndex * VERTEX_STRIDE + 2] = static_cast<float>(lBindPositions[lControlPointIndex][2]);
+        lPositions[lIndex * VERTEX_STRIDE + 3] = 1;
+
+        pSkinCache->GetVertexInfluences(lControlPointIndex, SKIN_INFLUENCE_COUNT, lBones,
+            lBoneWeights.GetArray() + lIndex * SKIN_INFLUENCE_COUNT);
+        for (int lInfluence = 0; lInfluence < SKIN_INFLUENCE_COUNT; ++lInfluence)
+        {
+            lBoneIndices[lIndex * SKIN_INFLUENCE_COUNT + lInfluence] = static_cast<float>(lBones[lInfluence]);
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, mVBONames[SKIN_POSITION_VBO]);
+    glBufferData(GL_ARRAY_BUFFER, mVertexBufferSize, lPositions.GetArray(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBONames[BONE_INDEX_VBO]);
+    glBufferData(GL_ARRAY_BUFFER, lBoneIndices.GetCount() * sizeof(float), lBoneIndices.GetArray(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, mVBONames[BONE_WEIGHT_VBO]);
+    glBufferData(GL_ARRAY_BUFFER, lBoneWeights.GetCount() * sizeof(float), lBoneWeights.GetArray(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // One RGBA texel for every row of the bone matrices.
+    mSkinBoneCount = pSkinCache->GetBoneCount();
+    glBindBuffer(GL_TEXTURE_BUFFER, mVBONames[PALETTE_VBO]);
+    glBufferData(GL_TEXTURE_BUFFER, mSkinBoneCount * SkinCache::PALETTE_STRIDE * sizeof(float), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &mPaletteTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, mPaletteTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mVBONames[PALETTE_VBO]);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    return true;
+}
+
+void VBOMesh::SkinVertexPosition(const float * pPalette) const
+{
+    // The GPU writes the next buffer of the ring after the draws reading it, no need to wait.
+    if (mStreaming)
+    {
+        mVertexRingIndex = (mVertexRingIndex + 1) % VERTEX_RING_SIZE;
+    }
+
+    const int lPaletteSize = mSkinBoneCount * SkinCache::PALETTE_STRIDE * sizeof(float);
+    glBindBuffer(GL_TEXTURE_BUFFER, mVBONames[PALETTE_VBO]);
+    if (GetSharedGeometry()->mPaletteSlotCount == 1)
     {
-        const GLsizei lElementCount = mSubMeshes[pMaterialIndex]->TriangleCount * 3;
-        glDrawElements(GL_TRIANGLES, lElementCount, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(lOffset));
+        // Orphan the palette of the last frame, which may still be read.
+        glBufferData(GL_TEXTURE_BUFFER, lPaletteSize, pPalette, GL_STREAM_DRAW);
     }
     else
     {
-        for (int lIndex = 0; lIndex < mSubMeshes[pMaterialIndex]->TriangleCount; ++lIndex)
+        // The other slots belong to the other copies, the driver orders the write after
+        // the reads of the slot.
+        glBufferSubData(GL_TEXTURE_BUFFER, mPaletteSlot * lPaletteSize, lPaletteSize, pPalette);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glUseProgram(gSkinProgram);
+    glUniform1i(gPaletteOffsetLocation, mPaletteSlot * mSkinBoneCount * SkinCache::PALETTE_STRIDE / 4);
+    glBindTexture(GL_TEXTURE_BUFFER, mPaletteTexture);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mVBONames[SKIN_POSITION_VBO]);
+    glVertexAttribPointer(SKIN_POSITION_ATTRIBUTE, VERTEX_STRIDE, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(SKIN_POSITION_ATTRIBUTE);
+    for (int lColumn = 0; lColumn < SKIN_INFLUENCE_COLUMN_COUNT; ++lColumn)
+    {
+        const GLvoid * lOffset = reinterpret_cast<const GLvoid *>(lColumn * 4 * sizeof(float));
+        glBindBuffer(GL_ARRAY_BUFFER, mVBONames[BONE_INDEX_VBO]);
+        glVertexAttribPointer(BONE_INDEX_ATTRIBUTE + lColumn, 4, GL_FLOAT, GL_FALSE, SKIN_INFLUENCE_COUNT * sizeof(float),
+            lOffset);
+        glEnableVertexAttribArray(BONE_INDEX_ATTRIBUTE + lColumn);
+        glBindBuffer(GL_ARRAY_BUFFER, mVBONames[BONE_WEIGHT_VBO]);
+        glVertexAttribPointer(BONE_WEIGHT_ATTRIBUTE + lColumn, 4, GL_FLOAT, GL_FALSE, SKIN_INFLUENCE_COUNT * sizeof(float),
+            lOffset);
+        glEnableVertexAttribArray(BONE_WEIGHT_ATTRIBUTE + lColumn);
+    }
+
+    // One point for every vertex, captured into the position buffer drawn next.
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, mVertexRing[mVertexRingIndex]);
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, mVertexBufferSize / static_cast<int>(VERTEX_STRIDE * sizeof(float)));
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+    glDisableVertexAttribArray(SKIN_POSITION_ATTRIBUTE);
+    for (int lColumn = 0; lColumn < SKIN_INFLUENCE_COLUMN_COUNT; ++lColumn)
+    {
+        glDisableVertexAttribArray(BONE_INDEX_ATTRIBUTE + lColumn);
+        glDisableVertexAttribArray(BONE_WEIGHT_ATTRIBUTE + lColumn);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+}
+
+int VBOMesh::GetVertexCount() const
+{
+    return mVertexBufferSize / static_cast<int>(VERTEX_STRIDE * sizeof(float));
+}
+
+int VBOMesh::GetVertexControlPoint(int pVertexIndex) const
+{
+    return mAllByControlPoint ? pVertexIndex : static_cast<int>(GetSharedGeometry()->mVertexControlPoints[pVertexIndex]);
+}
+
+void VBOMesh::ReadVertexPositions(FbxArray<float> & pVertices) const
+{
+    pVertices.Resize(GetVertexCount() * VERTEX_STRIDE);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexRing[mVertexRingIndex]);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, mVertexBufferSize, pVertices.GetArray());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+float * VBOMesh::BeginVertexPositionUpdate() const
+{
+    if (mStreaming)
+    {
+        mVertexRingIndex = (mVertexRingIndex + 1) % VERTEX_RING_SIZE;
+
+        // Wait until the GPU is done with the last draws from this buffer, usually frames ago.
+        GLsync & lFence = mVertexRingFences[mVertexRingIndex];
+        if (lFence)
         {
-            // Draw line loop for every triangle.
-            glDrawElements(GL_LINE_LOOP, TRIANGLE_VERTEX_COUNT, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(lOffset));
-            lOffset += sizeof(unsigned int) * TRIANGLE_VERTEX_COUNT;
+            glClientWaitSync(lFence, GL_SYNC_FLUSH_COMMANDS_BIT, VERTEX_RING_TIMEOUT);
+            glDeleteSync(lFence);
+            lFence = NULL;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, mVertexRing[mVertexRingIndex]);
+        void * lMapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, mVertexBufferSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (lMapped)
+        {
+            mVertexRingMapped = true;
+            return static_cast<float *>(lMapped);
         }
     }
+
+    mStagingVertices.Resize(mVertexBufferSize / sizeof(float));
+    return mStagingVertices.GetArray();
 }
 
-void VBOMesh::BeginDraw(ShadingMode pShadingMode) const
+void VBOMesh::EndVertexPositionUpdate() const
 {
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexRing[mVertexRingIndex]);
+    if (mVertexRingMapped)
+    {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        mVertexRingMapped = false;
+    }
+    else
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, mVertexBufferSize, mStagingVertices.GetArray());
+    }
+}
+
+const VBOMesh::SubMesh & VBOMesh::GetSubMesh(int pMaterialIndex) const
+{
+    if (mLod == 0)
+        return *mSubMeshes[pMaterialIndex];
+    return GetSharedGeometry()->mLodSubMeshes[(mLod - 1) * mSubMeshes.GetCount() + pMaterialIndex];
+}
+
+const int * VBOMesh::GetLodControlPointRanges(int pLod, int & pRangeCount) const
+{
+    const FbxArray<int> & lRanges = GetSharedGeometry()->mLodControlPointRanges[pLod];
+    pRangeCount = lRanges.GetCount() / 2;
+    return pLod ? lRanges.GetArray() : NULL;
+}
+
+void VBOMesh::Draw(int pMaterialIndex, ShadingMode pShadingMode) const
+{
+    // Where to start.
+    const SubMesh & lSubMesh = GetSubMesh(pMaterialIndex);
+    GLsizei lOffset = lSubMesh.IndexOffset * sizeof(unsigned int);
+    GLenum lMode = GL_TRIANGLES;
+    GLsizei lElementCount = lSubMesh.TriangleCount * 3;
+    if (pShadingMode != SHADING_MODE_SHADED)
+    {
+        // All the edges at once, from the edge index VBO bound by BeginDraw.
+        lOffset = lSubMesh.EdgeOffset * sizeof(unsigned int);
+        lMode = GL_LINES;
+        lElementCount = lSubMesh.EdgeCount * 2;
+    }
+
+    if (mInstanceCount)
+    {
+        // The shader cannot tell an unbound texture, the material may have bound one.
+        GLint lTextureName = 0;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &lTextureName);
+        glUniform1i(gHasTextureLocation, pShadingMode == SHADING_MODE_SHADED && lTextureName != 0);
+        glDrawElementsInstancedARB(lMode, lElementCount, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(lOffset), mInstanceCount);
+    }
+    else
+    {
+        glDrawElements(lMode, lElementCount, GL_UNSIGNED_INT, reinterpret_cast<const GLvoid *>(lOffset));
+    }
+}
+
+void VBOMesh::BeginDraw(ShadingMode pShadingMode, int pLod) const
+{
+    mLod = FbxMin(pLod, GetLodCount() - 1);
+
     // Push OpenGL attributes.
     glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
     glPushAttrib(GL_ENABLE_BIT);
@@ -434,8 +1654,8 @@ void VBOMesh::BeginDraw(ShadingMode pShadingMode) const
     glPushAttrib(GL_LIGHTING_BIT);
     glPushAttrib(GL_TEXTURE_BIT);
 
-    // Set vertex position array.
-    glBindBuffer(GL_ARRAY_BUFFER, mVBONames[VERTEX_VBO]);
+    // Set vertex position array, the last one written for deformed meshes.
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexRing[mVertexRingIndex]);
     glVertexPointer(VERTEX_STRIDE, GL_FLOAT, 0, 0);
     glEnableClientState(GL_VERTEX_ARRAY);
 
@@ -455,8 +1675,8 @@ void VBOMesh::BeginDraw(ShadingMode pShadingMode) const
         glEnableClientState(GL_TEXTURE_COORD_ARRAY);
     }
 
-    // Set index array.
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVBONames[INDEX_VBO]);
+    // Set index array, the edges for the wireframe.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mVBONames[pShadingMode == SHADING_MODE_SHADED ? INDEX_VBO : EDGE_INDEX_VBO]);
 
     if (pShadingMode == SHADING_MODE_SHADED)
     {
@@ -472,8 +1692,61 @@ void VBOMesh::BeginDraw(ShadingMode pShadingMode) const
     }
 }
 
+void VBOMesh::BeginInstancedDraw(ShadingMode pShadingMode, const float * pTransforms, int pInstanceCount, int pLod) const
+{
+    BeginDraw(pShadingMode, pLod);
+
+    // Orphan the transforms of the last instanced draw, which may still be read.
+    glBindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, pInstanceCount * MATRIX_STRIDE * sizeof(float), pTransforms, GL_STREAM_DRAW);
+    // A matrix attribute takes a location for every column.
+    for (int lColumn = 0; lColumn < 4; ++lColumn)
+    {
+        const GLuint lLocation = gInstanceTransformLocation + lColumn;
+        glVertexAttribPointer(lLocation, 4, GL_FLOAT, GL_FALSE, MATRIX_STRIDE * sizeof(float),
+            reinterpret_cast<const GLvoid *>(lColumn * 4 * sizeof(float)));
+        glVertexAttribDivisorARB(lLocation, 1);
+        glEnableVertexAttribArray(lLocation);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    GLint lLightEnabled[INSTANCE_LIGHT_COUNT];
+    for (int lLightIndex = 0; lLightIndex < INSTANCE_LIGHT_COUNT; ++lLightIndex)
+    {
+        lLightEnabled[lLightIndex] = glIsEnabled(GL_LIGHT0 + lLightIndex);
+    }
+
+    glUseProgram(gInstanceProgram);
+    glUniform1i(gLightingLocation, pShadingMode == SHADING_MODE_SHADED);
+    glUniform1iv(gLightEnabledLocation, INSTANCE_LIGHT_COUNT, lLightEnabled);
+
+    mInstanceCount = pInstanceCount;
+}
+
 void VBOMesh::EndDraw() const
 {
+    if (mInstanceCount)
+    {
+        for (int lColumn = 0; lColumn < 4; ++lColumn)
+        {
+            glVertexAttribDivisorARB(gInstanceTransformLocation + lColumn, 0);
+            glDisableVertexAttribArray(gInstanceTransformLocation + lColumn);
+        }
+        glUseProgram(0);
+        mInstanceCount = 0;
+    }
+
+    // Know when the GPU is done with the vertex buffer, before writing it again.
+    if (mStreaming)
+    {
+        GLsync & lFence = mVertexRingFences[mVertexRingIndex];
+        if (lFence)
+        {
+            glDeleteSync(lFence);
+        }
+        lFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
     // Reset VBO binding.
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -487,6 +1760,11 @@ void VBOMesh::EndDraw() const
     glPopClientAttrib();
 }
 
+bool VBOMesh::IsInstancingSupported()
+{
+    return GLEW_VERSION_2_0 && GLEW_ARB_draw_instanced && GLEW_ARB_instanced_arrays && GetInstanceProgram() != 0;
+}
+
 MaterialCache::MaterialCache() : mShinness(0)
 {
 
@@ -13,6 +13,9 @@ this software in either electronic or hard copy form.
 #define _SCENE_CACHE_H
 
 #include "GlFunctions.h"
+#include "DeformationCache.h"
+
+class SkinCache;
 
 // Save mesh vertices, normals, UVs and indices in GPU with OpenGL Vertex Buffer Objects
 class VBOMesh
@@ -24,11 +27,49 @@ public:
     // Save up data into GPU buffers.
     bool Initialize(const FbxMesh * pMesh);
 
-    // Update vertex positions for deformed meshes.
+    // A mesh baked by Initialize from the same geometry as pMesh, NULL if none. A mesh without
+    // deformer shares it, otherwise InitializeShared bakes a copy of it.
+    static VBOMesh * FindSameGeometry(const FbxMesh * pMesh);
+    // Use the buffers of pSource for everything but the vertex positions, deformed apart.
+    bool InitializeShared(const FbxMesh * pMesh, VBOMesh * pSource);
+    bool IsDeformed() const { return mDeformed; }
+
+    // Meshes hooking the VBO mesh, plus its copies; Release deletes it with the last one.
+    void AddReference() { ++mReferenceCount; }
+    static void Release(VBOMesh * pMeshCache);
+
+    // The VBO mesh holding the buffers of the geometry, the same for all its copies.
+    const VBOMesh * GetSharedGeometry() const { return mSource ? mSource : this; }
+    bool IsGeometryShared() const { return GetSharedGeometry()->mReferenceCount > 1; }
+
+    // Update vertex positions for deformed meshes, pVertices holds one for every control point.
     void UpdateVertexPosition(const FbxMesh * pMesh, const FbxVector4 * pVertices) const;
+    // Same with positions already in single precision, four floats for every control point.
+    void UpdateVertexPosition(const FbxMesh * pMesh, const float * pVertices) const;
+
+    // Upload the bind positions and the influences of every vertex for the GPU skinning path.
+    // Requires OpenGL 3.1; the additive link mode is not supported. Up to 8 influences are
+    // kept for every vertex: meshes with more return false and stay skinned on the CPU.
+    bool InitializeSkin(const FbxMesh * pMesh, const SkinCache * pSkinCache);
+    bool HasSkin() const { return mSkinBoneCount > 0; }
+    // Upload the palette, as SkinCache::ConvertPalette writes it, and deform the vertices
+    // with a vertex shader into the position buffer, through transform feedback.
+    // The copies of a mesh share one palette buffer, each one writing its own slot.
+    void SkinVertexPosition(const float * pPalette) const;
 
-    // Bind buffers, set vertex arrays, turn on lighting and texture.
-    void BeginDraw(ShadingMode pShadingMode) const;
+    // Vertices of the VBO, and the control point each one was made from.
+    int GetVertexCount() const;
+    int GetVertexControlPoint(int pVertexIndex) const;
+    // Read back the positions drawn next, four floats for every vertex. Slow, for the checks.
+    void ReadVertexPositions(FbxArray<float> & pVertices) const;
+
+    // Bind buffers, set vertex arrays, turn on lighting and texture. Draw uses the triangles
+    // of the level of detail pLod until EndDraw.
+    void BeginDraw(ShadingMode pShadingMode, int pLod = 0) const;
+    // Same, for pInstanceCount copies drawn by every call of Draw until EndDraw. pTransforms
+    // holds a column major matrix of 16 floats for every copy, applied before the model view
+    // matrix; a vertex shader lights the copies as the fixed pipeline does.
+    void BeginInstancedDraw(ShadingMode pShadingMode, const float * pTransforms, int pInstanceCount, int pLod = 0) const;
     // Draw all the faces with specific material with given shading mode.
     void Draw(int pMaterialIndex, ShadingMode pShadingMode) const;
     // Unbind buffers, reset vertex arrays, turn off lighting and texture.
@@ -37,6 +78,24 @@ public:
     // Get the count of material groups
     int GetSubMeshCount() const { return mSubMeshes.GetCount(); }
 
+    // Levels of detail, the first one is the full mesh. The coarser ones are simplified
+    // when the mesh is baked, they draw fewer triangles of the same vertices.
+    enum { MAX_LOD_COUNT = 4 };
+    int GetLodCount() const { return GetSharedGeometry()->mLodCount; }
+    // The control points used by a coarser level, in pRangeCount ranges [begin, end) of two
+    // ints each; the other ones need not be deformed. NULL for the full mesh.
+    const int * GetLodControlPointRanges(int pLod, int & pRangeCount) const;
+
+    // Box of the control points, in the space of the mesh.
+    const FbxVector4 & GetBoundsMin() const { return GetSharedGeometry()->mBoundsMin; }
+    const FbxVector4 & GetBoundsMax() const { return GetSharedGeometry()->mBoundsMax; }
+
+    // Whether BeginInstancedDraw can be used, it needs ARB_draw_instanced and ARB_instanced_arrays.
+    static bool IsInstancingSupported();
+
+    // Which deformation the position buffer holds, and the recently deformed frames.
+    DeformationCache & GetDeformationCache() const { return mDeformationCache; }
+
 private:
     enum
     {
@@ -44,23 +103,84 @@ private:
         NORMAL_VBO,
         UV_VBO,
         INDEX_VBO,
+        EDGE_INDEX_VBO,     // Two indices per edge, for the wireframe.
+        SKIN_POSITION_VBO,  // Bind positions, the source of the GPU skinning.
+        BONE_INDEX_VBO,
+        BONE_WEIGHT_VBO,
+        PALETTE_VBO,        // Read by the vertex shader through a buffer texture.
         VBO_COUNT,
     };
 
+    // Number of vertex position buffers written in turn for deformed meshes.
+    enum { VERTEX_RING_SIZE = 3 };
+
+    // Get the memory to write the new vertex positions to: the next buffer of the ring,
+    // mapped without synchronization, or a staging array if it cannot be mapped.
+    float * BeginVertexPositionUpdate() const;
+    // Unmap the buffer, or upload the staging array with glBufferSubData.
+    void EndVertexPositionUpdate() const;
+
     // For every material, record the offsets in every VBO and triangle counts
     struct SubMesh
     {
-        SubMesh() : IndexOffset(0), TriangleCount(0) {}
+        SubMesh() : IndexOffset(0), TriangleCount(0), EdgeOffset(0), EdgeCount(0) {}
 
         int IndexOffset;
         int TriangleCount;
+        // The edges of the triangles, each one once, in the edge index VBO.
+        int EdgeOffset;
+        int EdgeCount;
     };
 
+    // The material groups of the level drawn.
+    const SubMesh & GetSubMesh(int pMaterialIndex) const;
+
     GLuint mVBONames[VBO_COUNT];
     FbxArray<SubMesh*> mSubMeshes;
+    // The material groups of every coarser level, one level after the other. Their triangles
+    // follow the ones of the full mesh in the index VBO.
+    FbxArray<SubMesh> mLodSubMeshes;
+    int mLodCount;
+    FbxArray<int> mLodControlPointRanges[MAX_LOD_COUNT];
     bool mHasNormal;
     bool mHasUV;
     bool mAllByControlPoint; // Save data in VBO by control point or by polygon vertex.
+    // The control point of every vertex, if by polygon vertex.
+    FbxArray<unsigned int> mVertexControlPoints;
+    bool mDeformed;
+    FbxVector4 mBoundsMin;
+    FbxVector4 mBoundsMax;
+
+    // The mesh baked by Initialize, to find the meshes of the same geometry.
+    const FbxMesh * mSourceMesh;
+    // The VBO mesh owning the buffers of a copy, NULL if this one owns them.
+    VBOMesh * mSource;
+    int mReferenceCount;
+
+    // Deformed meshes stream their positions through a ring of buffers, the first one
+    // is mVBONames[VERTEX_VBO]. A fence tells when the GPU is done with the draws of a buffer.
+    bool mStreaming;
+    int mVertexBufferSize;
+    GLuint mVertexRing[VERTEX_RING_SIZE];
+    mutable GLsync mVertexRingFences[VERTEX_RING_SIZE];
+    mutable int mVertexRingIndex;
+    mutable bool mVertexRingMapped;
+    // Used instead of the mapped memory by old drivers, allocated once.
+    mutable FbxArray<float> mStagingVertices;
+
+    // GPU skinning, zero bones if the mesh is skinned on the CPU.
+    int mSkinBoneCount;
+    GLuint mPaletteTexture;
+    // Slot of this copy in the palette buffer, and the slots of all the copies in the source.
+    int mPaletteSlot;
+    int mPaletteSlotCount;
+
+    // Copies drawn by Draw, zero outside of BeginInstancedDraw.
+    mutable int mInstanceCount;
+    // Level of detail drawn by Draw.
+    mutable int mLod;
+
+    mutable DeformationCache mDeformationCache;
 };
 
 // Cache for FBX material
@@ -13,10 +13,17 @@ this software in either electronic or hard copy form.
 #include "SceneContext.h"
 
 #include "SceneCache.h"
+#include "SkinCache.h"
+#include "BlendShapeCache.h"
+#include "PointCacheStream.h"
 #include "SetCamera.h"
 #include "DrawScene.h"
 #include "DrawText.h"
-#include "targa.h"
+#include "ThreadPool.h"
+#include "GetPosition.h"
+#include "AnimationClip.h"
+#include "TextureCache.h"
+#include "Profiler.h"
 #include "../Common/Common.h"
 #include <string.h>
 #include "Skeleton.h"
@@ -38,6 +45,16 @@ namespace
     const int BUTTON_DOWN = 0;
     const int BUTTON_UP = 1;
 
+    // Frames kept for every mesh when the deformation cache is on, a few seconds of animation.
+    const int DEFORMATION_CACHE_FRAMES = 120;
+
+    // Work done by the render thread per timer callback while the scene is baked:
+    // a few texture uploads, then nodes until their control points reach the budget.
+    const int TEXTURE_UPLOAD_BUDGET = 2;
+    const int BAKE_VERTEX_BUDGET = 200000;
+    // Cost of a node besides its control points.
+    const int NODE_BAKE_COST = 100;
+
     // Find all the cameras under this node recursively.
     void FillCameraArrayRecursive(FbxNode* pNode, FbxArray<FbxNode*>& pCameraArray)
     {
@@ -78,7 +95,10 @@ namespace
         }
     }
 
-    void PreparePointCacheData(FbxScene* pScene, FbxTime &pCache_Start, FbxTime &pCache_Stop)
+    // The deformers of Maya caches are left inactive in pMayaCacheDeformers, to be converted
+    // to PC2 after the import.
+    void PreparePointCacheData(FbxScene* pScene, FbxTime &pCache_Start, FbxTime &pCache_Stop,
+                               FbxArray<FbxVertexCacheDeformer*> &pMayaCacheDeformers)
     {
         // This function show how to cycle through scene elements in a linear way.
 		const int lNodeCount = pScene->GetSrcObjectCount<FbxNode>();
@@ -121,15 +141,11 @@ namespace
                         }
                         else if (lCache->GetCacheFileFormat() == FbxCache::eMayaCache)
                         {
-                            // This code show how to convert from MC to PC2 point cache format
-                            // turn it on if you need it.
-                            //#if 0 
-                            if (!lCache->ConvertFromMCToPC2(FbxTime::GetFrameRate(pScene->GetGlobalSettings().GetTimeMode()), 0, &lStatus))
-                            {
-                                // Conversion failed, retrieve the error here
-                                FbxString lTheErrorIs = lStatus.GetErrorString();
-                            }
-                            //#endif
+                            // Converting a large cache takes long, a worker thread does it
+                            // while the scene is shown. The mesh is not deformed until then.
+                            lDeformer->SetActive(false);
+                            pMayaCacheDeformers.Add(lDeformer);
+                            continue;
                         }
 
 
@@ -144,6 +160,16 @@ namespace
                         }
 						else
 						{
+							// Stream the PC2 file from now on.
+							FbxString lRelativeFileName, lAbsoluteFileName;
+							lCache->GetCacheFileName(lRelativeFileName, lAbsoluteFileName);
+							FbxAutoPtr<PointCacheStream> lStream(new PointCacheStream);
+							if (lStream->Open(lAbsoluteFileName) &&
+								lStream->GetPointCount() == lNode->GetGeometry()->GetControlPointsCount())
+							{
+								lDeformer->SetUserDataPtr(lStream.Release());
+							}
+
 							// get the start and stop time of the cache
 							int lChannelCount = lCache->GetChannelCount();
 							
@@ -168,50 +194,21 @@ namespace
         }
     }
 
-    // Load a texture file (TGA only now) into GPU and return the texture object name
-    bool LoadTextureFromFile(const FbxString & pFilePath, unsigned int & pTextureObject)
+    // List this node and the nodes under it, parents first as they are drawn.
+    void FillNodeArrayRecursive(FbxNode * pNode, FbxArray<FbxNode *> & pNodeArray)
     {
-        if (pFilePath.Right(3).Upper() == "TGA")
-        {
-            tga_image lTGAImage;
+        pNodeArray.Add(pNode);
 
-            if (tga_read(&lTGAImage, pFilePath.Buffer()) == TGA_NOERR)
-            {
-                // Make sure the image is left to right
-                if (tga_is_right_to_left(&lTGAImage))
-                    tga_flip_horiz(&lTGAImage);
-
-                // Make sure the image is bottom to top
-                if (tga_is_top_to_bottom(&lTGAImage))
-                    tga_flip_vert(&lTGAImage);
-
-                // Make the image BGR 24
-                tga_convert_depth(&lTGAImage, 24);
-
-                // Transfer the texture date into GPU
-                glGenTextures(1, &pTextureObject);
-                glBindTexture(GL_TEXTURE_2D, pTextureObject);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-                glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-                glTexImage2D(GL_TEXTURE_2D, 0, 3, lTGAImage.width, lTGAImage.height, 0, GL_BGR,
-                    GL_UNSIGNED_BYTE, lTGAImage.image_data);
-                glBindTexture(GL_TEXTURE_2D, 0);
-
-                tga_free_buffers(&lTGAImage);
-
-                return true;
-            }
+        const int lChildCount = pNode->GetChildCount();
+        for (int lChildIndex = 0; lChildIndex < lChildCount; ++lChildIndex)
+        {
+            FillNodeArrayRecursive(pNode->GetChild(lChildIndex), pNodeArray);
         }
-
-        return false;
     }
 
-    // Bake node attributes and materials under this node recursively.
+    // Bake the node attribute and the materials of this node.
     // Currently only mesh, light and material.
-    void LoadCacheRecursive(FbxNode * pNode, FbxAnimLayer * pAnimLayer, bool pSupportVBO)
+    void LoadNodeCache(FbxNode * pNode, FbxAnimLayer * pAnimLayer, bool pSupportVBO)
     {
         // Bake material and hook as user data.
         const int lMaterialCount = pNode->GetMaterialCount();
@@ -237,10 +234,54 @@ namespace
                 FbxMesh * lMesh = pNode->GetMesh();
                 if (pSupportVBO && lMesh && !lMesh->GetUserDataPtr())
                 {
-                    FbxAutoPtr<VBOMesh> lMeshCache(new VBOMesh);
-                    if (lMeshCache->Initialize(lMesh))
+                    // Copies of a mesh share its buffers, only the deformed positions are kept apart.
+                    VBOMesh * lSameGeometry = VBOMesh::FindSameGeometry(lMesh);
+                    if (lSameGeometry && !lSameGeometry->IsDeformed())
                     {
-                        lMesh->SetUserDataPtr(lMeshCache.Release());
+                        lSameGeometry->AddReference();
+                        lMesh->SetUserDataPtr(lSameGeometry);
+                    }
+                    else
+                    {
+                        FbxAutoPtr<VBOMesh> lMeshCache(new VBOMesh);
+                        if (lSameGeometry ? lMeshCache->InitializeShared(lMesh, lSameGeometry) : lMeshCache->Initialize(lMesh))
+                        {
+                            lMesh->SetUserDataPtr(lMeshCache.Release());
+                        }
+                    }
+                }
+
+                // Bake the skin binding, hooked on the first skin of the mesh.
+                if (lMesh && lMesh->GetDeformerCount(FbxDeformer::eSkin) > 0)
+                {
+                    FbxSkin * lSkin = (FbxSkin *)lMesh->GetDeformer(0, FbxDeformer::eSkin);
+                    if (!lSkin->GetUserDataPtr())
+                    {
+                        FbxAutoPtr<SkinCache> lSkinCache(new SkinCache);
+                        if (lSkinCache->Initialize(lMesh))
+                        {
+                            // Let the VBO skin the mesh on the GPU when it can.
+                            VBOMesh * lMeshCache = static_cast<VBOMesh *>(lMesh->GetUserDataPtr());
+                            if (lMeshCache)
+                            {
+                                lMeshCache->InitializeSkin(lMesh, lSkinCache.Get());
+                            }
+                            lSkin->SetUserDataPtr(lSkinCache.Release());
+                        }
+                    }
+                }
+
+                // Bake the blend shape targets, hooked on the first blend shape deformer.
+                if (lMesh && lMesh->GetDeformerCount(FbxDeformer::eBlendShape) > 0)
+                {
+                    FbxDeformer * lBlendShape = lMesh->GetDeformer(0, FbxDeformer::eBlendShape);
+                    if (!lBlendShape->GetUserDataPtr())
+                    {
+                        FbxAutoPtr<BlendShapeCache> lShapeCache(new BlendShapeCache);
+                        if (lShapeCache->Initialize(lMesh))
+                        {
+                            lBlendShape->SetUserDataPtr(lShapeCache.Release());
+                        }
                     }
                 }
             }
@@ -258,12 +299,6 @@ namespace
                 }
             }
         }
-
-        const int lChildCount = pNode->GetChildCount();
-        for (int lChildIndex = 0; lChildIndex < lChildCount; ++lChildIndex)
-        {
-            LoadCacheRecursive(pNode->GetChild(lChildIndex), pAnimLayer, pSupportVBO);
-        }
     }
 
     // Unload the cache and release the memory under this node recursively.
@@ -293,7 +328,43 @@ namespace
                 {
                     VBOMesh * lMeshCache = static_cast<VBOMesh *>(lMesh->GetUserDataPtr());
                     lMesh->SetUserDataPtr(NULL);
-                    delete lMeshCache;
+                    VBOMesh::Release(lMeshCache);
+                }
+
+                // Unload the skin binding
+                if (lMesh && lMesh->GetDeformerCount(FbxDeformer::eSkin) > 0)
+                {
+                    FbxSkin * lSkin = (FbxSkin *)lMesh->GetDeformer(0, FbxDeformer::eSkin);
+                    if (lSkin->GetUserDataPtr())
+                    {
+                        SkinCache * lSkinCache = static_cast<SkinCache *>(lSkin->GetUserDataPtr());
+                        lSkin->SetUserDataPtr(NULL);
+                        delete lSkinCache;
+                    }
+                }
+
+                // Unload the blend shape targets
+                if (lMesh && lMesh->GetDeformerCount(FbxDeformer::eBlendShape) > 0)
+                {
+                    FbxDeformer * lBlendShape = lMesh->GetDeformer(0, FbxDeformer::eBlendShape);
+                    if (lBlendShape->GetUserDataPtr())
+                    {
+                        BlendShapeCache * lShapeCache = static_cast<BlendShapeCache *>(lBlendShape->GetUserDataPtr());
+                        lBlendShape->SetUserDataPtr(NULL);
+                        delete lShapeCache;
+                    }
+                }
+
+                // Stop streaming the point cache
+                if (lMesh && lMesh->GetDeformerCount(FbxDeformer::eVertexCache) > 0)
+                {
+                    FbxDeformer * lVertexCache = lMesh->GetDeformer(0, FbxDeformer::eVertexCache);
+                    if (lVertexCache->GetUserDataPtr())
+                    {
+                        PointCacheStream * lStream = static_cast<PointCacheStream *>(lVertexCache->GetUserDataPtr());
+                        lVertexCache->SetUserDataPtr(NULL);
+                        delete lStream;
+                    }
                 }
             }
             // Unload the light cache
@@ -316,62 +387,30 @@ namespace
         }
     }
 
-    // Bake node attributes and materials for this scene and load the textures.
-    void LoadCacheRecursive(FbxScene * pScene, FbxAnimLayer * pAnimLayer, const char * pFbxFileName, bool pSupportVBO)
+    // Find the file of a texture from its absolute path, or relative to the FBX file.
+    // Return an empty string if none of them exists.
+    FbxString ResolveTextureFile(const FbxFileTexture * pFileTexture, const char * pFbxFileName)
     {
-        // Load the textures into GPU, only for file texture now
-        const int lTextureCount = pScene->GetTextureCount();
-        for (int lTextureIndex = 0; lTextureIndex < lTextureCount; ++lTextureIndex)
-        {
-            FbxTexture * lTexture = pScene->GetTexture(lTextureIndex);
-            FbxFileTexture * lFileTexture = FbxCast<FbxFileTexture>(lTexture);
-            if (lFileTexture && !lFileTexture->GetUserDataPtr())
-            {
-                // Try to load the texture from absolute path
-                const FbxString lFileName = lFileTexture->GetFileName();
-                
-                // Only TGA textures are supported now.
-                if (lFileName.Right(3).Upper() != "TGA")
-                {
-                    FBXSDK_printf("Only TGA textures are supported now: %s\n", lFileName.Buffer());
-                    continue;
-                }
-
-                GLuint lTextureObject = 0;
-                bool lStatus = LoadTextureFromFile(lFileName, lTextureObject);
-
-                const FbxString lAbsFbxFileName = FbxPathUtils::Resolve(pFbxFileName);
-                const FbxString lAbsFolderName = FbxPathUtils::GetFolderName(lAbsFbxFileName);
-                if (!lStatus)
-                {
-                    // Load texture from relative file name (relative to FBX file)
-                    const FbxString lResolvedFileName = FbxPathUtils::Bind(lAbsFolderName, lFileTexture->GetRelativeFileName());
-                    lStatus = LoadTextureFromFile(lResolvedFileName, lTextureObject);
-                }
-
-                if (!lStatus)
-                {
-                    // Load texture from file name only (relative to FBX file)
-                    const FbxString lTextureFileName = FbxPathUtils::GetFileName(lFileName);
-                    const FbxString lResolvedFileName = FbxPathUtils::Bind(lAbsFolderName, lTextureFileName);
-                    lStatus = LoadTextureFromFile(lResolvedFileName, lTextureObject);
-                }
-
-                if (!lStatus)
-                {
-                    FBXSDK_printf("Failed to load texture file: %s\n", lFileName.Buffer());
-                    continue;
-                }
-
-                if (lStatus)
-                {
-                    GLuint * lTextureName = new GLuint(lTextureObject);
-                    lFileTexture->SetUserDataPtr(lTextureName);
-                }
-            }
-        }
-
-        LoadCacheRecursive(pScene->GetRootNode(), pAnimLayer, pSupportVBO);
+        // Try to load the texture from absolute path
+        const FbxString lFileName = pFileTexture->GetFileName();
+        if (FbxFileUtils::Exist(lFileName))
+            return lFileName;
+
+        const FbxString lAbsFbxFileName = FbxPathUtils::Resolve(pFbxFileName);
+        const FbxString lAbsFolderName = FbxPathUtils::GetFolderName(lAbsFbxFileName);
+
+        // Load texture from relative file name (relative to FBX file)
+        const FbxString lRelativeFileName = FbxPathUtils::Bind(lAbsFolderName, pFileTexture->GetRelativeFileName());
+        if (FbxFileUtils::Exist(lRelativeFileName))
+            return lRelativeFileName;
+
+        // Load texture from file name only (relative to FBX file)
+        const FbxString lTextureFileName = FbxPathUtils::GetFileName(lFileName);
+        const FbxString lResolvedFileName = FbxPathUtils::Bind(lAbsFolderName, lTextureFileName);
+        if (FbxFileUtils::Exist(lResolvedFileName))
+            return lResolvedFileName;
+
+        return FbxString();
     }
 
     // Unload the cache and release the memory fro this scene and release the textures in GPU
@@ -384,9 +423,10 @@ namespace
             FbxFileTexture * lFileTexture = FbxCast<FbxFileTexture>(lTexture);
             if (lFileTexture && lFileTexture->GetUserDataPtr())
             {
+                // Only the copy of the name, the texture object may be shared with other file
+                // textures and belongs to the scene context.
                 GLuint * lTextureName = static_cast<GLuint *>(lFileTexture->GetUserDataPtr());
                 lFileTexture->SetUserDataPtr(NULL);
-                glDeleteTextures(1, lTextureName);
                 delete lTextureName;
             }
         }
@@ -418,12 +458,43 @@ bool InitializeOpenGL()
     return true;
 }
 
+struct SceneContext::PendingTexture
+{
+    PendingTexture() : mDecoded(false) {}
+
+    FbxString mFilePath;
+    bool mDecoded;
+    CachedTexture mImage;
+    // All the file textures of the file.
+    FbxArray<FbxFileTexture *> mTextures;
+};
+
+struct SceneContext::PendingPointCache
+{
+    PendingPointCache() : mDeformer(NULL), mFrameRate(0.0), mPointCount(0), mStream(NULL), mOpened(false),
+        mConverted(false) {}
+    ~PendingPointCache() { delete mStream; }
+
+    FbxVertexCacheDeformer * mDeformer;
+    double mFrameRate;
+    int mPointCount;
+    // Results of the conversion thread, valid once mConverted is set.
+    PointCacheStream * mStream;
+    bool mOpened;
+    FbxTime mStart;
+    FbxTime mStop;
+    volatile bool mConverted;
+};
+
 SceneContext::SceneContext(const char * pFileName, int pWindowWidth, int pWindowHeight, bool pSupportVBO)
 : mFileName(pFileName), mStatus(UNLOADED),
 mSdkManager(NULL), mScene(NULL), mImporter(NULL), mCurrentAnimLayer(NULL), mSelectedNode(NULL),
 mPoseIndex(-1), mCameraStatus(CAMERA_NOTHING), mPause(false), mShadingMode(SHADING_MODE_SHADED),
 mSupportVBO(pSupportVBO), mCameraZoomMode(ZOOM_FOCAL_LENGTH),
-mWindowWidth(pWindowWidth), mWindowHeight(pWindowHeight), mDrawText(new DrawText), setAnim(false)
+mWindowWidth(pWindowWidth), mWindowHeight(pWindowHeight), mDrawText(new DrawText), mThreadPool(new ThreadPool),
+mGlobalPositionCache(new GlobalPositionCache), mShowTransformStatistics(false), mAnimationClip(new AnimationClip),
+mImportThread(NULL), mImportDone(false), mCancelImport(false), mImportResult(false), mImportProgress(0.0f),
+mPendingTextureIndex(0), mPendingNodeIndex(0), mPointCacheThread(NULL), mPendingPointCacheIndex(0), setAnim(false)
 {
     if (mFileName == NULL)
         mFileName = SAMPLE_FILENAME;
@@ -431,6 +502,9 @@ mWindowWidth(pWindowWidth), mWindowHeight(pWindowHeight), mDrawText(new DrawText
 	// initialize cache start and stop time
 	mCache_Start = FBXSDK_TIME_INFINITE;
 	mCache_Stop  = FBXSDK_TIME_MINUS_INFINITE;
+
+    // Poll the import at 30 frames per second until the time mode of the scene is known.
+    mFrameTime.SetTime(0, 0, 0, 1, 0, FbxTime::eFrames30);
   skeleton = new Skeleton();
 
    // Create the FBX SDK manager which is the object allocator for almost 
@@ -478,15 +552,48 @@ mWindowWidth(pWindowWidth), mWindowHeight(pWindowHeight), mDrawText(new DrawText
 
 SceneContext::~SceneContext()
 {
+    // The import cannot be interrupted, the progress callback cancels it.
+    if (mImportThread)
+    {
+        mCancelImport = true;
+        mImportThread->Join();
+        delete mImportThread;
+        mImportThread = NULL;
+    }
+    if (mPointCacheThread)
+    {
+        mCancelImport = true;
+        mPointCacheThread->Join();
+        delete mPointCacheThread;
+        mPointCacheThread = NULL;
+    }
+    for (int lPointCacheIndex = mPendingPointCacheIndex; lPointCacheIndex < mPendingPointCaches.GetCount(); ++lPointCacheIndex)
+    {
+        delete mPendingPointCaches[lPointCacheIndex];
+    }
+    mPendingPointCaches.Clear();
+    for (int lTextureIndex = mPendingTextureIndex; lTextureIndex < mPendingTextures.GetCount(); ++lTextureIndex)
+    {
+        delete mPendingTextures[lTextureIndex];
+    }
+    mPendingTextures.Clear();
+
     FbxArrayDelete(mAnimStackNameArray);
 
     delete mDrawText;
+    delete mThreadPool;
+    delete mGlobalPositionCache;
+    delete mAnimationClip;
 
     // Unload the cache and free the memory
     if (mScene)
     {
         UnloadCacheRecursive(mScene);
     }
+    if (mTextureObjects.GetCount())
+    {
+        glDeleteTextures(mTextureObjects.GetCount(), mTextureObjects.GetArray());
+    }
 
     // Delete the FBX SDK manager. All the objects that have been allocated 
     // using the FBX SDK manager and that haven't been explicitly destroyed 
@@ -496,92 +603,426 @@ SceneContext::~SceneContext()
 
 bool SceneContext::LoadFile()
 {
-
-    bool lResult = false;
     // Make sure that the scene is ready to load.
-    if (mStatus == MUST_BE_LOADED)
+    if (mStatus != MUST_BE_LOADED)
+        return false;
+
+    // The render thread keeps drawing the window message meanwhile, see UpdateLoading.
+    mStatus = IMPORTING;
+    mImportDone = false;
+    mImporter->SetProgressCallback(ImportProgress, this);
+    mImportThread = new FbxThread(ImportProc, this);
+
+    return true;
+}
+
+bool SceneContext::UpdateLoading()
+{
+    if (mStatus == IMPORTING)
+    {
+        if (mImportDone)
+            return FinishImport();
+
+        // Show the progress of the import thread.
+        mImportLock.Acquire();
+        const FbxString lStep = mImportStep;
+        const float lProgress = mImportProgress;
+        mImportLock.Release();
+
+        char lPercentage[16];
+        FBXSDK_sprintf(lPercentage, sizeof(lPercentage), " %d%%", static_cast<int>(lProgress));
+        mWindowMessage = "Importing file ";
+        mWindowMessage += mFileName;
+        mWindowMessage += "\n";
+        mWindowMessage += lStep;
+        mWindowMessage += lPercentage;
+        return false;
+    }
+
+    if (mPendingTextureIndex < mPendingTextures.GetCount() || mPendingNodeIndex < mPendingNodes.GetCount())
+    {
+        BakePendingCaches();
+        // Draw the nodes baked so far.
+        mStatus = MUST_BE_REFRESHED;
+    }
+    if (mPendingPointCacheIndex < mPendingPointCaches.GetCount())
+    {
+        AttachConvertedPointCaches();
+    }
+    return false;
+}
+
+bool SceneContext::IsLoading() const
+{
+    return mStatus == MUST_BE_LOADED || mStatus == IMPORTING ||
+        mPendingTextureIndex < mPendingTextures.GetCount() || mPendingNodeIndex < mPendingNodes.GetCount() ||
+        mPendingPointCacheIndex < mPendingPointCaches.GetCount();
+}
+
+void SceneContext::ImportProc(void * pArg)
+{
+    SceneContext * lContext = static_cast<SceneContext *>(pArg);
+    lContext->mImportResult = lContext->ImportScene();
+    lContext->mImportDone = true;
+}
+
+bool SceneContext::ImportProgress(void * pArgs, float pPercentage, const char * pStatus)
+{
+    SceneContext * lContext = static_cast<SceneContext *>(pArgs);
+    lContext->SetImportStep(pStatus && *pStatus ? pStatus : "Reading file", pPercentage);
+
+    // Returning false cancels the import.
+    return !lContext->mCancelImport;
+}
+
+void SceneContext::SetImportStep(const char * pStep, float pProgress)
+{
+    mImportLock.Acquire();
+    mImportStep = pStep;
+    mImportProgress = pProgress;
+    mImportLock.Release();
+}
+
+bool SceneContext::ImportScene()
+{
+    SetImportStep("Reading file", 0.0f);
+    if (mImporter->Import(mScene) == false)
+        return false;
+
+    SetImportStep("Converting scene", 100.0f);
+
+    // mCurrentAnimLayer->
+    // Convert Axis System to what is used in this example, if needed
+    FbxAxisSystem SceneAxisSystem = mScene->GetGlobalSettings().GetAxisSystem();
+    FbxAxisSystem OurAxisSystem(FbxAxisSystem::eYAxis, FbxAxisSystem::eParityOdd, FbxAxisSystem::eRightHanded);
+    if( SceneAxisSystem != OurAxisSystem )
     {
-        if (mImporter->Import(mScene) == true)
+        OurAxisSystem.ConvertScene(mScene);
+    }
+
+    // Convert Unit System to what is used in this example, if needed
+    FbxSystemUnit SceneSystemUnit = mScene->GetGlobalSettings().GetSystemUnit();
+    if( SceneSystemUnit.GetScaleFactor() != 1.0 )
+    {
+        //The unit in this example is centimeter.
+        FbxSystemUnit::cm.ConvertScene( mScene);
+    }
+
+    // Get the list of all the animation stack.
+    mScene->FillAnimStackNameArray(mAnimStackNameArray);
+
+    // Get the list of all the cameras in the scene.
+    FillCameraArray(mScene, mCameraArray);
+
+    // Convert mesh, NURBS and patch into triangle mesh
+    SetImportStep("Triangulating meshes", 100.0f);
+    FbxGeometryConverter lGeomConverter(mSdkManager);
+    lGeomConverter.Triangulate(mScene, /*replace*/true);
+
+    // Split meshes per material, so that we only have one material per mesh (for VBO support)
+    SetImportStep("Splitting meshes per material", 100.0f);
+    lGeomConverter.SplitMeshesPerMaterial(mScene, /*replace*/true);
+
+    // Index the nodes to evaluate their global positions once per frame.
+    mGlobalPositionCache->Initialize(mScene);
+
+    // Stream the PC2 files for vertex cache deformer playback. The .MC point cache data
+    // is converted into the .PC2 format after the import, see ConvertPointCacheProc.
+    SetImportStep("Preparing point caches", 100.0f);
+    FbxArray<FbxVertexCacheDeformer *> lMayaCacheDeformers;
+    PreparePointCacheData(mScene, mCache_Start, mCache_Stop, lMayaCacheDeformers);
+    const double lFrameRate = FbxTime::GetFrameRate(mScene->GetGlobalSettings().GetTimeMode());
+    for (int lDeformerIndex = 0; lDeformerIndex < lMayaCacheDeformers.GetCount(); ++lDeformerIndex)
+    {
+        PendingPointCache * lPendingPointCache = new PendingPointCache;
+        lPendingPointCache->mDeformer = lMayaCacheDeformers[lDeformerIndex];
+        lPendingPointCache->mFrameRate = lFrameRate;
+        lPendingPointCache->mPointCount = lMayaCacheDeformers[lDeformerIndex]->GetDstObject<FbxGeometry>()->GetControlPointsCount();
+        mPendingPointCaches.Add(lPendingPointCache);
+    }
+
+    // Get the list of pose in the scene
+    FillPoseArray(mScene, mPoseArray);
+
+    // Decode the textures, only for file texture now; the render thread uploads them.
+    // The textures sharing a file are decoded once.
+    SetImportStep("Reading textures", 100.0f);
+    const int lTextureCount = mScene->GetTextureCount();
+    for (int lTextureIndex = 0; lTextureIndex < lTextureCount; ++lTextureIndex)
+    {
+        FbxFileTexture * lFileTexture = FbxCast<FbxFileTexture>(mScene->GetTexture(lTextureIndex));
+        if (!lFileTexture || lFileTexture->GetUserDataPtr())
+            continue;
+
+        // Only TGA textures are supported now.
+        const FbxString lFileName = lFileTexture->GetFileName();
+        if (lFileName.Right(3).Upper() != "TGA")
         {
-            // Set the scene status flag to refresh 
-            // the scene in the first timer callback.
-            mStatus = MUST_BE_REFRESHED;
+            FBXSDK_printf("Only TGA textures are supported now: %s\n", lFileName.Buffer());
+            continue;
+        }
 
-            
-            // mCurrentAnimLayer->
-            // Convert Axis System to what is used in this example, if needed
-            FbxAxisSystem SceneAxisSystem = mScene->GetGlobalSettings().GetAxisSystem();
-            FbxAxisSystem OurAxisSystem(FbxAxisSystem::eYAxis, FbxAxisSystem::eParityOdd, FbxAxisSystem::eRightHanded);
-            if( SceneAxisSystem != OurAxisSystem )
+        const FbxString lFilePath = ResolveTextureFile(lFileTexture, mFileName);
+        if (lFilePath.IsEmpty())
+        {
+            FBXSDK_printf("Failed to load texture file: %s\n", lFileName.Buffer());
+            continue;
+        }
+
+        PendingTexture * lPendingTexture = NULL;
+        for (int lPendingIndex = 0; lPendingIndex < mPendingTextures.GetCount() && !lPendingTexture; ++lPendingIndex)
+        {
+            if (mPendingTextures[lPendingIndex]->mFilePath == lFilePath)
+                lPendingTexture = mPendingTextures[lPendingIndex];
+        }
+        if (!lPendingTexture)
+        {
+            lPendingTexture = new PendingTexture;
+            lPendingTexture->mFilePath = lFilePath;
+            mPendingTextures.Add(lPendingTexture);
+        }
+        lPendingTexture->mTextures.Add(lFileTexture);
+    }
+
+    // The render thread does not deform the meshes while importing, the pool is free.
+    mThreadPool->PushRange(DecodeTextureTask, this, 0, mPendingTextures.GetCount(), 1);
+    mThreadPool->Run();
+
+    for (int lPendingIndex = mPendingTextures.GetCount() - 1; lPendingIndex >= 0; --lPendingIndex)
+    {
+        if (!mPendingTextures[lPendingIndex]->mDecoded)
+        {
+            FBXSDK_printf("Failed to load texture file: %s\n", mPendingTextures[lPendingIndex]->mFilePath.Buffer());
+            delete mPendingTextures[lPendingIndex];
+            mPendingTextures.RemoveAt(lPendingIndex);
+        }
+    }
+
+    // The nodes are baked in the order they are drawn.
+    FillNodeArrayRecursive(mScene->GetRootNode(), mPendingNodes);
+
+    return true;
+}
+
+void SceneContext::DecodeTextureTask(void * pData, int pBegin, int pEnd)
+{
+    SceneContext * lContext = static_cast<SceneContext *>(pData);
+    for (int lPendingIndex = pBegin; lPendingIndex < pEnd && !lContext->mCancelImport; ++lPendingIndex)
+    {
+        PendingTexture * lPendingTexture = lContext->mPendingTextures[lPendingIndex];
+        // TGA only now; the mip chain comes from the texture cache when it is up to date.
+        if (lPendingTexture->mFilePath.Right(3).Upper() == "TGA")
+            lPendingTexture->mDecoded = lPendingTexture->mImage.Load(lPendingTexture->mFilePath.Buffer());
+    }
+}
+
+void SceneContext::ConvertPointCacheProc(void * pArg)
+{
+    SceneContext * lContext = static_cast<SceneContext *>(pArg);
+    for (int lIndex = 0; lIndex < lContext->mPendingPointCaches.GetCount() && !lContext->mCancelImport; ++lIndex)
+    {
+        // The deformer is inactive, the render thread does not read its cache meanwhile.
+        PendingPointCache * lPendingPointCache = lContext->mPendingPointCaches[lIndex];
+        FbxCache * lCache = lPendingPointCache->mDeformer->GetCache();
+        FbxStatus lStatus;
+        if (!lCache->ConvertFromMCToPC2(lPendingPointCache->mFrameRate, 0, &lStatus))
+        {
+            FBXSDK_printf("Failed to convert point cache: %s\n", lStatus.GetErrorString());
+        }
+
+        lPendingPointCache->mOpened = lCache->OpenFileForRead(&lStatus);
+        if (lPendingPointCache->mOpened)
+        {
+            // Stream the converted file.
+            FbxString lRelativeFileName, lAbsoluteFileName;
+            lCache->GetCacheFileName(lRelativeFileName, lAbsoluteFileName);
+            FbxAutoPtr<PointCacheStream> lStream(new PointCacheStream);
+            if (lStream->Open(FbxPathUtils::ChangeExtension(lAbsoluteFileName, ".pc2")) &&
+                lStream->GetPointCount() == lPendingPointCache->mPointCount)
             {
-                OurAxisSystem.ConvertScene(mScene);
+                lPendingPointCache->mStream = lStream.Release();
             }
 
-            // Convert Unit System to what is used in this example, if needed
-            FbxSystemUnit SceneSystemUnit = mScene->GetGlobalSettings().GetSystemUnit();
-            if( SceneSystemUnit.GetScaleFactor() != 1.0 )
+            lPendingPointCache->mStart = FBXSDK_TIME_INFINITE;
+            lPendingPointCache->mStop = FBXSDK_TIME_MINUS_INFINITE;
+            const int lChannelCount = lCache->GetChannelCount();
+            for (int lChannelIndex = 0; lChannelIndex < lChannelCount; ++lChannelIndex)
             {
-                //The unit in this example is centimeter.
-                FbxSystemUnit::cm.ConvertScene( mScene);
+                FbxTime lChannelStart, lChannelStop;
+                if (lCache->GetAnimationRange(lChannelIndex, lChannelStart, lChannelStop))
+                {
+                    if (lChannelStart < lPendingPointCache->mStart) lPendingPointCache->mStart = lChannelStart;
+                    if (lChannelStop > lPendingPointCache->mStop) lPendingPointCache->mStop = lChannelStop;
+                }
             }
+        }
+        lPendingPointCache->mConverted = true;
+    }
+}
+
+void SceneContext::AttachConvertedPointCaches()
+{
+    bool lAttached = false;
+    while (mPendingPointCacheIndex < mPendingPointCaches.GetCount() &&
+        mPendingPointCaches[mPendingPointCacheIndex]->mConverted)
+    {
+        PendingPointCache * lPendingPointCache = mPendingPointCaches[mPendingPointCacheIndex++];
+        if (lPendingPointCache->mOpened)
+        {
+            // Without a stream, the cache is read through the SDK as before.
+            FbxVertexCacheDeformer * lDeformer = lPendingPointCache->mDeformer;
+            lDeformer->SetUserDataPtr(lPendingPointCache->mStream);
+            lPendingPointCache->mStream = NULL;
+            lDeformer->SetActive(true);
+
+            // The time line grows to the range of the cache, as in SetCurrentAnimStack.
+            if (lPendingPointCache->mStart < mCache_Start) mCache_Start = lPendingPointCache->mStart;
+            if (lPendingPointCache->mStop > mCache_Stop) mCache_Stop = lPendingPointCache->mStop;
+            if (mCache_Start < mStart) mStart = mCache_Start;
+            if (mCache_Stop > mStop) mStop = mCache_Stop;
+            lAttached = true;
+        }
+        delete lPendingPointCache;
+    }
+
+    if (lAttached)
+    {
+        DeformationCache::InvalidateAll();
+        mStatus = MUST_BE_REFRESHED;
+    }
 
-            // Get the list of all the animation stack.
-            mScene->FillAnimStackNameArray(mAnimStackNameArray);
+    if (mPendingPointCacheIndex == mPendingPointCaches.GetCount())
+    {
+        mPointCacheThread->Join();
+        delete mPointCacheThread;
+        mPointCacheThread = NULL;
+        mPendingPointCaches.Clear();
+        mPendingPointCacheIndex = 0;
+    }
+}
 
-            // Get the list of all the cameras in the scene.
-            FillCameraArray(mScene, mCameraArray);
+bool SceneContext::FinishImport()
+{
+    mImportThread->Join();
+    delete mImportThread;
+    mImportThread = NULL;
 
-            // Convert mesh, NURBS and patch into triangle mesh
-			FbxGeometryConverter lGeomConverter(mSdkManager);
-			lGeomConverter.Triangulate(mScene, /*replace*/true);
+    // Destroy the importer to release the file.
+    const FbxString lError = mImporter->GetStatus().GetErrorString();
+    mImporter->Destroy();
+    mImporter = NULL;
 
-			// Split meshes per material, so that we only have one material per mesh (for VBO support)
-			lGeomConverter.SplitMeshesPerMaterial(mScene, /*replace*/true);
+    if (!mImportResult)
+    {
+        // Import failed, set the scene status flag accordingly.
+        mStatus = UNLOADED;
 
-            // Bake the scene for one frame
-            LoadCacheRecursive(mScene, mCurrentAnimLayer, mFileName, mSupportVBO);
+        mWindowMessage = "Unable to import file ";
+        mWindowMessage += mFileName;
+        mWindowMessage += "\nError reported: ";
+        mWindowMessage += lError;
+        return false;
+    }
 
-            // Convert any .PC2 point cache data into the .MC format for 
-            // vertex cache deformer playback.
-            PreparePointCacheData(mScene, mCache_Start, mCache_Stop);
+    // Set the scene status flag to refresh
+    // the scene in the first timer callback.
+    mStatus = MUST_BE_REFRESHED;
 
-            // Get the list of pose in the scene
-            FillPoseArray(mScene, mPoseArray);
+    GlobalPositionCache::SetCurrent(mGlobalPositionCache);
 
-            // Initialize the window message.
-            mWindowMessage = "File ";
-            mWindowMessage += mFileName;
-            mWindowMessage += "\nClick on the right mouse button to enter menu.";
-            mWindowMessage += "\nEsc to exit.";
+    // Convert the Maya caches while the scene is shown.
+    if (mPendingPointCaches.GetCount())
+    {
+        mPointCacheThread = new FbxThread(ConvertPointCacheProc, this);
+    }
 
-            // Initialize the frame period.
-            mFrameTime.SetTime(0, 0, 0, 1, 0, mScene->GetGlobalSettings().GetTimeMode());
+    // Meshes appear as their VBO is created, rather than in immediate mode before.
+    SetSkipMeshesWithoutVBO(mSupportVBO);
 
-            // Print the keyboard shortcuts.
-            FBXSDK_printf("Play/Pause Animation: Space Bar.\n");
-            FBXSDK_printf("Camera Rotate: Left Mouse Button.\n");
-            FBXSDK_printf("Camera Pan: Left Mouse Button + Middle Mouse Button.\n");
-            FBXSDK_printf("Camera Zoom: Middle Mouse Button.\n");
+    // Initialize the frame period.
+    mFrameTime.SetTime(0, 0, 0, 1, 0, mScene->GetGlobalSettings().GetTimeMode());
 
-            lResult = true;
+    // Select the active animation stack before baking any node, the lights are baked
+    // with its base layer.
+    int lCurrentAnimStackIndex = 0;
+    for (int lAnimStackIndex = 0; lAnimStackIndex < mAnimStackNameArray.GetCount(); ++lAnimStackIndex)
+    {
+        if (mAnimStackNameArray[lAnimStackIndex]->Compare(mScene->ActiveAnimStackName.Get()) == 0)
+        {
+            lCurrentAnimStackIndex = lAnimStackIndex;
         }
-        else
+    }
+    SetCurrentAnimStack(lCurrentAnimStackIndex);
+
+    // Print the keyboard shortcuts.
+    FBXSDK_printf("Play/Pause Animation: Space Bar.\n");
+    FBXSDK_printf("Camera Rotate: Left Mouse Button.\n");
+    FBXSDK_printf("Camera Pan: Left Mouse Button + Middle Mouse Button.\n");
+    FBXSDK_printf("Camera Zoom: Middle Mouse Button.\n");
+    FBXSDK_printf("Single Precision/GPU/Double Precision Skinning: K.\n");
+    FBXSDK_printf("Transform Cache and Culling Statistics: T.\n");
+    FBXSDK_printf("Frustum Culling: F.\n");
+    FBXSDK_printf("Levels of Detail: L.\n");
+    FBXSDK_printf("Bake/Release Animation Clip: B.\n");
+    FBXSDK_printf("Cache Recent Deformations: C.\n");
+    FBXSDK_printf("Frame Profile: P.\n");
+    FBXSDK_printf("Record Frame Trace: R.\n");
+
+    BakePendingCaches();
+
+    return true;
+}
+
+void SceneContext::BakePendingCaches()
+{
+    // Textures first, the materials baked with the nodes refer to them.
+    int lTextureBudget = TEXTURE_UPLOAD_BUDGET;
+    while (mPendingTextureIndex < mPendingTextures.GetCount() && lTextureBudget-- > 0)
+    {
+        PendingTexture * lPendingTexture = mPendingTextures[mPendingTextureIndex++];
+        const GLuint lTextureObject = lPendingTexture->mImage.Upload();
+        mTextureObjects.Add(lTextureObject);
+        for (int lIndex = 0; lIndex < lPendingTexture->mTextures.GetCount(); ++lIndex)
         {
-            // Import failed, set the scene status flag accordingly.
-            mStatus = UNLOADED;
+            lPendingTexture->mTextures[lIndex]->SetUserDataPtr(new GLuint(lTextureObject));
+        }
+        delete lPendingTexture;
+    }
 
-            mWindowMessage = "Unable to import file ";
-            mWindowMessage += mFileName;
-            mWindowMessage += "\nError reported: ";
-            mWindowMessage += mImporter->GetStatus().GetErrorString();
+    if (mPendingTextureIndex == mPendingTextures.GetCount())
+    {
+        int lVertexBudget = BAKE_VERTEX_BUDGET;
+        while (mPendingNodeIndex < mPendingNodes.GetCount() && lVertexBudget > 0)
+        {
+            FbxNode * lNode = mPendingNodes[mPendingNodeIndex++];
+            LoadNodeCache(lNode, mCurrentAnimLayer, mSupportVBO);
+            lVertexBudget -= NODE_BAKE_COST + (lNode->GetMesh() ? lNode->GetMesh()->GetControlPointsCount() : 0);
         }
+    }
 
-        // Destroy the importer to release the file.
-        mImporter->Destroy();
-        mImporter = NULL;
+    if (mPendingNodeIndex < mPendingNodes.GetCount())
+    {
+        char lProgress[64];
+        FBXSDK_sprintf(lProgress, sizeof(lProgress), "\nBaking scene: %d / %d", mPendingTextureIndex + mPendingNodeIndex,
+            mPendingTextures.GetCount() + mPendingNodes.GetCount());
+        mWindowMessage = "File ";
+        mWindowMessage += mFileName;
+        mWindowMessage += lProgress;
+        return;
     }
 
-    return lResult;
+    // Everything is baked.
+    mPendingTextures.Clear();
+    mPendingTextureIndex = 0;
+    mPendingNodes.Clear();
+    mPendingNodeIndex = 0;
+    SetSkipMeshesWithoutVBO(false);
+
+    // Initialize the window message.
+    mWindowMessage = "File ";
+    mWindowMessage += mFileName;
+    mWindowMessage += "\nClick on the right mouse button to enter menu.";
+    mWindowMessage += "\nEsc to exit.";
 }
 
 void SceneContext::convertToSkeleton(){
@@ -845,6 +1286,10 @@ bool SceneContext::SetCurrentAnimStack(int pIndex)
    // we assume that the first animation layer connected to the animation stack is the base layer
    // (this is the assumption made in the FBXSDK)
    mCurrentAnimLayer = lCurrentAnimationStack->GetMember<FbxAnimLayer>();
+   // A baked clip belongs to the previous animation stack.
+   mGlobalPositionCache->SetClip(NULL);
+   mAnimationClip->Unload();
+   DeformationCache::InvalidateAll();
    mScene->GetEvaluator()->SetContext(lCurrentAnimationStack);
 
    FbxTakeInfo* lCurrentTakeInfo = mScene->GetTakeInfo(*(mAnimStackNameArray[pIndex]));
@@ -903,6 +1348,10 @@ bool SceneContext::SetCurrentPoseIndex(int pPoseIndex)
 
 void SceneContext::OnTimerClick() const
 {
+    // Nothing to play before the scene is imported.
+    if (mStatus == IMPORTING)
+        return;
+
     // Loop in the animation stack if not paused.
     if (mStop > mStart && !mPause)
     {
@@ -930,10 +1379,15 @@ void SceneContext::OnTimerClick() const
 // Redraw the scene
 bool SceneContext::OnDisplay()
 {
+    // Collect the previous frame, all its scopes are closed and the workers are idle.
+    if (Profiler::IsRecording())
+        Profiler::EndFrame();
+    PROFILE_SCOPE("OnDisplay");
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Test if the scene has been loaded yet.
-    if (mStatus != UNLOADED && mStatus != MUST_BE_LOADED)
+    if (mStatus != UNLOADED && mStatus != MUST_BE_LOADED && mStatus != IMPORTING)
     {
         glPushAttrib(GL_ENABLE_BIT);
         glPushAttrib(GL_LIGHTING_BIT);
@@ -941,31 +1395,46 @@ bool SceneContext::OnDisplay()
         // Draw the front face only, except for the texts and lights.
         glEnable(GL_CULL_FACE);
 
-        // Set the view to the current camera settings.
-        SetCamera(mScene, mCurrentTime, mCurrentAnimLayer, mCameraArray,
-            mWindowWidth, mWindowHeight);
-
         FbxPose * lPose = NULL;
         if (mPoseIndex != -1)
         {
             lPose = mScene->GetPose(mPoseIndex);
         }
 
+        // Evaluate the global position of every node once for this frame.
+        {
+            PROFILE_SCOPE("GlobalPositionCache");
+            mGlobalPositionCache->Fill(mCurrentTime, lPose);
+        }
+
+        // Set the view to the current camera settings.
+        {
+            PROFILE_SCOPE("SetCamera");
+            SetCamera(mScene, mCurrentTime, mCurrentAnimLayer, mCameraArray,
+                mWindowWidth, mWindowHeight);
+        }
+
         // If one node is selected, draw it and its children.
+        // Otherwise, draw the whole scene.
+        FbxNode * lRootNode = mSelectedNode ? mSelectedNode : mScene->GetRootNode();
         FbxAMatrix lDummyGlobalPosition;
-        
-        if (mSelectedNode)
+
+        // Set the lighting before other things.
         {
-            // Set the lighting before other things.
+            PROFILE_SCOPE("InitializeLights");
             InitializeLights(mScene, mCurrentTime, lPose);
-            DrawNodeRecursive(mSelectedNode, mCurrentTime, mCurrentAnimLayer, lDummyGlobalPosition, lPose, mShadingMode);
-            DisplayGrid(lDummyGlobalPosition);
         }
-        // Otherwise, draw the whole scene.
-        else
         {
-            InitializeLights(mScene, mCurrentTime, lPose);
-            DrawNodeRecursive(mScene->GetRootNode(), mCurrentTime, mCurrentAnimLayer, lDummyGlobalPosition, lPose, mShadingMode);
+            PROFILE_SCOPE("ComputeDeformations");
+            ComputeDeformations(lRootNode, mCurrentTime, mCurrentAnimLayer, lDummyGlobalPosition, lPose, mThreadPool);
+        }
+        {
+            PROFILE_SCOPE("DrawNodeRecursive");
+            DrawNodeRecursive(lRootNode, mCurrentTime, mCurrentAnimLayer, lDummyGlobalPosition, lPose, mShadingMode);
+        }
+        ReleaseDeformations();
+        {
+            PROFILE_SCOPE("DisplayGrid");
             DisplayGrid(lDummyGlobalPosition);
         }
 
@@ -987,6 +1456,10 @@ void SceneContext::OnReshape(int pWidth, int pHeight)
 
 void SceneContext::OnKeyboard(unsigned char pKey)
 {
+    // The scene belongs to the import thread meanwhile.
+    if (mStatus == IMPORTING)
+        return;
+
     // Zoom In on '+' or '=' keypad keys
     if (pKey == 43 || pKey == 61)
     {
@@ -1022,10 +1495,112 @@ void SceneContext::OnKeyboard(unsigned char pKey)
     {
         SetPause(!GetPause());
     }
+
+    // 'T' show/hide the hits and misses of the global position cache
+    if (pKey == 'T' || pKey == 't')
+    {
+        mShowTransformStatistics = !mShowTransformStatistics;
+        mStatus = MUST_BE_REFRESHED;
+    }
+
+    // 'F' turn on/off the frustum culling
+    if (pKey == 'F' || pKey == 'f')
+    {
+        SetFrustumCulling(!GetFrustumCulling());
+        FBXSDK_printf("Frustum culling: %s\n", GetFrustumCulling() ? "on" : "off");
+        mStatus = MUST_BE_REFRESHED;
+    }
+
+    // 'L' turn on/off the levels of detail
+    if (pKey == 'L' || pKey == 'l')
+    {
+        SetLodSelection(!GetLodSelection());
+        FBXSDK_printf("Levels of detail: %s\n", GetLodSelection() ? "on" : "off");
+        mStatus = MUST_BE_REFRESHED;
+    }
+
+    // 'P' show/hide the average time per frame of the frame stages
+    if (pKey == 'P' || pKey == 'p')
+    {
+        Profiler::SetEnabled(!Profiler::IsEnabled());
+        mStatus = MUST_BE_REFRESHED;
+    }
+
+    // 'R' start/stop writing the frame stages into a Chrome trace next to the file
+    if (pKey == 'R' || pKey == 'r')
+    {
+        if (Profiler::IsTracing())
+        {
+            Profiler::StopTrace();
+        }
+        else
+        {
+            FbxString lTraceFileName(mFileName);
+            lTraceFileName += ".trace.json";
+            if (Profiler::StartTrace(lTraceFileName.Buffer()))
+                FBXSDK_printf("Writing the frame trace to %s\n", lTraceFileName.Buffer());
+            else
+                FBXSDK_printf("Failed to open the frame trace %s\n", lTraceFileName.Buffer());
+        }
+    }
+
+    // 'B' bake the current animation stack into a clip next to the file and play it,
+    // or release the clip and go back to the animation curves.
+    if ((pKey == 'B' || pKey == 'b') && mStatus != UNLOADED && mStatus != MUST_BE_LOADED)
+    {
+        if (mAnimationClip->IsLoaded())
+        {
+            mGlobalPositionCache->SetClip(NULL);
+            mAnimationClip->Unload();
+        }
+        else
+        {
+            FbxString lClipFileName(mFileName);
+            lClipFileName += ".clip";
+            if (AnimationClip::Bake(mScene, mCurrentAnimLayer, mStart, mStop, mFrameTime, lClipFileName.Buffer()) &&
+                mAnimationClip->Load(lClipFileName.Buffer()))
+            {
+                mGlobalPositionCache->SetClip(mAnimationClip);
+                FBXSDK_printf("Playing %d joints, %d frames from %s\n", mAnimationClip->GetJointCount(),
+                    mAnimationClip->GetFrameCount(), lClipFileName.Buffer());
+            }
+            else
+            {
+                FBXSDK_printf("Failed to bake the animation clip %s\n", lClipFileName.Buffer());
+            }
+        }
+        DeformationCache::InvalidateAll();
+        mStatus = MUST_BE_REFRESHED;
+    }
+
+    // 'K' switch the linear skinning between the single precision kernel, the GPU
+    // and the double precision reference.
+    if (pKey == 'K' || pKey == 'k')
+    {
+        if (SkinCache::GetSkinningPath() == SkinCache::SKINNING_PATH_FLOAT)
+            SkinCache::SetSkinningPath(SkinCache::SKINNING_PATH_GPU);
+        else if (SkinCache::GetSkinningPath() == SkinCache::SKINNING_PATH_GPU)
+            SkinCache::SetSkinningPath(SkinCache::SKINNING_PATH_REFERENCE);
+        else
+            SkinCache::SetSkinningPath(SkinCache::SKINNING_PATH_FLOAT);
+        DeformationCache::InvalidateAll();
+        mStatus = MUST_BE_REFRESHED;
+    }
+
+    // 'C' keep the recently deformed frames of every mesh, for scrubbing, or only the current one.
+    if (pKey == 'C' || pKey == 'c')
+    {
+        DeformationCache::SetCapacity(DeformationCache::GetCapacity() ? 0 : DEFORMATION_CACHE_FRAMES);
+        FBXSDK_printf("Deformation cache: %d frames per mesh\n", DeformationCache::GetCapacity());
+    }
 }
 
 void SceneContext::OnMouse(int pButton, int pState, int pX, int pY)
 {
+    // The scene belongs to the import thread meanwhile.
+    if (mStatus == IMPORTING)
+        return;
+
     // Move the camera (orbit, zoom or pan) with the mouse.
     FbxCamera* lCamera = GetCurrentCamera(mScene);
     if (lCamera)
@@ -1099,6 +1674,10 @@ void SceneContext::OnMouse(int pButton, int pState, int pX, int pY)
 
 void SceneContext::OnMouseMotion(int pX, int pY)
 {
+    // The scene belongs to the import thread meanwhile.
+    if (mStatus == IMPORTING)
+        return;
+
     int motion;
 
     switch (mCameraStatus)
@@ -1153,6 +1732,35 @@ void SceneContext::DisplayWindowMessage()
     mDrawText->SetPointSize(15.f);
     mDrawText->Display(mWindowMessage.Buffer());
 
+    if (mShowTransformStatistics && mStatus != UNLOADED && mStatus != MUST_BE_LOADED && mStatus != IMPORTING)
+    {
+        char lStatistics[128];
+        FBXSDK_sprintf(lStatistics, 128, "Transforms: %d nodes, %d hits, %d misses",
+            mGlobalPositionCache->GetNodeCount(), mGlobalPositionCache->GetHitCount(), mGlobalPositionCache->GetMissCount());
+
+        // Below the window message.
+        glLoadIdentity();
+        glTranslatef(lX, 20, 0);
+        mDrawText->Display(lStatistics);
+
+        int lVisitedNodeCount, lCulledNodeCount, lDrawnNodeCount;
+        GetCullingStatistics(lVisitedNodeCount, lCulledNodeCount, lDrawnNodeCount);
+        FBXSDK_sprintf(lStatistics, 128, "Culling %s: %d visited, %d culled, %d drawn",
+            GetFrustumCulling() ? "on" : "off", lVisitedNodeCount, lCulledNodeCount, lDrawnNodeCount);
+        glLoadIdentity();
+        glTranslatef(lX, 40, 0);
+        mDrawText->Display(lStatistics);
+    }
+
+    if (Profiler::IsEnabled())
+    {
+        // Under the window message, the last stage ends up a few lines above the bottom.
+        const FbxString lSummary = Profiler::GetSummary();
+        glLoadIdentity();
+        glTranslatef(lX, lY - 40, 0);
+        mDrawText->Display(lSummary.Buffer());
+    }
+
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
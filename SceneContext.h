@@ -18,6 +18,9 @@ this software in either electronic or hard copy form.
 #include "Frame.h"
 
 class DrawText;
+class ThreadPool;
+class GlobalPositionCache;
+class AnimationClip;
 
 // This class is responsive for loading files and recording current status as
 // a bridge between window system such as GLUT or Qt and a specific FBX scene.
@@ -28,6 +31,7 @@ public:
     {
         UNLOADED,               // Unload file or load failure;
         MUST_BE_LOADED,         // Ready for loading file;
+        IMPORTING,              // Importing file on a worker thread;
         MUST_BE_REFRESHED,      // Something changed and redraw needed;
         REFRESHED               // No redraw needed.
     };
@@ -39,8 +43,14 @@ public:
 
     // Return the FBX scene for more informations.
     const FbxScene * GetScene() const { return mScene; }
-    // Load the FBX or COLLADA file into memory.
+    // Start loading the FBX or COLLADA file into memory on a worker thread.
     bool LoadFile();
+    // Call this method on every timer callback while loading. Once the import is done,
+    // the caches of the scene are baked a few at a time and the scene is drawn as they
+    // become ready. Return true when the import just finished and the menus can be created.
+    bool UpdateLoading();
+    // Whether the file is still being imported or baked.
+    bool IsLoading() const;
 
     // The time period for one frame.
     const FbxTime GetFrameTime() const { return mFrameTime; }
@@ -100,6 +110,28 @@ private:
     // Display a X-Z grid.
     void DisplayGrid(const FbxAMatrix & pTransform);
 
+    // Texture decoded by the import thread, uploaded by the render thread.
+    struct PendingTexture;
+    // Maya cache converted to PC2 by the conversion thread, played once the render thread
+    // hooks its stream.
+    struct PendingPointCache;
+
+    static void ImportProc(void * pArg);
+    static bool ImportProgress(void * pArgs, float pPercentage, const char * pStatus);
+    // Import and convert the scene, everything which does not need the GL context.
+    bool ImportScene();
+    void SetImportStep(const char * pStep, float pProgress);
+    // Decode the pending textures [pBegin, pEnd) on the thread pool.
+    static void DecodeTextureTask(void * pData, int pBegin, int pEnd);
+    // Back on the render thread once the import thread is done.
+    bool FinishImport();
+    // Upload the decoded textures and bake the caches of the nodes within the frame budget.
+    void BakePendingCaches();
+    // Convert the pending Maya caches in turn, on a thread of its own after the import.
+    static void ConvertPointCacheProc(void * pArg);
+    // Play the point caches converted so far.
+    void AttachConvertedPointCaches();
+
     enum CameraStatus
     {
         CAMERA_NOTHING,
@@ -142,6 +174,34 @@ private:
     int mWindowWidth, mWindowHeight;
     // Utility class for draw text in OpenGL.
     DrawText * mDrawText;
+    // Threads deforming the meshes before drawing.
+    ThreadPool * mThreadPool;
+    // Global positions of the nodes, evaluated once per frame.
+    GlobalPositionCache * mGlobalPositionCache;
+    // Display the hits and misses of the global position cache.
+    bool mShowTransformStatistics;
+    // Current animation stack baked to a file, played instead of the curves when loaded.
+    AnimationClip * mAnimationClip;
+
+    // Import thread, and its progress for the window message.
+    FbxThread * mImportThread;
+    volatile bool mImportDone;
+    volatile bool mCancelImport;
+    bool mImportResult;
+    FbxSpinLock mImportLock;
+    FbxString mImportStep;
+    float mImportProgress;
+    // Textures and nodes still to bake after the import, in that order.
+    FbxArray<PendingTexture *> mPendingTextures;
+    int mPendingTextureIndex;
+    // The uploaded texture objects, one per file whatever the file textures sharing it.
+    FbxArray<GLuint> mTextureObjects;
+    FbxArray<FbxNode *> mPendingNodes;
+    int mPendingNodeIndex;
+    // Maya caches being converted, the ones before the index are attached.
+    FbxThread * mPointCacheThread;
+    FbxArray<PendingPointCache *> mPendingPointCaches;
+    int mPendingPointCacheIndex;
 
     Motion* motion;
     bool setAnim;
@@ -4,6 +4,7 @@
 
 #include "Skeleton.h"
 #include "Frame.h"
+#include "Motion.h"
 #include "Transformation.h"
 #include <fstream>
 
@@ -25,6 +26,7 @@ void Skeleton::Clear()
 {
 	m_pRoot = NULL;
 	m_joints.clear();
+    m_fkJoints.clear();
 }
 
 Skeleton::Skeleton(const Skeleton& skeleton)
@@ -41,6 +43,7 @@ Skeleton& Skeleton::operator=(const Skeleton& orig)
     }
 
     m_joints.clear();
+    m_fkJoints.clear();
     m_pRoot = 0;
     AMC = orig.AMC;
 
@@ -431,24 +434,53 @@ void Skeleton::AddJoint(Joint* joint, bool isRoot)
     joint->SetID(m_joints.size());
     m_joints.push_back(joint);
     if (isRoot) m_pRoot = joint;
+    m_fkJoints.clear();
 }
 
 void Skeleton::ReadFromFrame(const Frame& pFrame)
+{
+    ReadPose(pFrame);
+}
+
+void Skeleton::ReadFromFrame(const FrameView& pFrame)
+{
+    ReadPose(pFrame);
+}
+
+template <class FrameType>
+void Skeleton::ReadPose(const FrameType& pFrame)
 {
 	if (m_joints.size() != pFrame.GetNumJoints())
     {
         std::cout << "ERROR: Cannot read pose from frame: number of joints differ\n";
 		return;
     }
-
     m_pRoot->SetLocalTranslation(pFrame.GetRootTranslation() * mScale);
-	for (unsigned int i = 0; i < m_joints.size(); i++)
-	{
-        Joint* joint = m_joints[i];
+    if (!FlattenHierarchy())
+    {
+	    for (unsigned int i = 0; i < m_joints.size(); i++)
+	    {
+            m_joints[i]->SetLocalRotation(pFrame.GetJointRotation(m_joints[i]->GetID()));
+	    }
+        UpdateFK(m_pRoot);
+        return;
+    }
+
+    // One pass in hierarchy order sets the joints and gathers their local transforms
+    for (unsigned int i = 0; i < m_fkJoints.size(); i++)
+    {
+        Joint* joint = m_fkJoints[i];
         joint->SetLocalRotation(pFrame.GetJointRotation(joint->GetID()));
-	}
+        m_fkLocal[i] = joint->m_local;
+    }
 
-	UpdateFK(m_pRoot);
+    ComputeFlatFK();
+}
+
+const Transform& Skeleton::GetGlobalTransform(unsigned int id) const
+{
+    if (m_fkJoints.empty()) return m_joints[id]->GetGlobalTransform();
+    return m_fkGlobal[m_fkPositions[id]];
 }
 
 void Skeleton::WriteToFrame(Frame& pFrame) const
@@ -472,7 +504,79 @@ void Skeleton::UpdateFK(Joint* pRoot)
 {
    if (!pRoot) pRoot = m_pRoot;
    if (!pRoot) return; // Nothing loaded
-   pRoot->UpdateTransformation(true);
+
+   // A sub tree is updated recursively, the whole skeleton in one loop
+   if (pRoot != m_pRoot || !FlattenHierarchy())
+   {
+       pRoot->UpdateTransformation(true);
+       for (unsigned int i = 0; i < m_fkJoints.size(); i++)
+       {
+           m_fkGlobal[i] = m_fkJoints[i]->m_global;
+       }
+       return;
+   }
+
+   for (unsigned int i = 0; i < m_fkJoints.size(); i++)
+   {
+       m_fkLocal[i] = m_fkJoints[i]->m_local;
+   }
+   ComputeFlatFK();
+}
+
+// Order the joints with parents before children, unless it is up to date.
+// Return false if some joints are not under the root.
+bool Skeleton::FlattenHierarchy()
+{
+    if (!m_pRoot) return false;
+
+    // Still valid if no joint was added and every joint kept its parent
+    bool valid = m_fkJoints.size() == m_joints.size();
+    for (unsigned int i = 1; valid && i < m_fkJoints.size(); i++)
+    {
+        valid = m_fkJoints[i]->GetParent() == m_fkJoints[m_fkParents[i]];
+    }
+    if (valid) return true;
+
+    m_fkJoints.clear();
+    m_fkParents.clear();
+    m_fkPositions.assign(m_joints.size(), 0);
+
+    m_fkJoints.push_back(m_pRoot);
+    m_fkParents.push_back(-1);
+    for (unsigned int i = 0; i < m_fkJoints.size(); i++)
+    {
+        Joint* joint = m_fkJoints[i];
+        m_fkPositions[joint->GetID()] = i;
+        for (unsigned int c = 0; c < joint->GetNumChildren(); c++)
+        {
+            m_fkJoints.push_back(joint->GetChildAt(c));
+            m_fkParents.push_back(i);
+        }
+    }
+
+    m_fkLocal.resize(m_fkJoints.size());
+    m_fkGlobal.resize(m_fkJoints.size());
+    if (m_fkJoints.size() != m_joints.size())
+    {
+        m_fkJoints.clear();
+        return false;
+    }
+    return true;
+}
+
+// Forward kinematics over the flat arrays, then copy the global transforms to the joints
+void Skeleton::ComputeFlatFK()
+{
+    m_fkGlobal[0] = m_fkLocal[0];
+    for (unsigned int i = 1; i < m_fkJoints.size(); i++)
+    {
+        m_fkGlobal[i] = m_fkGlobal[m_fkParents[i]] * m_fkLocal[i];
+    }
+
+    for (unsigned int i = 0; i < m_fkJoints.size(); i++)
+    {
+        m_fkJoints[i]->m_global = m_fkGlobal[i];
+    }
 }
 
 vec3 Skeleton::GetDimensions() 
@@ -8,6 +8,7 @@
 #include "Joint.h"
 
 class Frame;
+class FrameView;
 class Player;
 class Skeleton
 {
@@ -18,7 +19,7 @@ public:
 	virtual ~Skeleton();
     virtual void Clear();
 
-    void UpdateFK(Joint* pRoot = NULL);
+    void UpdateFK(Joint* pRoot = NULL);	// From the root, FK is one loop over the flattened hierarchy
 
     bool LoadFromBVHFile(std::ifstream& inFile);
     void SaveToBVHFile(std::ofstream& outFile);
@@ -31,6 +32,8 @@ public:
 	size_t GetNumJoints() const { return m_joints.size(); }
 
 	void ReadFromFrame(const Frame& pFrame);
+	void ReadFromFrame(const FrameView& pFrame);
+	const Transform& GetGlobalTransform(unsigned int id) const;	// Global transform of the joint ID after FK
 	void WriteToFrame(Frame& frame) const;
 
     vec3 GetDimensions() ;
@@ -45,6 +48,17 @@ protected:
     void ReadJointFromASFFile(std::ifstream& inFile);
     void SaveToFileBVHRec(std::ofstream& outFile, Joint* pJoint, unsigned int level);
 
+    // Flattened hierarchy: the joints with parents before children, and their transforms
+    // in contiguous arrays. Rebuilt when the joints or their parents change.
+    template <class FrameType> void ReadPose(const FrameType& pFrame);
+    bool FlattenHierarchy();
+    void ComputeFlatFK();
+    std::vector<Joint*> m_fkJoints;
+    std::vector<int> m_fkParents;   // position of the parent in m_fkJoints, -1 for the root
+    std::vector<unsigned int> m_fkPositions;    // position of every joint ID in m_fkJoints
+    std::vector<Transform> m_fkLocal;
+    std::vector<Transform> m_fkGlobal;
+
     float mScale;
     
 	Joint* m_pRoot;
@@ -199,13 +199,13 @@ void SkeletonMesh::setupSkin(const Skeleton& skeleton)
 
 void SkeletonMesh::updateSkin(const Skeleton& skeleton)
 {
-    myAnimPose_Local2Global.clear();
+    // Read the global transforms from the flat arrays of the last FK
+    myAnimPose_Local2Global.resize(skeleton.GetNumJoints());
     int index = 0;
     for (unsigned int j = 0; j < skeleton.GetNumJoints(); j++)
     {
-        Joint* joint = skeleton.GetJointByID(j);
-        Transform jlocal2global = joint->GetGlobalTransform();
-        myAnimPose_Local2Global.push_back(jlocal2global);
+        const Transform& jlocal2global = skeleton.GetGlobalTransform(j);
+        myAnimPose_Local2Global[j] = jlocal2global;
 
         GLfloat mat[16];
         ToGLMatrix(jlocal2global, mat);
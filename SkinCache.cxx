@@ -0,0 +1,858 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "SkinCache.h"
+#include "GetPosition.h"
+
+// Use SSE for the single precision kernel when the target guarantees it.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define SKIN_CACHE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    // Four floats for every position, as in the VBO.
+    const int VERTEX_STRIDE = 4;
+
+    // Growth of the bounds of dual quaternion skins on every side, as a fraction of their size.
+    const double DUAL_QUATERNION_BOUNDS_MARGIN = 0.1;
+
+    // Grow the box to the point, or start it there.
+    void ExpandBounds(const FbxVector4 & pPoint, bool & pHasBounds, FbxVector4 & pMin, FbxVector4 & pMax)
+    {
+        if (!pHasBounds)
+        {
+            pMin = pPoint;
+            pMax = pPoint;
+            pHasBounds = true;
+            return;
+        }
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            if (pPoint[lAxis] < pMin[lAxis])
+                pMin[lAxis] = pPoint[lAxis];
+            if (pPoint[lAxis] > pMax[lAxis])
+                pMax[lAxis] = pPoint[lAxis];
+        }
+    }
+
+    // Turn a bone matrix into its additive influence: M * weight + I * (1 - weight).
+    void MatrixBlendWithIdentity(FbxAMatrix& pMatrix, double pWeight)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                pMatrix[i][j] *= pWeight;
+            }
+            pMatrix[i][i] += 1.0 - pWeight;
+        }
+    }
+
+    // Dual quaternion of the rotation and translation of a bone matrix, which transforms
+    // a point as FbxAMatrix::MultT does.
+    template <class T>
+    void ConvertToDualQuaternion(const FbxAMatrix & pMatrix, T * pDualQuaternion)
+    {
+        // The rows of the matrix are the images of the axes, drop their scaling.
+        double lAxes[3][3];
+        for (int i = 0; i < 3; ++i)
+        {
+            const double lLength = sqrt(pMatrix[i][0] * pMatrix[i][0] + pMatrix[i][1] * pMatrix[i][1] + pMatrix[i][2] * pMatrix[i][2]);
+            const double lInverse = lLength > 0.0 ? 1.0 / lLength : 0.0;
+            for (int j = 0; j < 3; ++j)
+            {
+                lAxes[i][j] = pMatrix[i][j] * lInverse;
+            }
+        }
+
+        // R[i][j] of the column vector convention is lAxes[j][i].
+        double lQ[4];
+        const double lTrace = lAxes[0][0] + lAxes[1][1] + lAxes[2][2];
+        if (lTrace > 0.0)
+        {
+            const double lS = sqrt(lTrace + 1.0) * 2.0;
+            lQ[0] = (lAxes[1][2] - lAxes[2][1]) / lS;
+            lQ[1] = (lAxes[2][0] - lAxes[0][2]) / lS;
+            lQ[2] = (lAxes[0][1] - lAxes[1][0]) / lS;
+            lQ[3] = 0.25 * lS;
+        }
+        else if (lAxes[0][0] > lAxes[1][1] && lAxes[0][0] > lAxes[2][2])
+        {
+            const double lS = sqrt(1.0 + lAxes[0][0] - lAxes[1][1] - lAxes[2][2]) * 2.0;
+            lQ[0] = 0.25 * lS;
+            lQ[1] = (lAxes[1][0] + lAxes[0][1]) / lS;
+            lQ[2] = (lAxes[2][0] + lAxes[0][2]) / lS;
+            lQ[3] = (lAxes[1][2] - lAxes[2][1]) / lS;
+        }
+        else if (lAxes[1][1] > lAxes[2][2])
+        {
+            const double lS = sqrt(1.0 + lAxes[1][1] - lAxes[0][0] - lAxes[2][2]) * 2.0;
+            lQ[0] = (lAxes[1][0] + lAxes[0][1]) / lS;
+            lQ[1] = 0.25 * lS;
+            lQ[2] = (lAxes[2][1] + lAxes[1][2]) / lS;
+            lQ[3] = (lAxes[2][0] - lAxes[0][2]) / lS;
+        }
+        else
+        {
+            const double lS = sqrt(1.0 + lAxes[2][2] - lAxes[0][0] - lAxes[1][1]) * 2.0;
+            lQ[0] = (lAxes[2][0] + lAxes[0][2]) / lS;
+            lQ[1] = (lAxes[2][1] + lAxes[1][2]) / lS;
+            lQ[2] = 0.25 * lS;
+            lQ[3] = (lAxes[0][1] - lAxes[1][0]) / lS;
+        }
+
+        // Dual part: half the translation times the rotation.
+        const double lT[3] = {pMatrix[3][0], pMatrix[3][1], pMatrix[3][2]};
+        pDualQuaternion[0] = static_cast<T>(lQ[0]);
+        pDualQuaternion[1] = static_cast<T>(lQ[1]);
+        pDualQuaternion[2] = static_cast<T>(lQ[2]);
+        pDualQuaternion[3] = static_cast<T>(lQ[3]);
+        pDualQuaternion[4] = static_cast<T>(0.5 * (lQ[3] * lT[0] + lT[1] * lQ[2] - lT[2] * lQ[1]));
+        pDualQuaternion[5] = static_cast<T>(0.5 * (lQ[3] * lT[1] + lT[2] * lQ[0] - lT[0] * lQ[2]));
+        pDualQuaternion[6] = static_cast<T>(0.5 * (lQ[3] * lT[2] + lT[0] * lQ[1] - lT[1] * lQ[0]));
+        pDualQuaternion[7] = static_cast<T>(-0.5 * (lT[0] * lQ[0] + lT[1] * lQ[1] + lT[2] * lQ[2]));
+    }
+
+    // Normalize a blended dual quaternion and transform the point with it.
+    template <class T>
+    void DeformWithDualQuaternion(const T * pDualQuaternion, T pX, T pY, T pZ, T * pResult)
+    {
+        const T lLengthSquare = pDualQuaternion[0] * pDualQuaternion[0] + pDualQuaternion[1] * pDualQuaternion[1] +
+            pDualQuaternion[2] * pDualQuaternion[2] + pDualQuaternion[3] * pDualQuaternion[3];
+        const T lInverse = lLengthSquare > 0 ? 1 / sqrt(lLengthSquare) : 0;
+        const T lX = pDualQuaternion[0] * lInverse, lY = pDualQuaternion[1] * lInverse;
+        const T lZ = pDualQuaternion[2] * lInverse, lW = pDualQuaternion[3] * lInverse;
+        const T lDX = pDualQuaternion[4] * lInverse, lDY = pDualQuaternion[5] * lInverse;
+        const T lDZ = pDualQuaternion[6] * lInverse, lDW = pDualQuaternion[7] * lInverse;
+
+        // Rotate: p + 2 * v x (v x p + w * p).
+        const T lCX = lY * pZ - lZ * pY + lW * pX;
+        const T lCY = lZ * pX - lX * pZ + lW * pY;
+        const T lCZ = lX * pY - lY * pX + lW * pZ;
+        // Translate by twice the vector part of the dual part times the conjugate rotation.
+        pResult[0] = pX + 2 * (lY * lCZ - lZ * lCY) + 2 * (lW * lDX - lDW * lX + lY * lDZ - lZ * lDY);
+        pResult[1] = pY + 2 * (lZ * lCX - lX * lCZ) + 2 * (lW * lDY - lDW * lY + lZ * lDX - lX * lDZ);
+        pResult[2] = pZ + 2 * (lX * lCY - lY * lCX) + 2 * (lW * lDZ - lDW * lZ + lX * lDY - lY * lDX);
+    }
+
+    // Linear deformation of one vertex in single precision: blend the rows of the bone
+    // matrices, then transform the vertex once. Four floats are written.
+    inline void ComputeLinearVertexFloat(const float * pPalette, const int * pBones, const float * pWeights, int pCount,
+                                         float pX, float pY, float pZ, float pWeightSum, bool pNormalize, float * pResult)
+    {
+#ifdef SKIN_CACHE_USE_SSE
+        __m128 lRow0 = _mm_setzero_ps();
+        __m128 lRow1 = _mm_setzero_ps();
+        __m128 lRow2 = _mm_setzero_ps();
+        __m128 lRow3 = _mm_setzero_ps();
+        for (int k = 0; k < pCount; ++k)
+        {
+            const float * lMatrix = pPalette + pBones[k] * SkinCache::PALETTE_STRIDE;
+            const __m128 lWeight = _mm_set1_ps(pWeights[k]);
+            lRow0 = _mm_add_ps(lRow0, _mm_mul_ps(lWeight, _mm_loadu_ps(lMatrix)));
+            lRow1 = _mm_add_ps(lRow1, _mm_mul_ps(lWeight, _mm_loadu_ps(lMatrix + 4)));
+            lRow2 = _mm_add_ps(lRow2, _mm_mul_ps(lWeight, _mm_loadu_ps(lMatrix + 8)));
+            lRow3 = _mm_add_ps(lRow3, _mm_mul_ps(lWeight, _mm_loadu_ps(lMatrix + 12)));
+        }
+
+        const __m128 lX = _mm_set1_ps(pX);
+        const __m128 lY = _mm_set1_ps(pY);
+        const __m128 lZ = _mm_set1_ps(pZ);
+        __m128 lResult = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lX, lRow0), _mm_mul_ps(lY, lRow1)),
+                                    _mm_add_ps(_mm_mul_ps(lZ, lRow2), lRow3));
+
+        if (pNormalize)
+        {
+            lResult = _mm_mul_ps(lResult, _mm_set1_ps(1.0f / pWeightSum));
+        }
+        else
+        {
+            const __m128 lSrcVertex = _mm_setr_ps(pX, pY, pZ, 1.0f);
+            lResult = _mm_add_ps(lResult, _mm_mul_ps(lSrcVertex, _mm_set1_ps(1.0f - pWeightSum)));
+        }
+        _mm_storeu_ps(pResult, lResult);
+#else
+        float lRows[SkinCache::PALETTE_STRIDE] = {0.0f};
+        for (int k = 0; k < pCount; ++k)
+        {
+            const float * lMatrix = pPalette + pBones[k] * SkinCache::PALETTE_STRIDE;
+            const float lWeight = pWeights[k];
+            for (int j = 0; j < SkinCache::PALETTE_STRIDE; ++j)
+            {
+                lRows[j] += lWeight * lMatrix[j];
+            }
+        }
+
+        for (int j = 0; j < 3; ++j)
+        {
+            pResult[j] = pX * lRows[j] + pY * lRows[4 + j] + pZ * lRows[8 + j] + lRows[12 + j];
+        }
+
+        if (pNormalize)
+        {
+            const float lInverse = 1.0f / pWeightSum;
+            pResult[0] *= lInverse;
+            pResult[1] *= lInverse;
+            pResult[2] *= lInverse;
+        }
+        else
+        {
+            const float lRest = 1.0f - pWeightSum;
+            pResult[0] += pX * lRest;
+            pResult[1] += pY * lRest;
+            pResult[2] += pZ * lRest;
+        }
+#endif
+        pResult[3] = 1.0f;
+    }
+
+    // Blend the dual quaternions of the bones of a vertex in single precision, all in the
+    // hemisphere of the first one; the weight missing to one goes to the identity.
+    inline void BlendDualQuaternionsFloat(const float * pDQPalette, const int * pBones, const float * pWeights, int pCount,
+                                          float pRestWeight, float * pResult)
+    {
+#ifdef SKIN_CACHE_USE_SSE
+        __m128 lReal = _mm_setzero_ps();
+        __m128 lDual = _mm_setzero_ps();
+        for (int k = 0; k < pCount; ++k)
+        {
+            const float * lDualQuaternion = pDQPalette + pBones[k] * SkinCache::DQ_PALETTE_STRIDE;
+            const __m128 lBoneReal = _mm_loadu_ps(lDualQuaternion);
+            const __m128 lBoneDual = _mm_loadu_ps(lDualQuaternion + 4);
+
+            // Horizontal dot product of the rotations, to flip the bone into the same hemisphere.
+            __m128 lDot = _mm_mul_ps(lReal, lBoneReal);
+            lDot = _mm_add_ps(lDot, _mm_movehl_ps(lDot, lDot));
+            lDot = _mm_add_ss(lDot, _mm_shuffle_ps(lDot, lDot, 1));
+            const float lWeight = _mm_cvtss_f32(lDot) < 0.0f ? -pWeights[k] : pWeights[k];
+
+            const __m128 lWeights = _mm_set1_ps(lWeight);
+            lReal = _mm_add_ps(lReal, _mm_mul_ps(lWeights, lBoneReal));
+            lDual = _mm_add_ps(lDual, _mm_mul_ps(lWeights, lBoneDual));
+        }
+        _mm_storeu_ps(pResult, lReal);
+        _mm_storeu_ps(pResult + 4, lDual);
+#else
+        for (int j = 0; j < SkinCache::DQ_PALETTE_STRIDE; ++j)
+        {
+            pResult[j] = 0.0f;
+        }
+        for (int k = 0; k < pCount; ++k)
+        {
+            const float * lDualQuaternion = pDQPalette + pBones[k] * SkinCache::DQ_PALETTE_STRIDE;
+            const float lDot = pResult[0] * lDualQuaternion[0] + pResult[1] * lDualQuaternion[1] +
+                pResult[2] * lDualQuaternion[2] + pResult[3] * lDualQuaternion[3];
+            const float lWeight = lDot < 0.0f ? -pWeights[k] : pWeights[k];
+            for (int j = 0; j < SkinCache::DQ_PALETTE_STRIDE; ++j)
+            {
+                pResult[j] += lWeight * lDualQuaternion[j];
+            }
+        }
+#endif
+        pResult[3] += pResult[3] < 0.0f ? -pRestWeight : pRestWeight;
+    }
+}
+
+SkinCache::SkinningPath SkinCache::sSkinningPath = SkinCache::SKINNING_PATH_FLOAT;
+
+SkinCache::SkinCache() : mLinkMode(FbxCluster::eNormalize), mSkinningType(FbxSkin::eLinear), mVertexCount(0),
+    mHasRestBounds(false)
+{
+}
+
+SkinCache::~SkinCache()
+{
+    for (int i = 0; i < mBones.GetCount(); i++)
+    {
+        delete mBones[i];
+    }
+
+    mBones.Clear();
+}
+
+bool SkinCache::Initialize(FbxMesh * pMesh)
+{
+    const int lSkinCount = pMesh->GetDeformerCount(FbxDeformer::eSkin);
+    if (lSkinCount == 0 || !pMesh->GetNode())
+        return false;
+
+    FbxSkin * lFirstSkin = (FbxSkin *)pMesh->GetDeformer(0, FbxDeformer::eSkin);
+    if (lFirstSkin->GetClusterCount() == 0)
+        return false;
+
+    // All the links must have the same link mode.
+    mLinkMode = lFirstSkin->GetCluster(0)->GetLinkMode();
+    mSkinningType = lFirstSkin->GetSkinningType();
+    mVertexCount = pMesh->GetControlPointsCount();
+
+    // The geometric transform of the mesh never changes, bake it with the bind matrices.
+    const FbxAMatrix lReferenceGeometry = GetGeometry(pMesh->GetNode());
+
+    // Count the influences of every vertex and bake the bind matrices of the bones.
+    mInfluenceOffsets.Resize(mVertexCount + 1);
+    for (int i = 0; i <= mVertexCount; ++i)
+    {
+        mInfluenceOffsets[i] = 0;
+    }
+
+    for (int lSkinIndex = 0; lSkinIndex < lSkinCount; ++lSkinIndex)
+    {
+        FbxSkin * lSkinDeformer = (FbxSkin *)pMesh->GetDeformer(lSkinIndex, FbxDeformer::eSkin);
+        const int lClusterCount = lSkinDeformer->GetClusterCount();
+        for (int lClusterIndex = 0; lClusterIndex < lClusterCount; ++lClusterIndex)
+        {
+            FbxCluster * lCluster = lSkinDeformer->GetCluster(lClusterIndex);
+            if (!lCluster->GetLink())
+                continue;
+
+            Bone * lBone = new Bone;
+            lBone->mLink = lCluster->GetLink();
+
+            FbxAMatrix lReferenceGlobalInitPosition;
+            lCluster->GetTransformMatrix(lReferenceGlobalInitPosition);
+            lReferenceGlobalInitPosition *= lReferenceGeometry;
+
+            FbxAMatrix lClusterGlobalInitPosition;
+            lCluster->GetTransformLinkMatrix(lClusterGlobalInitPosition);
+
+            if (lCluster->GetLinkMode() == FbxCluster::eAdditive && lCluster->GetAssociateModel())
+            {
+                lBone->mAssociateModel = lCluster->GetAssociateModel();
+
+                FbxAMatrix lAssociateGlobalInitPosition;
+                lCluster->GetTransformAssociateModelMatrix(lAssociateGlobalInitPosition);
+                lAssociateGlobalInitPosition *= GetGeometry(lBone->mAssociateModel);
+                lClusterGlobalInitPosition *= GetGeometry(lBone->mLink);
+
+                // ModelM-1 * AssoM * AssoGX-1 * LinkGX * LinkM-1*ModelM, without the current positions.
+                lBone->mPreMatrix = lReferenceGlobalInitPosition.Inverse() * lAssociateGlobalInitPosition;
+                lBone->mPostMatrix = lClusterGlobalInitPosition.Inverse() * lReferenceGlobalInitPosition;
+            }
+            else
+            {
+                // The initial position of the link relative to the reference.
+                lBone->mPreMatrix = lClusterGlobalInitPosition.Inverse() * lReferenceGlobalInitPosition;
+            }
+            mBones.Add(lBone);
+
+            const int lVertexIndexCount = lCluster->GetControlPointIndicesCount();
+            for (int k = 0; k < lVertexIndexCount; ++k)
+            {
+                const int lIndex = lCluster->GetControlPointIndices()[k];
+
+                // Sometimes, the mesh can have less points than at the time of the skinning
+                // because a smooth operator was active when skinning but has been deactivated during export.
+                if (lIndex >= mVertexCount || lCluster->GetControlPointWeights()[k] == 0.0)
+                    continue;
+
+                ++mInfluenceOffsets[lIndex + 1];
+            }
+        }
+    }
+
+    if (mBones.GetCount() == 0)
+        return false;
+
+    for (int i = 0; i < mVertexCount; ++i)
+    {
+        mInfluenceOffsets[i + 1] += mInfluenceOffsets[i];
+    }
+
+    // Fill the influences, in the same order as the clusters were accumulated before.
+    const int lInfluenceCount = mInfluenceOffsets[mVertexCount];
+    mInfluenceBones.Resize(lInfluenceCount);
+    mInfluenceWeights.Resize(lInfluenceCount);
+    mWeightSums.Resize(mVertexCount);
+
+    FbxArray<int> lCursors;
+    lCursors.Resize(mVertexCount);
+    for (int i = 0; i < mVertexCount; ++i)
+    {
+        lCursors[i] = mInfluenceOffsets[i];
+        mWeightSums[i] = 0.0;
+    }
+
+    int lBoneIndex = 0;
+    for (int lSkinIndex = 0; lSkinIndex < lSkinCount; ++lSkinIndex)
+    {
+        FbxSkin * lSkinDeformer = (FbxSkin *)pMesh->GetDeformer(lSkinIndex, FbxDeformer::eSkin);
+        const int lClusterCount = lSkinDeformer->GetClusterCount();
+        for (int lClusterIndex = 0; lClusterIndex < lClusterCount; ++lClusterIndex)
+        {
+            FbxCluster * lCluster = lSkinDeformer->GetCluster(lClusterIndex);
+            if (!lCluster->GetLink())
+                continue;
+
+            const int lVertexIndexCount = lCluster->GetControlPointIndicesCount();
+            for (int k = 0; k < lVertexIndexCount; ++k)
+            {
+                const int lIndex = lCluster->GetControlPointIndices()[k];
+                const double lWeight = lCluster->GetControlPointWeights()[k];
+                if (lIndex >= mVertexCount || lWeight == 0.0)
+                    continue;
+
+                mInfluenceBones[lCursors[lIndex]] = lBoneIndex;
+                mInfluenceWeights[lCursors[lIndex]] = lWeight;
+                ++lCursors[lIndex];
+
+                if (mLinkMode == FbxCluster::eAdditive)
+                {
+                    // Set the link to 1.0 just to know this vertex is influenced by a link.
+                    mWeightSums[lIndex] = 1.0;
+                }
+                else
+                {
+                    mWeightSums[lIndex] += lWeight;
+                }
+            }
+            ++lBoneIndex;
+        }
+    }
+
+    // Single precision copies for the SIMD kernel.
+    mInfluenceWeightsFloat.Resize(lInfluenceCount);
+    for (int i = 0; i < lInfluenceCount; ++i)
+    {
+        mInfluenceWeightsFloat[i] = static_cast<float>(mInfluenceWeights[i]);
+    }
+
+    mWeightSumsFloat.Resize(mVertexCount);
+    for (int i = 0; i < mVertexCount; ++i)
+    {
+        mWeightSumsFloat[i] = static_cast<float>(mWeightSums[i]);
+    }
+
+    // The blend weights of the first skin, zero (linear only) for the vertices it does not list.
+    if (mSkinningType == FbxSkin::eBlend)
+    {
+        mBlendWeights.Resize(mVertexCount);
+        mBlendWeightsFloat.Resize(mVertexCount);
+        const int lBlendWeightCount = lFirstSkin->GetControlPointIndicesCount();
+        const double * lBlendWeights = lFirstSkin->GetControlPointBlendWeights();
+        for (int i = 0; i < mVertexCount; ++i)
+        {
+            mBlendWeights[i] = i < lBlendWeightCount && lBlendWeights ? lBlendWeights[i] : 0.0;
+            mBlendWeightsFloat[i] = static_cast<float>(mBlendWeights[i]);
+        }
+    }
+
+    mBindPositions.Resize(mVertexCount * 3);
+    ConvertToSoA(pMesh->GetControlPoints(), mVertexCount, mBindPositions.GetArray(), 0, mVertexCount);
+
+    // The bind boxes of the bones, to bound the deformed mesh without deforming it.
+    const FbxVector4 * lControlPoints = pMesh->GetControlPoints();
+    mHasRestBounds = false;
+    for (int i = 0; i < mVertexCount; ++i)
+    {
+        for (int lInfluence = mInfluenceOffsets[i]; lInfluence < mInfluenceOffsets[i + 1]; ++lInfluence)
+        {
+            Bone * lBone = mBones[mInfluenceBones[lInfluence]];
+            ExpandBounds(lControlPoints[i], lBone->mHasBindBounds, lBone->mBindMin, lBone->mBindMax);
+        }
+        if (mWeightSums[i] < 1.0)
+        {
+            ExpandBounds(lControlPoints[i], mHasRestBounds, mRestMin, mRestMax);
+        }
+    }
+
+    return true;
+}
+
+bool SkinCache::ComputeBounds(const FbxAMatrix * pBoneMatrices, FbxVector4 & pMin, FbxVector4 & pMax) const
+{
+    if (mLinkMode == FbxCluster::eAdditive)
+        return false;
+
+    // A linear skin blends points of the moved boxes, the union bounds them.
+    bool lHasBounds = false;
+    if (mHasRestBounds)
+    {
+        pMin = mRestMin;
+        pMax = mRestMax;
+        lHasBounds = true;
+    }
+
+    const int lBoneCount = mBones.GetCount();
+    for (int lBoneIndex = 0; lBoneIndex < lBoneCount; ++lBoneIndex)
+    {
+        const Bone * lBone = mBones[lBoneIndex];
+        if (!lBone->mHasBindBounds)
+            continue;
+
+        // Center and half extent of the moved box, FbxAMatrix transforms row vectors.
+        const double * lMatrix = (const double *)pBoneMatrices[lBoneIndex];
+        for (int lAxis = 0; lAxis < 3; ++lAxis)
+        {
+            double lCenter = lMatrix[12 + lAxis];
+            double lExtent = 0.0;
+            for (int lRow = 0; lRow < 3; ++lRow)
+            {
+                lCenter += (lBone->mBindMin[lRow] + lBone->mBindMax[lRow]) * 0.5 * lMatrix[lRow * 4 + lAxis];
+                lExtent += (lBone->mBindMax[lRow] - lBone->mBindMin[lRow]) * 0.5 * fabs(lMatrix[lRow * 4 + lAxis]);
+            }
+            if (!lHasBounds || lCenter - lExtent < pMin[lAxis])
+                pMin[lAxis] = lCenter - lExtent;
+            if (!lHasBounds || lCenter + lExtent > pMax[lAxis])
+                pMax[lAxis] = lCenter + lExtent;
+        }
+        lHasBounds = true;
+    }
+
+    if (!lHasBounds)
+        return false;
+
+    // Dual quaternions blend the rotations, the result bulges a little out of the union.
+    if (mSkinningType == FbxSkin::eDualQuaternion || mSkinningType == FbxSkin::eBlend)
+    {
+        const FbxVector4 lMargin = (pMax - pMin) * DUAL_QUATERNION_BOUNDS_MARGIN;
+        pMin -= lMargin;
+        pMax += lMargin;
+    }
+    return true;
+}
+
+void SkinCache::ComputeBoneMatrices(const FbxAMatrix & pGlobalPosition,
+                                    const FbxTime & pTime,
+                                    FbxPose * pPose,
+                                    FbxAMatrix * pBoneMatrices) const
+{
+    const FbxAMatrix lReferenceGlobalCurrentPositionInverse = pGlobalPosition.Inverse();
+
+    const int lBoneCount = mBones.GetCount();
+    for (int lBoneIndex = 0; lBoneIndex < lBoneCount; ++lBoneIndex)
+    {
+        const Bone * lBone = mBones[lBoneIndex];
+        const FbxAMatrix lClusterGlobalCurrentPosition = GetGlobalPosition(lBone->mLink, pTime, pPose);
+
+        if (lBone->mAssociateModel)
+        {
+            const FbxAMatrix lAssociateGlobalCurrentPosition = GetGlobalPosition(lBone->mAssociateModel, pTime, pPose);
+            pBoneMatrices[lBoneIndex] = lBone->mPreMatrix * lAssociateGlobalCurrentPosition.Inverse() *
+                lClusterGlobalCurrentPosition * lBone->mPostMatrix;
+        }
+        else
+        {
+            // The current position of the link relative to the reference, times the bind position.
+            pBoneMatrices[lBoneIndex] = lReferenceGlobalCurrentPositionInverse * lClusterGlobalCurrentPosition *
+                lBone->mPreMatrix;
+        }
+    }
+}
+
+void SkinCache::ComputeLinearDeformation(const FbxAMatrix * pBoneMatrices, FbxVector4 * pVertexArray,
+                                         int pBegin, int pEnd) const
+{
+    for (int i = pBegin; i < pEnd; ++i)
+    {
+        // Only deform the vertex if there was at least a link with an influence on it.
+        if (mWeightSums[i] == 0.0)
+            continue;
+
+        pVertexArray[i] = ComputeLinearVertex(pBoneMatrices, i, pVertexArray[i]);
+    }
+}
+
+FbxVector4 SkinCache::ComputeLinearVertex(const FbxAMatrix * pBoneMatrices, int pVertexIndex, const FbxVector4 & pSrcVertex) const
+{
+    const int lBegin = mInfluenceOffsets[pVertexIndex];
+    const int lEnd = mInfluenceOffsets[pVertexIndex + 1];
+    const double lWeightSum = mWeightSums[pVertexIndex];
+
+    if (mLinkMode == FbxCluster::eAdditive)
+    {
+        // Multiply with the product of the deformations on the vertex.
+        FbxAMatrix lDeformation;
+        lDeformation.SetIdentity();
+        for (int k = lBegin; k < lEnd; ++k)
+        {
+            FbxAMatrix lInfluence = pBoneMatrices[mInfluenceBones[k]];
+            MatrixBlendWithIdentity(lInfluence, mInfluenceWeights[k]);
+            lDeformation = lInfluence * lDeformation;
+        }
+        return lDeformation.MultT(pSrcVertex);
+    }
+
+    // Transforming by the weighted sum of the matrices is
+    // the same as summing the weighted transformed vertices.
+    FbxVector4 lSum(0.0, 0.0, 0.0, 0.0);
+    for (int k = lBegin; k < lEnd; ++k)
+    {
+        lSum += pBoneMatrices[mInfluenceBones[k]].MultT(pSrcVertex) * mInfluenceWeights[k];
+    }
+
+    if (mLinkMode == FbxCluster::eNormalize)
+    {
+        // In the normalized link mode, a vertex is always totally influenced by the links.
+        lSum /= lWeightSum;
+    }
+    else if (mLinkMode == FbxCluster::eTotalOne)
+    {
+        // In the total 1 link mode, a vertex can be partially influenced by the links.
+        lSum += pSrcVertex * (1.0 - lWeightSum);
+    }
+    return lSum;
+}
+
+const int SkinCache::PALETTE_STRIDE;
+
+void SkinCache::ConvertPalette(const FbxAMatrix * pBoneMatrices, int pBoneCount, float * pPalette)
+{
+    for (int lBoneIndex = 0; lBoneIndex < pBoneCount; ++lBoneIndex)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                pPalette[lBoneIndex * PALETTE_STRIDE + i * 4 + j] = static_cast<float>(pBoneMatrices[lBoneIndex][i][j]);
+            }
+        }
+    }
+}
+
+bool SkinCache::ComputeLinearDeformation(const float * pPalette,
+                                         const float * pSrcPositions,
+                                         float * pDstVertices,
+                                         int pBegin, int pEnd) const
+{
+    if (mLinkMode == FbxCluster::eAdditive)
+        return false;
+
+    if (!pSrcPositions)
+        pSrcPositions = mBindPositions.GetArray();
+
+    const float * lSrcX = pSrcPositions;
+    const float * lSrcY = pSrcPositions + mVertexCount;
+    const float * lSrcZ = pSrcPositions + mVertexCount * 2;
+
+    const bool lNormalize = mLinkMode == FbxCluster::eNormalize;
+    for (int i = pBegin; i < pEnd; ++i)
+    {
+        const float lWeightSum = mWeightSumsFloat[i];
+        float * lDstVertex = pDstVertices + i * VERTEX_STRIDE;
+
+        // Vertices without any influence keep their source position.
+        if (lWeightSum == 0.0f)
+        {
+            lDstVertex[0] = lSrcX[i];
+            lDstVertex[1] = lSrcY[i];
+            lDstVertex[2] = lSrcZ[i];
+            lDstVertex[3] = 1.0f;
+            continue;
+        }
+
+        const int lBegin = mInfluenceOffsets[i];
+        ComputeLinearVertexFloat(pPalette, mInfluenceBones.GetArray() + lBegin, mInfluenceWeightsFloat.GetArray() + lBegin,
+            mInfluenceOffsets[i + 1] - lBegin, lSrcX[i], lSrcY[i], lSrcZ[i], lWeightSum, lNormalize, lDstVertex);
+    }
+
+    return true;
+}
+
+int SkinCache::GetMaxInfluenceCount() const
+{
+    int lMaxCount = 0;
+    for (int i = 0; i < mVertexCount; ++i)
+    {
+        lMaxCount = FbxMax(lMaxCount, mInfluenceOffsets[i + 1] - mInfluenceOffsets[i]);
+    }
+    return lMaxCount;
+}
+
+void SkinCache::GetVertexInfluences(int pVertexIndex, int pInfluenceCount, int * pBones, float * pWeights) const
+{
+    for (int i = 0; i < pInfluenceCount; ++i)
+    {
+        pBones[i] = 0;
+        pWeights[i] = 0.0f;
+    }
+
+    // Insert every influence in the list sorted by decreasing weight, dropping the smallest.
+    double lKeptSum = 0.0;
+    const int lEnd = mInfluenceOffsets[pVertexIndex + 1];
+    for (int k = mInfluenceOffsets[pVertexIndex]; k < lEnd; ++k)
+    {
+        const float lWeight = mInfluenceWeightsFloat[k];
+        int lSlot = pInfluenceCount;
+        while (lSlot > 0 && pWeights[lSlot - 1] < lWeight)
+        {
+            --lSlot;
+        }
+        if (lSlot == pInfluenceCount)
+            continue;
+
+        for (int i = pInfluenceCount - 1; i > lSlot; --i)
+        {
+            pBones[i] = pBones[i - 1];
+            pWeights[i] = pWeights[i - 1];
+        }
+        pBones[lSlot] = mInfluenceBones[k];
+        pWeights[lSlot] = lWeight;
+    }
+
+    for (int i = 0; i < pInfluenceCount; ++i)
+    {
+        lKeptSum += pWeights[i];
+    }
+    if (lKeptSum == 0.0)
+        return;
+
+    const double lTargetSum = mLinkMode == FbxCluster::eNormalize ? 1.0 : mWeightSums[pVertexIndex];
+    const float lScale = static_cast<float>(lTargetSum / lKeptSum);
+    for (int i = 0; i < pInfluenceCount; ++i)
+    {
+        pWeights[i] *= lScale;
+    }
+}
+
+const int SkinCache::DQ_PALETTE_STRIDE;
+
+void SkinCache::ConvertDualQuaternionPalette(const FbxAMatrix * pBoneMatrices, int pBoneCount, double * pPalette)
+{
+    for (int lBoneIndex = 0; lBoneIndex < pBoneCount; ++lBoneIndex)
+    {
+        ConvertToDualQuaternion(pBoneMatrices[lBoneIndex], pPalette + lBoneIndex * DQ_PALETTE_STRIDE);
+    }
+}
+
+void SkinCache::ConvertDualQuaternionPalette(const FbxAMatrix * pBoneMatrices, int pBoneCount, float * pPalette)
+{
+    for (int lBoneIndex = 0; lBoneIndex < pBoneCount; ++lBoneIndex)
+    {
+        ConvertToDualQuaternion(pBoneMatrices[lBoneIndex], pPalette + lBoneIndex * DQ_PALETTE_STRIDE);
+    }
+}
+
+void SkinCache::ComputeDualQuaternionDeformation(const FbxAMatrix * pBoneMatrices, const double * pDQPalette,
+                                                 FbxVector4 * pVertexArray, int pBegin, int pEnd) const
+{
+    const bool lBlend = mSkinningType == FbxSkin::eBlend;
+    for (int i = pBegin; i < pEnd; ++i)
+    {
+        const double lWeightSum = mWeightSums[i];
+        if (lWeightSum == 0.0)
+            continue;
+
+        const int lBegin = mInfluenceOffsets[i];
+        const int lEnd = mInfluenceOffsets[i + 1];
+        const FbxVector4 lSrcVertex = pVertexArray[i];
+
+        double lDualQuaternion[DQ_PALETTE_STRIDE] = {0.0};
+        if (mLinkMode == FbxCluster::eAdditive)
+        {
+            // Simply influenced by the last link.
+            memcpy(lDualQuaternion, pDQPalette + mInfluenceBones[lEnd - 1] * DQ_PALETTE_STRIDE, sizeof(lDualQuaternion));
+        }
+        else
+        {
+            // Add the bones in the hemisphere of the sum, the weight missing to one goes to the identity.
+            for (int k = lBegin; k < lEnd; ++k)
+            {
+                const double * lBone = pDQPalette + mInfluenceBones[k] * DQ_PALETTE_STRIDE;
+                const double lDot = lDualQuaternion[0] * lBone[0] + lDualQuaternion[1] * lBone[1] +
+                    lDualQuaternion[2] * lBone[2] + lDualQuaternion[3] * lBone[3];
+                const double lWeight = lDot < 0.0 ? -mInfluenceWeights[k] : mInfluenceWeights[k];
+                for (int j = 0; j < DQ_PALETTE_STRIDE; ++j)
+                {
+                    lDualQuaternion[j] += lWeight * lBone[j];
+                }
+            }
+            if (mLinkMode == FbxCluster::eTotalOne)
+            {
+                lDualQuaternion[3] += lDualQuaternion[3] < 0.0 ? lWeightSum - 1.0 : 1.0 - lWeightSum;
+            }
+        }
+
+        double lResult[3];
+        DeformWithDualQuaternion(lDualQuaternion, lSrcVertex[0], lSrcVertex[1], lSrcVertex[2], lResult);
+        FbxVector4 lDstVertex(lResult[0], lResult[1], lResult[2], 1.0);
+
+        if (lBlend)
+        {
+            // Final vertex = DQSVertex * blend weight + LinearVertex * (1 - blend weight)
+            const double lBlendWeight = mBlendWeights[i];
+            lDstVertex = lDstVertex * lBlendWeight + ComputeLinearVertex(pBoneMatrices, i, lSrcVertex) * (1.0 - lBlendWeight);
+        }
+        pVertexArray[i] = lDstVertex;
+    }
+}
+
+bool SkinCache::ComputeDualQuaternionDeformation(const float * pPalette,
+                                                 const float * pDQPalette,
+                                                 const float * pSrcPositions,
+                                                 float * pDstVertices,
+                                                 int pBegin, int pEnd) const
+{
+    if (mLinkMode == FbxCluster::eAdditive)
+        return false;
+
+    if (!pSrcPositions)
+        pSrcPositions = mBindPositions.GetArray();
+
+    const float * lSrcX = pSrcPositions;
+    const float * lSrcY = pSrcPositions + mVertexCount;
+    const float * lSrcZ = pSrcPositions + mVertexCount * 2;
+
+    const bool lNormalize = mLinkMode == FbxCluster::eNormalize;
+    const bool lBlend = mSkinningType == FbxSkin::eBlend;
+    for (int i = pBegin; i < pEnd; ++i)
+    {
+        const float lWeightSum = mWeightSumsFloat[i];
+        float * lDstVertex = pDstVertices + i * VERTEX_STRIDE;
+
+        // Vertices without any influence keep their source position.
+        if (lWeightSum == 0.0f)
+        {
+            lDstVertex[0] = lSrcX[i];
+            lDstVertex[1] = lSrcY[i];
+            lDstVertex[2] = lSrcZ[i];
+            lDstVertex[3] = 1.0f;
+            continue;
+        }
+
+        // Gather the influences once for both deformations.
+        const int lBegin = mInfluenceOffsets[i];
+        const int lCount = mInfluenceOffsets[i + 1] - lBegin;
+        const int * lBones = mInfluenceBones.GetArray() + lBegin;
+        const float * lWeights = mInfluenceWeightsFloat.GetArray() + lBegin;
+
+        float lDualQuaternion[DQ_PALETTE_STRIDE];
+        BlendDualQuaternionsFloat(pDQPalette, lBones, lWeights, lCount, lNormalize ? 0.0f : 1.0f - lWeightSum, lDualQuaternion);
+        DeformWithDualQuaternion(lDualQuaternion, lSrcX[i], lSrcY[i], lSrcZ[i], lDstVertex);
+        lDstVertex[3] = 1.0f;
+
+        if (lBlend)
+        {
+            float lLinear[VERTEX_STRIDE];
+            ComputeLinearVertexFloat(pPalette, lBones, lWeights, lCount, lSrcX[i], lSrcY[i], lSrcZ[i],
+                lWeightSum, lNormalize, lLinear);
+            const float lBlendWeight = mBlendWeightsFloat[i];
+            for (int j = 0; j < 3; ++j)
+            {
+                lDstVertex[j] = lDstVertex[j] * lBlendWeight + lLinear[j] * (1.0f - lBlendWeight);
+            }
+        }
+    }
+
+    return true;
+}
+
+void SkinCache::ConvertToSoA(const FbxVector4 * pVertexArray, int pVertexCount, float * pPositions,
+                             int pBegin, int pEnd)
+{
+    for (int i = pBegin; i < pEnd; ++i)
+    {
+        pPositions[i] = static_cast<float>(pVertexArray[i][0]);
+        pPositions[pVertexCount + i] = static_cast<float>(pVertexArray[i][1]);
+        pPositions[pVertexCount * 2 + i] = static_cast<float>(pVertexArray[i][2]);
+    }
+}
@@ -0,0 +1,159 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _SKIN_CACHE_H
+#define _SKIN_CACHE_H
+
+#include <fbxsdk.h>
+
+// Skin binding baked from the FbxSkin clusters of a mesh when the scene is loaded.
+// The influences are stored per vertex (bone index, weight), in the order of the
+// clusters, so that deforming a vertex only gathers the few bones it depends on.
+class SkinCache
+{
+public:
+    // Which implementation deforms linear skins.
+    enum SkinningPath
+    {
+        SKINNING_PATH_REFERENCE,    // Double precision, through FbxAMatrix and FbxVector4.
+        SKINNING_PATH_FLOAT,        // Single precision SIMD kernel, writing the VBO layout.
+        SKINNING_PATH_GPU           // Palette uploaded to a vertex shader, see VBOMesh::InitializeSkin.
+    };
+    static SkinningPath GetSkinningPath() { return sSkinningPath; }
+    static void SetSkinningPath(SkinningPath pPath) { sSkinningPath = pPath; }
+
+    SkinCache();
+    ~SkinCache();
+
+    // Bake the influences and bind matrices of all the skins of the mesh.
+    bool Initialize(FbxMesh * pMesh);
+
+    int GetBoneCount() const { return mBones.GetCount(); }
+    int GetVertexCount() const { return mVertexCount; }
+    FbxCluster::ELinkMode GetLinkMode() const { return mLinkMode; }
+    FbxSkin::EType GetSkinningType() const { return mSkinningType; }
+
+    // Compute the current deformation matrix of every bone, relative to the mesh.
+    // pBoneMatrices must hold GetBoneCount() matrices.
+    void ComputeBoneMatrices(const FbxAMatrix & pGlobalPosition,
+                             const FbxTime & pTime,
+                             FbxPose * pPose,
+                             FbxAMatrix * pBoneMatrices) const;
+
+    // Bounding box of the deformed mesh, relative to the mesh as the bone matrices: the union
+    // of the bind boxes of the vertices every bone moves, moved by the bone. Return false for
+    // the additive link mode, which cannot be bounded this way.
+    bool ComputeBounds(const FbxAMatrix * pBoneMatrices, FbxVector4 & pMin, FbxVector4 & pMax) const;
+
+    // Deform the vertices [pBegin, pEnd) of the array in classic linear way with the given bone matrices.
+    void ComputeLinearDeformation(const FbxAMatrix * pBoneMatrices, FbxVector4 * pVertexArray,
+                                  int pBegin, int pEnd) const;
+
+    // Sixteen floats for every bone matrix in the single precision palette, row by row as in FbxAMatrix.
+    static const int PALETTE_STRIDE = 16;
+    // Convert the bone matrices for the single precision kernel.
+    // pPalette must hold pBoneCount * PALETTE_STRIDE floats.
+    static void ConvertPalette(const FbxAMatrix * pBoneMatrices, int pBoneCount, float * pPalette);
+
+    // Eight values for every bone in the dual quaternion palettes: the rotation quaternion,
+    // then the dual part, X, Y, Z and W each. The scaling of the bone matrices is dropped.
+    static const int DQ_PALETTE_STRIDE = 8;
+    // pPalette must hold pBoneCount * DQ_PALETTE_STRIDE values.
+    static void ConvertDualQuaternionPalette(const FbxAMatrix * pBoneMatrices, int pBoneCount, double * pPalette);
+    static void ConvertDualQuaternionPalette(const FbxAMatrix * pBoneMatrices, int pBoneCount, float * pPalette);
+
+    // Deform the vertices [pBegin, pEnd) with the blended dual quaternions of their bones. For
+    // blend skins, the linear deformation with the bone matrices is computed in the same pass
+    // and mixed by the blend weight of the vertex.
+    void ComputeDualQuaternionDeformation(const FbxAMatrix * pBoneMatrices, const double * pDQPalette,
+                                          FbxVector4 * pVertexArray, int pBegin, int pEnd) const;
+
+    // Same deformation in single precision for the vertices [pBegin, pEnd). The source positions
+    // are in SoA layout, all the X, then all the Y, then all the Z; NULL means the bind positions.
+    // Four floats are written for every control point, as VBOMesh stores the positions.
+    // The additive link mode is not supported, return false in that case.
+    bool ComputeLinearDeformation(const float * pPalette,
+                                  const float * pSrcPositions,
+                                  float * pDstVertices,
+                                  int pBegin, int pEnd) const;
+
+    // Most influences of any vertex.
+    int GetMaxInfluenceCount() const;
+
+    // The pInfluenceCount largest influences of a vertex, padded with zero weights. They are
+    // scaled to keep the weight sum of the vertex, or to sum to one in the normalize link mode.
+    void GetVertexInfluences(int pVertexIndex, int pInfluenceCount, int * pBones, float * pWeights) const;
+
+    // Same in single precision, with the layouts of the single precision linear kernel. pPalette
+    // is only read for blend skins. The additive link mode is not supported, return false in that case.
+    bool ComputeDualQuaternionDeformation(const float * pPalette,
+                                          const float * pDQPalette,
+                                          const float * pSrcPositions,
+                                          float * pDstVertices,
+                                          int pBegin, int pEnd) const;
+
+    // Convert the positions [pBegin, pEnd) to the SoA layout used by the single precision kernel.
+    static void ConvertToSoA(const FbxVector4 * pVertexArray, int pVertexCount, float * pPositions,
+                             int pBegin, int pEnd);
+
+private:
+    // Everything about a cluster which does not change with time.
+    struct Bone
+    {
+        Bone() : mLink(NULL), mAssociateModel(NULL), mHasBindBounds(false) {}
+
+        FbxNode * mLink;
+        FbxNode * mAssociateModel;
+        // Normalize and total one modes: inverse bind matrix of the link, relative to the mesh.
+        // Additive mode: product of the init matrices on the left of the associate model.
+        FbxAMatrix mPreMatrix;
+        // Additive mode only: product of the init matrices on the right of the link.
+        FbxAMatrix mPostMatrix;
+        // Bind box of the vertices the bone moves, if any.
+        bool mHasBindBounds;
+        FbxVector4 mBindMin;
+        FbxVector4 mBindMax;
+    };
+
+    // Linear deformation of one vertex, in double precision.
+    FbxVector4 ComputeLinearVertex(const FbxAMatrix * pBoneMatrices, int pVertexIndex, const FbxVector4 & pSrcVertex) const;
+
+    FbxArray<Bone *> mBones;
+    FbxCluster::ELinkMode mLinkMode;
+    FbxSkin::EType mSkinningType;
+    int mVertexCount;
+
+    // Compressed rows: the influences of vertex i are in [mInfluenceOffsets[i], mInfluenceOffsets[i+1]).
+    FbxArray<int> mInfluenceOffsets;
+    FbxArray<int> mInfluenceBones;
+    FbxArray<double> mInfluenceWeights;
+    // Sum of the weights of every vertex, used to normalize or complete the vertex.
+    FbxArray<double> mWeightSums;
+
+    // Blend skins: weight of the dual quaternion deformation of every vertex.
+    FbxArray<double> mBlendWeights;
+
+    // Single precision copies for the SIMD kernel.
+    FbxArray<float> mInfluenceWeightsFloat;
+    FbxArray<float> mWeightSumsFloat;
+    FbxArray<float> mBlendWeightsFloat;
+    // Bind positions of the control points in SoA layout.
+    FbxArray<float> mBindPositions;
+
+    // Bind box of the vertices whose weights sum to less than one, which keep some of it.
+    bool mHasRestBounds;
+    FbxVector4 mRestMin;
+    FbxVector4 mRestMax;
+
+    static SkinningPath sSkinningPath;
+};
+
+#endif // _SKIN_CACHE_H
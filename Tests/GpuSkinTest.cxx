@@ -0,0 +1,153 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "ViewSceneTests.h"
+#include "../SceneCache.h"
+#include "../SkinCache.h"
+#include "../GetPosition.h"
+#include "../GL/glut.h"
+
+#include <math.h>
+
+namespace
+{
+    // Frames compared, spread over the animation.
+    const int FRAME_COUNT = 16;
+
+    // Largest difference allowed between the positions of the vertex shader and the double
+    // precision reference, relative to the largest deformed coordinate.
+    const double RELATIVE_TOLERANCE = 1e-5;
+
+    // A hidden GLUT window, created once for all the checks. Without a GPU, the Mesa llvmpipe
+    // opengl32.dll copied next to the executable renders it in software.
+    bool CreateGlContext()
+    {
+        static bool sCreated = false;
+        if (sCreated)
+            return true;
+
+        int lArgc = 1;
+        char lName[] = "ViewSceneTests";
+        char * lArgv[] = {lName, NULL};
+        glutInit(&lArgc, lArgv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+        glutInitWindowSize(64, 64);
+        glutCreateWindow(lName);
+        glutHideWindow();
+
+        GLenum lError = glewInit();
+        if (lError != GLEW_OK)
+        {
+            FBXSDK_printf("  GLEW Error: %s\n", glewGetErrorString(lError));
+            return false;
+        }
+        sCreated = true;
+        return true;
+    }
+}
+
+// Skin the meshes of happydanceboundskin.fbx with the vertex shader of VBOMesh, read the
+// positions back from the buffer written through transform feedback and compare them with
+// the double precision reference.
+bool TestGpuSkin(FbxManager * pManager)
+{
+    if (!CreateGlContext())
+        return false;
+    FBXSDK_printf("  %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+    if (!GLEW_VERSION_3_1)
+    {
+        FBXSDK_printf("  OpenGL 3.1 is needed\n");
+        return false;
+    }
+
+    FbxTime lStart, lStop;
+    FbxScene * lScene = LoadTestScene(pManager, "happydanceboundskin.fbx", lStart, lStop);
+    if (!lScene)
+        return false;
+
+    FbxArray<FbxNode *> lNodes;
+    FindSkinnedMeshes(lScene->GetRootNode(), lNodes);
+
+    bool lPassed = true;
+    int lGpuSkinnedCount = 0;
+    for (int lNodeIndex = 0; lNodeIndex < lNodes.GetCount(); ++lNodeIndex)
+    {
+        FbxNode * lNode = lNodes[lNodeIndex];
+        FbxMesh * lMesh = lNode->GetMesh();
+        SkinCache lSkinCache;
+        VBOMesh lMeshCache;
+        if (!lSkinCache.Initialize(lMesh) || !lMeshCache.Initialize(lMesh))
+        {
+            FBXSDK_printf("  %s: cannot bake the mesh\n", lNode->GetName());
+            lPassed = false;
+            continue;
+        }
+        if (!lMeshCache.InitializeSkin(lMesh, &lSkinCache))
+        {
+            FBXSDK_printf("  %s: skinned on the CPU, up to %d influences\n", lNode->GetName(),
+                lSkinCache.GetMaxInfluenceCount());
+            continue;
+        }
+        ++lGpuSkinnedCount;
+
+        const int lControlPointCount = lMesh->GetControlPointsCount();
+        const int lBoneCount = lSkinCache.GetBoneCount();
+        FbxAMatrix * lBoneMatrices = new FbxAMatrix[lBoneCount];
+        FbxVector4 * lReferenceVertices = new FbxVector4[lControlPointCount];
+        FbxArray<float> lPalette;
+        FbxArray<float> lVertices;
+        lPalette.Resize(lBoneCount * SkinCache::PALETTE_STRIDE);
+
+        double lMaxError = 0.0;
+        double lMaxCoordinate = 0.0;
+        for (int lFrame = 0; lFrame < FRAME_COUNT; ++lFrame)
+        {
+            const FbxTime lTime = GetTestFrameTime(lStart, lStop, lFrame, FRAME_COUNT);
+            const FbxAMatrix lGlobalOffPosition = GetGlobalPosition(lNode, lTime) * GetGeometry(lNode);
+            lSkinCache.ComputeBoneMatrices(lGlobalOffPosition, lTime, NULL, lBoneMatrices);
+
+            memcpy(lReferenceVertices, lMesh->GetControlPoints(), lControlPointCount * sizeof(FbxVector4));
+            lSkinCache.ComputeLinearDeformation(lBoneMatrices, lReferenceVertices, 0, lControlPointCount);
+
+            SkinCache::ConvertPalette(lBoneMatrices, lBoneCount, lPalette.GetArray());
+            lMeshCache.SkinVertexPosition(lPalette.GetArray());
+            lMeshCache.ReadVertexPositions(lVertices);
+
+            for (int lVertexIndex = 0; lVertexIndex < lMeshCache.GetVertexCount(); ++lVertexIndex)
+            {
+                const FbxVector4 & lReference = lReferenceVertices[lMeshCache.GetVertexControlPoint(lVertexIndex)];
+                for (int lAxis = 0; lAxis < 3; ++lAxis)
+                {
+                    lMaxError = FbxMax(lMaxError, fabs(lVertices[lVertexIndex * 4 + lAxis] - lReference[lAxis]));
+                    lMaxCoordinate = FbxMax(lMaxCoordinate, fabs(lReference[lAxis]));
+                }
+            }
+        }
+
+        const double lTolerance = RELATIVE_TOLERANCE * FbxMax(lMaxCoordinate, 1.0);
+        FBXSDK_printf("  %s: %d vertices, %d bones, %d frames, max error %g, tolerance %g\n", lNode->GetName(),
+            lMeshCache.GetVertexCount(), lBoneCount, FRAME_COUNT, lMaxError, lTolerance);
+        if (!(lMaxError <= lTolerance) || glGetError() != GL_NO_ERROR)
+            lPassed = false;
+
+        delete [] lBoneMatrices;
+        delete [] lReferenceVertices;
+    }
+
+    if (lGpuSkinnedCount == 0)
+    {
+        FBXSDK_printf("  no mesh skinned on the GPU\n");
+        lPassed = false;
+    }
+
+    lScene->Destroy();
+    return lPassed;
+}
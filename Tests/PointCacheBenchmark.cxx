@@ -0,0 +1,157 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+// Sustained playback rate of a large PC2 point cache through PointCacheStream.
+// Usage: PointCacheBenchmark [-points <count>] [-samples <count>] [-seconds <duration>]
+//                            [-minfps <rate>] [file.pc2]
+// Without a file, a cache of random points is written to PointCacheBenchmark.pc2 first.
+// The samples are read in turn, looping over the cache, as fast as possible for the duration;
+// the exit code is 1 if the frames per second fall below -minfps.
+
+#include "../PointCacheStream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+    const int DEFAULT_POINT_COUNT = 500000;
+    const int DEFAULT_SAMPLE_COUNT = 600;
+    const double DEFAULT_SECONDS = 10.0;
+    const char DEFAULT_FILE_NAME[] = "PointCacheBenchmark.pc2";
+
+    double GetSeconds()
+    {
+#if defined(_WIN32)
+        LARGE_INTEGER lFrequency, lCounter;
+        QueryPerformanceFrequency(&lFrequency);
+        QueryPerformanceCounter(&lCounter);
+        return static_cast<double>(lCounter.QuadPart) / lFrequency.QuadPart;
+#else
+        timespec lTime;
+        clock_gettime(CLOCK_MONOTONIC, &lTime);
+        return lTime.tv_sec + lTime.tv_nsec * 1e-9;
+#endif
+    }
+
+    // Write a PC2 file of pSampleCount samples of pPointCount points, one sample per frame.
+    bool WriteCache(const char * pFileName, int pPointCount, int pSampleCount)
+    {
+        FILE * lFile = fopen(pFileName, "wb");
+        if (!lFile)
+            return false;
+
+        const char lSignature[12] = "POINTCACHE2";
+        const int lFileVersion = 1;
+        const float lStartFrame = 0.0f;
+        const float lSampleRate = 1.0f;
+        fwrite(lSignature, sizeof(lSignature), 1, lFile);
+        fwrite(&lFileVersion, sizeof(int), 1, lFile);
+        fwrite(&pPointCount, sizeof(int), 1, lFile);
+        fwrite(&lStartFrame, sizeof(float), 1, lFile);
+        fwrite(&lSampleRate, sizeof(float), 1, lFile);
+        fwrite(&pSampleCount, sizeof(int), 1, lFile);
+
+        std::vector<float> lSample(pPointCount * 3);
+        bool lWritten = true;
+        for (int lSampleIndex = 0; lSampleIndex < pSampleCount && lWritten; ++lSampleIndex)
+        {
+            for (size_t lIndex = 0; lIndex < lSample.size(); ++lIndex)
+            {
+                lSample[lIndex] = static_cast<float>(rand()) / RAND_MAX;
+            }
+            lWritten = fwrite(&lSample[0], sizeof(float), lSample.size(), lFile) == lSample.size();
+        }
+        return fclose(lFile) == 0 && lWritten;
+    }
+}
+
+int main(int pArgc, char ** pArgv)
+{
+    int lPointCount = DEFAULT_POINT_COUNT;
+    int lSampleCount = DEFAULT_SAMPLE_COUNT;
+    double lSeconds = DEFAULT_SECONDS;
+    double lMinFps = 0.0;
+    const char * lFileName = NULL;
+    for (int lArgIndex = 1; lArgIndex < pArgc; ++lArgIndex)
+    {
+        const bool lHasValue = lArgIndex + 1 < pArgc;
+        if (lHasValue && strcmp(pArgv[lArgIndex], "-points") == 0)
+            lPointCount = atoi(pArgv[++lArgIndex]);
+        else if (lHasValue && strcmp(pArgv[lArgIndex], "-samples") == 0)
+            lSampleCount = atoi(pArgv[++lArgIndex]);
+        else if (lHasValue && strcmp(pArgv[lArgIndex], "-seconds") == 0)
+            lSeconds = atof(pArgv[++lArgIndex]);
+        else if (lHasValue && strcmp(pArgv[lArgIndex], "-minfps") == 0)
+            lMinFps = atof(pArgv[++lArgIndex]);
+        else
+            lFileName = pArgv[lArgIndex];
+    }
+
+    if (!lFileName)
+    {
+        lFileName = DEFAULT_FILE_NAME;
+        FBXSDK_printf("Writing %d samples of %d points to %s\n", lSampleCount, lPointCount, lFileName);
+        if (lPointCount <= 0 || lSampleCount <= 0 || !WriteCache(lFileName, lPointCount, lSampleCount))
+        {
+            FBXSDK_printf("Cannot write %s\n", lFileName);
+            return 1;
+        }
+    }
+
+    PointCacheStream lStream;
+    if (!lStream.Open(lFileName))
+    {
+        FBXSDK_printf("Cannot open %s\n", lFileName);
+        return 1;
+    }
+    FBXSDK_printf("Playing %d samples of %d points for %g seconds\n", lStream.GetSampleCount(),
+        lStream.GetPointCount(), lSeconds);
+
+    // The VBO layout, as VBOMesh::UpdateVertexPosition fills it.
+    std::vector<float> lVertices(lStream.GetPointCount() * 4);
+    std::vector<double> lFrameTimes;
+    const double lStart = GetSeconds();
+    double lNow = lStart;
+    for (int lFrame = 0; lFrame == 0 || lNow - lStart < lSeconds; ++lFrame)
+    {
+        FbxTime lTime;
+        lTime.SetFrame(lFrame % lStream.GetSampleCount());
+        const double lFrameStart = lNow;
+        lStream.Read(lTime, &lVertices[0], lStream.GetPointCount());
+        lNow = GetSeconds();
+        lFrameTimes.push_back(lNow - lFrameStart);
+    }
+
+    const double lFps = lFrameTimes.size() / (lNow - lStart);
+    std::sort(lFrameTimes.begin(), lFrameTimes.end());
+    const double lMedian = lFrameTimes[lFrameTimes.size() / 2];
+    const double lPercentile99 = lFrameTimes[lFrameTimes.size() * 99 / 100];
+    const double lWorst = lFrameTimes.back();
+    FBXSDK_printf("%d frames, %.1f fps, median %.3f ms, 99th percentile %.3f ms, worst %.3f ms\n",
+        static_cast<int>(lFrameTimes.size()), lFps, lMedian * 1000.0, lPercentile99 * 1000.0, lWorst * 1000.0);
+
+    if (lFps < lMinFps)
+    {
+        FBXSDK_printf("Below %g fps\n", lMinFps);
+        return 1;
+    }
+    return 0;
+}
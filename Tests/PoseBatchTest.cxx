@@ -0,0 +1,116 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "ViewSceneTests.h"
+#include "../Player.h"
+
+#include <math.h>
+
+namespace
+{
+    // Instances of the crowd, not a multiple of the four lanes so that the last group is partial.
+    const int INSTANCE_COUNT = 10;
+
+    // Scale of the skeleton, not 1 so that a root translation scaled twice shows.
+    const float SKELETON_SCALE = 2.0f;
+
+    // Largest difference allowed between the single precision palettes and the double precision
+    // joints, relative to the largest translation.
+    const double RELATIVE_TOLERANCE = 1e-5;
+
+    // Compare the global transform of every joint after Skeleton::ReadFromFrame with a palette.
+    void ComparePalette(const Skeleton & pSkeleton, const float * pPalette, double & pMaxError, double & pMaxTranslation)
+    {
+        for (unsigned int lJointId = 0; lJointId < pSkeleton.GetNumJoints(); ++lJointId)
+        {
+            const Transform & lGlobal = pSkeleton.GetGlobalTransform(lJointId);
+            const float * lMatrix = pPalette + lJointId * PoseBatch::PALETTE_STRIDE;
+            for (int lRow = 0; lRow < 3; ++lRow)
+            {
+                for (int lColumn = 0; lColumn < 3; ++lColumn)
+                {
+                    pMaxError = FbxMax(pMaxError, fabs(lMatrix[lColumn * 4 + lRow] - lGlobal.m_rotation[lRow][lColumn]));
+                }
+                pMaxError = FbxMax(pMaxError, fabs(lMatrix[12 + lRow] - lGlobal.m_translation[lRow]));
+                pMaxTranslation = FbxMax(pMaxTranslation, fabs(lGlobal.m_translation[lRow]));
+            }
+        }
+    }
+}
+
+// Evaluate a crowd playing testbvh.bvh with PoseBatch, through Player and for an instance
+// without motion, and compare the palettes with the poses of Skeleton::ReadFromFrame.
+bool TestPoseBatch(FbxManager * /*pManager*/)
+{
+    Player lPlayer;
+    const FbxString lPath = GetTestDataPath("testbvh.bvh");
+    if (!lPlayer.LoadBVHFile(lPath.Buffer()))
+    {
+        FBXSDK_printf("  cannot load %s\n", lPath.Buffer());
+        return false;
+    }
+
+    Skeleton & lSkeleton = lPlayer.GetSkeleton();
+    const Motion & lMotion = lPlayer.GetMotion();
+    lSkeleton.SetScale(SKELETON_SCALE);
+    const unsigned int lJointCount = lSkeleton.GetNumJoints();
+
+    // The instance without motion keeps the current root translation.
+    PoseBatch lBatch;
+    if (!lBatch.Initialize(lSkeleton))
+    {
+        FBXSDK_printf("  skeleton not supported\n");
+        return false;
+    }
+    PoseBatch::Instance lRestInstance;
+    std::vector<float> lRestPalette(lJointCount * PoseBatch::PALETTE_STRIDE);
+    lBatch.Evaluate(&lRestInstance, 1, &lRestPalette[0]);
+
+    Frame lRestFrame;
+    lRestFrame.SetNumJoints(lJointCount);
+    lRestFrame.SetRootTranslation(lSkeleton.GetRootJoint()->GetLocalTranslation() / SKELETON_SCALE);
+    for (unsigned int lJointId = 0; lJointId < lJointCount; ++lJointId)
+    {
+        lRestFrame.SetJointRotation(lJointId, identity3D);
+    }
+
+    // The crowd plays the motion at frame times, spread over the motion.
+    std::vector<unsigned int> lFrames(INSTANCE_COUNT);
+    std::vector<double> lTimes(INSTANCE_COUNT);
+    for (int lInstanceIndex = 0; lInstanceIndex < INSTANCE_COUNT; ++lInstanceIndex)
+    {
+        lFrames[lInstanceIndex] = (lMotion.GetNumFrames() - 1) * lInstanceIndex / (INSTANCE_COUNT - 1);
+        lTimes[lInstanceIndex] = lFrames[lInstanceIndex] / lMotion.GetFps();
+    }
+    std::vector<float> lPalettes;
+    if (!lPlayer.EvaluatePoses(lTimes, lPalettes))
+    {
+        FBXSDK_printf("  cannot evaluate the crowd\n");
+        return false;
+    }
+
+    double lRestError = 0.0;
+    double lMaxError = 0.0;
+    double lMaxTranslation = 0.0;
+    lSkeleton.ReadFromFrame(lRestFrame);
+    ComparePalette(lSkeleton, &lRestPalette[0], lRestError, lMaxTranslation);
+    for (int lInstanceIndex = 0; lInstanceIndex < INSTANCE_COUNT; ++lInstanceIndex)
+    {
+        lSkeleton.ReadFromFrame(lMotion.GetFrame(lFrames[lInstanceIndex]));
+        ComparePalette(lSkeleton, &lPalettes[lInstanceIndex * lJointCount * PoseBatch::PALETTE_STRIDE], lMaxError,
+            lMaxTranslation);
+    }
+
+    const double lTolerance = RELATIVE_TOLERANCE * FbxMax(lMaxTranslation, 1.0);
+    FBXSDK_printf("  %u joints, %d instances, max error %g, without motion %g, tolerance %g\n", lJointCount,
+        INSTANCE_COUNT, lMaxError, lRestError, lTolerance);
+    return lMaxError <= lTolerance && lRestError <= lTolerance;
+}
@@ -0,0 +1,110 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "ViewSceneTests.h"
+#include "../SkinCache.h"
+#include "../GetPosition.h"
+
+#include <math.h>
+
+namespace
+{
+    // Frames compared, spread over the animation.
+    const int FRAME_COUNT = 16;
+
+    // Largest difference allowed between the single and double precision positions, relative
+    // to the largest deformed coordinate: a few float roundings.
+    const double RELATIVE_TOLERANCE = 1e-5;
+}
+
+// Deform the skinned meshes of happydanceboundskin.fbx with the double precision reference
+// and with the single precision kernel, and compare the positions.
+bool TestSkinPrecision(FbxManager * pManager)
+{
+    FbxTime lStart, lStop;
+    FbxScene * lScene = LoadTestScene(pManager, "happydanceboundskin.fbx", lStart, lStop);
+    if (!lScene)
+        return false;
+
+    FbxArray<FbxNode *> lNodes;
+    FindSkinnedMeshes(lScene->GetRootNode(), lNodes);
+    if (lNodes.GetCount() == 0)
+    {
+        FBXSDK_printf("  no skinned mesh\n");
+        lScene->Destroy();
+        return false;
+    }
+
+    bool lPassed = true;
+    for (int lNodeIndex = 0; lNodeIndex < lNodes.GetCount(); ++lNodeIndex)
+    {
+        FbxNode * lNode = lNodes[lNodeIndex];
+        FbxMesh * lMesh = lNode->GetMesh();
+        SkinCache lSkinCache;
+        if (!lSkinCache.Initialize(lMesh))
+        {
+            FBXSDK_printf("  %s: cannot bake the skin\n", lNode->GetName());
+            lPassed = false;
+            continue;
+        }
+        if (lSkinCache.GetLinkMode() == FbxCluster::eAdditive)
+        {
+            FBXSDK_printf("  %s: additive link mode, only deformed in double precision\n", lNode->GetName());
+            continue;
+        }
+
+        const int lVertexCount = lMesh->GetControlPointsCount();
+        const int lBoneCount = lSkinCache.GetBoneCount();
+        FbxAMatrix * lBoneMatrices = new FbxAMatrix[lBoneCount];
+        FbxVector4 * lReferenceVertices = new FbxVector4[lVertexCount];
+        FbxArray<float> lPalette;
+        FbxArray<float> lVertices;
+        lPalette.Resize(lBoneCount * SkinCache::PALETTE_STRIDE);
+        lVertices.Resize(lVertexCount * 4);
+
+        double lMaxError = 0.0;
+        double lMaxCoordinate = 0.0;
+        for (int lFrame = 0; lFrame < FRAME_COUNT; ++lFrame)
+        {
+            const FbxTime lTime = GetTestFrameTime(lStart, lStop, lFrame, FRAME_COUNT);
+            const FbxAMatrix lGlobalOffPosition = GetGlobalPosition(lNode, lTime) * GetGeometry(lNode);
+            lSkinCache.ComputeBoneMatrices(lGlobalOffPosition, lTime, NULL, lBoneMatrices);
+
+            memcpy(lReferenceVertices, lMesh->GetControlPoints(), lVertexCount * sizeof(FbxVector4));
+            lSkinCache.ComputeLinearDeformation(lBoneMatrices, lReferenceVertices, 0, lVertexCount);
+
+            SkinCache::ConvertPalette(lBoneMatrices, lBoneCount, lPalette.GetArray());
+            lSkinCache.ComputeLinearDeformation(lPalette.GetArray(), NULL, lVertices.GetArray(), 0, lVertexCount);
+
+            for (int lVertexIndex = 0; lVertexIndex < lVertexCount; ++lVertexIndex)
+            {
+                for (int lAxis = 0; lAxis < 3; ++lAxis)
+                {
+                    const double lReference = lReferenceVertices[lVertexIndex][lAxis];
+                    lMaxError = FbxMax(lMaxError, fabs(lVertices[lVertexIndex * 4 + lAxis] - lReference));
+                    lMaxCoordinate = FbxMax(lMaxCoordinate, fabs(lReference));
+                }
+            }
+        }
+
+        const double lTolerance = RELATIVE_TOLERANCE * FbxMax(lMaxCoordinate, 1.0);
+        FBXSDK_printf("  %s: %d vertices, %d bones, %d frames, max error %g, tolerance %g\n", lNode->GetName(),
+            lVertexCount, lBoneCount, FRAME_COUNT, lMaxError, lTolerance);
+        if (!(lMaxError <= lTolerance))
+            lPassed = false;
+
+        delete [] lBoneMatrices;
+        delete [] lReferenceVertices;
+    }
+
+    lScene->Destroy();
+    return lPassed;
+}
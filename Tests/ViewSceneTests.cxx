@@ -0,0 +1,138 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+// Checks of the deformation paths of ViewScene against their reference paths.
+// Usage: ViewSceneTests [-data <directory>] [test name]...
+// All the tests run if none is named; the exit code is the count of failed tests.
+
+#include "ViewSceneTests.h"
+#include "../../Common/Common.h"
+
+#include <string.h>
+
+namespace
+{
+    struct Test
+    {
+        const char * mName;
+        bool (*mRun)(FbxManager * pManager);
+    };
+
+    const Test TESTS[] =
+    {
+        {"skin_precision", TestSkinPrecision},
+        {"pose_batch", TestPoseBatch},
+        {"gpu_skin", TestGpuSkin},
+    };
+    const int TEST_COUNT = sizeof(TESTS) / sizeof(TESTS[0]);
+
+    FbxString gDataDirectory(".");
+
+    bool IsSelected(const char * pName, int pArgc, char ** pArgv, int pFirstArg)
+    {
+        if (pFirstArg == pArgc)
+            return true;
+
+        for (int lArgIndex = pFirstArg; lArgIndex < pArgc; ++lArgIndex)
+        {
+            if (strcmp(pArgv[lArgIndex], pName) == 0)
+                return true;
+        }
+        return false;
+    }
+}
+
+FbxString GetTestDataPath(const char * pFileName)
+{
+    return FbxPathUtils::Bind(gDataDirectory.Buffer(), pFileName);
+}
+
+FbxScene * LoadTestScene(FbxManager * pManager, const char * pFileName, FbxTime & pStart, FbxTime & pStop)
+{
+    FbxScene * lScene = FbxScene::Create(pManager, pFileName);
+    const FbxString lPath = GetTestDataPath(pFileName);
+    if (!LoadScene(pManager, lScene, lPath.Buffer()))
+    {
+        FBXSDK_printf("  cannot import %s\n", lPath.Buffer());
+        lScene->Destroy();
+        return NULL;
+    }
+
+    FbxAnimStack * lAnimStack = lScene->GetSrcObject<FbxAnimStack>(0);
+    if (lAnimStack)
+    {
+        lScene->GetEvaluator()->SetContext(lAnimStack);
+        pStart = lAnimStack->GetLocalTimeSpan().GetStart();
+        pStop = lAnimStack->GetLocalTimeSpan().GetStop();
+    }
+    else
+    {
+        FbxTimeSpan lTimeLineTimeSpan;
+        lScene->GetGlobalSettings().GetTimelineDefaultTimeSpan(lTimeLineTimeSpan);
+        pStart = lTimeLineTimeSpan.GetStart();
+        pStop = lTimeLineTimeSpan.GetStop();
+    }
+    return lScene;
+}
+
+void FindSkinnedMeshes(FbxNode * pNode, FbxArray<FbxNode *> & pNodes)
+{
+    FbxMesh * lMesh = pNode->GetMesh();
+    if (lMesh && lMesh->GetDeformerCount(FbxDeformer::eSkin) > 0)
+    {
+        pNodes.Add(pNode);
+    }
+
+    for (int lChildIndex = 0; lChildIndex < pNode->GetChildCount(); ++lChildIndex)
+    {
+        FindSkinnedMeshes(pNode->GetChild(lChildIndex), pNodes);
+    }
+}
+
+FbxTime GetTestFrameTime(const FbxTime & pStart, const FbxTime & pStop, int pFrame, int pFrameCount)
+{
+    FbxTime lTime;
+    lTime.Set(pStart.Get() + (pStop.Get() - pStart.Get()) * pFrame / FbxMax(pFrameCount - 1, 1));
+    return lTime;
+}
+
+int main(int pArgc, char ** pArgv)
+{
+    int lFirstArg = 1;
+    if (pArgc > 2 && strcmp(pArgv[1], "-data") == 0)
+    {
+        gDataDirectory = pArgv[2];
+        lFirstArg = 3;
+    }
+
+    FbxManager * lSdkManager = NULL;
+    FbxScene * lScene = NULL;
+    InitializeSdkObjects(lSdkManager, lScene);
+    if (!lSdkManager)
+        return 1;
+
+    int lFailedCount = 0;
+    for (int lTestIndex = 0; lTestIndex < TEST_COUNT; ++lTestIndex)
+    {
+        const Test & lTest = TESTS[lTestIndex];
+        if (!IsSelected(lTest.mName, pArgc, pArgv, lFirstArg))
+            continue;
+
+        FBXSDK_printf("%s\n", lTest.mName);
+        const bool lPassed = lTest.mRun(lSdkManager);
+        FBXSDK_printf("%s: %s\n", lTest.mName, lPassed ? "passed" : "FAILED");
+        if (!lPassed)
+            ++lFailedCount;
+    }
+
+    DestroySdkObjects(lSdkManager, lFailedCount == 0);
+    return lFailedCount;
+}
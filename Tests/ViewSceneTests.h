@@ -0,0 +1,35 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _VIEW_SCENE_TESTS_H
+#define _VIEW_SCENE_TESTS_H
+
+#include <fbxsdk.h>
+
+// Path of a file of the test data directory, set with -data on the command line.
+FbxString GetTestDataPath(const char * pFileName);
+
+// Import a scene of the test data directory and make its first animation stack current,
+// pStart and pStop get its time span. NULL if the file cannot be imported.
+FbxScene * LoadTestScene(FbxManager * pManager, const char * pFileName, FbxTime & pStart, FbxTime & pStop);
+
+// The nodes of the meshes with a skin under pNode.
+void FindSkinnedMeshes(FbxNode * pNode, FbxArray<FbxNode *> & pNodes);
+
+// Time of the frame pFrame out of pFrameCount spread over [pStart, pStop].
+FbxTime GetTestFrameTime(const FbxTime & pStart, const FbxTime & pStop, int pFrame, int pFrameCount);
+
+// The checks, each one prints its measures and returns whether it passed.
+bool TestSkinPrecision(FbxManager * pManager);
+bool TestPoseBatch(FbxManager * pManager);
+bool TestGpuSkin(FbxManager * pManager);
+
+#endif // _VIEW_SCENE_TESTS_H
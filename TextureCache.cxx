@@ -0,0 +1,426 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "TextureCache.h"
+#include "GlFunctions.h"
+#include "targa.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace
+{
+    // Header of a cache file, followed by the path of the source file,
+    // the description of the levels and their data.
+    struct CacheHeader
+    {
+        char mSignature[8];
+        FbxLongLong mSourceTime;
+        int mFormat;
+        int mLevelCount;
+        int mDataSize;
+        int mPathLength;
+    };
+
+    const char CACHE_SIGNATURE[8] = "VSTEX01";
+
+    // Bytes of a BC1 block of 4x4 pixels.
+    const int BC1_BLOCK_SIZE = 8;
+
+    FbxLongLong GetModificationTime(const char * pFileName)
+    {
+        struct stat lStat;
+        if (stat(pFileName, &lStat) != 0)
+            return 0;
+        return static_cast<FbxLongLong>(lStat.st_mtime);
+    }
+
+    // Name of the cache file of a source file: a hash of its path, and the format.
+    FbxString GetCacheFileName(const char * pSourceFile, CachedTexture::EFormat pFormat)
+    {
+        // 64-bit FNV-1a.
+        unsigned long long lHash = 14695981039346656037ULL;
+        for (const char * lChar = pSourceFile; *lChar; ++lChar)
+        {
+            lHash ^= static_cast<unsigned char>(*lChar);
+            lHash *= 1099511628211ULL;
+        }
+
+        const char HEX_DIGITS[] = "0123456789abcdef";
+        char lName[17];
+        for (int i = 0; i < 16; ++i)
+        {
+            lName[i] = HEX_DIGITS[(lHash >> (60 - i * 4)) & 15];
+        }
+        lName[16] = '\0';
+
+        FbxString lFileName(lName);
+        lFileName += pFormat == CachedTexture::FORMAT_BC1 ? ".bc1" : ".bgr";
+        return lFileName;
+    }
+
+    int GetLevelSize(CachedTexture::EFormat pFormat, int pWidth, int pHeight)
+    {
+        if (pFormat == CachedTexture::FORMAT_BC1)
+            return ((pWidth + 3) / 4) * ((pHeight + 3) / 4) * BC1_BLOCK_SIZE;
+        return pWidth * pHeight * 3;
+    }
+
+    unsigned short Pack565(const int * pRGB)
+    {
+        return static_cast<unsigned short>((((pRGB[0] * 31 + 127) / 255) << 11) |
+            (((pRGB[1] * 63 + 127) / 255) << 5) | ((pRGB[2] * 31 + 127) / 255));
+    }
+
+    // Expand a 565 color to 8 bits per channel, as the GPU does.
+    void Expand565(unsigned short pColor, int * pRGB)
+    {
+        const int lRed = (pColor >> 11) & 31;
+        const int lGreen = (pColor >> 5) & 63;
+        const int lBlue = pColor & 31;
+        pRGB[0] = (lRed << 3) | (lRed >> 2);
+        pRGB[1] = (lGreen << 2) | (lGreen >> 4);
+        pRGB[2] = (lBlue << 3) | (lBlue >> 2);
+    }
+
+    // Encode the 4x4 pixels at (pX, pY) of a BGR 24 image, repeating the last row and
+    // column past the edges. The end points are two opposite corners of the bounding box
+    // of the colors, slightly inset, and every pixel takes the closest of the four colors.
+    void CompressBC1Block(const unsigned char * pPixels, int pWidth, int pHeight, int pX, int pY, unsigned char * pBlock)
+    {
+        int lColors[16][3];
+        int lMin[3] = {255, 255, 255};
+        int lMax[3] = {0, 0, 0};
+        for (int y = 0; y < 4; ++y)
+        {
+            const int lY = pY + y < pHeight ? pY + y : pHeight - 1;
+            for (int x = 0; x < 4; ++x)
+            {
+                const int lX = pX + x < pWidth ? pX + x : pWidth - 1;
+                const unsigned char * lPixel = pPixels + (lY * pWidth + lX) * 3;
+                int * lColor = lColors[y * 4 + x];
+                lColor[0] = lPixel[2];
+                lColor[1] = lPixel[1];
+                lColor[2] = lPixel[0];
+                for (int c = 0; c < 3; ++c)
+                {
+                    lMin[c] = FbxMin(lMin[c], lColor[c]);
+                    lMax[c] = FbxMax(lMax[c], lColor[c]);
+                }
+            }
+        }
+
+        // Take the diagonal of the box along which the colors spread: green and blue
+        // run against red when they decrease as it increases.
+        int lCenter[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            lCenter[c] = (lMin[c] + lMax[c]) / 2;
+        }
+        int lCovariance[3] = {0, 0, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            const int lRed = lColors[i][0] - lCenter[0];
+            lCovariance[1] += lRed * (lColors[i][1] - lCenter[1]);
+            lCovariance[2] += lRed * (lColors[i][2] - lCenter[2]);
+        }
+        for (int c = 1; c < 3; ++c)
+        {
+            if (lCovariance[c] < 0)
+            {
+                const int lSwap = lMin[c];
+                lMin[c] = lMax[c];
+                lMax[c] = lSwap;
+            }
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            const int lInset = (lMax[c] - lMin[c]) / 16;
+            lMin[c] += lInset;
+            lMax[c] -= lInset;
+        }
+
+        // The first end point must be the greater for the four color mode.
+        unsigned short lColor0 = Pack565(lMax);
+        unsigned short lColor1 = Pack565(lMin);
+        if (lColor0 < lColor1)
+        {
+            const unsigned short lSwap = lColor0;
+            lColor0 = lColor1;
+            lColor1 = lSwap;
+        }
+
+        unsigned int lIndices = 0;
+        if (lColor0 != lColor1)
+        {
+            int lPalette[4][3];
+            Expand565(lColor0, lPalette[0]);
+            Expand565(lColor1, lPalette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                lPalette[2][c] = (2 * lPalette[0][c] + lPalette[1][c]) / 3;
+                lPalette[3][c] = (lPalette[0][c] + 2 * lPalette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int lBest = 0;
+                int lBestDistance = INT_MAX;
+                for (int j = 0; j < 4; ++j)
+                {
+                    const int lDR = lColors[i][0] - lPalette[j][0];
+                    const int lDG = lColors[i][1] - lPalette[j][1];
+                    const int lDB = lColors[i][2] - lPalette[j][2];
+                    const int lDistance = lDR * lDR + lDG * lDG + lDB * lDB;
+                    if (lDistance < lBestDistance)
+                    {
+                        lBest = j;
+                        lBestDistance = lDistance;
+                    }
+                }
+                lIndices |= static_cast<unsigned int>(lBest) << (i * 2);
+            }
+        }
+
+        pBlock[0] = static_cast<unsigned char>(lColor0 & 0xFF);
+        pBlock[1] = static_cast<unsigned char>(lColor0 >> 8);
+        pBlock[2] = static_cast<unsigned char>(lColor1 & 0xFF);
+        pBlock[3] = static_cast<unsigned char>(lColor1 >> 8);
+        pBlock[4] = static_cast<unsigned char>(lIndices & 0xFF);
+        pBlock[5] = static_cast<unsigned char>((lIndices >> 8) & 0xFF);
+        pBlock[6] = static_cast<unsigned char>((lIndices >> 16) & 0xFF);
+        pBlock[7] = static_cast<unsigned char>(lIndices >> 24);
+    }
+
+    // Average 2x2 pixels of a BGR 24 image, the last row or column is repeated for odd sizes.
+    void DownsampleBGR(const unsigned char * pPixels, int pWidth, int pHeight,
+                       unsigned char * pResult, int pResultWidth, int pResultHeight)
+    {
+        for (int y = 0; y < pResultHeight; ++y)
+        {
+            const int lY0 = y * 2 < pHeight ? y * 2 : pHeight - 1;
+            const int lY1 = lY0 + 1 < pHeight ? lY0 + 1 : lY0;
+            for (int x = 0; x < pResultWidth; ++x)
+            {
+                const int lX0 = x * 2 < pWidth ? x * 2 : pWidth - 1;
+                const int lX1 = lX0 + 1 < pWidth ? lX0 + 1 : lX0;
+                const unsigned char * lP00 = pPixels + (lY0 * pWidth + lX0) * 3;
+                const unsigned char * lP01 = pPixels + (lY0 * pWidth + lX1) * 3;
+                const unsigned char * lP10 = pPixels + (lY1 * pWidth + lX0) * 3;
+                const unsigned char * lP11 = pPixels + (lY1 * pWidth + lX1) * 3;
+                unsigned char * lResult = pResult + (y * pResultWidth + x) * 3;
+                for (int c = 0; c < 3; ++c)
+                {
+                    lResult[c] = static_cast<unsigned char>((lP00[c] + lP01[c] + lP10[c] + lP11[c] + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+bool CachedTexture::sCompression = false;
+const char * CachedTexture::sCacheFolder = "TextureCache";
+
+CachedTexture::CachedTexture() : mFormat(FORMAT_BGR)
+{
+}
+
+bool CachedTexture::Load(const char * pSourceFile)
+{
+    mFormat = sCompression ? FORMAT_BC1 : FORMAT_BGR;
+
+    // A cache file older than the source is simply not found.
+    const FbxLongLong lSourceTime = GetModificationTime(pSourceFile);
+    FbxString lCacheFile;
+    if (sCacheFolder && lSourceTime)
+    {
+        lCacheFile = FbxPathUtils::Bind(sCacheFolder, GetCacheFileName(pSourceFile, mFormat));
+        if (ReadCacheFile(lCacheFile, pSourceFile, lSourceTime))
+            return true;
+    }
+
+    // Bottom to top, left to right BGR 24, in a single pass over the file.
+    tga_image lTGAImage;
+    if (tga_read_bgr24(&lTGAImage, pSourceFile) != TGA_NOERR)
+        return false;
+
+    Build(lTGAImage.image_data, lTGAImage.width, lTGAImage.height);
+    tga_free_buffers(&lTGAImage);
+
+    if (!lCacheFile.IsEmpty())
+    {
+        FbxPathUtils::Create(sCacheFolder);
+        WriteCacheFile(lCacheFile, pSourceFile, lSourceTime);
+    }
+
+    return true;
+}
+
+unsigned int CachedTexture::Upload() const
+{
+    GLuint lTextureObject = 0;
+    glGenTextures(1, &lTextureObject);
+    glBindTexture(GL_TEXTURE_2D, lTextureObject);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Trilinear filtering over the prebuilt chain.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mLevels.GetCount() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+    for (int lLevelIndex = 0; lLevelIndex < mLevels.GetCount(); ++lLevelIndex)
+    {
+        const Level & lLevel = mLevels[lLevelIndex];
+        const unsigned char * lData = mData.GetArray() + lLevel.mOffset;
+        if (mFormat == FORMAT_BC1)
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, lLevelIndex, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                lLevel.mWidth, lLevel.mHeight, 0, lLevel.mSize, lData);
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, lLevelIndex, 3, lLevel.mWidth, lLevel.mHeight, 0, GL_BGR,
+                GL_UNSIGNED_BYTE, lData);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return lTextureObject;
+}
+
+void CachedTexture::Build(const unsigned char * pPixels, int pWidth, int pHeight)
+{
+    mLevels.Clear();
+    mData.Clear();
+
+    // Every level is filtered from the previous one, down to a single pixel.
+    unsigned char * lPixels = new unsigned char[pWidth * pHeight * 3];
+    memcpy(lPixels, pPixels, pWidth * pHeight * 3);
+    int lWidth = pWidth;
+    int lHeight = pHeight;
+    for (;;)
+    {
+        Level lLevel;
+        lLevel.mWidth = lWidth;
+        lLevel.mHeight = lHeight;
+        lLevel.mOffset = mData.GetCount();
+        lLevel.mSize = GetLevelSize(mFormat, lWidth, lHeight);
+        mLevels.Add(lLevel);
+
+        mData.Resize(lLevel.mOffset + lLevel.mSize);
+        unsigned char * lData = mData.GetArray() + lLevel.mOffset;
+        if (mFormat == FORMAT_BC1)
+        {
+            for (int y = 0; y < lHeight; y += 4)
+            {
+                for (int x = 0; x < lWidth; x += 4)
+                {
+                    CompressBC1Block(lPixels, lWidth, lHeight, x, y, lData);
+                    lData += BC1_BLOCK_SIZE;
+                }
+            }
+        }
+        else
+        {
+            memcpy(lData, lPixels, lLevel.mSize);
+        }
+
+        if (lWidth == 1 && lHeight == 1)
+            break;
+
+        const int lNextWidth = lWidth > 1 ? lWidth / 2 : 1;
+        const int lNextHeight = lHeight > 1 ? lHeight / 2 : 1;
+        unsigned char * lNextPixels = new unsigned char[lNextWidth * lNextHeight * 3];
+        DownsampleBGR(lPixels, lWidth, lHeight, lNextPixels, lNextWidth, lNextHeight);
+        delete [] lPixels;
+        lPixels = lNextPixels;
+        lWidth = lNextWidth;
+        lHeight = lNextHeight;
+    }
+    delete [] lPixels;
+}
+
+bool CachedTexture::ReadCacheFile(const FbxString & pCacheFile, const char * pSourceFile, FbxLongLong pSourceTime)
+{
+    FILE * lFile = fopen(pCacheFile.Buffer(), "rb");
+    if (!lFile)
+        return false;
+
+    // Anything unexpected means the file is stale or broken, it is written again.
+    bool lResult = false;
+    CacheHeader lHeader;
+    const int lPathLength = static_cast<int>(strlen(pSourceFile));
+    if (fread(&lHeader, sizeof(lHeader), 1, lFile) == 1 &&
+        memcmp(lHeader.mSignature, CACHE_SIGNATURE, sizeof(CACHE_SIGNATURE)) == 0 &&
+        lHeader.mSourceTime == pSourceTime && lHeader.mFormat == mFormat &&
+        lHeader.mPathLength == lPathLength && lHeader.mLevelCount > 0 && lHeader.mDataSize > 0)
+    {
+        // Make sure a hash collision does not return the texture of another file.
+        FbxArray<char> lPath;
+        lPath.Resize(lPathLength);
+        if (fread(lPath.GetArray(), 1, lPathLength, lFile) == static_cast<size_t>(lPathLength) &&
+            memcmp(lPath.GetArray(), pSourceFile, lPathLength) == 0)
+        {
+            mLevels.Resize(lHeader.mLevelCount);
+            mData.Resize(lHeader.mDataSize);
+            lResult = fread(mLevels.GetArray(), sizeof(Level), lHeader.mLevelCount, lFile) == static_cast<size_t>(lHeader.mLevelCount) &&
+                fread(mData.GetArray(), 1, lHeader.mDataSize, lFile) == static_cast<size_t>(lHeader.mDataSize);
+            for (int lLevelIndex = 0; lResult && lLevelIndex < lHeader.mLevelCount; ++lLevelIndex)
+            {
+                const Level & lLevel = mLevels[lLevelIndex];
+                lResult = lLevel.mOffset >= 0 && lLevel.mSize == GetLevelSize(mFormat, lLevel.mWidth, lLevel.mHeight) &&
+                    lLevel.mOffset + lLevel.mSize <= lHeader.mDataSize;
+            }
+        }
+    }
+    fclose(lFile);
+
+    if (!lResult)
+    {
+        mLevels.Clear();
+        mData.Clear();
+    }
+    return lResult;
+}
+
+bool CachedTexture::WriteCacheFile(const FbxString & pCacheFile, const char * pSourceFile, FbxLongLong pSourceTime) const
+{
+    FILE * lFile = fopen(pCacheFile.Buffer(), "wb");
+    if (!lFile)
+        return false;
+
+    // The header is written last, an interrupted write leaves a file which is never read.
+    CacheHeader lHeader;
+    memset(&lHeader, 0, sizeof(lHeader));
+    const int lPathLength = static_cast<int>(strlen(pSourceFile));
+    bool lResult = fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1 &&
+        fwrite(pSourceFile, 1, lPathLength, lFile) == static_cast<size_t>(lPathLength) &&
+        fwrite(mLevels.GetArray(), sizeof(Level), mLevels.GetCount(), lFile) == static_cast<size_t>(mLevels.GetCount()) &&
+        fwrite(mData.GetArray(), 1, mData.GetCount(), lFile) == static_cast<size_t>(mData.GetCount());
+
+    if (lResult)
+    {
+        memcpy(lHeader.mSignature, CACHE_SIGNATURE, sizeof(CACHE_SIGNATURE));
+        lHeader.mSourceTime = pSourceTime;
+        lHeader.mFormat = mFormat;
+        lHeader.mLevelCount = mLevels.GetCount();
+        lHeader.mDataSize = mData.GetCount();
+        lHeader.mPathLength = lPathLength;
+        lResult = fseek(lFile, 0, SEEK_SET) == 0 && fwrite(&lHeader, sizeof(lHeader), 1, lFile) == 1;
+    }
+    fclose(lFile);
+
+    return lResult;
+}
@@ -0,0 +1,71 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _TEXTURE_CACHE_H
+#define _TEXTURE_CACHE_H
+
+#include <fbxsdk.h>
+
+// A texture ready for upload: the whole mip chain of a TGA file, in BGR 24 or BC1 (DXT1)
+// blocks. The chain is built once and saved in a cache folder, keyed by the path and the
+// modification time of the source file; the next loads read it back without decoding the
+// TGA file. Loading does not need the GL context, only Upload does.
+class CachedTexture
+{
+public:
+    enum EFormat
+    {
+        FORMAT_BGR,
+        FORMAT_BC1
+    };
+
+    CachedTexture();
+
+    // Read the cached mip chain of the source file, or decode the file and cache its chain.
+    bool Load(const char * pSourceFile);
+
+    // Create the texture object with all its levels and return its name.
+    unsigned int Upload() const;
+
+    EFormat GetFormat() const { return mFormat; }
+    int GetLevelCount() const { return mLevels.GetCount(); }
+
+    // Format of the textures loaded from now on, BC1 needs EXT_texture_compression_s3tc.
+    static void SetCompression(bool pCompression) { sCompression = pCompression; }
+    static bool GetCompression() { return sCompression; }
+    // Folder of the cache files, created on first use; the name is not copied.
+    // NULL disables the cache.
+    static void SetCacheFolder(const char * pFolder) { sCacheFolder = pFolder; }
+
+private:
+    struct Level
+    {
+        int mWidth;
+        int mHeight;
+        int mOffset;
+        int mSize;
+    };
+
+    // Build the chain from a bottom to top BGR 24 image.
+    void Build(const unsigned char * pPixels, int pWidth, int pHeight);
+    bool ReadCacheFile(const FbxString & pCacheFile, const char * pSourceFile, FbxLongLong pSourceTime);
+    bool WriteCacheFile(const FbxString & pCacheFile, const char * pSourceFile, FbxLongLong pSourceTime) const;
+
+    EFormat mFormat;
+    FbxArray<Level> mLevels;
+    FbxArray<unsigned char> mData;
+
+    static bool sCompression;
+    static const char * sCacheFolder;
+};
+
+#endif // _TEXTURE_CACHE_H
+
@@ -0,0 +1,189 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#include "ThreadPool.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+ThreadPool::ThreadPool(int pThreadCount) : mWorkerCount(0), mQueues(NULL), mWorkers(NULL), mNextQueue(0), mQuit(false)
+{
+    if (pThreadCount <= 0)
+        pThreadCount = GetProcessorCount();
+
+    // The calling thread also executes tasks in Run.
+    mWorkerCount = pThreadCount - 1;
+    if (mWorkerCount < 0)
+        mWorkerCount = 0;
+
+    mQueues = new Queue[mWorkerCount + 1];
+    if (mWorkerCount)
+    {
+        mWorkers = new Worker[mWorkerCount];
+        for (int lWorkerIndex = 0; lWorkerIndex < mWorkerCount; ++lWorkerIndex)
+        {
+            mWorkers[lWorkerIndex].mPool = this;
+            mWorkers[lWorkerIndex].mIndex = lWorkerIndex;
+            mWorkers[lWorkerIndex].mThread = new FbxThread(WorkerProc, &mWorkers[lWorkerIndex]);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    // Wake up the workers to let them quit.
+    mQuit = true;
+    if (mWorkerCount)
+    {
+        mStartSemaphore.Signal(mWorkerCount);
+    }
+
+    for (int lWorkerIndex = 0; lWorkerIndex < mWorkerCount; ++lWorkerIndex)
+    {
+        mWorkers[lWorkerIndex].mThread->Join();
+        delete mWorkers[lWorkerIndex].mThread;
+    }
+
+    delete [] mWorkers;
+    delete [] mQueues;
+}
+
+void ThreadPool::Push(TaskProc pProc, void * pData, int pBegin, int pEnd)
+{
+    Task lTask;
+    lTask.mProc = pProc;
+    lTask.mData = pData;
+    lTask.mBegin = pBegin;
+    lTask.mEnd = pEnd;
+
+    // Deal the tasks among the queues, the stealing balances the rest.
+    Queue & lQueue = mQueues[mNextQueue];
+    mNextQueue = (mNextQueue + 1) % (mWorkerCount + 1);
+
+    lQueue.mLock.Acquire();
+    lQueue.mTasks.Add(lTask);
+    lQueue.mLock.Release();
+}
+
+void ThreadPool::PushRange(TaskProc pProc, void * pData, int pBegin, int pEnd, int pGrainSize)
+{
+    if (pGrainSize <= 0)
+        pGrainSize = pEnd - pBegin;
+
+    for (int lBegin = pBegin; lBegin < pEnd; lBegin += pGrainSize)
+    {
+        const int lEnd = lBegin + pGrainSize < pEnd ? lBegin + pGrainSize : pEnd;
+        Push(pProc, pData, lBegin, lEnd);
+    }
+}
+
+void ThreadPool::Run()
+{
+    if (mWorkerCount)
+    {
+        mStartSemaphore.Signal(mWorkerCount);
+    }
+
+    ProcessTasks(mWorkerCount);
+
+    // Every worker signals once it found all the queues empty and finished its last task.
+    if (mWorkerCount)
+    {
+        mDoneSemaphore.Wait(mWorkerCount);
+    }
+
+    for (int lQueueIndex = 0; lQueueIndex <= mWorkerCount; ++lQueueIndex)
+    {
+        mQueues[lQueueIndex].mTasks.Clear();
+        mQueues[lQueueIndex].mHead = 0;
+    }
+    mNextQueue = 0;
+}
+
+int ThreadPool::GetProcessorCount()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO lSystemInfo;
+    GetSystemInfo(&lSystemInfo);
+    const int lProcessorCount = static_cast<int>(lSystemInfo.dwNumberOfProcessors);
+#else
+    const int lProcessorCount = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    return lProcessorCount > 0 ? lProcessorCount : 1;
+}
+
+void ThreadPool::WorkerProc(void * pArg)
+{
+    Worker * lWorker = static_cast<Worker *>(pArg);
+    ThreadPool * lPool = lWorker->mPool;
+
+    for (;;)
+    {
+        lPool->mStartSemaphore.Wait();
+        if (lPool->mQuit)
+            break;
+
+        lPool->ProcessTasks(lWorker->mIndex);
+        lPool->mDoneSemaphore.Signal();
+    }
+}
+
+void ThreadPool::ProcessTasks(int pQueueIndex)
+{
+    Task lTask;
+    while (PopTask(pQueueIndex, lTask) || StealTask(pQueueIndex, lTask))
+    {
+        lTask.mProc(lTask.mData, lTask.mBegin, lTask.mEnd);
+    }
+}
+
+bool ThreadPool::PopTask(int pQueueIndex, Task & pTask)
+{
+    Queue & lQueue = mQueues[pQueueIndex];
+    bool lFound = false;
+
+    lQueue.mLock.Acquire();
+    if (lQueue.mTasks.GetCount() > lQueue.mHead)
+    {
+        pTask = lQueue.mTasks.RemoveLast();
+        lFound = true;
+    }
+    lQueue.mLock.Release();
+
+    return lFound;
+}
+
+bool ThreadPool::StealTask(int pQueueIndex, Task & pTask)
+{
+    // Visit the other queues starting with the next one, so the thieves spread out.
+    for (int lOffset = 1; lOffset <= mWorkerCount; ++lOffset)
+    {
+        Queue & lQueue = mQueues[(pQueueIndex + lOffset) % (mWorkerCount + 1)];
+        bool lFound = false;
+
+        lQueue.mLock.Acquire();
+        if (lQueue.mTasks.GetCount() > lQueue.mHead)
+        {
+            pTask = lQueue.mTasks[lQueue.mHead];
+            ++lQueue.mHead;
+            lFound = true;
+        }
+        lQueue.mLock.Release();
+
+        if (lFound)
+            return true;
+    }
+
+    return false;
+}
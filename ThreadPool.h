@@ -0,0 +1,89 @@
+/****************************************************************************************
+
+Copyright (C) 2013 Autodesk, Inc.
+All rights reserved.
+
+Use of this software is subject to the terms of the Autodesk license agreement
+provided at the time of installation or download, or which otherwise accompanies
+this software in either electronic or hard copy form.
+
+****************************************************************************************/
+
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <fbxsdk.h>
+
+// A small work-stealing thread pool built on the FBX SDK threads.
+// Tasks are pushed from the main thread, then Run executes them on the workers
+// and the calling thread. Every worker pops its own tasks last in first out,
+// and steals the oldest tasks of the other workers when it runs out of work.
+class ThreadPool
+{
+public:
+    // A task processes the items [pBegin, pEnd) of pData.
+    typedef void (*TaskProc)(void * pData, int pBegin, int pEnd);
+
+    // Zero thread means one worker per processor, minus the calling thread.
+    explicit ThreadPool(int pThreadCount = 0);
+    ~ThreadPool();
+
+    // Number of threads running the tasks, the calling thread included.
+    int GetThreadCount() const { return mWorkerCount + 1; }
+
+    // Queue a task, it is not executed before Run is called.
+    void Push(TaskProc pProc, void * pData, int pBegin, int pEnd);
+    // Queue the items [pBegin, pEnd) of pData split in tasks of pGrainSize items at most.
+    void PushRange(TaskProc pProc, void * pData, int pBegin, int pEnd, int pGrainSize);
+
+    // Execute all the queued tasks and return when all of them are done.
+    void Run();
+
+    // Number of processors of the machine.
+    static int GetProcessorCount();
+
+private:
+    struct Task
+    {
+        TaskProc mProc;
+        void * mData;
+        int mBegin;
+        int mEnd;
+    };
+
+    // Tasks of one worker, the owner takes from the tail and the thieves from the head.
+    struct Queue
+    {
+        Queue() : mHead(0) {}
+
+        FbxSpinLock mLock;
+        FbxArray<Task> mTasks;
+        int mHead;
+    };
+
+    struct Worker
+    {
+        ThreadPool * mPool;
+        int mIndex;
+        FbxThread * mThread;
+    };
+
+    static void WorkerProc(void * pArg);
+
+    // Execute tasks until no queue has any left.
+    void ProcessTasks(int pQueueIndex);
+    bool PopTask(int pQueueIndex, Task & pTask);
+    bool StealTask(int pQueueIndex, Task & pTask);
+
+    int mWorkerCount;
+    // One queue for every worker, the last one for the calling thread.
+    Queue * mQueues;
+    Worker * mWorkers;
+    int mNextQueue;
+
+    FbxSemaphore mStartSemaphore;
+    FbxSemaphore mDoneSemaphore;
+    volatile bool mQuit;
+};
+
+#endif // _THREAD_POOL_H
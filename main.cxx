@@ -38,6 +38,8 @@ this software in either electronic or hard copy form.
 /////////////////////////////////////////////////////////////////////////
 
 #include "SceneContext.h"
+#include "Profiler.h"
+#include "TextureCache.h"
 #include "GL/glut.h"
 
 void ExitFunction();
@@ -172,12 +174,22 @@ int main(int argc, char** argv)
     glutMotionFunc(MotionCallback);
 
 	FbxString lFilePath("");
+	bool lCompressTextures = false;
 	for( int i = 1, c = argc; i < c; ++i )
 	{
 		if( FbxString(argv[i]) == "-test" ) gAutoQuit = true;
+		else if( FbxString(argv[i]) == "-trace" && i + 1 < c ) Profiler::StartTrace(argv[++i]);
+		else if( FbxString(argv[i]) == "-compress" ) lCompressTextures = true;
 		else if( lFilePath.IsEmpty() ) lFilePath = argv[i];
 	}
 
+	// BC1 is lossy, the textures are only compressed on request.
+	if( lCompressTextures )
+	{
+		if( GLEW_EXT_texture_compression_s3tc ) CachedTexture::SetCompression(true);
+		else FBXSDK_printf("BC1 texture compression is not supported, textures are not compressed.\n");
+	}
+
 	gSceneContext = new SceneContext(!lFilePath.IsEmpty() ? lFilePath.Buffer() : NULL, DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT, lSupportVBO);
 
 	glutMainLoop();
@@ -191,6 +203,7 @@ int main(int argc, char** argv)
 void ExitFunction()
 {
     delete gSceneContext;
+    Profiler::StopTrace();
 }
 
 // Create the menus to select the current camera and the current animation stack.
@@ -222,26 +235,16 @@ void CreateMenus()
     }   
 
     // Create the submenu to select the current animation stack.
+    // The active one is already selected by SceneContext::FinishImport.
     int lAnimStackMenu = glutCreateMenu(AnimStackSelectionCallback);
-    int lCurrentAnimStackIndex = 0;
 
     // Add the animation stack names.
     const FbxArray<FbxString *> & lAnimStackNameArray = gSceneContext->GetAnimStackNameArray();
     for (int lPoseIndex = 0; lPoseIndex < lAnimStackNameArray.GetCount(); ++lPoseIndex)
     {
         glutAddMenuEntry(lAnimStackNameArray[lPoseIndex]->Buffer(), lPoseIndex);
-
-        // Track the current animation stack index.
-        if (lAnimStackNameArray[lPoseIndex]->Compare(gSceneContext->GetScene()->ActiveAnimStackName.Get()) == 0)
-        {
-            lCurrentAnimStackIndex = lPoseIndex;
-        }
     }
 
-    // Call the animation stack selection callback immediately to 
-    // initialize the start, stop and current time.
-    AnimStackSelectionCallback(lCurrentAnimStackIndex);
-
     const int lShadingModeMenu = glutCreateMenu(ShadingModeSelectionCallback);
     glutAddMenuEntry(MENU_STRING_SHADING_MODE_WIREFRAME, MENU_SHADING_MODE_WIREFRAME);
     glutAddMenuEntry(MENU_STRING_SHADING_MODE_SHADED, MENU_SHADING_MODE_SHADED);
@@ -394,8 +397,15 @@ void MenuSelectionCallback(int pItem)
 // Trigger the display of the current frame.
 void TimerCallback(int)
 {
-    // Ask to display the current frame only if necessary.
-    if (gSceneContext->GetStatus() == SceneContext::MUST_BE_REFRESHED)
+    // The menus list the cameras, animation stacks and poses of the imported scene.
+    if (gSceneContext->UpdateLoading())
+    {
+        CreateMenus();
+    }
+
+    // Ask to display the current frame only if necessary, and the import progress.
+    if (gSceneContext->GetStatus() == SceneContext::MUST_BE_REFRESHED ||
+        gSceneContext->GetStatus() == SceneContext::IMPORTING)
     {
         glutPostRedisplay();
     }
@@ -419,16 +429,15 @@ void DisplayCallback()
     {
         // This function is only called in the first display callback
         // to make sure that the application window is opened and a 
-        // status message is displayed before.
+        // status message is displayed before. The import runs on a
+        // worker thread, the timer callback follows its progress.
         gSceneContext->LoadFile();
 
-        CreateMenus();
-
         // Call the timer to display the first frame.
         glutTimerFunc((unsigned int)gSceneContext->GetFrameTime().GetMilliSeconds(), TimerCallback, 0);
     }
 
-	if( gAutoQuit ) exit(0);
+	if( gAutoQuit && !gSceneContext->IsLoading() ) exit(0);
 }
 
 
@@ -9,6 +9,9 @@
  * This code is provided without any warranty.  The copyright holder is
  * not liable for anything bad that might happen as a result of the
  * code.
+ *
+ * Modified: tga_read_bgr24() decodes a whole file to BGR 24 in one pass, the
+ * depth conversions to 24 bits are vectorized and tga_flip_vert() swaps rows.
  * -------------------------------------------------------------------------*/
 
 /*@unused@*/ static const char rcsid[] =
@@ -26,6 +29,11 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h> /* memcpy, memcmp */
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TGA_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define SANE_DEPTH(x) ((x) == 8 || (x) == 16 || (x) == 24 || (x) == 32)
 #define UNMAP_DEPTH(x)            ((x) == 16 || (x) == 24 || (x) == 32)
 
@@ -45,6 +53,12 @@ static const size_t tga_id_length = 26; /* tga_id + \0 */
 
 /* helpers */
 static tga_result tga_read_rle(tga_image *dest, FILE *fp);
+static tga_result tga_decode_bgr24(tga_image *dest, const uint8_t *data,
+    const size_t size);
+static void tga_bgra32_to_bgr24(uint8_t *dest, const uint8_t *src,
+    size_t count);
+static void tga_bgr16_to_bgr24(uint8_t *dest, const uint8_t *src,
+    size_t count);
 static tga_result tga_write_row_RLE(FILE *fp,
     const tga_image *src, const uint8_t *row);
 typedef enum { RAW, RLE } packet_type;
@@ -167,6 +181,49 @@ tga_result tga_read(tga_image *dest, const char *filename)
 
 
 
+/* ---------------------------------------------------------------------------
+ * Read a Targa image from a file named <filename> to <dest>, as a bottom to
+ * top, left to right BGR 24 image whatever the type, depth and orientation
+ * of the file.  This gives the same image as tga_read() followed by
+ * tga_convert_depth() to 24 bits and the flips, but reads the whole file at
+ * once and converts each row as it is decoded, in a single pass.
+ *
+ * Returns: TGA_NOERR on success, or a matching TGAERR_* code on failure.
+ */
+tga_result tga_read_bgr24(tga_image *dest, const char *filename)
+{
+    tga_result result;
+    uint8_t *data;
+    long size;
+    FILE *fp = fopen(filename, "rb");
+    if (fp == NULL) return TGAERR_FOPEN;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return TGAERR_EOF;
+    }
+
+    data = (uint8_t*)malloc(size > 0 ? (size_t)size : 1);
+    if (data == NULL)
+    {
+        fclose(fp);
+        return TGAERR_NO_MEM;
+    }
+
+    if (size > 0 && fread(data, (size_t)size, 1, fp) != 1)
+        result = TGAERR_EOF;
+    else
+        result = tga_decode_bgr24(dest, data, (size_t)size);
+
+    free(data);
+    fclose(fp);
+    return result;
+}
+
+
+
 /* ---------------------------------------------------------------------------
  * Read a Targa image from <fp> to <dest>.
  *
@@ -343,6 +400,353 @@ static tga_result tga_read_rle(tga_image *dest, FILE *fp)
 
 
 
+/* ---------------------------------------------------------------------------
+ * Convert <count> pixels of BGRA 32 to BGR 24 by dropping the alpha bytes.
+ * <dest> may be <src>, the pixels are converted forwards.
+ */
+static void tga_bgra32_to_bgr24(uint8_t *dest, const uint8_t *src,
+    size_t count)
+{
+    size_t i = 0;
+
+#ifdef TGA_USE_SSE2
+    /* Four pixels at a time: each 64-bit lane packs its two pixels in six
+     * bytes, then the upper lane is moved against the lower one.  The store
+     * writes four bytes past the twelve converted, which the next iteration
+     * overwrites, hence the margin at the end of the loop.
+     */
+    const __m128i even_mask = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    const __m128i odd_mask = _mm_set_epi32(0x0000FFFF, (int)0xFF000000,
+                                           0x0000FFFF, (int)0xFF000000);
+    const __m128i low_lane = _mm_set_epi32(0, 0, -1, -1);
+    for (; i + 6 <= count; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        __m128i lanes = _mm_or_si128(_mm_and_si128(pixels, even_mask),
+            _mm_and_si128(_mm_srli_epi64(pixels, 8), odd_mask));
+        _mm_storeu_si128((__m128i*)(dest + i * 3),
+            _mm_or_si128(_mm_and_si128(lanes, low_lane),
+                _mm_srli_si128(_mm_andnot_si128(low_lane, lanes), 2)));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        uint8_t b = src[i * 4], g = src[i * 4 + 1], r = src[i * 4 + 2];
+        dest[i * 3] = b;
+        dest[i * 3 + 1] = g;
+        dest[i * 3 + 2] = r;
+    }
+}
+
+
+
+/* ---------------------------------------------------------------------------
+ * Convert <count> pixels of BGR 16 (5 bits per channel) to BGR 24, the same
+ * way as tga_unpack_pixel().
+ */
+static void tga_bgr16_to_bgr24(uint8_t *dest, const uint8_t *src,
+    size_t count)
+{
+    size_t i = 0;
+
+#ifdef TGA_USE_SSE2
+    /* Eight pixels at a time, widened to BGRX 32 then packed as above. */
+    const __m128i five_bits = _mm_set1_epi16(0x1F);
+    const __m128i even_mask = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    const __m128i odd_mask = _mm_set_epi32(0x0000FFFF, (int)0xFF000000,
+                                           0x0000FFFF, (int)0xFF000000);
+    const __m128i low_lane = _mm_set_epi32(0, 0, -1, -1);
+    for (; i + 10 <= count; i += 8)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i b = _mm_slli_epi16(_mm_and_si128(pixels, five_bits), 3);
+        __m128i g = _mm_slli_epi16(
+            _mm_and_si128(_mm_srli_epi16(pixels, 5), five_bits), 3);
+        __m128i r = _mm_slli_epi16(
+            _mm_and_si128(_mm_srli_epi16(pixels, 10), five_bits), 3);
+        __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+        __m128i halves[2];
+        int h;
+
+        halves[0] = _mm_unpacklo_epi16(bg, r);
+        halves[1] = _mm_unpackhi_epi16(bg, r);
+        for (h = 0; h < 2; h++)
+        {
+            __m128i lanes = _mm_or_si128(_mm_and_si128(halves[h], even_mask),
+                _mm_and_si128(_mm_srli_epi64(halves[h], 8), odd_mask));
+            _mm_storeu_si128((__m128i*)(dest + (i + h * 4) * 3),
+                _mm_or_si128(_mm_and_si128(lanes, low_lane),
+                    _mm_srli_si128(_mm_andnot_si128(low_lane, lanes), 2)));
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        (void)tga_unpack_pixel(src + i * 2, 16,
+            dest + i * 3, dest + i * 3 + 1, dest + i * 3 + 2, NULL);
+    }
+}
+
+
+
+/* ---------------------------------------------------------------------------
+ * Helper function for tga_read_bgr24().  Decodes the Targa image in the
+ * <size> bytes at <data> to <dest>, converting each row to BGR 24 as it is
+ * decoded and storing it at its place in a bottom to top, left to right
+ * image.
+ */
+static tga_result tga_decode_bgr24(tga_image *dest, const uint8_t *data,
+    const size_t size)
+{
+    #define BARF(errcode) \
+        { free(row); tga_free_buffers(dest); return errcode; }
+
+    #define NEED(n) \
+        if ((size_t)(end - pos) < (size_t)(n)) BARF(TGAERR_EOF)
+
+    #define READ8(dest) \
+        { NEED(1); dest = *pos++; }
+
+    #define READ16(dest) \
+        { NEED(2); dest = (uint16_t)(pos[0] | (pos[1] << 8)); pos += 2; }
+
+    const uint8_t *pos = data, *end = data + size;
+    uint8_t *row = NULL;
+    uint8_t palette[256 * 3], in_palette[256];
+    uint8_t run_pixel[4];
+    unsigned int run_left = 0, raw_left = 0;
+    size_t bpp, line;
+    uint16_t y;
+
+    dest->image_id = NULL;
+    dest->color_map_data = NULL;
+    dest->image_data = NULL;
+
+    READ8(dest->image_id_length);
+    READ8(dest->color_map_type);
+    if (dest->color_map_type != TGA_COLOR_MAP_ABSENT &&
+        dest->color_map_type != TGA_COLOR_MAP_PRESENT)
+            BARF(TGAERR_CMAP_TYPE);
+
+    READ8(dest->image_type);
+    if (dest->image_type == TGA_IMAGE_TYPE_NONE)
+            BARF(TGAERR_NO_IMG);
+
+    if (dest->image_type != TGA_IMAGE_TYPE_COLORMAP &&
+        dest->image_type != TGA_IMAGE_TYPE_BGR &&
+        dest->image_type != TGA_IMAGE_TYPE_MONO &&
+        dest->image_type != TGA_IMAGE_TYPE_COLORMAP_RLE &&
+        dest->image_type != TGA_IMAGE_TYPE_BGR_RLE &&
+        dest->image_type != TGA_IMAGE_TYPE_MONO_RLE)
+            BARF(TGAERR_IMG_TYPE);
+
+    if (tga_is_colormapped(dest) &&
+        dest->color_map_type == TGA_COLOR_MAP_ABSENT)
+            BARF(TGAERR_CMAP_MISSING);
+
+    if (!tga_is_colormapped(dest) &&
+        dest->color_map_type == TGA_COLOR_MAP_PRESENT)
+            BARF(TGAERR_CMAP_PRESENT);
+
+    READ16(dest->color_map_origin);
+    READ16(dest->color_map_length);
+    READ8(dest->color_map_depth);
+    if (dest->color_map_type == TGA_COLOR_MAP_PRESENT)
+    {
+        if (dest->color_map_length == 0)
+            BARF(TGAERR_CMAP_LENGTH);
+
+        if (!UNMAP_DEPTH(dest->color_map_depth))
+            BARF(TGAERR_CMAP_DEPTH);
+    }
+
+    READ16(dest->origin_x);
+    READ16(dest->origin_y);
+    READ16(dest->width);
+    READ16(dest->height);
+
+    if (dest->width == 0 || dest->height == 0)
+            BARF(TGAERR_ZERO_SIZE);
+
+    READ8(dest->pixel_depth);
+    if (!SANE_DEPTH(dest->pixel_depth) ||
+       (dest->pixel_depth != 8 && tga_is_colormapped(dest)) )
+            BARF(TGAERR_PIXEL_DEPTH);
+
+    READ8(dest->image_descriptor);
+
+    if (dest->image_id_length > 0)
+    {
+        NEED(dest->image_id_length);
+        dest->image_id = (uint8_t*)malloc(dest->image_id_length);
+        if (dest->image_id == NULL) BARF(TGAERR_NO_MEM);
+        memcpy(dest->image_id, pos, dest->image_id_length);
+        pos += dest->image_id_length;
+    }
+
+    /* The color map is only needed to decode, it becomes a BGR 24 palette
+     * indexed by the pixels directly.
+     */
+    if (dest->color_map_type == TGA_COLOR_MAP_PRESENT)
+    {
+        size_t cmap_bpp = dest->color_map_depth / 8;
+        unsigned int i;
+
+        NEED(dest->color_map_length * cmap_bpp);
+        memset(in_palette, 0, sizeof(in_palette));
+        for (i = 0; i < dest->color_map_length &&
+                    dest->color_map_origin + i < 256; i++)
+        {
+            unsigned int index = dest->color_map_origin + i;
+            (void)tga_unpack_pixel(pos + i * cmap_bpp, dest->color_map_depth,
+                &palette[index * 3], &palette[index * 3 + 1],
+                &palette[index * 3 + 2], NULL);
+            in_palette[index] = 1;
+        }
+        pos += dest->color_map_length * cmap_bpp;
+    }
+
+    dest->image_data = (uint8_t*)malloc(
+        (size_t)dest->width * dest->height * 3);
+    if (dest->image_data == NULL)
+            BARF(TGAERR_NO_MEM);
+
+    bpp = dest->pixel_depth / 8;
+    line = dest->width * bpp;
+    if (tga_is_rle(dest))
+    {
+        row = (uint8_t*)malloc(line);
+        if (row == NULL) BARF(TGAERR_NO_MEM);
+    }
+
+    for (y = 0; y < dest->height; y++)
+    {
+        const uint8_t *src;
+        uint8_t *out = dest->image_data + (size_t)dest->width * 3 *
+            (tga_is_top_to_bottom(dest) ? dest->height - 1 - y : y);
+
+        if (row == NULL)
+        {
+            /* uncompressed, the row is converted from the file data */
+            NEED(line);
+            src = pos;
+            pos += line;
+        }
+        else
+        {
+            /* the packets may run over the end of the row, what is left of
+             * the current one carries over to the next row
+             */
+            uint16_t x = 0;
+            while (x < dest->width)
+            {
+                if (run_left > 0)
+                {
+                    unsigned int n = dest->width - x;
+                    if (n > run_left) n = run_left;
+                    run_left -= n;
+                    if (bpp == 1)
+                    {
+                        memset(row + x, run_pixel[0], n);
+                        x += n;
+                    }
+                    else
+                    {
+                        for (; n > 0; n--, x++)
+                            memcpy(row + x * bpp, run_pixel, bpp);
+                    }
+                }
+                else if (raw_left > 0)
+                {
+                    unsigned int n = dest->width - x;
+                    if (n > raw_left) n = raw_left;
+                    NEED(n * bpp);
+                    memcpy(row + x * bpp, pos, n * bpp);
+                    pos += n * bpp;
+                    raw_left -= n;
+                    x += n;
+                }
+                else
+                {
+                    uint8_t b;
+                    READ8(b);
+                    if (b & BIT(7))
+                    {
+                        /* is an RLE packet */
+                        NEED(bpp);
+                        memcpy(run_pixel, pos, bpp);
+                        pos += bpp;
+                        run_left = (b & ~BIT(7)) + 1;
+                    }
+                    else /* RAW packet */
+                        raw_left = (b & ~BIT(7)) + 1;
+                }
+            }
+            src = row;
+        }
+
+        if (tga_is_colormapped(dest))
+        {
+            uint16_t x;
+            for (x = 0; x < dest->width; x++)
+            {
+                if (!in_palette[src[x]]) BARF(TGAERR_INDEX_RANGE);
+                memcpy(out + x * 3, palette + src[x] * 3, 3);
+            }
+        }
+        else if (dest->pixel_depth == 32)
+            tga_bgra32_to_bgr24(out, src, dest->width);
+        else if (dest->pixel_depth == 24)
+            memcpy(out, src, line);
+        else if (dest->pixel_depth == 16)
+            tga_bgr16_to_bgr24(out, src, dest->width);
+        else
+        {
+            uint16_t x;
+            for (x = 0; x < dest->width; x++)
+                out[x * 3] = out[x * 3 + 1] = out[x * 3 + 2] = src[x];
+        }
+
+        if (tga_is_right_to_left(dest))
+        {
+            uint8_t *left = out, *right = out + (dest->width - 1) * 3;
+            while (left < right)
+            {
+                uint8_t buffer[3];
+                memcpy(buffer, left, 3);
+                memcpy(left, right, 3);
+                memcpy(right, buffer, 3);
+                left += 3;
+                right -= 3;
+            }
+        }
+    }
+
+    /* the packets ran past the last pixel */
+    if (run_left > 0 || raw_left > 0) BARF(TGAERR_RLE);
+
+    free(row);
+
+    /* describe what is in image_data now */
+    dest->image_type = TGA_IMAGE_TYPE_BGR;
+    dest->pixel_depth = 24;
+    dest->image_descriptor &= ~(TGA_R_TO_L_BIT | TGA_T_TO_B_BIT);
+    dest->color_map_type = TGA_COLOR_MAP_ABSENT;
+    dest->color_map_origin = 0;
+    dest->color_map_length = 0;
+    dest->color_map_depth = 0;
+
+    return TGA_NOERR;
+    #undef BARF
+    #undef NEED
+    #undef READ8
+    #undef READ16
+}
+
+
+
 /* ---------------------------------------------------------------------------
  * Write a Targa image to a file named <filename> from <src>.  This is just a
  * wrapper around tga_write_to_FILE().
@@ -723,7 +1127,7 @@ tga_result tga_flip_horiz(tga_image *img)
  */
 tga_result tga_flip_vert(tga_image *img)
 {
-    uint16_t col;
+    uint16_t row;
     size_t bpp, line;
     uint8_t *top, *bottom;
     int t_to_b;
@@ -732,23 +1136,18 @@ tga_result tga_flip_vert(tga_image *img)
     bpp = (size_t)(img->pixel_depth / 8);   /* bytes per pixel */
     line = bpp * img->width;                /* bytes per line */
 
-    for (col=0; col<img->width; col++)
+    /* swap whole rows, walking the memory in order */
+    for (row=0; row<img->height/2; row++)
     {
-        top = img->image_data + col * bpp;
-        bottom = top + (img->height - 1) * line;
+        size_t i;
+        top = img->image_data + row * line;
+        bottom = img->image_data + (img->height - 1 - row) * line;
 
-        /* reverse from top to bottom */
-        while (top < bottom)
+        for (i=0; i<line; i++)
         {
-            uint8_t buffer[4];
-
-            /* swap */
-            memcpy(buffer, top, bpp);
-            memcpy(top, bottom, bpp);
-            memcpy(bottom, buffer, bpp);
-
-            top += line;
-            bottom -= line;
+            uint8_t buffer = top[i];
+            top[i] = bottom[i];
+            bottom[i] = buffer;
         }
     }
 
@@ -1023,7 +1422,10 @@ tga_result tga_convert_depth(tga_image *img, const uint8_t bits)
 
         /* convert forwards */
         dest = img->image_data;
-        for (src = img->image_data;
+        if (img->pixel_depth == 32 && bits == 24)
+            tga_bgra32_to_bgr24(dest, img->image_data,
+                (size_t)img->width * img->height);
+        else for (src = img->image_data;
              src < img->image_data + img->width * img->height * src_bpp;
              src += src_bpp)
         {
@@ -1048,7 +1450,24 @@ tga_result tga_convert_depth(tga_image *img, const uint8_t bits)
 
         /* convert backwards */
         dest = img->image_data + (img->width*img->height - 1) * dest_bpp;
-        for (src = img->image_data + (img->width*img->height - 1) * src_bpp;
+        if (img->pixel_depth == 16 && bits == 24)
+        {
+            /* convert by rows from the last one, through a copy of the
+             * row since the bigger result overlaps the following rows
+             */
+            size_t line = (size_t)img->width * 2;
+            uint8_t *row = (uint8_t*)malloc(line);
+            int y;
+            if (row == NULL) return TGAERR_NO_MEM;
+            for (y = img->height - 1; y >= 0; y--)
+            {
+                memcpy(row, img->image_data + y * line, line);
+                tga_bgr16_to_bgr24(img->image_data + y * line / 2 * 3, row,
+                    img->width);
+            }
+            free(row);
+        }
+        else for (src = img->image_data + (img->width*img->height - 1) * src_bpp;
              src >= img->image_data;
              src -= src_bpp)
         {
@@ -145,6 +145,7 @@ const char *tga_error(const tga_result errcode);
 /* Load/save ---------------------------------------------------------------*/
 tga_result tga_read(tga_image *dest, const char *filename);
 tga_result tga_read_from_FILE(tga_image *dest, FILE *fp);
+tga_result tga_read_bgr24(tga_image *dest, const char *filename);
 tga_result tga_write(const char *filename, const tga_image *src);
 tga_result tga_write_to_FILE(FILE *fp, const tga_image *src);
 